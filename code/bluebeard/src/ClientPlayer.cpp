@@ -1,6 +1,8 @@
 
 #include "ClientPlayer.h"
 
+#include <algorithm>
+
 
 #include "physics/OdeRigidBody.h"
 #include "physics/OdeSimulator.h"
@@ -13,6 +15,10 @@
 #include "NetworkCommand.h"
 #include "Profiler.h"
 #include "ParameterManager.h"
+#include "TimeStructs.h"
+
+#undef min
+#undef max
 
 
 
@@ -44,9 +50,20 @@ LocalPlayer::LocalPlayer() :
     correct_controllable_(NULL),
     test_controllable_(NULL),
     history_size_(0),
-    history_overflow_(false)
+    history_overflow_(false),
+    replay_skipped_(false),
+    skipped_sequence_number_(0),
+    num_corrections_(0),
+    num_replays_(0),
+    num_skipped_replays_(0),
+    num_replay_steps_(0),
+    total_replay_time_(0),
+    max_replay_time_(0)
 {
     s_console.addVariable("hist_size", &history_size_, &fp_group_);
+    s_console.addFunction("printReplayStats",
+                          ConsoleFun(this, &LocalPlayer::printReplayStats),
+                          &fp_group_);
 
     replay_simulator_->enableCategoryCollisions(CCRS_STATIC, CCRS_STATIC, false);
 }
@@ -137,6 +154,12 @@ void LocalPlayer::handleInput(const PlayerInput & input)
  *  player input since then is replayed to acquire the new current
  *  player state.
  *
+ *  Only the clone of the controllable and the static level geometry
+ *  take part in the replay. If more than
+ *  client.network.max_replay_steps physics steps would have to be
+ *  replayed, the server state is applied without replay instead and
+ *  the history is discarded, trading a visible jump for a frame
+ *  hitch.
  */
 void LocalPlayer::serverCorrection(uint8_t sequence_number,
                                    RakNet::BitStream & correct_state)
@@ -162,6 +185,26 @@ void LocalPlayer::serverCorrection(uint8_t sequence_number,
     ADD_STATIC_CONSOLE_VAR(bool, replaying_history, false);
     
 
+    // Corrections for inputs sent before a skipped replay are still
+    // on the way, but their history is gone.
+    if (replay_skipped_)
+    {
+        if (seqNumberDifference(cur_sequence_number_, skipped_sequence_number_) > MAX_SKIPPED_CORRECTION_AGE)
+        {
+            replay_skipped_ = false;
+        } else if (seqNumberDifference(sequence_number, skipped_sequence_number_) <= 0)
+        {
+            s_log << Log::debug('n')
+                  << "dropping correction "
+                  << (unsigned)sequence_number
+                  << " for input sent before skipped replay.\n";
+            return;
+        } else
+        {
+            replay_skipped_ = false;
+        }
+    }
+
     if(hist_head_ == hist_tail_)
     {   
         s_log << Log::debug('n')
@@ -224,6 +267,8 @@ void LocalPlayer::serverCorrection(uint8_t sequence_number,
     }
 
 
+    ++num_corrections_;
+    
     correct_controllable_->readStateFromBitstream(correct_state, OST_CORE, 0);
     readStateFromHistory(test_controllable_, hist_head_);
     test_controllable_->setSleeping(true); // XXXX just neccessary because test_controllable_ is in sim
@@ -260,10 +305,37 @@ void LocalPlayer::serverCorrection(uint8_t sequence_number,
     } else if (skip_correction) return;
 
     replaying_history = true;
+
+    static ParameterHandle<unsigned> max_replay_steps("client.network.max_replay_steps");
+    unsigned num_steps = seqNumberDifference(cur_sequence_number_, sequence_number);
+    if (num_steps > max_replay_steps.get())
+    {
+        s_log << Log::debug('n')
+              << "state mismatch, "
+              << num_steps
+              << " steps exceed max replay length. Applying server state.\n";
+
+        RakNet::BitStream state;
+        correct_controllable_->writeStateToBitstream(state, OST_CORE | OST_CLIENT_SIDE_PREDICTION);
+        controllable_->readStateFromBitstream(state, OST_CORE, 0);
+
+        // Corrections for the inputs still on the way are dropped,
+        // see above.
+        hist_head_ = hist_tail_;
+        replay_skipped_          = true;
+        skipped_sequence_number_ = cur_sequence_number_;
+
+        ++num_skipped_replays_;
+        return;
+    }
     
     // Now we need to replay the stored moves.
     s_log << Log::debug('n') << "state mismatch. starting correction replay\n";    
 
+    uint64_t replay_start = getCurMicros();
+    ++num_replays_;
+    num_replay_steps_ += num_steps;
+
     writeStateToHistory(correct_controllable_, hist_head_);
     
     unsigned cur_index = hist_head_;    
@@ -308,6 +380,10 @@ void LocalPlayer::serverCorrection(uint8_t sequence_number,
     } while (cur_index != hist_tail_);
 
     advanceHistoryIndex(hist_head_);
+
+    uint64_t replay_time = getCurMicros() - replay_start;
+    total_replay_time_ += replay_time;
+    max_replay_time_    = std::max(max_replay_time_, replay_time);
 }
 
 
@@ -393,6 +469,7 @@ void LocalPlayer::setControllable(Controllable * new_controllable)
 
     cur_sequence_number_ = 0;
     hist_head_ = hist_tail_ = 0;
+    replay_skipped_ = false;
 }
 
 
@@ -528,6 +605,35 @@ void LocalPlayer::readStateFromHistory(Controllable * c, unsigned index)
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Console function printing how often and how expensive correction
+ *  replays have been since the last call.
+ */
+std::string LocalPlayer::printReplayStats(const std::vector<std::string> & args)
+{
+    std::ostringstream ret;
+    ret << num_corrections_ << " corrections, "
+        << num_replays_ << " replays, "
+        << num_skipped_replays_ << " skipped for length.\n";
+    if (num_replays_)
+    {
+        ret << "Average " << (float)num_replay_steps_ / num_replays_ << " steps, "
+            << (float)total_replay_time_ / num_replays_ * 0.001f << " ms per replay, "
+            << "max " << (float)max_replay_time_ * 0.001f << " ms.";
+    }
+
+    num_corrections_     = 0;
+    num_replays_         = 0;
+    num_skipped_replays_ = 0;
+    num_replay_steps_    = 0;
+    total_replay_time_   = 0;
+    max_replay_time_     = 0;
+
+    return ret.str();
+}
+
+
 //------------------------------------------------------------------------------
 void LocalPlayer::onRigidBodyDeleted(Observable* o, unsigned)
 {
@@ -16,6 +16,10 @@ const unsigned HISTORY_SIZE = 30; // should not be much larger than
                                   // that, because of sequence number
                                   // wraparound at 255
 
+/// After a skipped replay, corrections are dropped until one for a
+/// newer input arrives, but at most for this many steps.
+const int MAX_SKIPPED_CORRECTION_AGE = 100;
+
 
 class PuppetMasterClient;
 class GameState;
@@ -91,6 +95,8 @@ class LocalPlayer : public Player
     void readStateFromHistory(Controllable * c, unsigned index);    
 
     void onRigidBodyDeleted(Observable* o, unsigned);
+
+    std::string printReplayStats(const std::vector<std::string> & args);
     
     uint8_t cur_sequence_number_;
 
@@ -110,9 +116,24 @@ class LocalPlayer : public Player
 
     bool history_overflow_;
 
+    bool replay_skipped_;             ///< Whether corrections up to
+                                      ///skipped_sequence_number_
+                                      ///must be dropped.
+    uint8_t skipped_sequence_number_; ///< cur_sequence_number_ when a
+                                      ///replay was last skipped.
+
     /// If a static object is deleted, we have to remove the
     /// corresponding OdeRigidBody from our replay simulator.
     std::map<RigidBody*, physics::OdeRigidBody*> static_body_; 
+
+    // Replay statistics since the last call to printReplayStats.
+    // Times are in microseconds.
+    unsigned num_corrections_;
+    unsigned num_replays_;
+    unsigned num_skipped_replays_; ///< Exceeded client.network.max_replay_steps.
+    unsigned num_replay_steps_;
+    uint64_t total_replay_time_;
+    uint64_t max_replay_time_;
 };
 
 
@@ -50,9 +50,14 @@ ClipmapGrid::ClipmapGrid(unsigned level, ClipmapGrid * child) :
                                 // (1<<numlevels) to enforce a setpos
                                 // on first toroidal shift
     clip_region_z_(0x01000000), 
+    pending_clip_region_x_(0),
+    pending_clip_region_z_(0),
+    shift_job_(0),
     vertices_changed_(true),
     vb_(GL_ARRAY_BUFFER_ARB),
     ib_(GL_ELEMENT_ARRAY_BUFFER_ARB),
+    staged_vertex_pos_(0),
+    staged_color_pos_(0),
     child_(child), parent_(NULL),
     level_(level)
 {
@@ -92,8 +97,10 @@ ClipmapGrid::ClipmapGrid(unsigned level, ClipmapGrid * child) :
     }
     unsigned lightmap_res = (resolution_ +1)*terrain_data_->getLmTexelsPerQuad();
 
-    // Used for IB, VB and Lightmap updates
+    // Used for IB updates
     tmp_buffer_.resize(lightmap_res*lightmap_res*3);
+
+    row_height_.resize(resolution_);
     
 
     // -------------------- OSG Stuff --------------------
@@ -168,6 +175,9 @@ ClipmapGrid::ClipmapGrid(unsigned level, ClipmapGrid * child) :
 //------------------------------------------------------------------------------
 ClipmapGrid::~ClipmapGrid()
 {
+    // The job accesses our staging buffers.
+    if (shift_job_) s_background_worker.wait(shift_job_);
+    
     s_log << Log::debug('d') << "ClipmapGrid destructor\n";
 }
 
@@ -291,52 +301,48 @@ void ClipmapGrid::setParent(ClipmapGrid * parent)
 
 
 //------------------------------------------------------------------------------
-void ClipmapGrid::update()
+/**
+ *  Returns true if the clip region for the current camera position
+ *  doesn't overlap the current one (first frame or teleport), so
+ *  there is no sensible old data to show while the new data is
+ *  generated.
+ */
+bool ClipmapGrid::needsFullRefill() const
 {
-    const Vector & camera_pos = s_scene_manager.getCamera().getPos();
+    int new_clip_region_x, new_clip_region_z;
+    calcClipRegion(new_clip_region_x, new_clip_region_z);
     
-    vertices_changed_ = false;
+    int dx = (new_clip_region_x - clip_region_x_) >> level_;
+    int dz = (new_clip_region_z - clip_region_z_) >> level_;
+    return abs(dx) >= resolution_ || abs(dz) >= resolution_;
+}
 
-    // First calculate the new clip region
+//------------------------------------------------------------------------------
+/**
+ *  \param publish_immediately Wait for the data of a new clip region
+ *  and use it this frame. Must be the same for all levels, else the
+ *  levels wouldn't be nested for a frame.
+ */
+void ClipmapGrid::update(bool publish_immediately)
+{
+    vertices_changed_ = false;
 
-    // The area in which the clip region is the same is of size
-    // 2^(level+1) vertices.
-    unsigned mask = ~((1<<(level_+1))-1);
-    
-    int new_clip_region_x = (int)floor(camera_pos.x_ / terrain_data_->getHorzScale()) & mask;
-    int new_clip_region_z = (int)floor(camera_pos.z_ / terrain_data_->getHorzScale()) & mask;
+    // Publish the data generated since the last frame.
+    if (shift_job_) publishShift();
 
-    // Now determine top-left corner of clip region
-    new_clip_region_x -= ((resolution_-3) >> 1) << level_ ;
-    new_clip_region_z -= ((resolution_-3) >> 1) << level_ ;
+    int new_clip_region_x, new_clip_region_z;
+    calcClipRegion(new_clip_region_x, new_clip_region_z);
         
     // If active region hasn't changed, no VB upload is necessary.
     if (new_clip_region_x != clip_region_x_ ||
         new_clip_region_z != clip_region_z_)
     {
-        vertices_changed_ = true;        
-
-        int dx = (new_clip_region_x - clip_region_x_) >> level_;
-        int dz = (new_clip_region_z - clip_region_z_) >> level_;
-                
-        vb_torus_.       shiftOrigin(dx, dz);
-        colormap_torus_. shiftOrigin(dx, dz);
-        ib_torus_[0].    shiftOrigin(dx, dz);
-        if (child_)
-        {
-            ib_torus_[1].shiftOrigin(dx, dz);
-            ib_torus_[2].shiftOrigin(dx, dz);
-            ib_torus_[3].shiftOrigin(dx, dz);
-        }
+        pending_clip_region_x_ = new_clip_region_x;
+        pending_clip_region_z_ = new_clip_region_z;
         
-        // Update our clip region origin
-        clip_region_x_ = new_clip_region_x;
-        clip_region_z_ = new_clip_region_z;
-
-        updateOffsetUniforms();
-        if (child_) child_->updateOffsetUniforms();
+        shift_job_ = s_background_worker.addJob(BackgroundJob(this, &ClipmapGrid::generateShift));
 
-        dirtyBound();
+        if (publish_immediately) publishShift();
     }
 
     if (vertices_changed_ || (child_ && child_->vertices_changed_))
@@ -348,6 +354,28 @@ void ClipmapGrid::update()
 
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Calculates the top-left corner of the clip region for the current
+ *  camera position.
+ */
+void ClipmapGrid::calcClipRegion(int & x, int & z) const
+{
+    const Vector & camera_pos = s_scene_manager.getCamera().getPos();
+    
+    // The area in which the clip region is the same is of size
+    // 2^(level+1) vertices.
+    unsigned mask = ~((1<<(level_+1))-1);
+    
+    x = (int)floor(camera_pos.x_ / terrain_data_->getHorzScale()) & mask;
+    z = (int)floor(camera_pos.z_ / terrain_data_->getHorzScale()) & mask;
+
+    // Now determine top-left corner of clip region
+    x -= ((resolution_-3) >> 1) << level_ ;
+    z -= ((resolution_-3) >> 1) << level_ ;
+}
+
+
 //------------------------------------------------------------------------------
 void ClipmapGrid::getClipRegion(int & x, int & z) const
 {
@@ -375,27 +403,70 @@ int ClipmapGrid::getClipmapResolution()
 
 
 //------------------------------------------------------------------------------
+/**
+ *  Uploads the vertices staged by generateVertices.
+ */
 void ClipmapGrid::fillVertexBuffer(BUFFERFILL_CALLBACK_TYPE type,
                                    unsigned dest_x, unsigned dest_z,
                                    int source_x, int source_z,
                                    unsigned width, unsigned height,
                                    const ToroidalBuffer * buffer)
 {
-    if (type != BCT_FILL) return;
+    if (type == BCT_LOCK)
+    {
+        staged_vertex_pos_ = 0;
+        return;
+    } else if (type == BCT_UNLOCK)
+    {
+        assert(staged_vertex_pos_ == staged_vertices_.size());
+        return;
+    }
     
     unsigned dest = (dest_x + dest_z*resolution_)*sizeof(GridVertex);
     
+    for (unsigned z=0; z<height; ++z)
+    {
+        assert(staged_vertex_pos_ + width*sizeof(GridVertex) <= staged_vertices_.size());
+        
+        vb_.subData(dest,
+                    width*sizeof(GridVertex),
+                    &staged_vertices_[staged_vertex_pos_]);
+
+        staged_vertex_pos_ += width*sizeof(GridVertex);
+        dest += resolution_*sizeof(GridVertex);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Called on the background worker. Appends the vertices for the
+ *  given region to staged_vertices_.
+ */
+void ClipmapGrid::generateVertices(BUFFERFILL_CALLBACK_TYPE type,
+                                   unsigned dest_x, unsigned dest_z,
+                                   int source_x, int source_z,
+                                   unsigned width, unsigned height,
+                                   const ToroidalBuffer * buffer)
+{
+    if (type == BCT_LOCK) staged_vertices_.clear();
+    if (type != BCT_FILL) return;
+
+    unsigned offset = staged_vertices_.size();
+    staged_vertices_.resize(offset + width*height*sizeof(GridVertex));
+    GridVertex * cur_vertex = (GridVertex*)&staged_vertices_[offset];
+
+    assert(row_height_.size() >= width);
+    
     for (int hz=source_z; hz < source_z+(int)height; ++hz)
     {
-        GridVertex * cur_vertex = (GridVertex*)&tmp_buffer_[0];
-        assert(tmp_buffer_.size() >= width*sizeof(GridVertex));
+        terrain_data_->getHeightAtGridRow(source_x, hz, width, level_, &row_height_[0]);
+        const float * h = &row_height_[0];
         
         for (int hx=source_x; hx < source_x+(int)width; ++hx)
         {
-            float h = terrain_data_->getHeightAtGrid(hx, hz, level_);
-         
             cur_vertex->pos_ = Vector((hx<<level_)*terrain_data_->getHorzScale(),
-                                      h,
+                                      *h++,
                                       (hz<<level_)*terrain_data_->getHorzScale());
             cur_vertex->height_next_lvl_ =
                 terrain_data_->getHeightAtGridInterpol(hx,hz, level_);
@@ -406,28 +477,66 @@ void ClipmapGrid::fillVertexBuffer(BUFFERFILL_CALLBACK_TYPE type,
             
             ++cur_vertex;
         }
-
-        vb_.subData(dest,
-                    width*sizeof(GridVertex),
-                    &tmp_buffer_[0]);
-        
-        dest += resolution_*sizeof(GridVertex);
     }
 }
 
 
 //------------------------------------------------------------------------------
+/**
+ *  Uploads the colors staged by generateColormap.
+ */
 void ClipmapGrid::fillColormap(BUFFERFILL_CALLBACK_TYPE type,
                                unsigned dest_x, unsigned dest_y,
                                int source_x, int source_y,
                                unsigned width, unsigned height,
                                const ToroidalBuffer * buffer)
 {
+    if (type == BCT_LOCK)
+    {
+        staged_color_pos_ = 0;
+        return;
+    } else if (type == BCT_UNLOCK)
+    {
+        assert(staged_color_pos_ == staged_colors_.size());
+        return;
+    }
+
+    unsigned f = terrain_data_->getLmTexelsPerQuad();
+    unsigned size = width*f*height*f*sizeof(RgbTriplet);
+
+    assert(staged_color_pos_ + size <= staged_colors_.size());
+    
+    color_map_->apply(s_scene_manager.getOsgState());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0,
+                    dest_x*f, dest_y*f,
+                    width*f, height*f,
+                    GL_RGB, GL_UNSIGNED_BYTE, &staged_colors_[staged_color_pos_]);
+
+    staged_color_pos_ += size;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Called on the background worker. Appends the colors for the given
+ *  region to staged_colors_.
+ */
+void ClipmapGrid::generateColormap(BUFFERFILL_CALLBACK_TYPE type,
+                                   unsigned dest_x, unsigned dest_y,
+                                   int source_x, int source_y,
+                                   unsigned width, unsigned height,
+                                   const ToroidalBuffer * buffer)
+{
+    if (type == BCT_LOCK) staged_colors_.clear();
     if (type != BCT_FILL) return;
 
     unsigned f = terrain_data_->getLmTexelsPerQuad();
+
+    unsigned offset = staged_colors_.size();
+    staged_colors_.resize(offset + width*f*height*f*sizeof(RgbTriplet));
     
-    RgbTriplet * dest = (RgbTriplet*)&tmp_buffer_[0];    
+    RgbTriplet * dest = (RgbTriplet*)&staged_colors_[offset];
     for (unsigned y=0; y<height*f; ++y)
     {
         for (unsigned x=0; x<width*f; ++x)
@@ -438,13 +547,6 @@ void ClipmapGrid::fillColormap(BUFFERFILL_CALLBACK_TYPE type,
             
         }
     }
-
-    color_map_->apply(s_scene_manager.getOsgState());
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexSubImage2D(GL_TEXTURE_2D, 0,
-                    dest_x*f, dest_y*f,
-                    width*f, height*f,
-                    GL_RGB, GL_UNSIGNED_BYTE, &tmp_buffer_[0]);
 }
 
 
@@ -501,6 +603,58 @@ void ClipmapGrid::fillIndexBuffer(BUFFERFILL_CALLBACK_TYPE type,
 
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Executed on the background worker. Fills the staging buffers with
+ *  the data needed to move the clip region to
+ *  pending_clip_region_x_, pending_clip_region_z_.
+ */
+void ClipmapGrid::generateShift()
+{
+    int dx = (pending_clip_region_x_ - clip_region_x_) >> level_;
+    int dz = (pending_clip_region_z_ - clip_region_z_) >> level_;
+
+    vb_staging_torus_.      shiftOrigin(dx, dz);
+    colormap_staging_torus_.shiftOrigin(dx, dz);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Waits for the background job if necessary, then uploads the staged
+ *  data and moves the clip region.
+ */
+void ClipmapGrid::publishShift()
+{
+    s_background_worker.wait(shift_job_);
+    shift_job_ = 0;
+
+    vertices_changed_ = true;
+
+    int dx = (pending_clip_region_x_ - clip_region_x_) >> level_;
+    int dz = (pending_clip_region_z_ - clip_region_z_) >> level_;
+                
+    vb_torus_.       shiftOrigin(dx, dz);
+    colormap_torus_. shiftOrigin(dx, dz);
+    ib_torus_[0].    shiftOrigin(dx, dz);
+    if (child_)
+    {
+        ib_torus_[1].shiftOrigin(dx, dz);
+        ib_torus_[2].shiftOrigin(dx, dz);
+        ib_torus_[3].shiftOrigin(dx, dz);
+    }
+        
+    // Update our clip region origin
+    clip_region_x_ = pending_clip_region_x_;
+    clip_region_z_ = pending_clip_region_z_;
+
+    updateOffsetUniforms();
+    if (child_) child_->updateOffsetUniforms();
+
+    dirtyBound();
+}
+
+
 //------------------------------------------------------------------------------
 /**
  *  Responsible for zero-area triangles at the level border to avoid
@@ -693,6 +847,16 @@ void ClipmapGrid::setupToroidalBuffers()
     colormap_torus_.setPos(posx, posz);
     colormap_torus_.setBufferFillCallback(BufferFillCallback(this, &ClipmapGrid::fillColormap));
 
+    // The staging buffers must always be in the same state as the
+    // ones above.
+    vb_staging_torus_.setSize(resolution_, resolution_);
+    vb_staging_torus_.setPos(posx, posz);
+    vb_staging_torus_.setBufferFillCallback(BufferFillCallback(this, &ClipmapGrid::generateVertices));
+
+    colormap_staging_torus_.setSize(lightmap_res, lightmap_res);
+    colormap_staging_torus_.setPos(posx, posz);
+    colormap_staging_torus_.setBufferFillCallback(BufferFillCallback(this, &ClipmapGrid::generateColormap));
+
 
 
     if (child_)
@@ -10,6 +10,7 @@
 #include "Vector.h"
 #include "ToroidalBuffer.h"
 #include "BufferObject.h"
+#include "BackgroundWorker.h"
 
 namespace terrain
 {
@@ -19,7 +20,13 @@ class TerrainDataClient;
 
 //------------------------------------------------------------------------------
 /**
- *  
+ *  When the clip region moves, the new vertices and colors are
+ *  generated on the background worker into staging buffers, using
+ *  toroidal buffers which mirror those of the GPU buffers. The next
+ *  update uploads the staged data and publishes the new clip region,
+ *  so all levels lag one frame behind the camera. After a jump,
+ *  TerrainVisual has all levels publish immediately to keep them
+ *  nested.
  */
 class ClipmapGrid : public osg::Drawable
 {
@@ -40,7 +47,8 @@ class ClipmapGrid : public osg::Drawable
     
     void setParent(ClipmapGrid * parent);
 
-    void update();
+    bool needsFullRefill() const;
+    void update(bool publish_immediately);
 
     void getClipRegion(int & x, int & z) const;
 
@@ -55,6 +63,11 @@ class ClipmapGrid : public osg::Drawable
                           int source_x, int source_y,
                           unsigned width, unsigned height,
                           const ToroidalBuffer * buffer);
+    void generateVertices(BUFFERFILL_CALLBACK_TYPE type,
+                          unsigned dest_x, unsigned dest_y,
+                          int source_x, int source_y,
+                          unsigned width, unsigned height,
+                          const ToroidalBuffer * buffer);
     
 
     void fillColormap(BUFFERFILL_CALLBACK_TYPE type,
@@ -62,6 +75,11 @@ class ClipmapGrid : public osg::Drawable
                       int source_x, int source_y,
                       unsigned width, unsigned height,
                       const ToroidalBuffer * buffer);
+    void generateColormap(BUFFERFILL_CALLBACK_TYPE type,
+                          unsigned dest_x, unsigned dest_y,
+                          int source_x, int source_y,
+                          unsigned width, unsigned height,
+                          const ToroidalBuffer * buffer);
 
     void fillIndexBuffer(BUFFERFILL_CALLBACK_TYPE type,
                          unsigned dest_x, unsigned dest_y,
@@ -69,6 +87,10 @@ class ClipmapGrid : public osg::Drawable
                          unsigned width, unsigned height,
                          const ToroidalBuffer * buffer);
     
+    void generateShift();
+    void calcClipRegion(int & x, int & z) const;
+    void publishShift();
+    
     void updateStitchingIndices();
 
     void updateOffsetUniforms();
@@ -84,6 +106,11 @@ class ClipmapGrid : public osg::Drawable
     /// \brief Z-Index in height_data of the top-left corner vertex of
     /// the clip region. The size is stored in resolution_.
     int clip_region_z_;
+
+    /// The clip region currently being generated in the background.
+    int pending_clip_region_x_;
+    int pending_clip_region_z_;
+    hBackgroundJob shift_job_; ///< 0 if no shift is pending.
     
     bool vertices_changed_; ///< Used to signal the next level that
                             ///this level has shifted and the
@@ -100,6 +127,18 @@ class ClipmapGrid : public osg::Drawable
     ToroidalBuffer colormap_torus_;
     ToroidalBuffer ib_torus_[4];
 
+    /// Shifted along with vb_torus_ and colormap_torus_ by the
+    /// background job, filling the staging buffers.
+    ToroidalBuffer vb_staging_torus_;
+    ToroidalBuffer colormap_staging_torus_;
+
+    std::vector<unsigned char> staged_vertices_; ///< GridVertex rows in fill order.
+    std::vector<unsigned char> staged_colors_;   ///< RgbTriplet rows in fill order.
+    unsigned staged_vertex_pos_; ///< Upload position in staged_vertices_.
+    unsigned staged_color_pos_;  ///< Upload position in staged_colors_.
+
+    std::vector<float> row_height_; ///< One row of heights for vertex generation.
+
     std::vector<uint16_t> index_stitching_tris_;
 
     ClipmapGrid * child_;    ///< The enclosed, smaller grid.
@@ -133,9 +172,8 @@ class ClipmapGrid : public osg::Drawable
                                     ///frustum clipping.
 
     
-    static std::vector<unsigned char> tmp_buffer_; ///< Used for IB,
-                                                   ///VB and tex
-                                                   ///subdata updates
+    static std::vector<unsigned char> tmp_buffer_; ///< Used for IB
+                                                   ///updates.
 
     static const TerrainDataClient * terrain_data_;
 };
@@ -12,6 +12,9 @@
 const float STATE_ROT_THRESHOLD   = 0.004f;
 const float STATE_TRANS_THRESHOLD = 0.0003f;
 
+/// Other players' vehicles are what clients care about most.
+const float CONTROLLABLE_NETWORK_IMPORTANCE = 2.0f;
+
 
 //------------------------------------------------------------------------------
 Controllable::~Controllable()
@@ -76,6 +79,12 @@ void Controllable::readStateFromBitstream(RakNet::BitStream & stream, unsigned t
 }
 
 
+//------------------------------------------------------------------------------
+float Controllable::getNetworkImportance() const
+{
+    return CONTROLLABLE_NETWORK_IMPORTANCE;
+}
+
 
 //------------------------------------------------------------------------------
 bool Controllable::isStateEqual(const Controllable * other) const
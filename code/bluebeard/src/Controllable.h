@@ -35,6 +35,8 @@ class Controllable : public RigidBody
     virtual void writeStateToBitstream (RakNet::BitStream & stream, unsigned type) const;
     virtual void readStateFromBitstream(RakNet::BitStream & stream, unsigned type, uint32_t timestamp);
 
+    virtual float getNetworkImportance() const;
+
     virtual bool isStateEqual(const Controllable * other) const;
 
     virtual Controllable * cloneForReplay(physics::OdeSimulator * sim) const = 0;
@@ -0,0 +1,162 @@
+
+#include "CookedTerrain.h"
+
+#include "Exception.h"
+#include "Serializer.h"
+#include "Paths.h"
+#include "Log.h"
+
+
+namespace terrain
+{
+
+    
+//------------------------------------------------------------------------------
+/**
+ *  \param path The level directory.
+ */
+CookedTerrain::CookedTerrain(const std::string & path) :
+    file_(path + COOKED_TERRAIN_FILE),
+    header_((const CookedTerrainHeader*)file_.getData())
+{
+    if (file_.getSize() < sizeof(CookedTerrainHeader) ||
+        header_->magic_ != COOKED_TERRAIN_MAGIC)
+    {
+        Exception e(file_.getFilename());
+        e << " is not a cooked terrain file.";
+        throw e;
+    }
+
+    if (header_->version_ != COOKED_TERRAIN_VERSION)
+    {
+        Exception e(file_.getFilename());
+        e << " has version " << header_->version_
+          << ", expected " << COOKED_TERRAIN_VERSION << ". Recook the level.";
+        throw e;
+    }
+
+    for (unsigned s=0; s<CTS_LAST; ++s)
+    {
+        if (header_->section_offset_[s] % COOKED_TERRAIN_ALIGNMENT != 0 ||
+            header_->section_offset_[s] > file_.getSize() ||
+            header_->section_size_[s] > file_.getSize() - header_->section_offset_[s])
+        {
+            Exception e(file_.getFilename());
+            e << " is corrupt.";
+            throw e;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+const CookedTerrainHeader & CookedTerrain::getHeader() const
+{
+    return *header_;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns NULL if the section is empty.
+ *
+ *  \param expected_size The section size implied by the header
+ *  fields. A mismatch indicates a corrupt file and throws.
+ */
+const void * CookedTerrain::getSection(COOKED_TERRAIN_SECTION section, size_t expected_size) const
+{
+    uint32_t size = header_->section_size_[section];
+    if (size == 0) return NULL;
+    
+    if (size != expected_size)
+    {
+        Exception e(file_.getFilename());
+        e << ": section " << section << " has size " << size
+          << ", expected " << expected_size << ".";
+        throw e;
+    }
+
+    return (const uint8_t*)file_.getData() + header_->section_offset_[section];
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns true if the level directory contains a cooked terrain
+ *  file which is not older than any of the files it was cooked from,
+ *  so edited levels fall back to their source files until they are
+ *  recooked.
+ */
+bool CookedTerrain::isUpToDate(const std::string & path)
+{
+    const char * SOURCE_FILES[] = { "terrain.hm", "lm_color.png", "detail.png", "waypoints.bin" };
+
+    try
+    {
+        boost::filesystem::path cooked(path + COOKED_TERRAIN_FILE);
+        if (!boost::filesystem::exists(cooked)) return false;
+
+        std::time_t cooked_time = boost::filesystem::last_write_time(cooked);
+        for (unsigned i=0; i<sizeof(SOURCE_FILES)/sizeof(SOURCE_FILES[0]); ++i)
+        {
+            boost::filesystem::path source(path + SOURCE_FILES[i]);
+            if (boost::filesystem::exists(source) &&
+                boost::filesystem::last_write_time(source) > cooked_time)
+            {
+                s_log << Log::warning
+                      << cooked.string() << " is older than " << SOURCE_FILES[i]
+                      << ", loading source files instead.\n";
+                return false;
+            }
+        }
+    } catch (boost::filesystem::basic_filesystem_error<boost::filesystem::path> & e)
+    {
+        s_log << Log::warning << e.what() << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Writes a cooked terrain file into the given level directory.
+ *
+ *  \param header The header with all fields except magic, version
+ *  and section offsets filled in.
+ *
+ *  \param section_data CTS_LAST pointers to the section contents,
+ *  whose sizes are given in the header. May be NULL for empty
+ *  sections.
+ */
+void CookedTerrain::write(const std::string & path,
+                          CookedTerrainHeader header,
+                          const void * const * section_data)
+{
+    header.magic_   = COOKED_TERRAIN_MAGIC;
+    header.version_ = COOKED_TERRAIN_VERSION;
+
+    uint32_t offset = sizeof(CookedTerrainHeader);
+    for (unsigned s=0; s<CTS_LAST; ++s)
+    {
+        offset += (COOKED_TERRAIN_ALIGNMENT - offset % COOKED_TERRAIN_ALIGNMENT) % COOKED_TERRAIN_ALIGNMENT;
+        header.section_offset_[s] = offset;
+        offset += header.section_size_[s];
+    }
+    
+    serializer::Serializer s(path + COOKED_TERRAIN_FILE, serializer::SOM_WRITE);
+
+    s.putRaw(&header, sizeof(header));
+
+    const uint8_t PADDING[COOKED_TERRAIN_ALIGNMENT] = { 0 };
+    offset = sizeof(CookedTerrainHeader);
+    for (unsigned i=0; i<CTS_LAST; ++i)
+    {
+        s.putRaw(PADDING, header.section_offset_[i] - offset);
+        if (header.section_size_[i]) s.putRaw(section_data[i], header.section_size_[i]);
+        offset = header.section_offset_[i] + header.section_size_[i];
+    }
+}
+
+} // namespace terrain
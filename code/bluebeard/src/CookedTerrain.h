@@ -0,0 +1,101 @@
+
+#ifndef BLUEBEARD_COOKED_TERRAIN_INCLUDED
+#define BLUEBEARD_COOKED_TERRAIN_INCLUDED
+
+#include <string>
+
+#include "Datatypes.h"
+#include "MappedFile.h"
+
+
+namespace terrain
+{
+
+/// Written into the level directory by the terrain cooker.
+const std::string COOKED_TERRAIN_FILE = "terrain.cooked";
+
+const uint32_t COOKED_TERRAIN_MAGIC     = 0x4b4f4f43; // "COOK"
+const uint32_t COOKED_TERRAIN_VERSION   = 1;
+
+/// All sections start at a multiple of this, so they can be used
+/// in place with aligned loads.
+const unsigned COOKED_TERRAIN_ALIGNMENT = 16;
+
+//------------------------------------------------------------------------------
+enum COOKED_TERRAIN_SECTION
+{
+    CTS_HEIGHT,    ///< float32_t per height sample, in terrain.hm order.
+    CTS_COLOR,     ///< RgbTriplet per lightmap texel, as in TerrainDataClient.
+    CTS_DETAIL,    ///< uint32_t per height sample, as in TerrainDataClient.
+    CTS_WAYPOINTS, ///< CookedWaypoint per waypoint, in waypoints.bin order.
+    CTS_LAST
+};
+
+//------------------------------------------------------------------------------
+struct CookedWaypoint
+{
+    float32_t pos_[3];
+    uint32_t  level_;
+};
+
+//------------------------------------------------------------------------------
+/**
+ *  Stored at the start of the cooked file in native byte order, so
+ *  files are not portable between architectures of different
+ *  endianness.
+ *
+ *  Empty sections have size 0 and are skipped on load.
+ */
+struct CookedTerrainHeader
+{
+    uint32_t magic_;
+    uint32_t version_;
+
+    uint32_t  width_;
+    uint32_t  height_;
+    float32_t max_height_;
+    float32_t min_height_;
+    float32_t horz_scale_;
+
+    uint32_t  lm_texels_per_quad_;
+
+    uint32_t  wp_width_;
+    uint32_t  wp_height_;
+    float32_t wp_horz_scale_;
+    
+    uint32_t section_offset_[CTS_LAST];
+    uint32_t section_size_  [CTS_LAST];
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The precompiled terrain of a level in a single file, which is
+ *  mapped into memory instead of being parsed and copied on level
+ *  load. Created from terrain.hm, lm_color.png, detail.png and
+ *  waypoints.bin by the cooker tool.
+ *
+ *  Section data stays valid as long as this object exists.
+ */
+class CookedTerrain
+{
+ public:
+    CookedTerrain(const std::string & path);
+
+    const CookedTerrainHeader & getHeader() const;
+    const void * getSection(COOKED_TERRAIN_SECTION section, size_t expected_size) const;
+
+    static bool isUpToDate(const std::string & path);
+    static void write(const std::string & path,
+                      CookedTerrainHeader header,
+                      const void * const * section_data);
+    
+ protected:
+    MappedFile file_;
+
+    const CookedTerrainHeader * header_;
+};
+
+} // namespace terrain
+
+#endif
@@ -93,6 +93,9 @@ class GameObject : public Observable
     virtual void writeStateToBitstream (RakNet::BitStream & stream, unsigned type) const               {}
     virtual void readStateFromBitstream(RakNet::BitStream & stream, unsigned type, uint32_t timestamp) {}
 
+    /// Relative priority of this object's state updates, see RelevancyGrid.
+    virtual float getNetworkImportance() const { return 1.0f; }
+
     bool isScheduledForDeletion() const;
     virtual void scheduleForDeletion();
 
@@ -61,7 +61,8 @@ void GameState::frameMove(float dt)
 {
     PROFILE(GameState::frameMove);
 
-    dt *= s_params.get<float>("physics.time_scale");
+    static ParameterHandle<float> time_scale("physics.time_scale");
+    dt *= time_scale.get();
     
     
     GameObjectContainer::iterator it;
@@ -106,11 +106,18 @@ InstancePlacer::InstancePlacer(unsigned layer_num,
                                const std::vector<bbm::DetailTexInfo> & tex_info) :
     cur_camera_cell_x_(-1000),
     cur_camera_cell_z_(-1000),
+    num_staged_cells_(0),
+    cur_staged_cell_(0),
+    pending_camera_cell_x_(0),
+    pending_camera_cell_z_(0),
+    update_job_(0),
     terrain_(terrain_data),
     instances_per_cell_(0),
     layer_num_(layer_num)
 {
     cos_threshold_steepness_ = cosf(deg2Rad(s_params.get<float>("instances.threshold_steepness")));
+    min_scale_ = s_params.get<float>("instances.min_scale");
+    max_scale_ = s_params.get<float>("instances.max_scale");
     unsigned num_layers = s_params.get<unsigned>("instances.num_layers");
     
     if (s_params.get<std::vector<float> >("instances.density_factor").size() != num_layers)
@@ -216,6 +223,8 @@ InstancePlacer::InstancePlacer(unsigned layer_num,
 //------------------------------------------------------------------------------
 InstancePlacer::~InstancePlacer()
 {
+    // The job accesses our cells.
+    if (update_job_) s_background_worker.wait(update_job_);
 }
 
 
@@ -223,16 +232,22 @@ InstancePlacer::~InstancePlacer()
 //------------------------------------------------------------------------------
 void InstancePlacer::update(float dt)
 {
+    if (update_job_ && s_background_worker.isDone(update_job_)) publishCells();
+    
     const Vector & pos = s_scene_manager.getCamera().getPos();
     
     int new_camera_cell_x = (int)(pos.x_ / cell_size_);
     int new_camera_cell_z = (int)(pos.z_ / cell_size_);    
 
-    instance_torus_.shiftOrigin(new_camera_cell_x - cur_camera_cell_x_,
-                                new_camera_cell_z - cur_camera_cell_z_);
-    
-    cur_camera_cell_x_ = new_camera_cell_x;
-    cur_camera_cell_z_ = new_camera_cell_z;
+    if (!update_job_ &&
+        (new_camera_cell_x != cur_camera_cell_x_ ||
+         new_camera_cell_z != cur_camera_cell_z_))
+    {
+        pending_camera_cell_x_ = new_camera_cell_x;
+        pending_camera_cell_z_ = new_camera_cell_z;
+        
+        update_job_ = s_background_worker.addJob(BackgroundJob(this, &InstancePlacer::generateCells));
+    }
 
 
     // Perform brute force culling for now...
@@ -273,10 +288,30 @@ void InstancePlacer::initCells()
     instance_torus_.setPos(cur_camera_cell_x_,
                            cur_camera_cell_z_);
     instance_torus_.setBufferFillCallback(BufferFillCallback(this, &InstancePlacer::fillInstanceCell));
+
+    staging_torus_.setSize(cell_resolution_, cell_resolution_);
+    staging_torus_.setPos(cur_camera_cell_x_,
+                          cur_camera_cell_z_);
+    staging_torus_.setBufferFillCallback(BufferFillCallback(this, &InstancePlacer::generateInstanceCell));
     
     instance_cell_.resize(cell_resolution_*
                           cell_resolution_);
 
+    // A single shift refills at most all cells.
+    staged_cell_.resize(cell_resolution_*
+                        cell_resolution_);
+    for (unsigned i=0; i<staged_cell_.size(); ++i)
+    {
+        staged_cell_[i].position_.resize(instances_per_cell_);
+        staged_cell_[i].diffuse_ .resize(instances_per_cell_);
+        staged_cell_[i].desc_    .resize(instances_per_cell_);
+    }
+
+    sample_x_.resize(instances_per_cell_);
+    sample_z_.resize(instances_per_cell_);
+    sample_h_.resize(instances_per_cell_);
+    sample_n_.resize(instances_per_cell_);
+
     for (unsigned r=0; r<cell_resolution_; ++r)
     {
         for (unsigned c=0; c<cell_resolution_; ++c)
@@ -284,19 +319,19 @@ void InstancePlacer::initCells()
             // Pre-calculate random positions for instance proxies
             InstanceCell & cur_cell = instance_cell_[c + r*cell_resolution_];
             cur_cell.instance_.resize(instances_per_cell_);
+            cur_cell.position_.resize(instances_per_cell_);
 
             for (unsigned m=0; m<instances_per_cell_; ++m)
             {
-                float scale = s_params.get<float>("instances.min_scale") +
-                    (float)rand()/RAND_MAX*(s_params.get<float>("instances.max_scale") -
-                                            s_params.get<float>("instances.min_scale"));
+                float scale = min_scale_ + (float)rand()/RAND_MAX*(max_scale_ - min_scale_);
 
                 float rand_angle = normalizeAngle((float)rand()/RAND_MAX);
 
                         
-                cur_cell.instance_[m].setPosition(Vector(((float)rand()/RAND_MAX - 0.5f)*cell_size_,
-                                                         0.0f,
-                                                         ((float)rand()/RAND_MAX - 0.5f)*cell_size_));
+                cur_cell.position_[m] = Vector(((float)rand()/RAND_MAX - 0.5f)*cell_size_,
+                                               0.0f,
+                                               ((float)rand()/RAND_MAX - 0.5f)*cell_size_);
+                cur_cell.instance_[m].setPosition(cur_cell.position_[m]);
                 
                 // encode multiple of base draw distance in rotation
                 // angle for shader to find correct draw distance
@@ -308,12 +343,85 @@ void InstancePlacer::initCells()
 
 
 //------------------------------------------------------------------------------
+/**
+ *  Applies the cells staged by generateInstanceCell.
+ */
 void InstancePlacer::fillInstanceCell(BUFFERFILL_CALLBACK_TYPE type,
                                       unsigned dest_x, unsigned dest_y,
                                       int source_x, int source_y,
                                       unsigned width, unsigned height,
                                       const ToroidalBuffer * buffer)
 {
+    if (type == BCT_LOCK)
+    {
+        cur_staged_cell_ = 0;
+        return;
+    } else if (type == BCT_UNLOCK)
+    {
+        assert(cur_staged_cell_ == num_staged_cells_);
+        return;
+    }
+    
+    for (unsigned r=0; r<height; ++r)
+    {
+        for (unsigned c=0; c<width; ++c)
+        {
+            InstanceCell & cur_cell = instance_cell_[dest_x+c + (dest_y+r)*cell_resolution_];
+
+            assert(cur_staged_cell_ < num_staged_cells_);
+            const StagedInstanceCell & staged = staged_cell_[cur_staged_cell_++];
+
+            cur_cell.center_   = staged.center_;
+            cur_cell.position_ = staged.position_;
+            
+            for (unsigned i=0; i<instances_per_cell_; ++i)
+            {
+                cur_cell.instance_[i].setPosition(staged.position_[i]);
+                cur_cell.instance_[i].setDiffuse(staged.diffuse_[i]);
+                cur_cell.instance_[i].assignToDescription(staged.desc_[i]);
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Linear congruential generator seeded from the cell coordinates.
+ *  Used on the background worker instead of rand(), whose state is
+ *  shared with the main thread.
+ */
+class CellRandom
+{
+ public:
+    CellRandom(int x, int z, unsigned layer) :
+        state_((unsigned)x*73856093u ^ (unsigned)z*19349663u ^ layer*83492791u) {}
+
+    /// Returns a value in [0,1).
+    float get()
+        {
+            state_ = state_*1664525u + 1013904223u;
+            return (float)(state_ >> 8) / (float)(1u << 24);
+        }
+
+ protected:
+    unsigned state_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Called on the background worker. Determines the new positions and
+ *  models of the instances in the given cells and appends them to
+ *  staged_cell_.
+ */
+void InstancePlacer::generateInstanceCell(BUFFERFILL_CALLBACK_TYPE type,
+                                          unsigned dest_x, unsigned dest_y,
+                                          int source_x, int source_y,
+                                          unsigned width, unsigned height,
+                                          const ToroidalBuffer * buffer)
+{
+    if (type == BCT_LOCK) num_staged_cells_ = 0;
     if (type != BCT_FILL) return;
         
     Vector2d new_cell_center_base(
@@ -324,78 +432,103 @@ void InstancePlacer::fillInstanceCell(BUFFERFILL_CALLBACK_TYPE type,
     {
         for (unsigned c=0; c<width; ++c)
         {
-            InstanceCell & cur_cell = instance_cell_[dest_x+c + (dest_y+r)*cell_resolution_];
+            const InstanceCell & cur_cell = instance_cell_[dest_x+c + (dest_y+r)*cell_resolution_];
+
+            assert(num_staged_cells_ < staged_cell_.size());
+            StagedInstanceCell & staged = staged_cell_[num_staged_cells_++];
+
+            CellRandom random(source_x+c, source_y+r, layer_num_);
 
             Vector2d new_center = new_cell_center_base + Vector2d(c*cell_size_, r*cell_size_);
             Vector2d offset = new_center - cur_cell.center_;
-            cur_cell.center_ = new_center;
 
+            // Don't use Vector2d's conversion to Vector here, it is
+            // not thread safe.
+            staged.center_ = Vector(new_center.x_, 0.0f, new_center.y_);
 
             // Get height too
             Vector dummy_n;
-            terrain_->getHeightAndNormal(cur_cell.center_.x_,
-                                         cur_cell.center_.z_,
-                                         cur_cell.center_.y_, dummy_n);
+            terrain_->getHeightAndNormal(staged.center_.x_,
+                                         staged.center_.z_,
+                                         staged.center_.y_, dummy_n);
 
             
             for (unsigned i=0; i<instances_per_cell_; ++i)
             {
-                Vector pos = cur_cell.instance_[i].getPosition();
-                pos += offset;
-                float h;
-                Vector n;
-                terrain_->getHeightAndNormal(pos.x_, pos.z_, h, n);
-                pos.y_ = h;
+                sample_x_[i] = cur_cell.position_[i].x_ + offset.x_;
+                sample_z_[i] = cur_cell.position_[i].z_ + offset.y_;
+            }
+            terrain_->getHeightAndNormal(instances_per_cell_,
+                                         &sample_x_[0], &sample_z_[0],
+                                         &sample_h_[0], &sample_n_[0]);
+            
+            for (unsigned i=0; i<instances_per_cell_; ++i)
+            {
+                Vector pos(sample_x_[i], sample_h_[i], sample_z_[i]);
+                const Vector & n = sample_n_[i];
                 
-                cur_cell.instance_[i].setPosition(pos);
-                cur_cell.instance_[i].setDiffuse(terrain_->getColor(pos.x_, pos.z_).getBrightness());
+                staged.position_[i] = pos;
+                staged.diffuse_ [i] = terrain_->getColor(pos.x_, pos.z_).getBrightness();
+                staged.desc_    [i] = NULL;
                 
                 // Bail if the terrain is too steep.
-                if (n.y_ < cos_threshold_steepness_)
-                {
-                    cur_cell.instance_[i].assignToDescription(NULL);
-                    continue;
-                }
+                if (n.y_ < cos_threshold_steepness_) continue;
 
                 unsigned tex_type = terrain_->getPrevalentDetail(pos.x_,
                                                                  pos.z_);
                 
                 // Bail if no prototype exists for this texture type.
-                if (tex_type >= instance_prototype_.size())
-                {
-                    cur_cell.instance_[i].assignToDescription(NULL);
-                    continue;
-                }
-                std::vector<osg::ref_ptr<InstanceProxy> > & prototypes = instance_prototype_[tex_type];
-                if (prototypes.empty())
-                {
-                    cur_cell.instance_[i].assignToDescription(NULL);
-                    continue;
-                }
+                if (tex_type >= instance_prototype_.size()) continue;
+                const std::vector<osg::ref_ptr<InstanceProxy> > & prototypes = instance_prototype_[tex_type];
+                if (prototypes.empty()) continue;
                 
 
-                float r = (float)rand() / RAND_MAX;
+                float p_rand = random.get();
                 float cum_p = 0.0f;
                 unsigned p=0;
                 do
                 {
                     cum_p += instance_probability_[tex_type][p];
                     assert(cum_p <= 1.01f);
-                    if (cum_p >= r)
+                    if (cum_p >= p_rand)
                     {
-                        cur_cell.instance_[i].assignToDescription(prototypes[p]->getDescription());
+                        staged.desc_[i] = prototypes[p]->getDescription();
                         break;
                     }
                     ++p;
                 } while (p<prototypes.size());
-                
-                if (p==prototypes.size()) cur_cell.instance_[i].assignToDescription(NULL);
             }
         }
     }
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Executed on the background worker. Generates the cells needed to
+ *  move to pending_camera_cell_x_, pending_camera_cell_z_.
+ */
+void InstancePlacer::generateCells()
+{
+    staging_torus_.shiftOrigin(pending_camera_cell_x_ - cur_camera_cell_x_,
+                               pending_camera_cell_z_ - cur_camera_cell_z_);
+}
+
+
+//------------------------------------------------------------------------------
+void InstancePlacer::publishCells()
+{
+    s_background_worker.wait(update_job_);
+    update_job_ = 0;
+
+    instance_torus_.shiftOrigin(pending_camera_cell_x_ - cur_camera_cell_x_,
+                                pending_camera_cell_z_ - cur_camera_cell_z_);
+    
+    cur_camera_cell_x_ = pending_camera_cell_x_;
+    cur_camera_cell_z_ = pending_camera_cell_z_;
+}
+
+
 //------------------------------------------------------------------------------
 /**
  *  Converts the relative probabilities for instance models into
@@ -9,6 +9,7 @@
 
 #include "InstancedGeometry.h"
 #include "ToroidalBuffer.h"
+#include "BackgroundWorker.h"
 
 namespace bbm
 {
@@ -53,10 +54,32 @@ struct InstanceCell
     
     Vector center_;
     std::vector<PlacedInstance> instance_;
+    std::vector<Vector> position_; ///< Instance positions, readable
+                                   ///by the background worker.
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The result of refilling an instance cell, generated in the
+ *  background and applied to the InstanceCell on the main thread.
+ */
+struct StagedInstanceCell
+{
+    Vector center_;
+    std::vector<Vector> position_;
+    std::vector<float> diffuse_;
+    std::vector<InstancedGeometryDescription*> desc_; ///< NULL for no instance.
 };
  
 
 //------------------------------------------------------------------------------
+/**
+ *  When the camera moves to another cell, the cells coming into range
+ *  are regenerated by the background worker, using a toroidal buffer
+ *  mirroring instance_torus_. The results are applied in the first
+ *  update after the job is done.
+ */
 class InstancePlacer
 {
  public:
@@ -76,7 +99,14 @@ class InstancePlacer
                           int source_x, int source_y,
                           unsigned width, unsigned height,
                           const ToroidalBuffer * buffer);
+    void generateInstanceCell(BUFFERFILL_CALLBACK_TYPE type,
+                              unsigned dest_x, unsigned dest_y,
+                              int source_x, int source_y,
+                              unsigned width, unsigned height,
+                              const ToroidalBuffer * buffer);
 
+    void generateCells();
+    void publishCells();
 
     void normalizeProbabilities(std::vector<std::vector<float> > & instance_probability,
                                 float max_density,
@@ -91,6 +121,17 @@ class InstancePlacer
     
     ToroidalBuffer instance_torus_;
     std::vector<InstanceCell> instance_cell_;
+
+    /// Shifted along with instance_torus_ by the background job,
+    /// filling staged_cell_.
+    ToroidalBuffer staging_torus_;
+    std::vector<StagedInstanceCell> staged_cell_;
+    unsigned num_staged_cells_;
+    unsigned cur_staged_cell_; ///< The next staged cell to apply.
+
+    int pending_camera_cell_x_; ///< The camera cell being generated in the background.
+    int pending_camera_cell_z_;
+    hBackgroundJob update_job_; ///< 0 if no update is pending.
         
     const TerrainDataClient * terrain_;
 
@@ -99,6 +140,15 @@ class InstancePlacer
     unsigned instances_per_cell_; ///< Calculated from params.
 
     float cos_threshold_steepness_; ///< Cached param.
+    float min_scale_;               ///< Cached param.
+    float max_scale_;               ///< Cached param.
+
+    /// Scratch space for the background worker to sample the terrain
+    /// for all instances of a cell at once.
+    std::vector<float>  sample_x_;
+    std::vector<float>  sample_z_;
+    std::vector<float>  sample_h_;
+    std::vector<Vector> sample_n_;
     
     unsigned layer_num_;
     
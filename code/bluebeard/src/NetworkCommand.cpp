@@ -82,7 +82,10 @@ const char * TANK_PACKET_NAME[] =
     "TPI_KICK                                 ",
 
     "TPI_CUSTOM_SERVER_CMD                    ",
-    "TPI_CUSTOM_CLIENT_CMD                    "             
+    "TPI_CUSTOM_CLIENT_CMD                    ",
+
+    "TPI_ACK_GAME_OBJECT_STATE                ",
+    "TPI_WORLD_SNAPSHOT                       "
 };
 
 
@@ -178,6 +181,19 @@ std::string NetworkCommand::printAndResetNetSummary(const std::vector<std::strin
 
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Returns the number of bits accounted for all packet types since
+ *  the last call to printAndResetNetSummary.
+ */
+unsigned NetworkCommand::getNumBitsAccounted(ACCOUNT_TYPE type)
+{
+    unsigned ret = 0;
+    for (unsigned i=0; i<NUM_PACKET_TYPES; ++i) ret += num_bits_accounted_[type][i];
+    return ret;
+}
+
+
 //------------------------------------------------------------------------------
 void NetworkCommand::accountPacket(RakNet::BitStream & stream, ACCOUNT_TYPE type)
 {
@@ -281,6 +297,9 @@ NetworkCommandServer * NetworkCommandServer::createFromPacket(unsigned char pack
     case TPI_SET_GAME_OBJECT_STATE_BOTH:
         ret = new SetGameObjectStateCmd();
         break;  
+    case TPI_WORLD_SNAPSHOT:
+        ret = new WorldSnapshotCmd();
+        break;  
     case TPI_STRING_MESSAGE_CMD:
         ret = new StringMessageCmd();
         break;
@@ -371,6 +390,9 @@ NetworkCommandClient * NetworkCommandClient::createFromPacket(unsigned char pack
     case TPI_PLAYER_INPUT:
         ret = new PlayerInputCmd(p->systemAddress);
         break;
+    case TPI_ACK_GAME_OBJECT_STATE:
+        ret = new AckGameObjectStateCmd(p->systemAddress);
+        break;
     case TPI_RCON_CMD:
         ret = new RconCmd(p->systemAddress);
         break;
@@ -75,6 +75,9 @@ enum TANK_PACKET_ID
     
     TPI_CUSTOM_SERVER_CMD,
     TPI_CUSTOM_CLIENT_CMD,
+
+    TPI_ACK_GAME_OBJECT_STATE,
+    TPI_WORLD_SNAPSHOT,
     
     TPI_LAST
 };
@@ -111,6 +114,7 @@ class NetworkCommand
 
     static void initAccounting(RegisteredFpGroup * fp_group);
     static std::string printAndResetNetSummary(const std::vector<std::string>&);
+    static unsigned getNumBitsAccounted(ACCOUNT_TYPE type);
     
  protected:
 
@@ -90,6 +90,109 @@ void PlayerInputCmd::readFromBitstream(RakNet::BitStream & stream)
 
 
 
+//********** AckGameObjectStateCmd **********//
+
+//------------------------------------------------------------------------------
+AckGameObjectStateCmd::AckGameObjectStateCmd(const SystemAddress & player_id) :
+    NetworkCommandClient(player_id)
+{
+}
+
+
+//------------------------------------------------------------------------------
+AckGameObjectStateCmd::AckGameObjectStateCmd(const std::vector<std::pair<uint16_t, uint16_t> > & acks,
+                                             const std::vector<uint16_t> & resync) :
+    ack_(acks),
+    resync_(resync)
+{
+}
+
+//------------------------------------------------------------------------------
+void AckGameObjectStateCmd::execute(PuppetMasterServer * master)
+{
+    ServerPlayer * player = master->getPlayer(player_address_);
+    if (!player) return;
+
+    SnapshotBaselines & baselines = player->getSnapshotBaselines();
+    
+    for (unsigned i=0; i<ack_.size(); ++i)
+    {
+        baselines.acknowledge(ack_[i].first, ack_[i].second);
+    }
+
+    for (unsigned i=0; i<resync_.size(); ++i)
+    {
+        baselines.removeObject(resync_[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void AckGameObjectStateCmd::getNetworkOptions(PacketReliability & reliability,
+                                              PacketPriority    & priority,
+                                              unsigned          & channel)
+{
+    reliability = UNRELIABLE;
+    priority    = LOW_PRIORITY;
+    channel     = NC_DONTCARE;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Object ids are sorted, so only their differences are written.
+ */
+void AckGameObjectStateCmd::writeToBitstream (RakNet::BitStream & stream)
+{
+    stream.Write((char)TPI_ACK_GAME_OBJECT_STATE);
+
+    stream.WriteCompressed((uint16_t)ack_.size());
+    uint16_t prev_id = 0;
+    for (unsigned i=0; i<ack_.size(); ++i)
+    {
+        stream.WriteCompressed((uint16_t)(ack_[i].first - prev_id));
+        stream.Write(ack_[i].second);
+        prev_id = ack_[i].first;
+    }
+
+    stream.WriteCompressed((uint16_t)resync_.size());
+    for (unsigned i=0; i<resync_.size(); ++i)
+    {
+        stream.Write(resync_[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void AckGameObjectStateCmd::readFromBitstream(RakNet::BitStream & stream)
+{
+    char packet_id;
+    stream.Read(packet_id);
+
+    uint16_t num_acks = 0;
+    stream.ReadCompressed(num_acks);
+    ack_.resize(num_acks);
+    uint16_t prev_id = 0;
+    for (unsigned i=0; i<num_acks; ++i)
+    {
+        uint16_t id_diff = 0;
+        stream.ReadCompressed(id_diff);
+        ack_[i].first = prev_id + id_diff;
+        stream.Read(ack_[i].second);
+        prev_id = ack_[i].first;
+    }
+
+    uint16_t num_resync = 0;
+    stream.ReadCompressed(num_resync);
+    resync_.resize(num_resync);
+    for (unsigned i=0; i<num_resync; ++i)
+    {
+        stream.Read(resync_[i]);
+    }
+}
+
+
+
 //********** RconCmd **********//
 
 //------------------------------------------------------------------------------
@@ -48,6 +48,37 @@ class PlayerInputCmd : public NetworkCommandClient
 };
 
  
+//------------------------------------------------------------------------------
+/**
+ *  Acknowledges received delta states, making them the baselines for
+ *  further deltas. Also requests full states for objects whose deltas
+ *  couldn't be decoded.
+ *
+ *  \see WorldSnapshotCmd
+ */
+class AckGameObjectStateCmd : public NetworkCommandClient
+{
+ public:
+    AckGameObjectStateCmd(const SystemAddress & player_id);
+    AckGameObjectStateCmd(const std::vector<std::pair<uint16_t, uint16_t> > & acks,
+                          const std::vector<uint16_t> & resync);
+
+    virtual void execute(PuppetMasterServer * master);
+
+ protected:
+    
+    virtual void getNetworkOptions(PacketReliability & reliability,
+                                   PacketPriority    & priority,
+                                   unsigned          & channel);
+
+    virtual void writeToBitstream (RakNet::BitStream & stream);
+    virtual void readFromBitstream(RakNet::BitStream & stream);
+
+    std::vector<std::pair<uint16_t, uint16_t> > ack_; ///< object id, snapshot seq. Sorted by object id.
+    std::vector<uint16_t> resync_;
+};
+
+ 
 //------------------------------------------------------------------------------ 
 class RconCmd : public NetworkCommandClient
 {
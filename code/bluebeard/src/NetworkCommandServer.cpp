@@ -2,6 +2,8 @@
 
 #include "NetworkCommandServer.h"
 
+#include <algorithm>
+
 #include <raknet/RakPeerInterface.h>
 #include <raknet/RakNetworkFactory.h>
 #include <raknet/GetTime.h>
@@ -560,6 +562,10 @@ void SetGameObjectStateCmd::execute(PuppetMasterClient * master)
     }
 
     target->readStateFromBitstream(object_state_stream_, type_, timestamp_);
+
+    // A full reliable state is sent when the object goes to sleep,
+    // and the server forgets our baselines for it.
+    if (type_ == OST_BOTH) master->getSnapshotHistory().resetObject(id_);
    
     // set local players latency value, used for calculations on client
     uint32_t cur_time = RakNet::GetTime();
@@ -627,6 +633,208 @@ void SetGameObjectStateCmd::readFromBitstream(RakNet::BitStream & stream)
 }
 
 
+//********** WorldSnapshotCmd **********//
+
+//------------------------------------------------------------------------------
+WorldSnapshotCmd::WorldSnapshotCmd() :
+    seq_(0),
+    num_states_(0),
+    num_state_bits_(0)
+{
+}
+
+//------------------------------------------------------------------------------
+WorldSnapshotCmd::WorldSnapshotCmd(uint16_t seq) :
+    seq_(seq),
+    num_states_(0),
+    num_state_bits_(0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  \param baseline The state to encode against, or NULL to send the
+ *  full state.
+ *
+ *  \param max_size The size in bytes the command must not grow
+ *  beyond.
+ *
+ *  \return False if the state wasn't added because the command would
+ *  become too large. The first state is always added.
+ */
+bool WorldSnapshotCmd::addState(uint16_t object_id,
+                                const SerializedState & state,
+                                const SerializedState * baseline,
+                                uint16_t baseline_seq,
+                                unsigned max_size)
+{
+    ObjectState object_state;
+    object_state.id_           = object_id;
+    object_state.is_delta_     = baseline && baseline->num_bits_ == state.num_bits_;
+    object_state.baseline_seq_ = baseline_seq;
+
+    RakNet::BitStream delta_stream;
+    network::writeStateDelta(delta_stream, object_state.is_delta_ ? baseline : NULL, state);
+    object_state.data_ = SerializedState(delta_stream);
+
+    // Assume one byte for the compressed id difference.
+    unsigned num_bits = 8 + 1 + object_state.data_.num_bits_;
+    if (object_state.is_delta_) num_bits += 8*sizeof(baseline_seq);
+
+    if (!isEmpty() && getSize() + ((num_bits + 7) >> 3) > max_size) return false;
+
+    state_.push_back(object_state);
+    num_state_bits_ += num_bits;
+    ++num_states_;
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Reconstructs the states from the client's snapshot history. If a
+ *  baseline is missing, a resync is requested from the server.
+ *
+ *  States arriving out of order are stored as baselines, but not
+ *  applied.
+ */
+void WorldSnapshotCmd::execute(PuppetMasterClient * master)
+{
+#ifndef DEDICATED_SERVER
+    SnapshotHistory & history = master->getSnapshotHistory();
+
+    uint16_t id = 0;
+    for (unsigned i=0; i<num_states_; ++i)
+    {
+        uint16_t id_diff = 0;
+        bool is_delta = false;
+        uint16_t baseline_seq = 0;
+
+        if (!state_stream_.ReadCompressed(id_diff)) break;
+        if (!state_stream_.Read(is_delta))         break;
+        if (is_delta && !state_stream_.Read(baseline_seq)) break;
+
+        id += id_diff;
+
+        SerializedState state;
+        if (!network::readStateDelta(state_stream_,
+                                     is_delta,
+                                     is_delta ? history.getState(id, baseline_seq) : NULL,
+                                     state))
+        {
+            s_log << Log::debug('n')
+                  << "Missing baseline "
+                  << baseline_seq
+                  << " for object "
+                  << id
+                  << ", requesting resync.\n";
+            history.requestResync(id);
+            continue;
+        }
+
+        if (!history.addState(id, seq_, state)) continue;
+    
+        GameObject * target = master->getGameState()->getGameObject(id);
+        if (!target)
+        {
+            s_log << Log::debug('n')
+                  << "Got WorldSnapshotCmd for nonexisting object "
+                  << id << "\n";
+            continue;
+        }
+
+        RakNet::BitStream object_stream;
+        state.writeToBitstream(object_stream);
+        target->readStateFromBitstream(object_stream, OST_CORE, timestamp_);
+    }
+    
+    // set local players latency value, used for calculations on client
+    uint32_t cur_time = RakNet::GetTime();
+    if (cur_time <= timestamp_) return;
+    float latency = (float)(cur_time - timestamp_) * 0.001f;
+
+    master->getLocalPlayer()->setNetworkDelay(latency);
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+bool WorldSnapshotCmd::isEmpty() const
+{
+    return num_states_ == 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the approximate size of the command in bytes as written by
+ *  writeToBitstream, used for bandwidth budgeting.
+ */
+unsigned WorldSnapshotCmd::getSize() const
+{
+    unsigned num_bits = 8*sizeof(char) + 8*sizeof(timestamp_) + 8*sizeof(uint8_t) +
+        8*sizeof(seq_) + 16 + num_state_bits_;
+
+    return (num_bits + 7) >> 3;
+}
+
+
+//------------------------------------------------------------------------------
+void WorldSnapshotCmd::getNetworkOptions(PacketReliability & reliability,
+                                         PacketPriority    & priority,
+                                         unsigned          & channel)
+{
+    reliability = UNRELIABLE;
+    priority    = LOW_PRIORITY;
+    channel     = NC_DONTCARE;
+}
+
+//------------------------------------------------------------------------------
+void WorldSnapshotCmd::writeToBitstream (RakNet::BitStream & stream)
+{
+    timestamp_ = RakNet::GetTime();
+    
+    stream.Write((char)ID_TIMESTAMP);
+    stream.Write(timestamp_);
+
+    stream.Write((uint8_t)TPI_WORLD_SNAPSHOT);
+
+    stream.Write(seq_);
+    stream.WriteCompressed(num_states_);
+
+    std::sort(state_.begin(), state_.end());
+
+    uint16_t prev_id = 0;
+    for (unsigned i=0; i<state_.size(); ++i)
+    {
+        stream.WriteCompressed((uint16_t)(state_[i].id_ - prev_id));
+        stream.Write(state_[i].is_delta_);
+        if (state_[i].is_delta_) stream.Write(state_[i].baseline_seq_);
+
+        state_[i].data_.writeToBitstream(stream);
+
+        prev_id = state_[i].id_;
+    }
+}
+
+//------------------------------------------------------------------------------
+void WorldSnapshotCmd::readFromBitstream(RakNet::BitStream & stream)
+{
+    char packet_id;
+
+    stream.Read(packet_id);
+    stream.Read(timestamp_);
+
+    stream.Read(packet_id);
+
+    stream.Read(seq_);
+    stream.ReadCompressed(num_states_);
+
+    state_stream_.Write(&stream, stream.GetNumberOfUnreadBits());
+}
+
+
 //********** StringMessageCmd **********//
 
 //------------------------------------------------------------------------------
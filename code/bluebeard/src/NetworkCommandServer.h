@@ -14,6 +14,7 @@
 #include "GameState.h"
 #include "NetworkCommand.h"
 #include "GameObject.h"
+#include "StateSnapshot.h"
 
 
 class GameLogicServer;
@@ -271,6 +272,65 @@ class SetGameObjectStateCmd : public NetworkCommandServer
     uint32_t timestamp_;
 };
 
+//------------------------------------------------------------------------------
+/**
+ *  Unreliable core state update of several objects for a single
+ *  client, sharing one header and timestamp. Each state is delta
+ *  encoded against the last state the client has acknowledged for
+ *  the object. Object ids are sent ascending, as differences to the
+ *  previous id.
+ *
+ *  \see SnapshotBaselines, SnapshotHistory
+ */
+class WorldSnapshotCmd : public NetworkCommandServer
+{
+ public:
+    WorldSnapshotCmd();
+    WorldSnapshotCmd(uint16_t seq);
+
+    bool addState(uint16_t object_id,
+                  const SerializedState & state,
+                  const SerializedState * baseline,
+                  uint16_t baseline_seq,
+                  unsigned max_size);
+
+    virtual void execute(PuppetMasterClient * master);
+
+    bool isEmpty() const;
+    unsigned getSize() const;
+
+ protected:
+    virtual void getNetworkOptions(PacketReliability & reliability,
+                                   PacketPriority    & priority,
+                                   unsigned          & channel);
+    
+    virtual void writeToBitstream (RakNet::BitStream & stream);
+    virtual void readFromBitstream(RakNet::BitStream & stream);
+
+    //------------------------------------------------------------------------------
+    class ObjectState
+    {
+    public:
+        bool operator<(const ObjectState & other) const { return id_ < other.id_; }
+
+        uint16_t id_;           ///< Id of the game object which is to be updated.
+        bool is_delta_;         ///< Whether the state is encoded against a baseline.
+        uint16_t baseline_seq_; ///< Sequence number of the baseline, only valid if is_delta_.
+        SerializedState data_;  ///< The encoded state, see network::writeStateDelta.
+    };
+    
+    uint16_t seq_;     ///< Snapshot sequence number of all contained states.
+    uint16_t num_states_;
+    
+    std::vector<ObjectState> state_; ///< Server side only.
+    unsigned num_state_bits_;        ///< Server side only, size of state_ when written.
+
+    RakNet::BitStream state_stream_; ///< Client side only, the
+                                     ///unparsed object states.
+
+    uint32_t timestamp_;
+};
+
 //------------------------------------------------------------------------------
 /**
  *  Represents a string message from the server to the client.
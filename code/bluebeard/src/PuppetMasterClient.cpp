@@ -223,6 +223,8 @@ void PuppetMasterClient::reset()
     game_state_->reset();
     game_logic_.reset(NULL);
 
+    snapshot_history_.clear();
+
     local_player_.reset();
 
     hud_->setStatusLine("");
@@ -542,6 +544,8 @@ void PuppetMasterClient::addGameObject(GameObject * object)
 //------------------------------------------------------------------------------
 void PuppetMasterClient::deleteGameObject(uint16_t id)
 {
+    snapshot_history_.removeObject(id);
+    
     GameObject * object = game_state_->getGameObject(id);
     
     if (!object)
@@ -574,6 +578,12 @@ GameLogicClient * PuppetMasterClient::getGameLogic()
     return game_logic_.get();
 }
 
+//------------------------------------------------------------------------------
+SnapshotHistory & PuppetMasterClient::getSnapshotHistory()
+{
+    return snapshot_history_;
+}
+
 //------------------------------------------------------------------------------
 const std::list<RemotePlayer> & PuppetMasterClient::getConnectedPlayers()
 {
@@ -907,6 +917,8 @@ void PuppetMasterClient::handleInput(float dt)
 {
     if (!game_logic_.get()) return;
 
+    sendStateAcks();
+
 //    s_log << Log::debug('t') << "handleInput\n";
 
     float min = s_params.get<float>("client.input.mouse_sensitivity_min");
@@ -954,6 +966,24 @@ void PuppetMasterClient::handleInput(float dt)
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Acknowledges the delta encoded states received since the last
+ *  call, piggybacking on the input send rate.
+ */
+void PuppetMasterClient::sendStateAcks()
+{
+    if (!snapshot_history_.hasPendingAcks()) return;
+
+    std::vector<std::pair<uint16_t, uint16_t> > acks;
+    std::vector<uint16_t> resync;
+    snapshot_history_.fetchPendingAcks(acks, resync);
+
+    network::AckGameObjectStateCmd cmd(acks, resync);
+    cmd.send(client_interface_);
+}
+
+
 //------------------------------------------------------------------------------
 void PuppetMasterClient::up     (bool b)
 {
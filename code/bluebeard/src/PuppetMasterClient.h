@@ -12,6 +12,7 @@
 #include "GameObject.h"
 #include "NetworkCommandServer.h"
 #include "Console.h"
+#include "StateSnapshot.h"
 
 class RakPeerInterface;
 class PlayerInput;
@@ -68,6 +69,8 @@ class PuppetMasterClient
 
     GameLogicClient * getGameLogic();
 
+    SnapshotHistory & getSnapshotHistory();
+
     const std::list<RemotePlayer> & getConnectedPlayers();
 
     bool isConnectionProblem();
@@ -99,6 +102,7 @@ class PuppetMasterClient
     void saveLevelResources() const;
 
     void handleInput(float dt);
+    void sendStateAcks();
 
 
     // Input handling functions
@@ -128,6 +132,8 @@ class PuppetMasterClient
 
     LocalPlayer local_player_;
 
+    SnapshotHistory snapshot_history_; ///< Baselines for delta encoded object states.
+
     typedef std::list<RemotePlayer> RemotePlayerContainer;
     RemotePlayerContainer remote_player_;
 
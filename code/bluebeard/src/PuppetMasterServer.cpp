@@ -29,13 +29,19 @@
 #include "RankingStatistics.h"
 
 
+/// Room left in each snapshot datagram for RakNet, UDP and IP
+/// headers.
+const unsigned SNAPSHOT_HEADER_RESERVE = 64;
+
+
 //------------------------------------------------------------------------------
 PuppetMasterServer::PuppetMasterServer(RakPeerInterface * server_interface) :
     game_state_(new GameState()),
     interface_(server_interface),
     announcer_(this),
     user_id_    (network::ranking::INVALID_USER_ID),
-    session_key_(network::ranking::INVALID_SESSION_KEY)
+    session_key_(network::ranking::INVALID_SESSION_KEY),
+    snapshot_seq_(0)
 {
     try
     {
@@ -82,8 +88,12 @@ void PuppetMasterServer::reset()
          ++it)
     {
         it->setControllable(NULL);
+        it->getSnapshotBaselines().clear();
+        it->getClientRelevancy().clear();
     }
 
+    relevancy_grid_.reset();
+
     game_state_->reset();
     game_logic_.reset(NULL);
 
@@ -132,7 +142,7 @@ void PuppetMasterServer::frameMove(float dt)
             // We must send the correction for the returned sequence
             // number
 #ifdef ENABLE_DEV_FEATURES            
-            s_log << Log::debug('b')
+            LOG_DEBUG('b')
                   << "Sending correction for state "
                   << (unsigned)seq_number
                   << "\n";
@@ -182,7 +192,7 @@ void PuppetMasterServer::handleInput(const SystemAddress & id,
 
     if(player->getControllable() == NULL)
     {
-        s_log << Log::debug('n')
+        LOG_DEBUG('n')
               << "input from client still arriving, controllable == NULL \n";
         return;   
     }
@@ -197,13 +207,19 @@ void PuppetMasterServer::handleInput(const SystemAddress & id,
 /**
  *  Broadcasts the current game state to all connected clients.
  *
- *
+ *  If server.network.delta_snapshots is set, core states are delta
+ *  encoded per client against the last state it acknowledged, see
+ *  sendDeltaStates.
  */
 void PuppetMasterServer::sendGameState()
 {
     ADD_STATIC_CONSOLE_VAR(bool, send_gamestate, true);
     if (!send_gamestate) return;
 
+    bool delta_snapshots = s_params.get<bool>("server.network.delta_snapshots");
+    ++snapshot_seq_;
+
+    std::vector<RigidBody*> awake_objects;
     
     // Traverse all game objects and send their state
     for (GameState::GameObjectContainer::const_iterator it =
@@ -225,7 +241,7 @@ void PuppetMasterServer::sendGameState()
         if (it->second->isDirty())
         {
             // Send extra state to all players
-            s_log << Log::debug('n')
+            LOG_DEBUG('n')
                   << "Sending extra state for "
                   << *rigid_body
                   << "\n";
@@ -237,6 +253,12 @@ void PuppetMasterServer::sendGameState()
             
         // Skip sleeping objects.
         if (rigid_body->isSleeping()) continue;
+
+        if (delta_snapshots)
+        {
+            awake_objects.push_back(rigid_body);
+            continue;
+        }
         
         // Don't send object state to owner, as this would mess up
         // client side prediction. This will be handled with a
@@ -247,6 +269,8 @@ void PuppetMasterServer::sendGameState()
         network::SetGameObjectStateCmd cmd_core(it->second, OST_CORE);
         sendNetworkCommand(cmd_core, exclude_id, CST_BROADCAST_READY);
     }
+
+    if (delta_snapshots) sendDeltaStates(awake_objects);
 }
 
 
@@ -766,6 +790,8 @@ void PuppetMasterServer::loadLevel(void * opts)
         throw e;
     }
 
+    relevancy_grid_.init(game_state_->getTerrainData());
+
     game_logic_->getMatchEvents()->setHosterAuthData(user_id_, session_key_);
 
     // re-add existing players to logic
@@ -962,6 +988,109 @@ void PuppetMasterServer::sendReliableState(Observable* observable, unsigned even
 
     // This needs to go to ALL players, even the ones not ready.
     cmd_core.send(interface_, UNASSIGNED_SYSTEM_ADDRESS, true);
+
+    // The clients' state now differs from their acknowledged
+    // baselines, so the object must be sent in full when it wakes up
+    // again.
+    for (PlayerContainer::iterator it = player_.begin();
+         it != player_.end();
+         ++it)
+    {
+        it->getSnapshotBaselines().removeObject(rigid_body->getId());
+        it->getClientRelevancy()  .removeObject(rigid_body->getId());
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Sends the core states of the given objects to all ready clients,
+ *  delta encoded against the last state each client has
+ *  acknowledged. Clients known to have the current state already are
+ *  skipped. All states for a client are batched into a single
+ *  WorldSnapshotCmd, split only if it would exceed the MTU.
+ *
+ *  If server.relevancy.enabled is set, each client only receives the
+ *  objects its RelevancyGrid query deems due, highest priority first,
+ *  until server.relevancy.bytes_per_client have been sent. Objects
+ *  not needed by any client aren't serialized at all.
+ */
+void PuppetMasterServer::sendDeltaStates(const std::vector<RigidBody*> & objects)
+{
+    bool relevancy = s_params.get<bool>("server.relevancy.enabled");
+    unsigned budget = relevancy ? s_params.get<unsigned>("server.relevancy.bytes_per_client") : (unsigned)-1;
+    unsigned max_packet_size = s_params.get<unsigned>("server.network.mtu_size") - SNAPSHOT_HEADER_RESERVE;
+
+    if (relevancy) relevancy_grid_.update(objects);
+
+    std::map<uint16_t, SerializedState> state; // Serialized on first use.
+    std::vector<RelevantObject> relevant;
+
+    for (PlayerContainer::iterator cur_player = player_.begin();
+         cur_player != player_.end();
+         ++cur_player)
+    {
+        if (cur_player->getNeededReadies() != 0 ) continue;
+
+        // Bots will never acknowledge anything.
+        if (cur_player->getAIPlayer()) continue;
+
+        if (relevancy)
+        {
+            relevancy_grid_.getRelevantObjects(cur_player->getControllable(),
+                                               cur_player->getClientRelevancy(),
+                                               relevant);
+        } else
+        {
+            relevant.clear();
+            for (unsigned o=0; o<objects.size(); ++o) relevant.push_back(RelevantObject(objects[o], 1.0f));
+        }
+
+        SnapshotBaselines & baselines = cur_player->getSnapshotBaselines();
+        unsigned bytes_sent = 0;
+
+        std::auto_ptr<network::WorldSnapshotCmd> cmd(new network::WorldSnapshotCmd(snapshot_seq_));
+
+        for (unsigned r=0; r<relevant.size() && bytes_sent + cmd->getSize() < budget; ++r)
+        {
+            const RigidBody * object = relevant[r].object_;
+            
+            // Don't send object state to owner, as this would mess up
+            // client side prediction. This will be handled with a
+            // SetControllableStateCmd.
+            if (dynamic_cast<const Controllable*>(object) &&
+                object->getOwner() == cur_player->getId()) continue;
+
+            std::map<uint16_t, SerializedState>::iterator cur_state = state.find(object->getId());
+            if (cur_state == state.end())
+            {
+                RakNet::BitStream stream;
+                object->writeStateToBitstream(stream, OST_CORE);
+                cur_state = state.insert(std::make_pair(object->getId(), SerializedState(stream))).first;
+            }
+
+            cur_player->getClientRelevancy().objectSent(object->getId());
+            
+            if (baselines.isUpToDate(object->getId(), cur_state->second)) continue;
+
+            uint16_t baseline_seq = 0;
+            const SerializedState * baseline = baselines.getBaseline(object->getId(), baseline_seq);
+        
+            if (!cmd->addState(object->getId(), cur_state->second, baseline, baseline_seq, max_packet_size))
+            {
+                // Datagram is full, start a new one.
+                bytes_sent += cmd->getSize();
+                cmd->send(interface_, cur_player->getId(), false);
+
+                cmd.reset(new network::WorldSnapshotCmd(snapshot_seq_));
+                cmd->addState(object->getId(), cur_state->second, baseline, baseline_seq, max_packet_size);
+            }
+
+            baselines.addSentState(object->getId(), snapshot_seq_, cur_state->second);
+        }
+
+        if (!cmd->isEmpty()) cmd->send(interface_, cur_player->getId(), false);
+    }
 }
 
 
@@ -996,6 +1125,14 @@ void PuppetMasterServer::deleteScheduledObjects()
         
         game_state_->deleteGameObject(id_to_delete);
 
+        for (PlayerContainer::iterator player = player_.begin();
+             player != player_.end();
+             ++player)
+        {
+            player->getSnapshotBaselines().removeObject(id_to_delete);
+            player->getClientRelevancy()  .removeObject(id_to_delete);
+        }
+
         network::DeleteGameObjectCmd delete_cmd(id_to_delete);
         delete_cmd.send(interface_, UNASSIGNED_SYSTEM_ADDRESS, true);
     }
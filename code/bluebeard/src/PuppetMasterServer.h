@@ -11,6 +11,7 @@
 #include "RegisteredFpGroup.h"
 #include "Observable.h"
 #include "ServerAnnouncer.h"
+#include "RelevancyGrid.h"
 
 class RakPeerInterface;
 class GameState;
@@ -149,6 +150,7 @@ class PuppetMasterServer : public Observable
     void updatePlayerAuthData(const ServerPlayer * player) const;
 
     void sendReliableState(Observable* rigid_body, unsigned event);
+    void sendDeltaStates(const std::vector<RigidBody*> & objects);
 
     void deleteScheduledObjects();
 
@@ -184,6 +186,13 @@ class PuppetMasterServer : public Observable
 
     uint32_t user_id_;
     uint32_t session_key_;
+
+    uint16_t snapshot_seq_; ///< Incremented for every sendGameState,
+                            ///identifies delta baselines. Not reset
+                            ///on level change to avoid confusion with
+                            ///stale packets.
+
+    RelevancyGrid relevancy_grid_;
     
     RegisteredFpGroup fp_group_;
 };
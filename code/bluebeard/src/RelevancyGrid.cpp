@@ -0,0 +1,239 @@
+
+#include "RelevancyGrid.h"
+
+#include <algorithm>
+
+#include "RigidBody.h"
+#include "TerrainData.h"
+#include "ParameterManager.h"
+#include "utility_Math.h"
+
+
+/// Limits memory if the grid is configured too fine-grained for the
+/// level.
+const int MAX_CELLS_PER_SIDE = 256;
+
+
+//------------------------------------------------------------------------------
+ClientRelevancy::ClientRelevancy()
+{
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  \return The total priority accumulated for the object since it was
+ *  last sent.
+ */
+float ClientRelevancy::addPriority(uint16_t object_id, float priority)
+{
+    float & acc = accumulated_priority_[object_id];
+    acc += priority;
+    return acc;
+}
+
+//------------------------------------------------------------------------------
+void ClientRelevancy::objectSent(uint16_t object_id)
+{
+    accumulated_priority_.erase(object_id);
+}
+
+//------------------------------------------------------------------------------
+void ClientRelevancy::removeObject(uint16_t object_id)
+{
+    accumulated_priority_.erase(object_id);
+}
+
+//------------------------------------------------------------------------------
+void ClientRelevancy::clear()
+{
+    accumulated_priority_.clear();
+}
+
+
+
+//------------------------------------------------------------------------------
+RelevancyGrid::RelevancyGrid() :
+    cell_size_(1.0f),
+    num_cells_x_(1),
+    num_cells_z_(1),
+    cell_(1)
+{
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Sets up the grid to cover the given terrain. If there is no
+ *  terrain, a single cell is used.
+ */
+void RelevancyGrid::init(const terrain::TerrainData * terrain)
+{
+    reset();
+
+    if (!terrain) return;
+
+    cell_size_ = s_params.get<float>("server.relevancy.cell_size");
+
+    float extent_x = (terrain->getResX()-1) * terrain->getHorzScale();
+    float extent_z = (terrain->getResZ()-1) * terrain->getHorzScale();
+
+    num_cells_x_ = clamp((int)ceilf(extent_x / cell_size_), 1, MAX_CELLS_PER_SIDE);
+    num_cells_z_ = clamp((int)ceilf(extent_z / cell_size_), 1, MAX_CELLS_PER_SIDE);
+
+    // Grid might have been clamped, enlarge cells accordingly.
+    cell_size_ = std::max(cell_size_, std::max(extent_x / num_cells_x_,
+                                               extent_z / num_cells_z_));
+
+    cell_.resize(num_cells_x_ * num_cells_z_);
+}
+
+
+//------------------------------------------------------------------------------
+void RelevancyGrid::reset()
+{
+    cell_size_   = 1.0f;
+    num_cells_x_ = 1;
+    num_cells_z_ = 1;
+
+    cell_.clear();
+    cell_.resize(1);
+    object_.clear();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Sorts the given objects into the grid, replacing the previous
+ *  contents.
+ */
+void RelevancyGrid::update(const std::vector<RigidBody*> & objects)
+{
+    for (unsigned c=0; c<cell_.size(); ++c) cell_[c].clear();
+    object_ = objects;
+
+    for (unsigned o=0; o<objects.size(); ++o)
+    {
+        int x, z;
+        getCell(objects[o]->getPosition(), x, z);
+        cell_[x + z*num_cells_x_].push_back(objects[o]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Accumulates the priorities of all objects relevant to the given
+ *  viewer and returns those which are due, highest priority first.
+ *
+ *  \param viewer The object controlled by the client, or NULL if the
+ *  client currently has no position in the world. In this case, all
+ *  objects are considered with their plain importance.
+ */
+void RelevancyGrid::getRelevantObjects(const RigidBody * viewer,
+                                       ClientRelevancy & relevancy,
+                                       std::vector<RelevantObject> & result) const
+{
+    result.clear();
+
+    if (!viewer)
+    {
+        for (unsigned o=0; o<object_.size(); ++o)
+        {
+            float p = relevancy.addPriority(object_[o]->getId(), object_[o]->getNetworkImportance());
+            if (p >= 1.0f) result.push_back(RelevantObject(object_[o], p));
+        }
+    } else
+    {
+        static ParameterHandle<float> radius_param        ("server.relevancy.radius");
+        static ParameterHandle<float> full_rate_dist_param("server.relevancy.full_rate_distance");
+        static ParameterHandle<float> behind_factor_param ("server.relevancy.behind_factor");
+        
+        float radius         = radius_param.get();
+        float full_rate_dist = full_rate_dist_param.get();
+        float behind_factor  = behind_factor_param.get();
+
+        Matrix transform = viewer->getTransform();
+        Vector viewer_pos =  transform.getTranslation();
+        Vector viewer_dir = -transform.getZ();
+        viewer_dir.y_ = 0.0f;
+        viewer_dir.safeNormalize();
+
+        int min_x, min_z, max_x, max_z;
+        getCell(viewer_pos - Vector(radius, 0.0f, radius), min_x, min_z);
+        getCell(viewer_pos + Vector(radius, 0.0f, radius), max_x, max_z);
+
+        for (int z=min_z; z<=max_z; ++z)
+        {
+            for (int x=min_x; x<=max_x; ++x)
+            {
+                const std::vector<RigidBody*> & cell = cell_[x + z*num_cells_x_];
+                for (unsigned o=0; o<cell.size(); ++o)
+                {
+                    if (cell[o] == viewer) continue;
+
+                    Vector diff = cell[o]->getPosition() - viewer_pos;
+                    if (diff.lengthSqr() > radius*radius)
+                    {
+                        // Start afresh once the object comes into
+                        // range again.
+                        relevancy.removeObject(cell[o]->getId());
+                        continue;
+                    }
+
+                    float p = relevancy.addPriority(cell[o]->getId(),
+                                                    calcPriority(cell[o], diff, viewer_dir,
+                                                                 full_rate_dist, behind_factor));
+                    if (p >= 1.0f) result.push_back(RelevantObject(cell[o], p));
+                }
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the cell the given position falls into. Positions outside
+ *  the terrain are clamped to the border cells.
+ */
+void RelevancyGrid::getCell(const Vector & pos, int & x, int & z) const
+{
+    x = clamp((int)floorf(pos.x_ / cell_size_), 0, num_cells_x_-1);
+    z = clamp((int)floorf(pos.z_ / cell_size_), 0, num_cells_z_-1);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The per-send priority of an object: its importance, scaled down
+ *  proportional to distance beyond server.relevancy.full_rate_distance
+ *  and by server.relevancy.behind_factor if it lies behind the viewer.
+ *
+ *  \param diff The object's position relative to the viewer.
+ */
+float RelevancyGrid::calcPriority(const RigidBody * object,
+                                  Vector diff,
+                                  const Vector & viewer_dir,
+                                  float full_rate_dist,
+                                  float behind_factor) const
+{
+    diff.y_ = 0.0f;
+    float dist = diff.length();
+
+    float priority = object->getNetworkImportance();
+
+    if (dist > full_rate_dist)
+    {
+        priority *= full_rate_dist / dist;
+
+        // Interpolate between behind_factor directly behind the
+        // viewer and 1 directly in front.
+        float cos_alpha = vecDot(&diff, &viewer_dir) / dist;
+        priority *= behind_factor + (1.0f - behind_factor) * 0.5f * (cos_alpha + 1.0f);
+    }
+
+    return priority;
+}
@@ -0,0 +1,109 @@
+#ifndef TANK_RELEVANCY_GRID_INCLUDED
+#define TANK_RELEVANCY_GRID_INCLUDED
+
+
+#include <map>
+#include <vector>
+
+#include "Datatypes.h"
+#include "Vector.h"
+
+
+class RigidBody;
+
+namespace terrain
+{
+    class TerrainData;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Server side, per client: the update priority accumulated by each
+ *  object since its state was last sent to the client. Objects which
+ *  aren't sent keep accumulating priority, so even low priority
+ *  objects are eventually updated.
+ */
+class ClientRelevancy
+{
+ public:
+    ClientRelevancy();
+
+    float addPriority(uint16_t object_id, float priority);
+    void  objectSent (uint16_t object_id);
+
+    void removeObject(uint16_t object_id);
+    void clear();
+
+ protected:
+    std::map<uint16_t, float> accumulated_priority_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  An object selected for transmission to a client.
+ */
+class RelevantObject
+{
+ public:
+    RelevantObject(RigidBody * object, float priority) :
+        object_(object), priority_(priority) {}
+
+    /// Sorts highest priority first.
+    bool operator<(const RelevantObject & other) const { return priority_ > other.priority_; }
+
+    RigidBody * object_;
+    float priority_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Uniform grid over the terrain extents, used to decide which awake
+ *  objects are worth sending to which client.
+ *
+ *  The grid is filled once per sendGameState. For each client, only
+ *  the cells within server.relevancy.radius of its controllable are
+ *  visited. Every object found there gets a priority based on its
+ *  importance, its distance to the viewer and whether it lies in
+ *  front of or behind the viewer. Priority is accumulated over
+ *  several sends, objects are due as soon as their accumulated
+ *  priority reaches 1. Thus nearby objects are sent every time,
+ *  distant ones at a lower rate.
+ */
+class RelevancyGrid
+{
+ public:
+    RelevancyGrid();
+
+    void init(const terrain::TerrainData * terrain);
+    void reset();
+
+    void update(const std::vector<RigidBody*> & objects);
+
+    void getRelevantObjects(const RigidBody * viewer,
+                            ClientRelevancy & relevancy,
+                            std::vector<RelevantObject> & result) const;
+
+ protected:
+
+    void getCell(const Vector & pos, int & x, int & z) const;
+
+    float calcPriority(const RigidBody * object,
+                       Vector diff,
+                       const Vector & viewer_dir,
+                       float full_rate_dist,
+                       float behind_factor) const;
+
+    float cell_size_;
+    int num_cells_x_;
+    int num_cells_z_;
+
+    std::vector<std::vector<RigidBody*> > cell_; ///< Objects per cell, row major.
+
+    std::vector<RigidBody*> object_; ///< All objects, used for
+                                     ///viewers without position.
+};
+
+#endif
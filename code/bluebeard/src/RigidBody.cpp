@@ -32,8 +32,10 @@ RigidBody::~RigidBody()
 {
     scheduleForDeletion();
 
-    if (proxy_object_) delete proxy_object_;
-    delete target_object_;
+    // Bodies are returned to the simulator, which recycles them if
+    // their blueprint is pooled.
+    if (proxy_object_)  proxy_object_ ->getSimulator()->releaseBody(proxy_object_);
+    if (target_object_) target_object_->getSimulator()->releaseBody(target_object_);
 }
 
 
@@ -704,13 +706,17 @@ void RigidBody::deadReckon(Matrix & transform,
     if (cur_time <= timestamp) return;
     float dt = (float)(cur_time - timestamp) * 0.001f;
     
-    float step_size = 1.0f / s_params.get<float>("physics.fps");
+    static ParameterHandle<float> fps          ("physics.fps");
+    static ParameterHandle<float> lin_dampening("physics.lin_dampening");
+    static ParameterHandle<float> gravity      ("physics.gravity");
+    
+    float step_size = 1.0f / fps.get();
     while (dt > 0.0f)
     {   
-        v -= step_size*v*s_params.get<float>("physics.lin_dampening");
+        v -= step_size*v*lin_dampening.get();
         if (gravitiy)
         {
-            v.y_ -= step_size * s_params.get<float>("physics.gravity");
+            v.y_ -= step_size * gravity.get();
         }
         transform.getTranslation() += step_size * v;
 
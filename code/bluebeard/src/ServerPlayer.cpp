@@ -49,7 +49,9 @@ ServerPlayer::ServerPlayer(const ServerPlayer & other) :
     deque_underflow_   (other.deque_underflow_),
     deque_size_        (other.deque_size_),
     ranking_id_        (other.ranking_id_),
-    session_key_       (other.session_key_)
+    session_key_       (other.session_key_),
+    snapshot_baselines_(other.snapshot_baselines_),
+    client_relevancy_  (other.client_relevancy_)
 { 
     s_console.addVariable("network_delay",   &network_delay_,   &fp_group_);
     s_console.addVariable("total_delay",     &total_delay_,     &fp_group_);
@@ -111,7 +113,8 @@ bool ServerPlayer::handleInput(uint8_t & seq_number)
     ++cur_input_steps_;    
 
     // Completely flush input buffer if it grows too large
-    if (input_.size() > s_params.get<unsigned>("server.network.max_input_deque_size"))
+    static ParameterHandle<unsigned> max_input_deque_size("server.network.max_input_deque_size");
+    if (input_.size() > max_input_deque_size.get())
     {
         while (input_.size() > 1) input_.pop_front();
         seq_number = input_[0].first;
@@ -121,7 +124,7 @@ bool ServerPlayer::handleInput(uint8_t & seq_number)
         deque_overflow_ = true;
 
 #ifdef ENABLE_DEV_FEATURES        
-        s_log << Log::debug('D')
+        LOG_DEBUG('D')
               << " Deque overflow for "
               << getName()
               << "\n";
@@ -146,7 +149,8 @@ bool ServerPlayer::handleInput(uint8_t & seq_number)
 
         // This is needed e.g. for projectile offset to compensate for
         // network and input deque delay
-        float send_input_dt = (float)target_steps / s_params.get<float>("physics.fps");
+        static ParameterHandle<float> fps("physics.fps");
+        float send_input_dt = (float)target_steps / fps.get();
         total_delay_ *= 1.0f - TOTAL_DELAY_TRACKING_SPEED;
         total_delay_ += TOTAL_DELAY_TRACKING_SPEED * (network_delay_ + (input_.size()-1)*send_input_dt);
 
@@ -156,7 +160,7 @@ bool ServerPlayer::handleInput(uint8_t & seq_number)
             target_steps--;
             
 #ifdef ENABLE_DEV_FEATURES
-            s_log << Log::debug('D')
+            LOG_DEBUG('D')
                   << "Shrinking deque size for "
                   << getName()
                   << ".\n";
@@ -175,7 +179,7 @@ bool ServerPlayer::handleInput(uint8_t & seq_number)
 #ifdef ENABLE_DEV_FEATURES            
             if (deque_underflow_)
             {
-                s_log << Log::debug('D')
+                LOG_DEBUG('D')
                       << "Deque underflow for "
                       << getName()
                       << "\n";
@@ -225,7 +229,7 @@ void ServerPlayer::enqueueInput(uint8_t seq_number, const PlayerInput & input)
          seqNumberDifference(seq_number, input_.rbegin()->first) > 50))
     {
         // Drop out-of-order packets
-        s_log << Log::debug('n')
+        LOG_DEBUG('n')
               << "ServerPlayer::enqueueInput() : Dropped out-of-order packet "
               << (unsigned)seq_number
               << ". Current: "
@@ -235,7 +239,7 @@ void ServerPlayer::enqueueInput(uint8_t seq_number, const PlayerInput & input)
         return;
     }
 #ifdef ENABLE_DEV_FEATURES
-    else
+    else if (s_log.isDebugEnabled('b'))
     {
         s_log << Log::debug('b')
               << "ServerPlayer::enqueueInput "
@@ -312,3 +316,15 @@ void ServerPlayer::setAIPlayer(AIPlayer * aip)
     ai_player_ = aip;
 }
 
+
+//------------------------------------------------------------------------------
+SnapshotBaselines & ServerPlayer::getSnapshotBaselines()
+{
+    return snapshot_baselines_;
+}
+
+//------------------------------------------------------------------------------
+ClientRelevancy & ServerPlayer::getClientRelevancy()
+{
+    return client_relevancy_;
+}
@@ -12,6 +12,8 @@
 #include "Controllable.h"
 #include "Player.h"
 #include "AIPlayer.h"
+#include "StateSnapshot.h"
+#include "RelevancyGrid.h"
 
 struct SystemAddress;
 
@@ -44,6 +46,9 @@ class ServerPlayer : public Player
 
     AIPlayer * getAIPlayer();
     void setAIPlayer(AIPlayer * aip);
+
+    SnapshotBaselines & getSnapshotBaselines();
+    ClientRelevancy   & getClientRelevancy();
     
  protected:
 
@@ -91,6 +96,13 @@ class ServerPlayer : public Player
     /// GameStats too, because GameStats is lost after each level.
     uint32_t ranking_id_;
     uint32_t session_key_;
+
+    SnapshotBaselines snapshot_baselines_; ///< The object states this
+                                           ///client has acknowledged.
+
+    ClientRelevancy client_relevancy_; ///< Update priorities of the
+                                       ///objects not yet sent to
+                                       ///this client.
 };
 
 #endif
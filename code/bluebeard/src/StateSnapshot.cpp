@@ -0,0 +1,405 @@
+
+#include "StateSnapshot.h"
+
+#include <algorithm>
+
+#include <raknet/BitStream.h>
+
+#include "assert.h"
+
+
+/// Limits the memory spent on unacknowledged states for clients which
+/// stopped acknowledging.
+const unsigned MAX_UNACKED_STATES = 2*SNAPSHOT_HISTORY_SIZE;
+
+
+//------------------------------------------------------------------------------
+SerializedState::SerializedState() :
+    num_bits_(0)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Copies the complete contents of the given stream.
+ */
+SerializedState::SerializedState(RakNet::BitStream & stream) :
+    num_bits_(stream.GetNumberOfBitsUsed()),
+    data_(stream.GetData(), stream.GetData() + stream.GetNumberOfBytesUsed())
+{
+    // Clear padding bits so states can be compared bytewise.
+    if (num_bits_ & 7) data_.back() &= (uint8_t)(0xff << (8 - (num_bits_ & 7)));
+}
+
+//------------------------------------------------------------------------------
+void SerializedState::writeToBitstream(RakNet::BitStream & stream) const
+{
+    if (num_bits_ == 0) return;
+    stream.WriteBits(&data_[0], num_bits_, false);
+}
+
+//------------------------------------------------------------------------------
+bool SerializedState::operator==(const SerializedState & other) const
+{
+    return num_bits_ == other.num_bits_ && data_ == other.data_;
+}
+
+//------------------------------------------------------------------------------
+bool SerializedState::operator!=(const SerializedState & other) const
+{
+    return !(*this == other);
+}
+
+
+
+//------------------------------------------------------------------------------
+SnapshotBaselines::SnapshotBaselines()
+{
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the most recent state of the given object the client has
+ *  acknowledged, or NULL if there is none the client is guaranteed to
+ *  still have around.
+ */
+const SerializedState * SnapshotBaselines::getBaseline(uint16_t object_id, uint16_t & baseline_seq) const
+{
+    BaselineContainer::const_iterator it = baseline_.find(object_id);
+    if (it == baseline_.end())      return NULL;
+    if (!it->second.acknowledged_) return NULL;
+
+    // The client only keeps the last SNAPSHOT_HISTORY_SIZE states per
+    // object. All unacknowledged states are newer than the baseline,
+    // so if too many of them arrived, the baseline is lost.
+    if (it->second.unacked_.size() >= SNAPSHOT_HISTORY_SIZE) return NULL;
+
+    baseline_seq = it->second.acked_seq_;
+    return &it->second.acked_state_;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns true if the client is known to have the given state for
+ *  the object, so there is no need to send anything at all.
+ */
+bool SnapshotBaselines::isUpToDate(uint16_t object_id, const SerializedState & state) const
+{
+    BaselineContainer::const_iterator it = baseline_.find(object_id);
+    if (it == baseline_.end()) return false;
+
+    return (it->second.acknowledged_ &&
+            it->second.unacked_.empty() &&
+            it->second.acked_state_ == state);
+}
+
+
+//------------------------------------------------------------------------------
+void SnapshotBaselines::addSentState(uint16_t object_id, uint16_t seq, const SerializedState & state)
+{
+    ObjectBaseline & baseline = baseline_[object_id];
+
+    baseline.unacked_.push_back(std::make_pair(seq, state));
+    while (baseline.unacked_.size() > MAX_UNACKED_STATES) baseline.unacked_.pop_front();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The client has received the state with the given sequence number
+ *  for the given object. It becomes the new baseline, all older
+ *  unacknowledged states are discarded.
+ */
+void SnapshotBaselines::acknowledge(uint16_t object_id, uint16_t seq)
+{
+    BaselineContainer::iterator it = baseline_.find(object_id);
+    if (it == baseline_.end()) return;
+
+    ObjectBaseline & baseline = it->second;
+
+    for (unsigned i=0; i<baseline.unacked_.size(); ++i)
+    {
+        if (baseline.unacked_[i].first != seq) continue;
+
+        baseline.acknowledged_ = true;
+        baseline.acked_seq_    = seq;
+        baseline.acked_state_  = baseline.unacked_[i].second;
+
+        baseline.unacked_.erase(baseline.unacked_.begin(), baseline.unacked_.begin() + i + 1);
+        return;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Forget everything about the given object, the next state will be
+ *  sent without baseline.
+ */
+void SnapshotBaselines::removeObject(uint16_t object_id)
+{
+    baseline_.erase(object_id);
+}
+
+//------------------------------------------------------------------------------
+void SnapshotBaselines::clear()
+{
+    baseline_.clear();
+}
+
+
+
+//------------------------------------------------------------------------------
+SnapshotHistory::SnapshotHistory() :
+    has_newest_seq_(false),
+    newest_seq_(0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Stores a received state and schedules its acknowledgement.
+ *
+ *  \return Whether this is the most recent state received for the
+ *  object. Older states arriving out of order are still kept as
+ *  baseline, but shouldn't be applied to the object.
+ */
+bool SnapshotHistory::addState(uint16_t object_id, uint16_t seq, const SerializedState & state)
+{
+    if (!has_newest_seq_ || isSnapshotSeqNewer(seq, newest_seq_))
+    {
+        has_newest_seq_ = true;
+        newest_seq_     = seq;
+        if (!reset_seq_.empty()) expireResets();
+    }
+
+    // Drop states which were sent before the object was reset, but
+    // arrived after it.
+    std::map<uint16_t, uint16_t>::iterator reset = reset_seq_.find(object_id);
+    if (reset != reset_seq_.end())
+    {
+        if (!isSnapshotSeqNewer(seq, reset->second)) return false;
+        reset_seq_.erase(reset);
+    }
+    
+    StateContainer & states = state_[object_id];
+
+    // Keep states sorted by sequence number
+    StateContainer::iterator it = states.end();
+    while (it != states.begin())
+    {
+        StateContainer::iterator prev = it-1;
+        if (prev->first == seq) return false;
+        if (isSnapshotSeqNewer(seq, prev->first)) break;
+        it = prev;
+    }
+
+    bool newest = (it == states.end());
+
+    states.insert(it, std::make_pair(seq, state));
+    while (states.size() > SNAPSHOT_HISTORY_SIZE) states.pop_front();
+
+    std::map<uint16_t, uint16_t>::iterator ack = pending_ack_.find(object_id);
+    if (ack == pending_ack_.end())
+    {
+        pending_ack_[object_id] = seq;
+    } else if (isSnapshotSeqNewer(seq, ack->second))
+    {
+        ack->second = seq;
+    }
+
+    return newest;
+}
+
+//------------------------------------------------------------------------------
+const SerializedState * SnapshotHistory::getState(uint16_t object_id, uint16_t seq) const
+{
+    std::map<uint16_t, StateContainer>::const_iterator it = state_.find(object_id);
+    if (it == state_.end()) return NULL;
+
+    for (StateContainer::const_iterator cur = it->second.begin();
+         cur != it->second.end();
+         ++cur)
+    {
+        if (cur->first == seq) return &cur->second;
+    }
+
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  A delta for the given object couldn't be decoded, ask the server to
+ *  send the full state again.
+ */
+void SnapshotHistory::requestResync(uint16_t object_id)
+{
+    if (std::find(pending_resync_.begin(), pending_resync_.end(), object_id) != pending_resync_.end()) return;
+    pending_resync_.push_back(object_id);
+}
+
+
+//------------------------------------------------------------------------------
+bool SnapshotHistory::hasPendingAcks() const
+{
+    return !pending_ack_.empty() || !pending_resync_.empty();
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the acknowledgements and resync requests collected since
+ *  the last call and clears them.
+ */
+void SnapshotHistory::fetchPendingAcks(std::vector<std::pair<uint16_t, uint16_t> > & acks,
+                                       std::vector<uint16_t> & resync)
+{
+    acks.assign(pending_ack_.begin(), pending_ack_.end());
+    resync.swap(pending_resync_);
+
+    pending_ack_.clear();
+    pending_resync_.clear();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The object's state was set by a reliable full state, and the
+ *  server dropped its baselines. Forget the received states: once
+ *  the sequence number has wrapped around, the next state might
+ *  otherwise compare as older than the stale ones and never be
+ *  applied.
+ */
+void SnapshotHistory::resetObject(uint16_t object_id)
+{
+    removeObject(object_id);
+
+    if (has_newest_seq_) reset_seq_[object_id] = newest_seq_;
+}
+
+//------------------------------------------------------------------------------
+void SnapshotHistory::removeObject(uint16_t object_id)
+{
+    state_.erase(object_id);
+    pending_ack_.erase(object_id);
+    reset_seq_.erase(object_id);
+}
+
+//------------------------------------------------------------------------------
+void SnapshotHistory::clear()
+{
+    state_.clear();
+    pending_ack_.clear();
+    pending_resync_.clear();
+    reset_seq_.clear();
+
+    has_newest_seq_ = false;
+    newest_seq_     = 0;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Late states are only a concern shortly after a reset. Forget old
+ *  reset marks so they can't reject valid states after the sequence
+ *  number wrapped around.
+ */
+void SnapshotHistory::expireResets()
+{
+    std::map<uint16_t, uint16_t>::iterator it = reset_seq_.begin();
+    while (it != reset_seq_.end())
+    {
+        if ((uint16_t)(newest_seq_ - it->second) > 4*SNAPSHOT_HISTORY_SIZE)
+        {
+            reset_seq_.erase(it++);
+        } else ++it;
+    }
+}
+
+
+namespace network
+{
+
+//------------------------------------------------------------------------------
+/**
+ *  Writes state to the stream. If a baseline is given, only the bytes
+ *  differing from it are transmitted (xor'ed against the baseline),
+ *  preceded by one bit per byte. Unchanged bytes thus cost a single
+ *  bit.
+ *
+ *  \param baseline The state to encode against, or NULL. Must have the
+ *  same size as state.
+ */
+void writeStateDelta(RakNet::BitStream & stream,
+                     const SerializedState * baseline,
+                     const SerializedState & state)
+{
+    stream.WriteCompressed(state.num_bits_);
+
+    if (!baseline)
+    {
+        state.writeToBitstream(stream);
+        return;
+    }
+
+    assert(baseline->num_bits_ == state.num_bits_);
+
+    for (unsigned i=0; i<state.data_.size(); ++i)
+    {
+        uint8_t x = state.data_[i] ^ baseline->data_[i];
+        if (x)
+        {
+            stream.Write(true);
+            stream.Write(x);
+        } else
+        {
+            stream.Write(false);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Counterpart to writeStateDelta. Always consumes the encoded state
+ *  from the stream.
+ *
+ *  \return False if the state couldn't be reconstructed because the
+ *  baseline is missing or doesn't match.
+ */
+bool readStateDelta(RakNet::BitStream & stream,
+                    bool is_delta,
+                    const SerializedState * baseline,
+                    SerializedState & state)
+{
+    uint16_t num_bits = 0;
+    if (!stream.ReadCompressed(num_bits)) return false;
+
+    state.num_bits_ = num_bits;
+    state.data_.assign((num_bits + 7) >> 3, 0);
+
+    if (!is_delta)
+    {
+        if (num_bits == 0) return true;
+        return stream.ReadBits(&state.data_[0], num_bits, false);
+    }
+
+    bool baseline_valid = baseline && baseline->num_bits_ == num_bits;
+
+    for (unsigned i=0; i<state.data_.size(); ++i)
+    {
+        bool changed = false;
+        uint8_t x = 0;
+        if (!stream.Read(changed)) return false;
+        if (changed && !stream.Read(x)) return false;
+
+        state.data_[i] = baseline_valid ? baseline->data_[i] ^ x : x;
+    }
+
+    return baseline_valid;
+}
+
+}
@@ -0,0 +1,151 @@
+#ifndef TANK_STATE_SNAPSHOT_INCLUDED
+#define TANK_STATE_SNAPSHOT_INCLUDED
+
+
+#include <map>
+#include <deque>
+#include <vector>
+
+#include "Datatypes.h"
+
+
+namespace RakNet
+{
+    class BitStream;
+}
+
+
+/// The number of states per object the client keeps around for
+/// decoding deltas. The server never references a baseline older
+/// than that.
+const unsigned SNAPSHOT_HISTORY_SIZE = 16;
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The core state of a single object as written by
+ *  GameObject::writeStateToBitstream(OST_CORE), kept around as raw
+ *  bits to serve as delta baseline.
+ */
+class SerializedState
+{
+ public:
+    SerializedState();
+    SerializedState(RakNet::BitStream & stream);
+
+    void writeToBitstream(RakNet::BitStream & stream) const;
+
+    bool operator==(const SerializedState & other) const;
+    bool operator!=(const SerializedState & other) const;
+
+    uint16_t num_bits_;
+    std::vector<uint8_t> data_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Server side: keeps track of the object states a single client has
+ *  acknowledged, and of the states sent to it which are still
+ *  awaiting acknowledgement.
+ */
+class SnapshotBaselines
+{
+ public:
+    SnapshotBaselines();
+
+    const SerializedState * getBaseline(uint16_t object_id, uint16_t & baseline_seq) const;
+    bool isUpToDate(uint16_t object_id, const SerializedState & state) const;
+
+    void addSentState(uint16_t object_id, uint16_t seq, const SerializedState & state);
+    void acknowledge (uint16_t object_id, uint16_t seq);
+
+    void removeObject(uint16_t object_id);
+    void clear();
+
+ protected:
+
+    //------------------------------------------------------------------------------
+    class ObjectBaseline
+    {
+    public:
+        ObjectBaseline() : acknowledged_(false), acked_seq_(0) {}
+
+        bool acknowledged_;
+        uint16_t acked_seq_;
+        SerializedState acked_state_;
+
+        std::deque<std::pair<uint16_t, SerializedState> > unacked_; ///< Sent states, oldest first.
+    };
+
+    typedef std::map<uint16_t, ObjectBaseline> BaselineContainer;
+    BaselineContainer baseline_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Client side: the states most recently received for each object,
+ *  used to reconstruct delta encoded states. Also collects the
+ *  acknowledgements to be sent back to the server.
+ */
+class SnapshotHistory
+{
+ public:
+    SnapshotHistory();
+
+    bool addState(uint16_t object_id, uint16_t seq, const SerializedState & state);
+    const SerializedState * getState(uint16_t object_id, uint16_t seq) const;
+
+    void requestResync(uint16_t object_id);
+
+    bool hasPendingAcks() const;
+    void fetchPendingAcks(std::vector<std::pair<uint16_t, uint16_t> > & acks,
+                          std::vector<uint16_t> & resync);
+
+    void resetObject (uint16_t object_id);
+    void removeObject(uint16_t object_id);
+    void clear();
+
+ protected:
+
+    void expireResets();
+    
+    typedef std::deque<std::pair<uint16_t, SerializedState> > StateContainer;
+    std::map<uint16_t, StateContainer> state_; ///< Received states per object, oldest first.
+
+    bool has_newest_seq_;
+    uint16_t newest_seq_; ///< Newest sequence number received for any object.
+    std::map<uint16_t, uint16_t> reset_seq_; ///< Object id -> newest_seq_
+                                             ///at the time of its reset.
+
+    std::map<uint16_t, uint16_t> pending_ack_; ///< Object id -> newest received seq.
+    std::vector<uint16_t> pending_resync_;     ///< Objects for which a delta couldn't be decoded.
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns true if snapshot sequence number a is more recent than b,
+ *  taking into account wraparound.
+ */
+inline bool isSnapshotSeqNewer(uint16_t a, uint16_t b)
+{
+    return (int16_t)(uint16_t)(a - b) > 0;
+}
+
+
+namespace network
+{
+
+void writeStateDelta(RakNet::BitStream & stream,
+                     const SerializedState * baseline,
+                     const SerializedState & state);
+bool readStateDelta (RakNet::BitStream & stream,
+                     bool is_delta,
+                     const SerializedState * baseline,
+                     SerializedState & state);
+
+}
+
+#endif
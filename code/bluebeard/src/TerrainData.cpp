@@ -2,6 +2,7 @@
 #include "TerrainData.h"
 
 #include <limits>
+#include <algorithm>
 
 #include "physics/OdeCollision.h"
 
@@ -9,6 +10,7 @@
 #include "Serializer.h"
 #include "Paths.h"
 #include "Geometry.h"
+#include "CookedTerrain.h"
 
 
 #ifndef DEDICATED_SERVER
@@ -18,6 +20,21 @@
 #endif
 
 
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define TERRAIN_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(TERRAIN_SSE2) && defined(__GNUC__)
+#define TERRAIN_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TERRAIN_TARGET_SSE2
+#endif
+
+
 #undef min
 #undef max
 
@@ -26,9 +43,266 @@ namespace terrain
 
 const float BORDER_SLOPE = -0.1;
 
+
+#ifdef TERRAIN_SSE2
+namespace
+{
+
+//------------------------------------------------------------------------------
+/**
+ *  The SSE2 kernels are compiled regardless of the target
+ *  architecture flags, so check the CPU before using them.
+ */
+bool hasSse2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1<<26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+//------------------------------------------------------------------------------
+bool useSse2()
+{
+    static const bool use_sse2 = hasSse2();
+    return use_sse2;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The kernels below evaluate the same expressions in the same order
+ *  as their scalar counterparts in TerrainData, so results are
+ *  identical as long as the scalar code uses plain SSE math as well
+ *  (the default on x86-64; no x87, no FMA contraction). Keep both in
+ *  sync.
+ */
+TERRAIN_TARGET_SSE2 inline __m128 neg4(__m128 a)
+{
+    return _mm_xor_ps(a, _mm_set1_ps(-0.0f));
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Border falloff along one axis, see TerrainData::getLinearFalloff.
+ */
+TERRAIN_TARGET_SSE2 inline __m128 linearFalloff4(__m128 a, uint32_t size)
+{
+    __m128 zero  = _mm_setzero_ps();
+    __m128 slope = _mm_set1_ps(BORDER_SLOPE);
+
+    __m128 below = _mm_cmplt_ps(a, zero);
+    __m128 above = _mm_cmpge_ps(a, _mm_set1_ps((float)(int)size));
+
+    __m128 dh_below = _mm_mul_ps(slope, neg4(a));
+    __m128 dh_above = _mm_mul_ps(slope, _mm_add_ps(_mm_sub_ps(a, _mm_set1_ps((float)size)),
+                                                   _mm_set1_ps(1.0f)));
+
+    return _mm_or_ps(_mm_and_ps(below, dh_below),
+                     _mm_andnot_ps(below, _mm_and_ps(above, dh_above)));
+}
+
+//------------------------------------------------------------------------------
+TERRAIN_TARGET_SSE2 inline __m128 gather4(const float * const * base, int offset)
+{
+    return _mm_setr_ps(base[0][offset], base[1][offset], base[2][offset], base[3][offset]);
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Normalizes (x,y,z) the way Vector::normalize does and stores the
+ *  results in n.
+ */
+TERRAIN_TARGET_SSE2 inline void storeNormalized4(__m128 x, __m128 y, __m128 z, Vector * n)
+{
+    __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x,x), _mm_mul_ps(y,y)), _mm_mul_ps(z,z)));
+    __m128 inv_len = _mm_div_ps(_mm_set1_ps(1.0f), len);
+
+    float nx[4], ny[4], nz[4];
+    _mm_storeu_ps(nx, _mm_mul_ps(x, inv_len));
+    _mm_storeu_ps(ny, _mm_mul_ps(y, inv_len));
+    _mm_storeu_ps(nz, _mm_mul_ps(z, inv_len));
+
+    for (unsigned i=0; i<4; ++i) n[i] = Vector(nx[i], ny[i], nz[i]);
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Clamps the sample positions in place and returns pointers to the
+ *  upper left height samples and the fractional parts of the
+ *  positions.
+ */
+TERRAIN_TARGET_SSE2 inline void getSampleBase4(const float * data, uint32_t width,
+                                               __m128 & x, __m128 & z,
+                                               const float ** base,
+                                               __m128 & x_frac, __m128 & z_frac)
+{
+    __m128 one   = _mm_set1_ps(1.0f);
+    __m128 limit = _mm_set1_ps(width - EPSILON - 2.0f);
+
+    x = _mm_min_ps(_mm_max_ps(x, one), limit);
+    z = _mm_min_ps(_mm_max_ps(z, one), limit);
+
+    __m128i x_int = _mm_cvttps_epi32(x);
+    __m128i z_int = _mm_cvttps_epi32(z);
+    x_frac = _mm_sub_ps(x, _mm_cvtepi32_ps(x_int));
+    z_frac = _mm_sub_ps(z, _mm_cvtepi32_ps(z_int));
+
+    int xi[4], zi[4];
+    _mm_storeu_si128((__m128i*)xi, x_int);
+    _mm_storeu_si128((__m128i*)zi, z_int);
+
+    for (unsigned i=0; i<4; ++i) base[i] = &data[xi[i] + zi[i]*width];
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Four samples of TerrainData::getHeightAndNormal at once.
+ */
+TERRAIN_TARGET_SSE2 void getHeightAndNormalSse2(const float * data,
+                                                uint32_t width, uint32_t height,
+                                                float horz_scale,
+                                                const float * px, const float * pz,
+                                                float * h, Vector * n)
+{
+    __m128 scale = _mm_set1_ps(horz_scale);
+    __m128 x = _mm_div_ps(_mm_loadu_ps(px), scale);
+    __m128 z = _mm_div_ps(_mm_loadu_ps(pz), scale);
+
+    __m128 dh = _mm_add_ps(_mm_add_ps(_mm_setzero_ps(), linearFalloff4(x, width)),
+                           linearFalloff4(z, height));
+
+    const float * base[4];
+    __m128 x_frac, z_frac;
+    getSampleBase4(data, width, x, z, base, x_frac, z_frac);
+
+    __m128 h00 = gather4(base, 0);
+    __m128 h10 = gather4(base, 1);
+    __m128 h01 = gather4(base, width);
+    __m128 h11 = gather4(base, width+1);
+
+    __m128 ab   = _mm_sub_ps(h10, h00);
+    __m128 ac   = _mm_sub_ps(h01, h00);
+    __m128 adbc = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(h00, h11), h10), h01);
+
+    __m128 res = _mm_add_ps(h00, _mm_mul_ps(x_frac, ab));
+    res = _mm_add_ps(res, _mm_mul_ps(z_frac, ac));
+    res = _mm_add_ps(res, _mm_mul_ps(_mm_mul_ps(x_frac, z_frac), adbc));
+    res = _mm_add_ps(res, dh);
+    _mm_storeu_ps(h, res);
+
+    __m128 hx = _mm_add_ps(ab, _mm_mul_ps(z_frac, adbc));
+    __m128 hz = _mm_add_ps(ac, _mm_mul_ps(x_frac, adbc));
+
+    storeNormalized4(neg4(hx), scale, neg4(hz), n);
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  The four cubic interpolation weights and their derivatives, see
+ *  TerrainData::c0 - c3d.
+ */
+TERRAIN_TARGET_SSE2 inline void getCubicCoeffs4(__m128 frac, __m128 * c, __m128 * cd)
+{
+    __m128 frac2 = _mm_mul_ps(frac, frac);
+    __m128 frac3 = _mm_mul_ps(frac, frac2);
+
+    c[0] = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.5f), frac3), frac2),
+                      _mm_mul_ps(_mm_set1_ps(0.5f), frac));
+    c[1] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.5f), frac3),
+                                 _mm_mul_ps(_mm_set1_ps(2.5f), frac2)),
+                      _mm_set1_ps(1.0f));
+    c[2] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.5f), frac3),
+                                 _mm_mul_ps(_mm_set1_ps(2.0f), frac2)),
+                      _mm_mul_ps(_mm_set1_ps(0.5f), frac));
+    c[3] = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(0.5f), frac3),
+                      _mm_mul_ps(_mm_set1_ps(0.5f), frac2));
+
+    cd[0] = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.5f), frac2),
+                                  _mm_mul_ps(_mm_set1_ps(2.0f), frac)),
+                       _mm_set1_ps(0.5f));
+    cd[1] = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(4.5f), frac2),
+                       _mm_mul_ps(_mm_set1_ps(5.0f), frac));
+    cd[2] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(-4.5f), frac2),
+                                  _mm_mul_ps(_mm_set1_ps(4.0f), frac)),
+                       _mm_set1_ps(0.5f));
+    cd[3] = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.5f), frac2),
+                       _mm_mul_ps(_mm_set1_ps(1.0f), frac));
+}
+
+//------------------------------------------------------------------------------
+TERRAIN_TARGET_SSE2 inline __m128 dot4(const __m128 * a, const __m128 * b)
+{
+    __m128 res = _mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1]));
+    res = _mm_add_ps(res, _mm_mul_ps(a[2], b[2]));
+    return _mm_add_ps(res, _mm_mul_ps(a[3], b[3]));
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Four samples of TerrainData::getHeightAndNormalBicubic at once.
+ */
+TERRAIN_TARGET_SSE2 void getHeightAndNormalBicubicSse2(const float * data,
+                                                       uint32_t width, uint32_t height,
+                                                       float horz_scale,
+                                                       const float * px, const float * pz,
+                                                       float * h, Vector * n)
+{
+    __m128 scale = _mm_set1_ps(horz_scale);
+    __m128 x = _mm_div_ps(_mm_loadu_ps(px), scale);
+    __m128 z = _mm_div_ps(_mm_loadu_ps(pz), scale);
+
+    __m128 dh = _mm_add_ps(_mm_add_ps(_mm_setzero_ps(), linearFalloff4(x, width)),
+                           linearFalloff4(z, height));
+
+    __m128 one   = _mm_set1_ps(1.0f);
+    __m128 limit = _mm_set1_ps(width - EPSILON - 2.0f);
+    __m128 clamp_x = _mm_or_ps(_mm_cmplt_ps(x, one), _mm_cmpgt_ps(x, limit));
+    __m128 clamp_z = _mm_or_ps(_mm_cmplt_ps(z, one), _mm_cmpgt_ps(z, limit));
+
+    const float * base[4];
+    __m128 x_frac, z_frac;
+    getSampleBase4(data, width, x, z, base, x_frac, z_frac);
+
+    __m128 cx[4], cxd[4], cz[4], czd[4];
+    getCubicCoeffs4(x_frac, cx, cxd);
+    getCubicCoeffs4(z_frac, cz, czd);
+
+    __m128 x_interpol [4];
+    __m128 xd_interpol[4];
+    for (int i=0; i<4; ++i)
+    {
+        x_interpol [i] = _mm_setzero_ps();
+        xd_interpol[i] = _mm_setzero_ps();
+        for (int j=0; j<4; ++j)
+        {
+            __m128 s = gather4(base, j-1 + (i-1)*(int)width);
+            x_interpol [i] = _mm_add_ps(x_interpol [i], _mm_mul_ps(s, cx [j]));
+            xd_interpol[i] = _mm_add_ps(xd_interpol[i], _mm_mul_ps(s, cxd[j]));
+        }
+    }
+
+    _mm_storeu_ps(h, _mm_add_ps(dot4(x_interpol, cz), dh));
+    __m128 hz = dot4(x_interpol,  czd);
+    __m128 hx = dot4(xd_interpol, cz);
+
+    storeNormalized4(_mm_andnot_ps(clamp_x, neg4(hx)),
+                     scale,
+                     _mm_andnot_ps(clamp_z, neg4(hz)),
+                     n);
+}
+
+} // namespace
+#endif // #ifdef TERRAIN_SSE2
+
     
 //------------------------------------------------------------------------------
 TerrainData::TerrainData() :
+    height_data_(NULL),
     width_(0), height_(0),
     max_height_(0.0f), min_height_(0.0f),
     horz_scale_(0.0f)
@@ -41,15 +315,27 @@ TerrainData::~TerrainData()
 }
 
 //------------------------------------------------------------------------------
-void TerrainData::load(const std::string & name)
+/**
+ *  \param use_cooked Whether to map the level's cooked terrain file
+ *  if it is up to date. If false, the source files are always read.
+ */
+void TerrainData::load(const std::string & name, bool use_cooked)
 {
     if (name == name_) return;
 
     reset();    
     name_ = name;
 
+    std::string path = LEVEL_PATH + name + "/";
+    if (use_cooked && CookedTerrain::isUpToDate(path))
+    {
+        loadCooked(path);
+    } else
+    {
+        loadHm(path);
+    }
 
-    loadHm(LEVEL_PATH + name + "/");
+    buildHeightRangeMips();
 }
 
 //------------------------------------------------------------------------------
@@ -108,6 +394,33 @@ float TerrainData::getHeightAtGridInterpol(int x, int z,
     }
 }
 
+//------------------------------------------------------------------------------
+/**
+ *  Equivalent to calling getHeightAtGrid for x, x+1, ..., x+num-1,
+ *  but clamps and applies the border falloff for z only once.
+ */
+void TerrainData::getHeightAtGridRow(int x, int z, unsigned num,
+                                     unsigned level, float * h) const
+{
+    int step = 1<<level;
+    x *= step;
+    z *= step;
+
+    const float * row = &height_data_[clamp(z, 0, (int)height_ - 1)*width_];
+    float dh_inside = getLinearFalloff(0.0f, z);
+
+    for (unsigned i=0; i<num; ++i, x += step)
+    {
+        if (x >= 0 && x < (int)width_)
+        {
+            h[i] = row[x] + dh_inside;
+        } else
+        {
+            h[i] = row[clamp(x, 0, (int)width_ - 1)] + getLinearFalloff(x, z);
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 float TerrainData::getMinHeight() const
 {
@@ -129,7 +442,7 @@ float TerrainData::getHorzScale() const
 //------------------------------------------------------------------------------
 const float * TerrainData::getHeightData() const
 {
-    return &height_data_[0];
+    return height_data_;
 }
 
 
@@ -232,8 +545,8 @@ void TerrainData::getHeightAndNormalBicubic(float x, float z,
     {
         for (int j=0; j<4; ++j)
         {
-            x_interpol [i] += h_base[j-1 + (i-1)*width_]*cx[j];
-            xd_interpol[i] += h_base[j-1 + (i-1)*width_]*cxd[j];
+            x_interpol [i] += h_base[j-1 + (i-1)*(int)width_]*cx[j];
+            xd_interpol[i] += h_base[j-1 + (i-1)*(int)width_]*cxd[j];
         }
     }
 
@@ -258,6 +571,52 @@ void TerrainData::getHeightAndNormalBicubic(float x, float z,
     n.normalize();
 }
 
+//------------------------------------------------------------------------------
+/**
+ *  Samples num positions at once, yielding the same results as
+ *  calling getHeightAndNormal for each of them. Uses SSE2 for groups
+ *  of four positions if the CPU supports it.
+ */
+void TerrainData::getHeightAndNormal(unsigned num,
+                                     const float * x, const float * z,
+                                     float * h, Vector * n) const
+{
+    unsigned i=0;
+#ifdef TERRAIN_SSE2
+    if (useSse2())
+    {
+        for (; i+4 <= num; i+=4)
+        {
+            getHeightAndNormalSse2(height_data_, width_, height_, horz_scale_,
+                                   x+i, z+i, h+i, n+i);
+        }
+    }
+#endif
+    for (; i<num; ++i) getHeightAndNormal(x[i], z[i], h[i], n[i]);
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  \see getHeightAndNormal(unsigned, const float*, const float*, float*, Vector*)
+ */
+void TerrainData::getHeightAndNormalBicubic(unsigned num,
+                                            const float * x, const float * z,
+                                            float * h, Vector * n) const
+{
+    unsigned i=0;
+#ifdef TERRAIN_SSE2
+    if (useSse2())
+    {
+        for (; i+4 <= num; i+=4)
+        {
+            getHeightAndNormalBicubicSse2(height_data_, width_, height_, horz_scale_,
+                                          x+i, z+i, h+i, n+i);
+        }
+    }
+#endif
+    for (; i<num; ++i) getHeightAndNormalBicubic(x[i], z[i], h[i], n[i]);
+}
+
 //------------------------------------------------------------------------------
 /**
  *  Collide a ray against the interpolated surface. Simple euler-style
@@ -294,45 +653,136 @@ bool TerrainData::collideRay(physics::CollisionInfo & info,
     if (bicubic) getHeightAndNormalBicubic(guess.x_, guess.z_, h, n);
     else         getHeightAndNormal       (guess.x_, guess.z_, h, n);        
 
-    // pos lies on the interpolated surface
-    Vector pos(guess.x_, h, guess.z_);
+    return intersectTangentPlane(info, guess, h, n, dir, penetration_guess);
+}
 
 
-    // Now find an estimate for the intersection point euler-style by
-    // constructing the tangent plane and intersecting it with our
-    // ray.
-    Plane p(pos, n);
+//------------------------------------------------------------------------------
+/**
+ *  Performs collideRay for num rays sharing the same direction,
+ *  sampling the terrain for all of them at once.
+ *
+ *  \param info Contact data for each ray, see collideRay.
+ */
+void TerrainData::collideRays(unsigned num,
+                              physics::CollisionInfo * const * info,
+                              const Vector * tip,
+                              const Vector & dir,
+                              const float * penetration_guess,
+                              bool bicubic) const
+{
+    const unsigned BATCH_SIZE = 8;
 
-    float d = -p.evalPoint(guess);
-    float dot = vecDot(&n, &dir);
-    if (dot < 0.0f) return false;
- 
-    // pen is the distance of guess from the plane p in direction
-    // up. It also is the difference between this frame's penetration
-    // and the previous frame's penetration.
-    float pen = d / dot;
+    Vector guess[BATCH_SIZE];
+    float x[BATCH_SIZE];
+    float z[BATCH_SIZE];
+    float h[BATCH_SIZE];
+    Vector n[BATCH_SIZE];
 
-    if (pen + penetration_guess > info.penetration_)
+    for (unsigned b=0; b<num; b+=BATCH_SIZE)
     {
-        info.penetration_ = pen + penetration_guess;
-        info.n_           = dir;
-        info.pos_         = guess + dir * pen;
+        unsigned cur_size = std::min(BATCH_SIZE, num-b);
 
-        // pos must lie on plane
-        // this happens because of numeric inaccuracies -> disable
-        //assert(equalsZero(p.evalPoint(info.pos_)));
+        for (unsigned i=0; i<cur_size; ++i)
+        {
+            guess[i] = tip[b+i] + penetration_guess[b+i]*dir;
+            x[i] = guess[i].x_;
+            z[i] = guess[i].z_;
+        }
 
-        return true;
-    } else return false;
+        if (bicubic) getHeightAndNormalBicubic(cur_size, x, z, h, n);
+        else         getHeightAndNormal       (cur_size, x, z, h, n);
+
+        for (unsigned i=0; i<cur_size; ++i)
+        {
+            intersectTangentPlane(*info[b+i], guess[i], h[i], n[i], dir, penetration_guess[b+i]);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Finds the first intersection of a ray with the terrain surface, as
+ *  triangulated by the ODE heightfield geom. Parts of the terrain the
+ *  ray passes above are skipped using the height range pyramid.
+ *
+ *  A ray starting below the surface hits at distance 0.
+ *
+ *  \param dir The normalized ray direction.
+ *
+ *  \param dist [out] The distance of the intersection from pos.
+ *
+ *  \param normal [out] If not NULL, receives the normal of the
+ *  terrain triangle which was hit.
+ *
+ *  \return Whether the ray hits the terrain within max_dist.
+ */
+bool TerrainData::intersectRay(const Vector & pos, const Vector & dir, float max_dist,
+                               float & dist, Vector * normal) const
+{
+    if (height_range_mip_.empty()) return false;
+
+    float t0 = 0.0f;
+    float t1 = max_dist;
+    if (!clipRayToQuads(pos, dir, 0, 0, width_-1, height_-1, t0, t1)) return false;
+
+    return traverseRay(pos, dir, height_range_mip_.size()-1, 0, 0, t0, t1, false, dist, normal);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Performs intersectRay for num rays.
+ *
+ *  \param dist [out] The distance of the intersection for each ray
+ *  which hit the terrain, max_dist otherwise.
+ *
+ *  \param hit [out] Whether each ray hit the terrain.
+ */
+void TerrainData::intersectRays(unsigned num,
+                                const Vector * pos, const Vector * dir, const float * max_dist,
+                                float * dist, bool * hit) const
+{
+    for (unsigned r=0; r<num; ++r)
+    {
+        hit[r] = intersectRay(pos[r], dir[r], max_dist[r], dist[r]);
+        if (!hit[r]) dist[r] = max_dist[r];
+    }
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Returns whether the terrain blocks the line of sight between start
+ *  and end. Cheaper than intersectRay because traversal stops at the
+ *  first terrain block the line passes completely below.
+ */
+bool TerrainData::isOccluded(const Vector & start, const Vector & end) const
+{
+    if (height_range_mip_.empty()) return false;
+
+    Vector dir = end - start;
+    float len = dir.length();
+    if (len < EPSILON) return false;
+    dir /= len;
+
+    float t0 = 0.0f;
+    float t1 = len;
+    if (!clipRayToQuads(start, dir, 0, 0, width_-1, height_-1, t0, t1)) return false;
+
+    float dist;
+    return traverseRay(start, dir, height_range_mip_.size()-1, 0, 0, t0, t1, true, dist, NULL);
+}
+
 //------------------------------------------------------------------------------
 void TerrainData::reset()
 {
     name_ = "";
 
-    std::vector<float32_t>  hd; height_data_.swap(hd);
+    height_data_ = NULL;
+    std::vector<float32_t>  hd; height_storage_.swap(hd);
+    cooked_.reset();
+    std::vector<HeightRangeMip> hm; height_range_mip_.swap(hm);
 
     width_      = 0;
     height_     = 0;
@@ -354,9 +804,11 @@ void TerrainData::loadHm(const std::string & path)
         s.get(min_height_);
         s.get(horz_scale_);
 
-        height_data_.resize(width_*height_);
+        height_storage_.resize(width_*height_);
 
-        s.getRaw(&height_data_[0], height_data_.size() * sizeof(float32_t));
+        s.getRaw(&height_storage_[0], height_storage_.size() * sizeof(float32_t));
+
+        height_data_ = &height_storage_[0];
     } else
     {
         Exception e("Couldn't load hm file from ");
@@ -365,6 +817,341 @@ void TerrainData::loadHm(const std::string & path)
     }
 }
 
+//------------------------------------------------------------------------------
+/**
+ *  Maps the level's cooked terrain file. The height data is used in
+ *  place, pages are loaded by the OS on first access.
+ */
+void TerrainData::loadCooked(const std::string & path)
+{
+    cooked_.reset(new CookedTerrain(path));
+
+    const CookedTerrainHeader & header = cooked_->getHeader();
+    
+    width_      = header.width_;
+    height_     = header.height_;
+    max_height_ = header.max_height_;
+    min_height_ = header.min_height_;
+    horz_scale_ = header.horz_scale_;
+
+    height_data_ = (const float32_t*)cooked_->getSection(CTS_HEIGHT, width_*height_*sizeof(float32_t));
+    if (!height_data_)
+    {
+        Exception e(path);
+        e << COOKED_TERRAIN_FILE << " contains no height data.";
+        throw e;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Builds the height range pyramid used for ray queries. Level 0
+ *  holds the height range of each quad, every further level combines
+ *  2x2 entries of the previous one until a single entry is left.
+ */
+void TerrainData::buildHeightRangeMips()
+{
+    std::vector<HeightRangeMip> mips;
+    
+    if (width_ < 2 || height_ < 2)
+    {
+        height_range_mip_.swap(mips);
+        return;
+    }
+
+    mips.push_back(HeightRangeMip());
+    HeightRangeMip & base = mips.back();
+    base.width_  = width_  - 1;
+    base.height_ = height_ - 1;
+    base.range_.resize(base.width_ * base.height_);
+
+    for (unsigned z=0; z<base.height_; ++z)
+    {
+        const float32_t * row  = &height_data_[ z   *width_];
+        const float32_t * row1 = &height_data_[(z+1)*width_];
+        HeightRange * range = &base.range_[z*base.width_];
+        
+        for (unsigned x=0; x<base.width_; ++x)
+        {
+            range[x].min_ = std::min(std::min(row[x], row[x+1]), std::min(row1[x], row1[x+1]));
+            range[x].max_ = std::max(std::max(row[x], row[x+1]), std::max(row1[x], row1[x+1]));
+        }
+    }
+
+    while (mips.back().width_ > 1 || mips.back().height_ > 1)
+    {
+        mips.push_back(HeightRangeMip());
+        const HeightRangeMip & prev = mips[mips.size()-2];
+        HeightRangeMip & cur = mips.back();
+
+        cur.width_  = (prev.width_ +1) >> 1;
+        cur.height_ = (prev.height_+1) >> 1;
+        cur.range_.resize(cur.width_ * cur.height_);
+
+        for (unsigned z=0; z<cur.height_; ++z)
+        {
+            for (unsigned x=0; x<cur.width_; ++x)
+            {
+                HeightRange & range = cur.range_[x + z*cur.width_];
+                range = prev.range_[2*x + 2*z*prev.width_];
+                
+                for (unsigned c=1; c<4; ++c)
+                {
+                    unsigned px = 2*x + (c&1);
+                    unsigned pz = 2*z + (c>>1);
+                    if (px >= prev.width_ || pz >= prev.height_) continue;
+
+                    const HeightRange & child = prev.range_[px + pz*prev.width_];
+                    range.min_ = std::min(range.min_, child.min_);
+                    range.max_ = std::max(range.max_, child.max_);
+                }
+            }
+        }
+    }
+
+    height_range_mip_.swap(mips);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Recursively traverses the height range pyramid front to back,
+ *  starting at entry (x,z) of the given level.
+ *
+ *  \param t0,t1 The part of the ray inside the entry's quads.
+ *
+ *  \param any_hit Whether any intersection will do. If true, dist
+ *  and normal are not set.
+ */
+bool TerrainData::traverseRay(const Vector & pos, const Vector & dir,
+                              unsigned level, unsigned x, unsigned z,
+                              float t0, float t1, bool any_hit,
+                              float & dist, Vector * normal) const
+{
+    const HeightRange & range = height_range_mip_[level].range_[x + z*height_range_mip_[level].width_];
+
+    // Ray height is linear, so its extremes are at the interval ends.
+    float y0 = pos.y_ + t0*dir.y_;
+    float y1 = pos.y_ + t1*dir.y_;
+    
+    if (std::min(y0, y1) > range.max_) return false;
+    if (any_hit && std::max(y0, y1) < range.min_) return true;
+
+    if (level == 0) return intersectQuad(pos, dir, x, z, t0, t1, dist, normal);
+
+    // Clip the ray against the up to four children and visit them in
+    // the order the ray enters them.
+    const HeightRangeMip & child_mip = height_range_mip_[level-1];
+    unsigned child_size = 1 << (level-1);
+    
+    unsigned num_children = 0;
+    unsigned child_x[4], child_z[4];
+    float child_t0[4], child_t1[4];
+    for (unsigned c=0; c<4; ++c)
+    {
+        unsigned cx = 2*x + (c&1);
+        unsigned cz = 2*z + (c>>1);
+        if (cx >= child_mip.width_ || cz >= child_mip.height_) continue;
+
+        float ct0 = t0;
+        float ct1 = t1;
+        if (!clipRayToQuads(pos, dir,
+                            cx*child_size, cz*child_size,
+                            std::min((cx+1)*child_size, width_ -1),
+                            std::min((cz+1)*child_size, height_-1),
+                            ct0, ct1)) continue;
+
+        // Insertion sort by entry distance
+        unsigned i = num_children++;
+        for (; i>0 && child_t0[i-1] > ct0; --i)
+        {
+            child_x [i] = child_x [i-1];
+            child_z [i] = child_z [i-1];
+            child_t0[i] = child_t0[i-1];
+            child_t1[i] = child_t1[i-1];
+        }
+        child_x [i] = cx;
+        child_z [i] = cz;
+        child_t0[i] = ct0;
+        child_t1[i] = ct1;
+    }
+
+    for (unsigned c=0; c<num_children; ++c)
+    {
+        if (traverseRay(pos, dir, level-1, child_x[c], child_z[c],
+                        child_t0[c], child_t1[c], any_hit, dist, normal)) return true;
+    }
+
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Intersects the ray with the two triangles of quad (x,z). The quad
+ *  is split along the diagonal from (x+1,z) to (x,z+1), like the ODE
+ *  heightfield does.
+ *
+ *  \param t0,t1 The part of the ray inside the quad.
+ */
+bool TerrainData::intersectQuad(const Vector & pos, const Vector & dir,
+                                unsigned x, unsigned z,
+                                float t0, float t1,
+                                float & dist, Vector * normal) const
+{
+    const float32_t * h = &height_data_[x + z*width_];
+    float h00 = h[0];
+    float h10 = h[1];
+    float h01 = h[width_];
+    float h11 = h[width_+1];
+
+    // Quad local coordinates u,v in [0;1] are linear in t.
+    float inv_scale = 1.0f / horz_scale_;
+    float u0 = (pos.x_ - x*horz_scale_) * inv_scale;
+    float v0 = (pos.z_ - z*horz_scale_) * inv_scale;
+    float du = dir.x_ * inv_scale;
+    float dv = dir.z_ * inv_scale;
+
+    // Split the interval where the ray crosses the diagonal u+v=1.
+    float t_split[3] = { t0, t1, t1 };
+    unsigned num_parts = 1;
+    bool first_upper = u0 + t0*du + v0 + t0*dv > 1.0f;
+    float duv = du + dv;
+    if (duv != 0.0f)
+    {
+        float td = (1.0f - u0 - v0) / duv;
+        if (td > t0 && td < t1)
+        {
+            t_split[1] = td;
+            num_parts = 2;
+        }
+    }
+
+    for (unsigned i=0; i<num_parts; ++i)
+    {
+        float s0 = t_split[i];
+        float s1 = t_split[i+1];
+        
+        bool upper = (i == 0) == first_upper;
+
+        // Height of the triangle plane at (u,v) is
+        // base + u*dhdu + v*dhdv.
+        float base, dhdu, dhdv;
+        if (upper)
+        {
+            dhdu = h11 - h01;
+            dhdv = h11 - h10;
+            base = h11 - dhdu - dhdv;
+        } else
+        {
+            dhdu = h10 - h00;
+            dhdv = h01 - h00;
+            base = h00;
+        }
+
+        // Height of the ray above the plane, linear in t.
+        float f0 = pos.y_ + s0*dir.y_ - (base + (u0 + s0*du)*dhdu + (v0 + s0*dv)*dhdv);
+        float f1 = pos.y_ + s1*dir.y_ - (base + (u0 + s1*du)*dhdu + (v0 + s1*dv)*dhdv);
+
+        if (f0 > 0.0f && f1 > 0.0f) continue;
+
+        dist = f0 <= 0.0f ? s0 : s0 + (s1-s0) * f0 / (f0-f1);
+        if (normal)
+        {
+            *normal = Vector(-dhdu, horz_scale_, -dhdv);
+            normal->normalize();
+        }
+        
+        return true;
+    }
+
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Clips the ray interval [t0;t1] to the horizontal extent of the
+ *  quads from (x0,z0) to (x1,z1), with x1,z1 exclusive.
+ *
+ *  \return Whether the clipped interval is not empty.
+ */
+bool TerrainData::clipRayToQuads(const Vector & pos, const Vector & dir,
+                                 unsigned x0, unsigned z0, unsigned x1, unsigned z1,
+                                 float & t0, float & t1) const
+{
+    float min[2] = { x0*horz_scale_, z0*horz_scale_ };
+    float max[2] = { x1*horz_scale_, z1*horz_scale_ };
+    float p[2]   = { pos.x_, pos.z_ };
+    float d[2]   = { dir.x_, dir.z_ };
+
+    for (unsigned a=0; a<2; ++a)
+    {
+        if (d[a] == 0.0f)
+        {
+            if (p[a] < min[a] || p[a] > max[a]) return false;
+            continue;
+        }
+
+        float inv_d = 1.0f / d[a];
+        float ta = (min[a] - p[a]) * inv_d;
+        float tb = (max[a] - p[a]) * inv_d;
+        if (ta > tb) std::swap(ta, tb);
+
+        if (ta > t0) t0 = ta;
+        if (tb < t1) t1 = tb;
+    }
+
+    return t0 <= t1;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Second half of collideRay: intersects the ray with the tangent
+ *  plane at the sampled surface point below guess.
+ *
+ *  \param h,n The terrain height and normal below guess.
+ */
+bool TerrainData::intersectTangentPlane(physics::CollisionInfo & info,
+                                        const Vector & guess,
+                                        float h, const Vector & n,
+                                        const Vector & dir,
+                                        float penetration_guess) const
+{
+    // pos lies on the interpolated surface
+    Vector pos(guess.x_, h, guess.z_);
+
+
+    // Now find an estimate for the intersection point euler-style by
+    // constructing the tangent plane and intersecting it with our
+    // ray.
+    Plane p(pos, n);
+
+    float d = -p.evalPoint(guess);
+    float dot = vecDot(&n, &dir);
+    if (dot < 0.0f) return false;
+ 
+    // pen is the distance of guess from the plane p in direction
+    // up. It also is the difference between this frame's penetration
+    // and the previous frame's penetration.
+    float pen = d / dot;
+
+    if (pen + penetration_guess > info.penetration_)
+    {
+        info.penetration_ = pen + penetration_guess;
+        info.n_           = dir;
+        info.pos_         = guess + dir * pen;
+
+        // pos must lie on plane
+        // this happens because of numeric inaccuracies -> disable
+        //assert(equalsZero(p.evalPoint(info.pos_)));
+
+        return true;
+    } else return false;
+}
+
+
 //------------------------------------------------------------------------------
 float TerrainData::getLinearFalloff(float x, float z) const
 {
@@ -2,6 +2,9 @@
 #ifndef RACING_HEIGHTDATA_INCLUDED
 #define RACING_HEIGHTDATA_INCLUDED
 
+#include <memory>
+#include <vector>
+
 #include "Vector.h"
 #include "Datatypes.h"
 
@@ -13,6 +16,8 @@ namespace physics
 
 namespace terrain
 {
+
+class CookedTerrain;
  
 //------------------------------------------------------------------------------
 class TerrainData
@@ -21,7 +26,7 @@ class TerrainData
     TerrainData();
     virtual ~TerrainData();
 
-    virtual void load(const std::string & name);
+    virtual void load(const std::string & name, bool use_cooked = true);
     const std::string & getName() const;
 
     unsigned getResX() const;
@@ -30,6 +35,8 @@ class TerrainData
     float getHeightAtGrid(int x, int z, unsigned level) const;
     float getHeightAtGridInterpol(int x, int z,
                                   unsigned level) const;
+    void getHeightAtGridRow(int x, int z, unsigned num,
+                            unsigned level, float * h) const;
 
     float getMinHeight() const;
     float getMaxHeight() const;
@@ -44,16 +51,68 @@ class TerrainData
     void getHeightAndNormalBicubic(float x, float z,
                                    float & h, Vector & n) const;
 
+    void getHeightAndNormal(unsigned num,
+                            const float * x, const float * z,
+                            float * h, Vector * n) const;
+    void getHeightAndNormalBicubic(unsigned num,
+                                   const float * x, const float * z,
+                                   float * h, Vector * n) const;
+
     bool collideRay(physics::CollisionInfo & info,
                     const Vector & tip,
                     const Vector & dir,
                     float penetration_guess,
                     bool bicubic) const;
+    void collideRays(unsigned num,
+                     physics::CollisionInfo * const * info,
+                     const Vector * tip,
+                     const Vector & dir,
+                     const float * penetration_guess,
+                     bool bicubic) const;
+
+    bool intersectRay(const Vector & pos, const Vector & dir, float max_dist,
+                      float & dist, Vector * normal = NULL) const;
+    void intersectRays(unsigned num,
+                       const Vector * pos, const Vector * dir, const float * max_dist,
+                       float * dist, bool * hit) const;
+    bool isOccluded(const Vector & start, const Vector & end) const;
+    
 protected:
 
+    /// Minimum and maximum terrain height in a block of quads.
+    struct HeightRange
+    {
+        float32_t min_;
+        float32_t max_;
+    };
+
+    /// One level of the height range pyramid, level 0 has one entry
+    /// per terrain quad.
+    struct HeightRangeMip
+    {
+        unsigned width_;
+        unsigned height_;
+        std::vector<HeightRange> range_;
+    };
+
     virtual void reset();
 
     void loadHm(const std::string & name);
+    void loadCooked(const std::string & path);
+
+    void buildHeightRangeMips();
+
+    bool traverseRay(const Vector & pos, const Vector & dir,
+                     unsigned level, unsigned x, unsigned z,
+                     float t0, float t1, bool any_hit,
+                     float & dist, Vector * normal) const;
+    bool intersectQuad(const Vector & pos, const Vector & dir,
+                       unsigned x, unsigned z,
+                       float t0, float t1,
+                       float & dist, Vector * normal) const;
+    bool clipRayToQuads(const Vector & pos, const Vector & dir,
+                        unsigned x0, unsigned z0, unsigned x1, unsigned z1,
+                        float & t0, float & t1) const;
 
 
     float c0(float frac3, float frac2, float frac) const { return -0.5f*frac3 +      frac2 - 0.5f*frac      ; }
@@ -67,11 +126,27 @@ protected:
     float c3d(float frac2, float frac) const { return  1.5f*frac2 - 1.0f*frac        ; }
 
     float getLinearFalloff(float x, float z) const;
+
+    bool intersectTangentPlane(physics::CollisionInfo & info,
+                               const Vector & guess,
+                               float h, const Vector & n,
+                               const Vector & dir,
+                               float penetration_guess) const;
     
-    std::vector<float32_t>  height_data_; ///< The actual height data
-                                          ///in one large array. Column
-                                          ///major to match grome
-                                          ///height data.
+    const float32_t * height_data_; ///< The actual height data in
+                                    ///one large array. Column major to
+                                    ///match grome height data. Points
+                                    ///either into height_storage_ or
+                                    ///into cooked_.
+
+    std::vector<float32_t> height_storage_; ///< Height data read from terrain.hm.
+
+    std::auto_ptr<CookedTerrain> cooked_; ///< The mapped cooked terrain
+                                          ///file, if it was loaded.
+
+    std::vector<HeightRangeMip> height_range_mip_; ///< Used to skip
+                                                   ///terrain parts a
+                                                   ///ray passes above.
     
     uint32_t width_;                     ///< The width of the height_data_ array.
     uint32_t height_;                    ///< The width of the height_data_ array.
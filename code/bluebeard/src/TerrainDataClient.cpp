@@ -10,6 +10,7 @@
 
 #include "ParameterManager.h"
 #include "Paths.h"
+#include "CookedTerrain.h"
 
 #undef min
 #undef max
@@ -19,6 +20,8 @@ namespace terrain
 
 //------------------------------------------------------------------------------
 TerrainDataClient::TerrainDataClient() :
+    color_data_(NULL),
+    detail_data_(NULL),
     lm_texels_per_quad_(0)
 {
 }
@@ -31,11 +34,18 @@ TerrainDataClient::~TerrainDataClient()
     
 
 //------------------------------------------------------------------------------
-void TerrainDataClient::load(const std::string & name)
+/**
+ *  Color and detail data are taken from the cooked terrain file if
+ *  it was mapped and contains them.
+ */
+void TerrainDataClient::load(const std::string & name, bool use_cooked)
 {
-    TerrainData::load(name);
+    TerrainData::load(name, use_cooked);
 
-    loadFromImages(LEVEL_PATH + name + "/");
+    if (!cooked_.get() || !loadCookedColorAndDetail())
+    {
+        loadFromImages(LEVEL_PATH + name + "/");
+    }
 }
 
 
@@ -169,11 +179,29 @@ unsigned TerrainDataClient::getLmTexelsPerQuad() const
     return lm_texels_per_quad_;
 }
 
+//------------------------------------------------------------------------------
+const RgbTriplet * TerrainDataClient::getColorData() const
+{
+    return color_data_;
+}
+
+//------------------------------------------------------------------------------
+const uint32_t * TerrainDataClient::getDetailData() const
+{
+    return detail_data_;
+}
+
 //------------------------------------------------------------------------------
 void TerrainDataClient::reset()
 {
-    std::vector<RgbTriplet> cd; color_data_. swap(cd);
-    std::vector<uint32_t>   dd; detail_data_.swap(dd);    
+    TerrainData::reset();
+    
+    color_data_  = NULL;
+    detail_data_ = NULL;
+    lm_texels_per_quad_ = 0;
+    
+    std::vector<RgbTriplet> cd; color_storage_. swap(cd);
+    std::vector<uint32_t>   dd; detail_storage_.swap(dd);    
 }
 
 
@@ -194,7 +222,7 @@ void TerrainDataClient::loadFromImages(const std::string & path)
         unsigned lm_width  = lm_texels_per_quad_*width_;
         unsigned lm_height = lm_texels_per_quad_*height_;
         
-        color_data_.resize(lm_width*lm_height);
+        color_storage_.resize(lm_width*lm_height);
 
         unsigned bytes_per_pixel = color->getPixelSizeInBits() >> 3;
 
@@ -204,15 +232,15 @@ void TerrainDataClient::loadFromImages(const std::string & path)
             const unsigned char * cur_src = cur_line;
             for (unsigned c=0; c<lm_width; ++c)
             {
-                color_data_[c + r*lm_width].r_ = cur_src[0];
+                color_storage_[c + r*lm_width].r_ = cur_src[0];
                 if (bytes_per_pixel >= 3)
                 {
-                    color_data_[c + r*lm_width].g_ = cur_src[1];
-                    color_data_[c + r*lm_width].b_ = cur_src[2];
+                    color_storage_[c + r*lm_width].g_ = cur_src[1];
+                    color_storage_[c + r*lm_width].b_ = cur_src[2];
                 } else
                 {
-                    color_data_[c + r*lm_width].g_ = cur_src[0];
-                    color_data_[c + r*lm_width].b_ = cur_src[0];
+                    color_storage_[c + r*lm_width].g_ = cur_src[0];
+                    color_storage_[c + r*lm_width].b_ = cur_src[0];
                 }
 
                 cur_src += bytes_per_pixel;
@@ -222,7 +250,8 @@ void TerrainDataClient::loadFromImages(const std::string & path)
         }
 
         color->flipVertical();
-        
+
+        color_data_ = &color_storage_[0];
     }
 
     
@@ -246,10 +275,10 @@ void TerrainDataClient::loadFromImages(const std::string & path)
             throw Exception("Detail map must be RGBA");
         }
         
-        detail_data_.resize(width_*height_);
+        detail_storage_.resize(width_*height_);
 
         detail->flipVertical();        
-        uint32_t * cur_dest = &detail_data_[0];
+        uint32_t * cur_dest = &detail_storage_[0];
         const uint8_t * cur_line = (uint8_t*)detail->data();
         for (unsigned row=0; row<height_; ++row)
         {
@@ -258,8 +287,34 @@ void TerrainDataClient::loadFromImages(const std::string & path)
             cur_dest += width_;
         }
         detail->flipVertical();
+
+        detail_data_ = &detail_storage_[0];
     }
 }
 
+//------------------------------------------------------------------------------
+/**
+ *  Uses the color and detail sections of the mapped cooked terrain
+ *  file in place.
+ *
+ *  \return false if the cooked file doesn't contain them.
+ */
+bool TerrainDataClient::loadCookedColorAndDetail()
+{
+    unsigned texels_per_quad = cooked_->getHeader().lm_texels_per_quad_;
+    
+    const void * color  = cooked_->getSection(CTS_COLOR,
+                                              width_*height_*texels_per_quad*texels_per_quad*sizeof(RgbTriplet));
+    const void * detail = cooked_->getSection(CTS_DETAIL,
+                                              width_*height_*sizeof(uint32_t));
+    if (!color || !detail || texels_per_quad == 0) return false;
+
+    lm_texels_per_quad_ = texels_per_quad;
+    color_data_  = (const RgbTriplet*)color;
+    detail_data_ = (const uint32_t*)detail;
+
+    return true;
+}
+
 
 } // namespace terrain
@@ -29,7 +29,7 @@ class TerrainDataClient : public TerrainData
     TerrainDataClient();
     virtual ~TerrainDataClient();
     
-    virtual void load(const std::string & name);
+    virtual void load(const std::string & name, bool use_cooked = true);
 
     Color getColor(float x, float z) const;
     RgbTriplet getColorAtGrid(int x, int z, unsigned level) const;
@@ -38,15 +38,20 @@ class TerrainDataClient : public TerrainData
     unsigned getPrevalentDetail(float x, float z) const;
     
     unsigned getLmTexelsPerQuad() const;
+    const RgbTriplet * getColorData() const;
+    const uint32_t * getDetailData() const;
  protected:
 
     virtual void reset();
     
     void loadFromImages(const std::string & path);
+    bool loadCookedColorAndDetail();
 
+    const RgbTriplet * color_data_;  ///< Points into color_storage_ or cooked_.
+    const uint32_t   * detail_data_; ///< Points into detail_storage_ or cooked_.
     
-    std::vector<RgbTriplet> color_data_;
-    std::vector<uint32_t>   detail_data_;
+    std::vector<RgbTriplet> color_storage_;
+    std::vector<uint32_t>   detail_storage_;
 
     unsigned lm_texels_per_quad_;
 };
@@ -47,11 +47,19 @@ TerrainVisual::~TerrainVisual()
 //------------------------------------------------------------------------------
 void TerrainVisual::operator() (osg::Node *node, osg::NodeVisitor *nv)
 {
+    // If any level jumps, all levels must use their new clip region
+    // this frame to stay nested.
+    bool full_refill = false;
+    for (unsigned l=0; l<grid_.size(); ++l)
+    {
+        full_refill |= grid_[l]->needsFullRefill();
+    }
+    
     for (unsigned l=0; l<grid_.size(); ++l)
     {
         // Updating has to start with innermost grid because of
         // stitching triangles.
-        grid_[l]->update();
+        grid_[l]->update(full_refill);
     }
 }
 
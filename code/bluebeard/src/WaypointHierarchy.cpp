@@ -0,0 +1,771 @@
+
+#include "WaypointHierarchy.h"
+
+#include <queue>
+#include <limits>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+
+#include "Serializer.h"
+
+#undef min
+#undef max
+
+
+/// Increment whenever the file layout changes.
+const uint32_t WAYPOINT_HIERARCHY_VERSION = 1;
+
+/// Open border segments longer than this get a portal at each end
+/// instead of a single one in the middle.
+const unsigned MAX_SINGLE_PORTAL_LENGTH = 5;
+
+/// Waypoints of this level or above cannot be entered.
+const uint8_t BLOCKED_LEVEL = 9;
+
+const int NEIGHBOUR_DX[] = { -1, 0, 1, 0, -1, 1, 1, -1 };
+const int NEIGHBOUR_DZ[] = { 0, -1, 0, 1, -1, 1, -1, 1 };
+
+
+//------------------------------------------------------------------------------
+PortalSearchNode::PortalSearchNode() :
+    hierarchy_(NULL),
+    node_(0)
+{
+}
+
+//------------------------------------------------------------------------------
+PortalSearchNode::PortalSearchNode(const WaypointHierarchy * hierarchy, unsigned node) :
+    hierarchy_(hierarchy),
+    node_(node)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Chebyshev distance times the cheapest step, as every step moves at
+ *  most one cell in each direction.
+ */
+float PortalSearchNode::GoalDistanceEstimate( PortalSearchNode &nodeGoal )
+{
+    unsigned a = hierarchy_->node_[node_].cell_;
+    unsigned b = hierarchy_->node_[nodeGoal.node_].cell_;
+
+    int dx = abs((int)(a / hierarchy_->h_) - (int)(b / hierarchy_->h_));
+    int dz = abs((int)(a % hierarchy_->h_) - (int)(b % hierarchy_->h_));
+
+    return (float)std::max(dx, dz) * hierarchy_->min_step_cost_;
+}
+
+//------------------------------------------------------------------------------
+bool PortalSearchNode::IsGoal( PortalSearchNode &nodeGoal )
+{
+    return node_ == nodeGoal.node_;
+}
+
+//------------------------------------------------------------------------------
+bool PortalSearchNode::GetSuccessors( AStarSearch<PortalSearchNode> *astarsearch, PortalSearchNode *parent_node )
+{
+    const std::vector<WaypointHierarchy::Edge> & edge = hierarchy_->node_[node_].edge_;
+
+    for (unsigned e=0; e<edge.size(); ++e)
+    {
+        if (parent_node && parent_node->node_ == edge[e].target_) continue;
+
+        PortalSearchNode successor(hierarchy_, edge[e].target_);
+        astarsearch->AddSuccessor(successor);
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+float PortalSearchNode::GetCost( PortalSearchNode &successor )
+{
+    return hierarchy_->findEdge(node_, successor.node_)->cost_;
+}
+
+//------------------------------------------------------------------------------
+bool PortalSearchNode::IsSameState( PortalSearchNode &rhs )
+{
+    return node_ == rhs.node_;
+}
+
+//------------------------------------------------------------------------------
+unsigned PortalSearchNode::Hash() const
+{
+    return node_ * 2654435761u;
+}
+
+
+
+//------------------------------------------------------------------------------
+WaypointHierarchy::WaypointHierarchy() :
+    w_(0),
+    h_(0),
+    cluster_size_(1),
+    num_clusters_x_(0),
+    num_clusters_z_(0),
+    min_step_cost_(0.0f),
+    checksum_(0),
+    num_search_steps_(0),
+    cur_x0_(0),
+    cur_z0_(0),
+    cur_z1_(0)
+{
+}
+
+//------------------------------------------------------------------------------
+WaypointHierarchy::~WaypointHierarchy()
+{
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Creates the portal graph for the given waypoint grid.
+ *
+ *  \param level The waypoint level of every cell, indexed by x*h+z.
+ */
+void WaypointHierarchy::build(const std::vector<uint8_t> & level, unsigned w, unsigned h, unsigned cluster_size)
+{
+    assert(level.size() == w*h);
+
+    clear();
+
+    level_          = level;
+    w_              = w;
+    h_              = h;
+    cluster_size_   = std::max(cluster_size, 2u);
+    num_clusters_x_ = (w_ + cluster_size_ - 1) / cluster_size_;
+    num_clusters_z_ = (h_ + cluster_size_ - 1) / cluster_size_;
+    checksum_       = calcChecksum(level_, w_, h_, cluster_size_);
+
+    uint8_t min_level = BLOCKED_LEVEL;
+    for (unsigned c=0; c<level_.size(); ++c) min_level = std::min(min_level, level_[c]);
+    min_step_cost_ = min_level;
+
+    // vertical borders
+    for (unsigned x=cluster_size_; x<w_; x+=cluster_size_)
+    {
+        for (unsigned z=0; z<h_; z+=cluster_size_)
+        {
+            addEntrances(x-1, z, x, z, 0, 1, std::min(cluster_size_, h_-z));
+        }
+    }
+
+    // horizontal borders
+    for (unsigned z=cluster_size_; z<h_; z+=cluster_size_)
+    {
+        for (unsigned x=0; x<w_; x+=cluster_size_)
+        {
+            addEntrances(x, z-1, x, z, 1, 0, std::min(cluster_size_, w_-x));
+        }
+    }
+
+    createClusterNodes();
+
+    for (unsigned c=0; c<cluster_node_.size(); ++c)
+    {
+        addClusterEdges(c);
+    }
+
+    createSearch();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Loads a previously saved hierarchy. Fails if the file doesn't exist
+ *  or was built from a different grid or cluster size.
+ */
+bool WaypointHierarchy::load(const std::string & filename, const std::vector<uint8_t> & level,
+                             unsigned w, unsigned h, unsigned cluster_size)
+{
+    clear();
+
+    cluster_size = std::max(cluster_size, 2u);
+
+    try
+    {
+        serializer::Serializer s(filename, serializer::SOM_READ | serializer::SOM_COMPRESS);
+
+        uint32_t version, checksum;
+        s.get(version);
+        s.get(checksum);
+
+        if (version  != WAYPOINT_HIERARCHY_VERSION ||
+            checksum != calcChecksum(level, w, h, cluster_size)) return false;
+
+        uint32_t num_nodes;
+        s.get(min_step_cost_);
+        s.get(num_nodes);
+
+        node_.resize(num_nodes);
+        for (unsigned n=0; n<num_nodes; ++n)
+        {
+            uint32_t num_edges;
+            s.get(node_[n].cell_);
+            s.get(num_edges);
+
+            node_[n].edge_.resize(num_edges);
+            for (unsigned e=0; e<num_edges; ++e)
+            {
+                s.get(node_[n].edge_[e].target_);
+                s.get(node_[n].edge_[e].cost_);
+                s.get(node_[n].edge_[e].path_);
+            }
+        }
+    } catch (Exception & e)
+    {
+        clear();
+        return false;
+    }
+
+    level_          = level;
+    w_              = w;
+    h_              = h;
+    cluster_size_   = cluster_size;
+    num_clusters_x_ = (w_ + cluster_size_ - 1) / cluster_size_;
+    num_clusters_z_ = (h_ + cluster_size_ - 1) / cluster_size_;
+    checksum_       = calcChecksum(level_, w_, h_, cluster_size_);
+
+    for (unsigned n=0; n<node_.size(); ++n)
+    {
+        node_[n].cluster_ = getCluster(node_[n].cell_);
+    }
+
+    createClusterNodes();
+    createSearch();
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+void WaypointHierarchy::save(const std::string & filename) const
+{
+    serializer::Serializer s(filename, serializer::SOM_WRITE | serializer::SOM_COMPRESS);
+
+    s.put(WAYPOINT_HIERARCHY_VERSION);
+    s.put(checksum_);
+    s.put(min_step_cost_);
+    s.put((uint32_t)node_.size());
+
+    for (unsigned n=0; n<node_.size(); ++n)
+    {
+        s.put((uint32_t)node_[n].cell_);
+        s.put((uint32_t)node_[n].edge_.size());
+
+        for (unsigned e=0; e<node_[n].edge_.size(); ++e)
+        {
+            s.put((uint32_t)node_[n].edge_[e].target_);
+            s.put(node_[n].edge_[e].cost_);
+            s.put(node_[n].edge_[e].path_);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void WaypointHierarchy::clear()
+{
+    level_.clear();
+    node_.clear();
+    cluster_node_.clear();
+    search_.reset(NULL);
+
+    w_ = h_ = 0;
+    num_clusters_x_ = num_clusters_z_ = 0;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Finds a path between two cells in different clusters.
+ *
+ *  \param path Receives all cells of the path, including start and
+ *  goal.
+ *
+ *  \return False if both cells are in the same cluster or no path
+ *  through the portal graph exists. The caller should search the
+ *  grid directly in that case.
+ */
+bool WaypointHierarchy::findPath(unsigned start, unsigned goal, std::vector<unsigned> & path)
+{
+    path.clear();
+    num_search_steps_ = 0;
+
+    if (node_.empty() || start >= level_.size() || goal >= level_.size()) return false;
+    if (getCluster(start) == getCluster(goal)) return false;
+
+    unsigned num_nodes = node_.size();
+
+    // Temporarily insert start and goal into the graph, unless they
+    // already are portals. Only the goal adds edges to existing nodes,
+    // remember those for removal.
+    std::vector<unsigned> goal_neighbour;
+
+    int start_node = findNode(start);
+    if (start_node == -1)
+    {
+        start_node = node_.size();
+
+        Node node;
+        node.cell_    = start;
+        node.cluster_ = getCluster(start);
+        node_.push_back(node);
+
+        searchCluster(start, false);
+
+        const std::vector<unsigned> & portal = cluster_node_[node.cluster_];
+        for (unsigned p=0; p<portal.size(); ++p)
+        {
+            unsigned cell = node_[portal[p]].cell_;
+            float dist = dist_[(cell/h_ - cur_x0_)*(cur_z1_-cur_z0_) + cell%h_ - cur_z0_];
+            if (dist == std::numeric_limits<float>::max()) continue;
+
+            Edge edge;
+            edge.target_ = portal[p];
+            edge.cost_   = dist;
+            getClusterPath(cell, false, edge.path_);
+            node_[start_node].edge_.push_back(edge);
+        }
+    }
+
+    int goal_node = findNode(goal);
+    if (goal_node == -1)
+    {
+        goal_node = node_.size();
+
+        Node node;
+        node.cell_    = goal;
+        node.cluster_ = getCluster(goal);
+        node_.push_back(node);
+
+        searchCluster(goal, true);
+
+        const std::vector<unsigned> & portal = cluster_node_[node.cluster_];
+        for (unsigned p=0; p<portal.size(); ++p)
+        {
+            unsigned cell = node_[portal[p]].cell_;
+            float dist = dist_[(cell/h_ - cur_x0_)*(cur_z1_-cur_z0_) + cell%h_ - cur_z0_];
+            if (dist == std::numeric_limits<float>::max()) continue;
+
+            Edge edge;
+            edge.target_ = goal_node;
+            edge.cost_   = dist;
+            getClusterPath(cell, true, edge.path_);
+            node_[portal[p]].edge_.push_back(edge);
+
+            goal_neighbour.push_back(portal[p]);
+        }
+    }
+
+    PortalSearchNode start_state(this, start_node);
+    PortalSearchNode goal_state (this, goal_node);
+
+    search_->SetStartAndGoalStates(start_state, goal_state);
+
+    unsigned state;
+    do
+    {
+        state = search_->SearchStep();
+    } while (state == AStarSearch<PortalSearchNode>::SEARCH_STATE_SEARCHING);
+
+    num_search_steps_ = search_->GetStepCount();
+
+    if (state == AStarSearch<PortalSearchNode>::SEARCH_STATE_SUCCEEDED)
+    {
+        path.push_back(start);
+
+        PortalSearchNode * prev = search_->GetSolutionStart();
+        PortalSearchNode * cur;
+        while ((cur = search_->GetSolutionNext()))
+        {
+            const std::vector<uint32_t> & edge_path = findEdge(prev->node_, cur->node_)->path_;
+            path.insert(path.end(), edge_path.begin(), edge_path.end());
+
+            prev = cur;
+        }
+
+        search_->FreeSolutionNodes();
+    }
+
+    search_->EnsureMemoryFreed();
+
+    // remove temporary nodes and edges again
+    for (unsigned n=0; n<goal_neighbour.size(); ++n)
+    {
+        node_[goal_neighbour[n]].edge_.pop_back();
+    }
+    node_.resize(num_nodes);
+
+    return !path.empty();
+}
+
+
+//------------------------------------------------------------------------------
+unsigned WaypointHierarchy::getNumNodes() const
+{
+    return node_.size();
+}
+
+//------------------------------------------------------------------------------
+unsigned WaypointHierarchy::getNumClusters() const
+{
+    return num_clusters_x_ * num_clusters_z_;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  The number of A* steps on the portal graph the last call to
+ *  findPath took, as a measure of its cost.
+ */
+unsigned WaypointHierarchy::getNumSearchSteps() const
+{
+    return num_search_steps_;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Walks along a cluster border of the given length, starting at cell
+ *  (ax,az) on one side and (bx,bz) on the other, and adds portals for
+ *  every stretch where both sides are open.
+ */
+void WaypointHierarchy::addEntrances(unsigned ax, unsigned az, unsigned bx, unsigned bz,
+                                     unsigned dx, unsigned dz, unsigned length)
+{
+    unsigned segment_start = 0;
+    bool in_segment = false;
+
+    for (unsigned i=0; i<=length; ++i)
+    {
+        bool open = i < length &&
+            isOpen((ax + i*dx)*h_ + az + i*dz) &&
+            isOpen((bx + i*dx)*h_ + bz + i*dz);
+
+        if (open && !in_segment)
+        {
+            segment_start = i;
+            in_segment = true;
+        } else if (!open && in_segment)
+        {
+            in_segment = false;
+
+            unsigned segment_end = i-1;
+
+            if (segment_end - segment_start + 1 > MAX_SINGLE_PORTAL_LENGTH)
+            {
+                addPortal((ax + segment_start*dx)*h_ + az + segment_start*dz,
+                          (bx + segment_start*dx)*h_ + bz + segment_start*dz);
+                addPortal((ax + segment_end*dx)*h_ + az + segment_end*dz,
+                          (bx + segment_end*dx)*h_ + bz + segment_end*dz);
+            } else
+            {
+                unsigned mid = (segment_start + segment_end) / 2;
+                addPortal((ax + mid*dx)*h_ + az + mid*dz,
+                          (bx + mid*dx)*h_ + bz + mid*dz);
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Connects the neighbouring cells a and b, which lie in different
+ *  clusters.
+ */
+void WaypointHierarchy::addPortal(unsigned a, unsigned b)
+{
+    unsigned node_a = getOrCreateNode(a);
+    unsigned node_b = getOrCreateNode(b);
+
+    Edge edge;
+
+    edge.target_ = node_b;
+    edge.cost_   = getStepCost(a, b);
+    edge.path_.push_back(b);
+    node_[node_a].edge_.push_back(edge);
+
+    edge.target_   = node_a;
+    edge.cost_     = getStepCost(b, a);
+    edge.path_[0]  = a;
+    node_[node_b].edge_.push_back(edge);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Only used while building, so the linear search is ok.
+ */
+unsigned WaypointHierarchy::getOrCreateNode(unsigned cell)
+{
+    for (unsigned n=0; n<node_.size(); ++n)
+    {
+        if (node_[n].cell_ == cell) return n;
+    }
+
+    Node node;
+    node.cell_    = cell;
+    node.cluster_ = getCluster(cell);
+    node_.push_back(node);
+
+    return node_.size()-1;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Connects every portal of the cluster with all other portals
+ *  reachable inside the cluster.
+ */
+void WaypointHierarchy::addClusterEdges(unsigned cluster)
+{
+    const std::vector<unsigned> & portal = cluster_node_[cluster];
+
+    for (unsigned p=0; p<portal.size(); ++p)
+    {
+        searchCluster(node_[portal[p]].cell_, false);
+
+        for (unsigned t=0; t<portal.size(); ++t)
+        {
+            if (t == p) continue;
+
+            unsigned cell = node_[portal[t]].cell_;
+            float dist = dist_[(cell/h_ - cur_x0_)*(cur_z1_-cur_z0_) + cell%h_ - cur_z0_];
+            if (dist == std::numeric_limits<float>::max()) continue;
+
+            Edge edge;
+            edge.target_ = portal[t];
+            edge.cost_   = dist;
+            getClusterPath(cell, false, edge.path_);
+            node_[portal[p]].edge_.push_back(edge);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void WaypointHierarchy::createClusterNodes()
+{
+    cluster_node_.clear();
+    cluster_node_.resize(num_clusters_x_ * num_clusters_z_);
+
+    for (unsigned n=0; n<node_.size(); ++n)
+    {
+        cluster_node_[node_[n].cluster_].push_back(n);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Creates the search object, which is reused for all queries. Its
+ *  node memory must hold the whole graph including the temporary
+ *  start and goal nodes, plus the successors of a single expansion.
+ *  The start node has an edge to every portal of its cluster, all
+ *  other nodes at most one more than they have now.
+ */
+void WaypointHierarchy::createSearch()
+{
+    unsigned max_successors = 0;
+    for (unsigned n=0; n<node_.size(); ++n)
+    {
+        max_successors = std::max(max_successors, (unsigned)node_[n].edge_.size() + 1);
+    }
+    for (unsigned c=0; c<cluster_node_.size(); ++c)
+    {
+        max_successors = std::max(max_successors, (unsigned)cluster_node_[c].size());
+    }
+
+    search_.reset(new AStarSearch<PortalSearchNode>(node_.size() + 2 + max_successors));
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Dijkstra search restricted to the cluster containing source. Fills
+ *  dist_ and link_ for all cells of the cluster.
+ *
+ *  \param reverse If false, dist_ is the cost from source to a cell
+ *  and link_ the previous cell on that path. If true, dist_ is the
+ *  cost from a cell to source and link_ the next cell on that path.
+ */
+void WaypointHierarchy::searchCluster(unsigned source, bool reverse)
+{
+    unsigned x0, z0, x1, z1;
+    getClusterBounds(getCluster(source), x0, z0, x1, z1);
+
+    cur_x0_ = x0;
+    cur_z0_ = z0;
+    cur_z1_ = z1;
+
+    unsigned cluster_h = z1 - z0;
+
+    dist_.assign((x1-x0)*cluster_h, std::numeric_limits<float>::max());
+    link_.assign((x1-x0)*cluster_h, -1);
+
+    typedef std::pair<float, unsigned> QueueEntry;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > queue;
+
+    dist_[(source/h_ - x0)*cluster_h + source%h_ - z0] = 0.0f;
+    queue.push(QueueEntry(0.0f, source));
+
+    while (!queue.empty())
+    {
+        float    cur_dist = queue.top().first;
+        unsigned cur      = queue.top().second;
+        queue.pop();
+
+        int x = cur / h_;
+        int z = cur % h_;
+
+        if (cur_dist > dist_[(x - x0)*cluster_h + z - z0]) continue;
+
+        for (unsigned d=0; d<8; ++d)
+        {
+            int nx = x + NEIGHBOUR_DX[d];
+            int nz = z + NEIGHBOUR_DZ[d];
+
+            if (nx < (int)x0 || nx >= (int)x1 ||
+                nz < (int)z0 || nz >= (int)z1) continue;
+
+            unsigned neighbour = nx*h_ + nz;
+            if (!isOpen(neighbour)) continue;
+
+            float new_dist = cur_dist + (reverse ?
+                                         getStepCost(neighbour, cur) :
+                                         getStepCost(cur, neighbour));
+
+            unsigned index = (nx - x0)*cluster_h + nz - z0;
+            if (new_dist >= dist_[index]) continue;
+
+            dist_[index] = new_dist;
+            link_[index] = cur;
+            queue.push(QueueEntry(new_dist, neighbour));
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Extracts the path to or from the source of the last searchCluster
+ *  call, in the format of Edge::path_.
+ */
+void WaypointHierarchy::getClusterPath(unsigned cell, bool reverse, std::vector<uint32_t> & path) const
+{
+    path.clear();
+
+    unsigned cluster_h = cur_z1_ - cur_z0_;
+
+    if (reverse)
+    {
+        // follow next links from cell to source
+        int cur = link_[(cell/h_ - cur_x0_)*cluster_h + cell%h_ - cur_z0_];
+        while (cur != -1)
+        {
+            path.push_back(cur);
+            cur = link_[(cur/h_ - cur_x0_)*cluster_h + cur%h_ - cur_z0_];
+        }
+    } else
+    {
+        // follow previous links from cell to source, then reverse
+        int cur = cell;
+        while (link_[(cur/h_ - cur_x0_)*cluster_h + cur%h_ - cur_z0_] != -1)
+        {
+            path.push_back(cur);
+            cur = link_[(cur/h_ - cur_x0_)*cluster_h + cur%h_ - cur_z0_];
+        }
+        std::reverse(path.begin(), path.end());
+    }
+}
+
+
+//------------------------------------------------------------------------------
+int WaypointHierarchy::findNode(unsigned cell) const
+{
+    const std::vector<unsigned> & portal = cluster_node_[getCluster(cell)];
+    for (unsigned p=0; p<portal.size(); ++p)
+    {
+        if (node_[portal[p]].cell_ == cell) return portal[p];
+    }
+
+    return -1;
+}
+
+
+//------------------------------------------------------------------------------
+const WaypointHierarchy::Edge * WaypointHierarchy::findEdge(unsigned from, unsigned to) const
+{
+    const std::vector<Edge> & edge = node_[from].edge_;
+    for (unsigned e=0; e<edge.size(); ++e)
+    {
+        if (edge[e].target_ == to) return &edge[e];
+    }
+
+    assert(false);
+    return NULL;
+}
+
+
+//------------------------------------------------------------------------------
+unsigned WaypointHierarchy::getCluster(unsigned cell) const
+{
+    return (cell / h_ / cluster_size_) * num_clusters_z_ + (cell % h_) / cluster_size_;
+}
+
+
+//------------------------------------------------------------------------------
+void WaypointHierarchy::getClusterBounds(unsigned cluster, unsigned & x0, unsigned & z0, unsigned & x1, unsigned & z1) const
+{
+    x0 = (cluster / num_clusters_z_) * cluster_size_;
+    z0 = (cluster % num_clusters_z_) * cluster_size_;
+    x1 = std::min(x0 + cluster_size_, w_);
+    z1 = std::min(z0 + cluster_size_, h_);
+}
+
+
+//------------------------------------------------------------------------------
+bool WaypointHierarchy::isOpen(unsigned cell) const
+{
+    return level_[cell] < BLOCKED_LEVEL;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Must match WaypointSearchNode::GetCost: the level of the cell left,
+ *  plus one for diagonal moves.
+ */
+float WaypointHierarchy::getStepCost(unsigned from, unsigned to) const
+{
+    bool diagonal = from / h_ != to / h_ && from % h_ != to % h_;
+
+    return (float)level_[from] + (diagonal ? 1.0f : 0.0f);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  FNV-1a over the grid dimensions and levels, to detect stale
+ *  hierarchy files.
+ */
+uint32_t WaypointHierarchy::calcChecksum(const std::vector<uint8_t> & level, unsigned w, unsigned h, unsigned cluster_size)
+{
+    uint32_t ret = 2166136261u;
+
+    ret = (ret ^ w)            * 16777619u;
+    ret = (ret ^ h)            * 16777619u;
+    ret = (ret ^ cluster_size) * 16777619u;
+
+    for (unsigned c=0; c<level.size(); ++c)
+    {
+        ret = (ret ^ level[c]) * 16777619u;
+    }
+
+    return ret;
+}
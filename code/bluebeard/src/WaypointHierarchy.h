@@ -0,0 +1,143 @@
+
+#ifndef TANKGAME_WAYPOINTHIERARCHY_INCLUDED
+#define TANKGAME_WAYPOINTHIERARCHY_INCLUDED
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "Datatypes.h"
+#include "AStarSearch.h"
+
+
+class WaypointHierarchy;
+
+//------------------------------------------------------------------------------
+/**
+ *  Used as a templated class for the A star search on the abstract
+ *  portal graph.
+ */
+class PortalSearchNode
+{
+ public:
+    PortalSearchNode();
+    PortalSearchNode(const WaypointHierarchy * hierarchy, unsigned node);
+
+    float GoalDistanceEstimate( PortalSearchNode &nodeGoal );
+    bool IsGoal( PortalSearchNode &nodeGoal );
+    bool GetSuccessors( AStarSearch<PortalSearchNode> *astarsearch, PortalSearchNode *parent_node );
+    float GetCost( PortalSearchNode &successor );
+    bool IsSameState( PortalSearchNode &rhs );
+    unsigned Hash() const;
+
+    const WaypointHierarchy * hierarchy_;
+    unsigned node_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Hierarchical abstraction of the waypoint grid (HPA*).
+ *
+ *  The grid is divided into square clusters. Wherever two neighbouring
+ *  clusters share open border cells, portal nodes are placed on both
+ *  sides of the border. Portals of the same cluster are connected by
+ *  edges holding the cost and the cells of the cheapest path between
+ *  them inside the cluster.
+ *
+ *  A long-range query only searches the cluster of the start and the
+ *  goal on the grid, and otherwise the much smaller portal graph, so
+ *  its cost barely depends on the size of the map. Paths are slightly
+ *  longer than the optimal grid path because they are forced through
+ *  portals.
+ *
+ *  Cells are addressed as x*h + z, the same layout as the waypoint map.
+ */
+class WaypointHierarchy
+{
+    friend class PortalSearchNode;
+ public:
+    WaypointHierarchy();
+    virtual ~WaypointHierarchy();
+
+    void build(const std::vector<uint8_t> & level, unsigned w, unsigned h, unsigned cluster_size);
+    bool load(const std::string & filename, const std::vector<uint8_t> & level,
+              unsigned w, unsigned h, unsigned cluster_size);
+    void save(const std::string & filename) const;
+    void clear();
+
+    bool findPath(unsigned start, unsigned goal, std::vector<unsigned> & path);
+
+    unsigned getNumNodes() const;
+    unsigned getNumClusters() const;
+    unsigned getNumSearchSteps() const;
+
+ protected:
+
+    //------------------------------------------------------------------------------
+    struct Edge
+    {
+        unsigned target_;
+        float cost_;
+        std::vector<uint32_t> path_; ///< Cells after the source up to and
+                                     ///including the target.
+    };
+
+    //------------------------------------------------------------------------------
+    struct Node
+    {
+        unsigned cell_;
+        unsigned cluster_;
+        std::vector<Edge> edge_;
+    };
+
+    void addEntrances(unsigned ax, unsigned az, unsigned bx, unsigned bz,
+                      unsigned dx, unsigned dz, unsigned length);
+    void addPortal(unsigned a, unsigned b);
+    unsigned getOrCreateNode(unsigned cell);
+    void addClusterEdges(unsigned cluster);
+
+    void createClusterNodes();
+    void createSearch();
+
+    void searchCluster(unsigned source, bool reverse);
+    void getClusterPath(unsigned cell, bool reverse, std::vector<uint32_t> & path) const;
+
+    int findNode(unsigned cell) const;
+    const Edge * findEdge(unsigned from, unsigned to) const;
+
+    unsigned getCluster(unsigned cell) const;
+    void getClusterBounds(unsigned cluster, unsigned & x0, unsigned & z0, unsigned & x1, unsigned & z1) const;
+    bool isOpen(unsigned cell) const;
+    float getStepCost(unsigned from, unsigned to) const;
+
+    static uint32_t calcChecksum(const std::vector<uint8_t> & level, unsigned w, unsigned h, unsigned cluster_size);
+
+    unsigned w_;
+    unsigned h_;
+    unsigned cluster_size_;
+    unsigned num_clusters_x_;
+    unsigned num_clusters_z_;
+
+    float min_step_cost_; ///< Cheapest move on the grid, used for an
+                          ///admissible heuristic.
+
+    std::vector<uint8_t> level_;
+    std::vector<Node> node_;
+    std::vector<std::vector<unsigned> > cluster_node_; ///< Portal nodes by cluster.
+
+    uint32_t checksum_; ///< Of the grid the hierarchy was built from.
+
+    std::auto_ptr<AStarSearch<PortalSearchNode> > search_;
+    unsigned num_search_steps_; ///< Of the last call to findPath.
+
+    /// Scratch space for searchCluster, indexed by the cell's
+    /// position inside the searched cluster.
+    std::vector<float> dist_;
+    std::vector<int> link_;
+    unsigned cur_x0_;
+    unsigned cur_z0_;
+    unsigned cur_z1_;
+};
+
+#endif
@@ -2,22 +2,64 @@
 #include "WaypointManagerServer.h"
 
 #include <limits>
+#include <algorithm>
 
 #include "Log.h"
 #include "Paths.h"
 #include "Serializer.h"
+#include "ParameterManager.h"
+#include "Scheduler.h"
+#include "Profiler.h"
+#include "CookedTerrain.h"
 
 #undef min
 #undef max
 
 
+/// Side length in waypoints of the buckets of OpenWaypointGrid.
+const unsigned OPEN_WAYPOINT_BUCKET_SIZE = 8;
+
+
+//------------------------------------------------------------------------------
+PathRequestFp::PathRequestFp(hPathRequest request) :
+    request_(request)
+{
+}
+
+//------------------------------------------------------------------------------
+const std::string & PathRequestFp::toString() const
+{
+    const static std::string name = "Path request";
+    return name;
+}
+
+//------------------------------------------------------------------------------
+bool PathRequestFp::operator==(const RegisteredFp & other) const
+{
+    const PathRequestFp * other_prf = dynamic_cast<const PathRequestFp*>(&other);
+    if (!other_prf) return false;
+
+    return request_ == other_prf->request_;
+}
+
+//------------------------------------------------------------------------------
+void PathRequestFp::deregisterPointer() const
+{
+    s_waypoint_manager_server.removePathRequest(request_);
+}
+
+
 //------------------------------------------------------------------------------
 WaypointManagerServer::WaypointManagerServer() :
     w_(1),
     h_(1),
-    horz_scale_(1.0f)
+    horz_scale_(1.0f),
+    grid_search_active_(false),
+    next_path_request_(0)
 {
-
+    s_scheduler.addFrameTask(PeriodicTaskCallback(this, &WaypointManagerServer::handlePathRequests),
+                             "WaypointManagerServer::handlePathRequests",
+                             &fp_group_);
 }
 
 //------------------------------------------------------------------------------
@@ -29,11 +71,35 @@ WaypointManagerServer::~WaypointManagerServer()
 //------------------------------------------------------------------------------
 void WaypointManagerServer::loadWaypoints(const std::string & lvl_name)
 {
+    // Queued requests are answered from the new map. A search in
+    // progress must start over.
+    cancelGridSearch();
+    path_cache_.clear();
+    path_cache_order_.clear();
+
     wp_map_.clear();
     open_wp_.clear();
+    hierarchy_.clear();
+
+    std::string lvl_path = LEVEL_PATH + lvl_name + "/";
+
+    if (!(terrain::CookedTerrain::isUpToDate(lvl_path) && loadCookedWaypoints(lvl_path)) &&
+        !loadWaypointFile(lvl_path + "waypoints.bin"))
+    {
+        return;
+    }
+
+    open_wp_.init(wp_map_, w_, h_);
 
-    std::string wp_file = LEVEL_PATH + lvl_name + "/waypoints.bin";
+    buildHierarchy(lvl_name);
+}
 
+//------------------------------------------------------------------------------
+/**
+ *  \return false if the file couldn't be read.
+ */
+bool WaypointManagerServer::loadWaypointFile(const std::string & wp_file)
+{
     try
     {
         serializer::Serializer s(wp_file, serializer::SOM_READ | serializer::SOM_COMPRESS);
@@ -60,12 +126,6 @@ void WaypointManagerServer::loadWaypoints(const std::string & lvl_name)
                 wp_server.pos_ = pos;
 
                 wp_map_[x_index].push_back(wp_server);
-
-                /// store point in open map if level lesser than 9
-                if(lvl < 9)
-                {
-                    open_wp_.push_back(Vector(x_index,0.0,z_index));
-                }
             }
         }
     }
@@ -73,11 +133,63 @@ void WaypointManagerServer::loadWaypoints(const std::string & lvl_name)
     {   
         s_log << Log::warning << " Unable to load Waypoint map for level: " << wp_file << "\n Error: "
               << e.getMessage();
+        return false;
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Reads the waypoint grid from the mapped cooked terrain file,
+ *  avoiding decompression and per-value parsing of waypoints.bin.
+ *
+ *  \return false if the cooked file contains no waypoints or cannot
+ *  be read.
+ */
+bool WaypointManagerServer::loadCookedWaypoints(const std::string & lvl_path)
+{
+    try
+    {
+        terrain::CookedTerrain cooked(lvl_path);
+
+        const terrain::CookedTerrainHeader & header = cooked.getHeader();
+        const terrain::CookedWaypoint * cur_wp = (const terrain::CookedWaypoint*)
+            cooked.getSection(terrain::CTS_WAYPOINTS,
+                              header.wp_width_*header.wp_height_*sizeof(terrain::CookedWaypoint));
+        if (!cur_wp) return false;
+        
+        w_          = header.wp_width_;
+        h_          = header.wp_height_;
+        horz_scale_ = header.wp_horz_scale_;
+
+        wp_map_.resize(w_);
+        for(unsigned x_index=0; x_index < w_; x_index++)
+        {
+            wp_map_[x_index].resize(h_);
+            for(unsigned z_index=0; z_index < h_; z_index++)
+            {
+                wp_map_[x_index][z_index].pos_   = Vector(cur_wp->pos_);
+                wp_map_[x_index][z_index].level_ = cur_wp->level_;
+                ++cur_wp;
+            }
+        }
+    } catch (Exception & e)
+    {
+        s_log << Log::warning << " Unable to load cooked waypoints for level " << lvl_path
+              << "\n Error: " << e.getMessage();
+        wp_map_.clear();
+        return false;
     }
 
+    return true;
 }
 
 //------------------------------------------------------------------------------
+/**
+ *  Long-range queries are answered by the hierarchical waypoint
+ *  graph, everything else by searching the grid directly.
+ */
 std::deque<WaypointServer*> WaypointManagerServer::findPath(WaypointSearchNode * start, WaypointSearchNode * end)
 {
     std::deque<WaypointServer*> result;
@@ -85,26 +197,157 @@ std::deque<WaypointServer*> WaypointManagerServer::findPath(WaypointSearchNode *
     // no waypoints loaded here -> bail
     if(open_wp_.empty() || wp_map_.empty()) return result;    
 
-    AStarSearch<WaypointSearchNode> astarsearch;
+    if (findHierarchicalPath(*start, *end, result)) return result;
 
-    unsigned int SearchCount = 0;
+    // The synchronous search would clobber a time-sliced one.
+    cancelGridSearch();
+
+    return findGridPath(start, end);
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Queues a path search. The callback is executed by a later frame
+ *  task on the main thread, never from within this function.
+ *
+ *  \param group The request is cancelled when this group is
+ *  destroyed, so the callback is never executed for a deleted bot.
+ */
+hPathRequest WaypointManagerServer::requestPath(const WaypointSearchNode & start, const WaypointSearchNode & end,
+                                                PathCallback callback, RegisteredFpGroup * group)
+{
+    PathRequester requester;
+    requester.id_       = next_path_request_++;
+    requester.callback_ = callback;
+    requester.fp_group_ = group;
+
+    group->addFunctionPointer(new PathRequestFp(requester.id_));
+
+    // Share a queued search with the same goal and a nearby start
+    int coalesce_dist = s_params.get<unsigned>("server.ai.path_coalesce_dist");
+    for (std::deque<PathSearch>::iterator it = path_search_.begin();
+         it != path_search_.end();
+         ++it)
+    {
+        if (it->end_.x_ != end.x_ || it->end_.z_ != end.z_) continue;
+
+        if (abs((int)it->start_.x_ - (int)start.x_) > coalesce_dist ||
+            abs((int)it->start_.z_ - (int)start.z_) > coalesce_dist) continue;
+
+        it->requester_.push_back(requester);
+        return requester.id_;
+    }
+
+    PathSearch search;
+    search.start_ = start;
+    search.end_   = end;
+    search.requester_.push_back(requester);
+    path_search_.push_back(search);
+
+    return requester.id_;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  The callback of the request will not be executed. Requests are
+ *  removed automatically after their callback was executed, so this
+ *  must only be called before that.
+ */
+void WaypointManagerServer::cancelPathRequest(hPathRequest request, RegisteredFpGroup * group)
+{
+    if (request == INVALID_PATH_REQUEST) return;
+
+    group->deregister(PathRequestFp(request));
+}
+
+//------------------------------------------------------------------------------
+bool WaypointManagerServer::findHierarchicalPath(const WaypointSearchNode & start, const WaypointSearchNode & end,
+                                                 std::deque<WaypointServer*> & result)
+{
+    std::vector<unsigned> cells;
+    if (!isValidCell(start) || !isValidCell(end) ||
+        !hierarchy_.findPath(start.x_*h_ + start.z_, end.x_*h_ + end.z_, cells)) return false;
+
+    result.clear();
+    for (unsigned c=0; c<cells.size(); ++c)
+    {
+        result.push_back(&wp_map_[cells[c] / h_][cells[c] % h_]);
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Loads the hierarchical waypoint graph stored next to the waypoint
+ *  map. If it is missing or was built from a different waypoint map,
+ *  it is built and saved again.
+ */
+void WaypointManagerServer::buildHierarchy(const std::string & lvl_name)
+{
+    std::string graph_file = LEVEL_PATH + lvl_name + "/waypoints_graph.bin";
+    unsigned cluster_size = s_params.get<unsigned>("server.ai.waypoint_cluster_size");
+
+    std::vector<uint8_t> level(w_*h_);
+    for(unsigned x_index=0; x_index < w_; x_index++)
+    {
+        for(unsigned z_index=0; z_index < h_; z_index++)
+        {
+            level[x_index*h_ + z_index] = std::min(wp_map_[x_index][z_index].level_, (unsigned short)9);
+        }
+    }
+
+    if (hierarchy_.load(graph_file, level, w_, h_, cluster_size)) return;
+
+    hierarchy_.build(level, w_, h_, cluster_size);
+
+    s_log << Log::debug('l')
+          << "Built waypoint graph with "
+          << hierarchy_.getNumNodes()
+          << " portals in "
+          << hierarchy_.getNumClusters()
+          << " clusters.\n";
+
+    try
+    {
+        hierarchy_.save(graph_file);
+    } catch (serializer::IoException & e)
+    {
+        s_log << Log::warning << "Unable to save waypoint graph " << graph_file << ": "
+              << e.getMessage() << "\n";
+    }
+}
+
+//------------------------------------------------------------------------------
+std::deque<WaypointServer*> WaypointManagerServer::findGridPath(WaypointSearchNode * start, WaypointSearchNode * end)
+{
+    AStarSearch<WaypointSearchNode> & astarsearch = astar_search_;
 
-		
     // Set Start and goal states
 		
     astarsearch.SetStartAndGoalStates( *start, *end );
 
     unsigned int SearchState;
-    unsigned int SearchSteps = 0;
 
     do
     {
         SearchState = astarsearch.SearchStep();
-
-        SearchSteps++;
     }
     while( SearchState == AStarSearch<WaypointSearchNode>::SEARCH_STATE_SEARCHING );
 
+    return getGridSearchResult(SearchState);
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Collects the path found by astar_search_ and frees its nodes.
+ */
+std::deque<WaypointServer*> WaypointManagerServer::getGridSearchResult(unsigned SearchState)
+{
+    std::deque<WaypointServer*> result;
+
+    AStarSearch<WaypointSearchNode> & astarsearch = astar_search_;
+
     if( SearchState == AStarSearch<WaypointSearchNode>::SEARCH_STATE_SUCCEEDED )
     {
         // s_log << "Search found goal state\n";
@@ -144,11 +387,6 @@ std::deque<WaypointServer*> WaypointManagerServer::findPath(WaypointSearchNode *
         //s_log << "Search terminated. Did not find goal state\n";		
     }
 
-    // Display the number of loops the search went through
-    // s_log << "SearchSteps : " << SearchSteps << "\n";
-
-    SearchCount ++;
-
     astarsearch.EnsureMemoryFreed();
 	
 
@@ -156,50 +394,199 @@ std::deque<WaypointServer*> WaypointManagerServer::findPath(WaypointSearchNode *
 }
 
 //------------------------------------------------------------------------------
-void WaypointManagerServer::getNearestOpenWaypoint(const Vector & pos, unsigned & x, unsigned & z)
+void WaypointManagerServer::cancelGridSearch()
 {
-    /// use int due to minus calculations for distance
-    int x_index = round((pos.x_/horz_scale_) / N_TH_WP);
-    int z_index = round((pos.z_/horz_scale_) / N_TH_WP);
+    if (!grid_search_active_) return;
+
+    astar_search_.CancelSearch();
+    astar_search_.SearchStep(); // frees all nodes
+    astar_search_.EnsureMemoryFreed();
+
+    grid_search_active_ = false;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Works on the queued searches until the step budget for this frame
+ *  is used up. Cached paths and hierarchical searches are finished
+ *  at once, grid searches may take several frames.
+ */
+void WaypointManagerServer::handlePathRequests(float dt)
+{
+    if (path_search_.empty()) return;
 
-    int smallest = std::numeric_limits<int>::max();
+    PROFILE(WaypointManagerServer::handlePathRequests);
 
-    // iterate over accessible points and get the one with the smallest distance to
-    // the given point (pos).
-    std::vector<Vector>::const_iterator it;
-    for (it = open_wp_.begin(); it != open_wp_.end(); ++it)
+    int budget = s_params.get<unsigned>("server.ai.path_steps_per_frame");
+
+    while (!path_search_.empty() && budget > 0)
     {
-        /// Chebyshev distance
-        int distance = max( abs(x_index - (int)(*it).x_) , 
-                            abs(z_index - (int)(*it).z_) );
+        PathSearch & search = path_search_.front();
 
-        if( distance < smallest )
+        if (!grid_search_active_)
         {
-            smallest = distance;
-            x = (*it).x_;
-            z = (*it).z_;
+            std::deque<WaypointServer*> path;
+
+            if (open_wp_.empty() || wp_map_.empty() ||
+                !isValidCell(search.start_) || !isValidCell(search.end_))
+            {
+                finishPathSearch(path);
+                continue;
+            }
+
+            PathCache::const_iterator cached = path_cache_.find(
+                PathCacheKey(search.start_.x_*h_ + search.start_.z_,
+                             search.end_.x_  *h_ + search.end_.z_));
+            if (cached != path_cache_.end())
+            {
+                path = cached->second;
+                finishPathSearch(path);
+                continue;
+            }
+
+            bool found = findHierarchicalPath(search.start_, search.end_, path);
+            budget -= hierarchy_.getNumSearchSteps() + 1;
+
+            if (found)
+            {
+                addToPathCache(search, path);
+                finishPathSearch(path);
+                continue;
+            }
+
+            astar_search_.SetStartAndGoalStates(search.start_, search.end_);
+            grid_search_active_ = true;
         }
+
+        unsigned state = AStarSearch<WaypointSearchNode>::SEARCH_STATE_SEARCHING;
+        while (budget > 0 && state == AStarSearch<WaypointSearchNode>::SEARCH_STATE_SEARCHING)
+        {
+            state = astar_search_.SearchStep();
+            --budget;
+        }
+
+        if (state == AStarSearch<WaypointSearchNode>::SEARCH_STATE_SEARCHING) break;
+
+        grid_search_active_ = false;
+
+        std::deque<WaypointServer*> path = getGridSearchResult(state);
+        addToPathCache(search, path);
+        finishPathSearch(path);
     }
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Removes the first search from the queue and passes its result to
+ *  all requesters.
+ */
+void WaypointManagerServer::finishPathSearch(const std::deque<WaypointServer*> & path)
+{
+    // Callbacks may queue new requests, so don't touch the queue
+    // after executing them.
+    std::vector<PathRequester> requester;
+    requester.swap(path_search_.front().requester_);
+    path_search_.pop_front();
+
+    for (unsigned r=0; r<requester.size(); ++r)
+    {
+        requester[r].fp_group_->deregister(PathRequestFp(requester[r].id_));
+        requester[r].callback_(path);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Called when a request is deregistered from its fp group. Drops its
+ *  search if nobody else is waiting for it.
+ */
+void WaypointManagerServer::removePathRequest(hPathRequest request)
+{
+    for (unsigned s=0; s<path_search_.size(); ++s)
+    {
+        std::vector<PathRequester> & requester = path_search_[s].requester_;
+
+        for (unsigned r=0; r<requester.size(); ++r)
+        {
+            if (requester[r].id_ != request) continue;
+
+            requester.erase(requester.begin() + r);
+
+            if (requester.empty())
+            {
+                if (s == 0) cancelGridSearch();
+                path_search_.erase(path_search_.begin() + s);
+            }
+            return;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void WaypointManagerServer::addToPathCache(const PathSearch & search, const std::deque<WaypointServer*> & path)
+{
+    unsigned cache_size = s_params.get<unsigned>("server.ai.path_cache_size");
+    if (cache_size == 0) return;
+
+    PathCacheKey key(search.start_.x_*h_ + search.start_.z_,
+                     search.end_.x_  *h_ + search.end_.z_);
+
+    if (!path_cache_.insert(std::make_pair(key, path)).second) return;
+    path_cache_order_.push_back(key);
+
+    while (path_cache_order_.size() > cache_size)
+    {
+        path_cache_.erase(path_cache_order_.front());
+        path_cache_order_.pop_front();
+    }
+}
+
+//------------------------------------------------------------------------------
+bool WaypointManagerServer::isValidCell(const WaypointSearchNode & node) const
+{
+    return node.x_ < w_ && node.z_ < h_;
+}
+
+//------------------------------------------------------------------------------
+void WaypointManagerServer::getNearestOpenWaypoint(const Vector & pos, unsigned & x, unsigned & z)
+{
+    /// use int due to minus calculations for distance
+    int x_index = round((pos.x_/horz_scale_) / N_TH_WP);
+    int z_index = round((pos.z_/horz_scale_) / N_TH_WP);
+
+    std::vector<unsigned> nearest;
+    open_wp_.findNearest(x_index, z_index, 1, nearest);
 
     // if it is the case that there are no open points at all,
-    if(open_wp_.empty())
+    if(nearest.empty())
     {
         x = 0;
         z = 0;
+    } else
+    {
+        x = nearest[0] / h_;
+        z = nearest[0] % h_;
     }
-
 }
 
 //------------------------------------------------------------------------------
+/**
+ *  Picks an open waypoint, each with the same probability. Snapping a
+ *  random position to the nearest open waypoint would favor waypoints
+ *  next to blocked areas.
+ */
 void WaypointManagerServer::getRandomOpenWaypoint(unsigned & x, unsigned & z)
 {
-    Vector pos(0.0,0.0,0.0);
-
-    // create random position inside of map bounds
-    pos.x_ = ((float)(rand()%w_)) * horz_scale_ * N_TH_WP;
-    pos.z_ = ((float)(rand()%h_)) * horz_scale_ * N_TH_WP;
-
-    getNearestOpenWaypoint(pos, x, z);
+    if (open_wp_.empty())
+    {
+        x = 0;
+        z = 0;
+        return;
+    }
+    
+    unsigned cell = open_wp_.getRandom();
+    x = cell / h_;
+    z = cell % h_;
 }
 
 //------------------------------------------------------------------------------
@@ -219,6 +606,186 @@ unsigned WaypointManagerServer::getMapValue(unsigned int x, unsigned int z)
 
 
 
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+OpenWaypointGrid::OpenWaypointGrid() :
+    h_(0),
+    num_buckets_x_(0),
+    num_buckets_z_(0),
+    num_open_(0)
+{
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Sorts all waypoints with level lesser than 9 into their buckets.
+ */
+void OpenWaypointGrid::init(const std::vector< std::vector<WaypointServer> > & wp_map, unsigned w, unsigned h)
+{
+    clear();
+
+    h_ = h;
+    num_buckets_x_ = (w + OPEN_WAYPOINT_BUCKET_SIZE - 1) / OPEN_WAYPOINT_BUCKET_SIZE;
+    num_buckets_z_ = (h + OPEN_WAYPOINT_BUCKET_SIZE - 1) / OPEN_WAYPOINT_BUCKET_SIZE;
+
+    bucket_.resize(num_buckets_x_ * num_buckets_z_);
+
+    for(unsigned x_index=0; x_index < w; x_index++)
+    {
+        for(unsigned z_index=0; z_index < h; z_index++)
+        {
+            if(wp_map[x_index][z_index].level_ >= 9) continue;
+
+            bucket_[(x_index / OPEN_WAYPOINT_BUCKET_SIZE) * num_buckets_z_ +
+                    z_index / OPEN_WAYPOINT_BUCKET_SIZE].push_back(x_index*h_ + z_index);
+            ++num_open_;
+        }
+    }
+
+    bucket_end_.resize(bucket_.size());
+    unsigned num_cells = 0;
+    for (unsigned b=0; b<bucket_.size(); ++b)
+    {
+        num_cells += bucket_[b].size();
+        bucket_end_[b] = num_cells;
+    }
+}
+
+//------------------------------------------------------------------------------
+void OpenWaypointGrid::clear()
+{
+    bucket_.clear();
+    bucket_end_.clear();
+    num_buckets_x_ = num_buckets_z_ = 0;
+    num_open_ = 0;
+}
+
+//------------------------------------------------------------------------------
+bool OpenWaypointGrid::empty() const
+{
+    return num_open_ == 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns a uniformly distributed open cell. The buckets act as
+ *  strata: one is chosen with a probability proportional to its
+ *  number of open cells, then a cell inside of it.
+ *
+ *  Must not be called if the grid is empty.
+ */
+unsigned OpenWaypointGrid::getRandom() const
+{
+    assert(num_open_);
+
+    unsigned r = (unsigned)(((double)rand() / ((double)RAND_MAX+1.0)) * num_open_);
+    
+    unsigned b = std::upper_bound(bucket_end_.begin(), bucket_end_.end(), r) - bucket_end_.begin();
+    assert(b < bucket_.size());
+
+    unsigned bucket_start = b ? bucket_end_[b-1] : 0;
+    return bucket_[b][r - bucket_start];
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Finds the k open waypoints with the smallest Chebyshev distance to
+ *  (x,z), which may lie outside of the map. Equally distant waypoints
+ *  are ordered by x, then z.
+ *
+ *  Buckets are visited in rings of increasing distance around the
+ *  bucket containing (x,z). Distances to the rings never decrease, so
+ *  the search stops at the first ring which is farther away than the
+ *  k-th best waypoint found so far.
+ *
+ *  \param result Receives up to k cells, nearest first.
+ */
+void OpenWaypointGrid::findNearest(int x, int z, unsigned k, std::vector<unsigned> & result) const
+{
+    result.clear();
+    if (num_open_ == 0 || k == 0) return;
+
+    int center_x = clamp(x / (int)OPEN_WAYPOINT_BUCKET_SIZE, 0, num_buckets_x_-1);
+    int center_z = clamp(z / (int)OPEN_WAYPOINT_BUCKET_SIZE, 0, num_buckets_z_-1);
+
+    int max_ring = std::max(std::max(center_x, num_buckets_x_-1 - center_x),
+                            std::max(center_z, num_buckets_z_-1 - center_z));
+
+    /// (distance, cell) of the best waypoints so far, sorted
+    std::vector<std::pair<int, unsigned> > best;
+
+    for (int ring=0; ring<=max_ring; ++ring)
+    {
+        int ring_min_dist = std::numeric_limits<int>::max();
+
+        for (int bx = center_x-ring; bx <= center_x+ring; ++bx)
+        {
+            visitBucket(bx, center_z-ring, x, z, k, best, ring_min_dist);
+            if (ring) visitBucket(bx, center_z+ring, x, z, k, best, ring_min_dist);
+        }
+        for (int bz = center_z-ring+1; bz <= center_z+ring-1; ++bz)
+        {
+            visitBucket(center_x-ring, bz, x, z, k, best, ring_min_dist);
+            visitBucket(center_x+ring, bz, x, z, k, best, ring_min_dist);
+        }
+
+        if (best.size() == k && ring_min_dist > best.back().first) break;
+    }
+
+    for (unsigned b=0; b<best.size(); ++b)
+    {
+        result.push_back(best[b].second);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Merges the waypoints of a bucket into best, unless the bucket is
+ *  out of the grid or too far away.
+ *
+ *  \param ring_min_dist Is lowered to the smallest possible distance
+ *  of a waypoint in this bucket.
+ */
+void OpenWaypointGrid::visitBucket(int bx, int bz, int x, int z, unsigned k,
+                                   std::vector<std::pair<int, unsigned> > & best,
+                                   int & ring_min_dist) const
+{
+    if (bx < 0 || bx >= num_buckets_x_ ||
+        bz < 0 || bz >= num_buckets_z_) return;
+
+    int x0 = bx * OPEN_WAYPOINT_BUCKET_SIZE;
+    int z0 = bz * OPEN_WAYPOINT_BUCKET_SIZE;
+    int x1 = x0 + OPEN_WAYPOINT_BUCKET_SIZE - 1;
+    int z1 = z0 + OPEN_WAYPOINT_BUCKET_SIZE - 1;
+
+    int min_dist = std::max(std::max(x0 - x, x - x1),
+                            std::max(z0 - z, z - z1));
+    min_dist = std::max(min_dist, 0);
+
+    ring_min_dist = std::min(ring_min_dist, min_dist);
+
+    if (best.size() == k && min_dist > best.back().first) return;
+
+    const std::vector<uint32_t> & cell = bucket_[bx * num_buckets_z_ + bz];
+    for (unsigned c=0; c<cell.size(); ++c)
+    {
+        /// Chebyshev distance
+        std::pair<int, unsigned> candidate(std::max(abs(x - (int)(cell[c] / h_)),
+                                                    abs(z - (int)(cell[c] % h_))),
+                                           cell[c]);
+
+        if (best.size() == k)
+        {
+            if (!(candidate < best.back())) continue;
+            best.pop_back();
+        }
+
+        best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+    }
+}
+
+
+
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 WaypointSearchNode::WaypointSearchNode()
@@ -385,6 +952,15 @@ bool WaypointSearchNode::IsSameState( WaypointSearchNode &rhs )
     }
 }
 
+//------------------------------------------------------------------------------
+/**
+ *  Used by AStarSearch to index its open and closed sets.
+ */
+unsigned WaypointSearchNode::Hash() const
+{
+    return (x_ * 73856093u) ^ (z_ * 19349663u);
+}
+
 //------------------------------------------------------------------------------
 void WaypointSearchNode::PrintNodeInfo()
 {
@@ -4,9 +4,13 @@
 #include <deque>
 #include <map>
 
+#include <loki/Functor.h>
+
 #include "Vector.h"
 #include "Singleton.h"
+#include "RegisteredFpGroup.h"
 #include "AStarSearch.h"
+#include "WaypointHierarchy.h"
 
 
 #ifdef FULL_METAL_SOCCER_MODE
@@ -44,6 +48,7 @@ class WaypointSearchNode
     bool GetSuccessors( AStarSearch<WaypointSearchNode> *astarsearch, WaypointSearchNode *parent_node );
     float GetCost( WaypointSearchNode &successor );
     bool IsSameState( WaypointSearchNode &rhs );
+    unsigned Hash() const;
 
     void PrintNodeInfo(); 
 
@@ -53,10 +58,86 @@ class WaypointSearchNode
 };
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Bucketed grid over the open waypoints, so nearest waypoint queries
+ *  only visit the buckets around the query position instead of every
+ *  open waypoint of the level.
+ *
+ *  Cells are addressed as x*h + z, like in WaypointHierarchy.
+ */
+class OpenWaypointGrid
+{
+ public:
+    OpenWaypointGrid();
+
+    void init(const std::vector< std::vector<WaypointServer> > & wp_map, unsigned w, unsigned h);
+    void clear();
+
+    bool empty() const;
+
+    void findNearest(int x, int z, unsigned k, std::vector<unsigned> & result) const;
+    unsigned getRandom() const;
+
+ protected:
+
+    void visitBucket(int bx, int bz, int x, int z, unsigned k,
+                     std::vector<std::pair<int, unsigned> > & best,
+                     int & ring_min_dist) const;
+
+    unsigned h_;
+    int num_buckets_x_;
+    int num_buckets_z_;
+
+    std::vector<std::vector<uint32_t> > bucket_; ///< Open cells per bucket, x major.
+    std::vector<unsigned> bucket_end_;           ///< Number of open cells in all
+                                                 ///buckets up to and including
+                                                 ///this one.
+    unsigned num_open_;
+};
+
+
+typedef unsigned hPathRequest;
+const hPathRequest INVALID_PATH_REQUEST = (hPathRequest)-1;
+
+/// Receives the waypoints of a requested path, empty if none was
+/// found.
+typedef Loki::Functor<void, LOKI_TYPELIST_1(const std::deque<WaypointServer*> &) > PathCallback;
+
+//------------------------------------------------------------------------------
+/**
+ *  \see RegisteredFpGroup.
+ */
+class PathRequestFp : public RegisteredFp
+{
+ public:
+    PathRequestFp(hPathRequest request = INVALID_PATH_REQUEST);
+
+    virtual const std::string & toString() const;
+    virtual bool operator==(const RegisteredFp & other) const;
+    virtual void deregisterPointer() const;
+
+ protected:
+
+    hPathRequest request_;
+};
+
+
 #define s_waypoint_manager_server Loki::SingletonHolder<WaypointManagerServer, Loki::CreateUsingNew, SingletonDefaultLifetime >::Instance()
 //------------------------------------------------------------------------------
+/**
+ *  Path requests are queued and executed by a frame task, which does
+ *  at most server.ai.path_steps_per_frame search steps per frame. A
+ *  long grid search is thereby spread over several frames instead of
+ *  stalling a single server tick.
+ *
+ *  Requests for the same goal from nearby starts share a single
+ *  search, and recent results are cached until the next level is
+ *  loaded.
+ */
 class WaypointManagerServer
 {
+    friend class PathRequestFp;
 
     DECLARE_SINGLETON(WaypointManagerServer);
 
@@ -68,6 +149,10 @@ class WaypointManagerServer
 
     std::deque<WaypointServer*> findPath(WaypointSearchNode * start, WaypointSearchNode * end);
 
+    hPathRequest requestPath(const WaypointSearchNode & start, const WaypointSearchNode & end,
+                             PathCallback callback, RegisteredFpGroup * group);
+    void cancelPathRequest(hPathRequest request, RegisteredFpGroup * group);
+
     void getNearestOpenWaypoint(const Vector & pos, unsigned & x, unsigned & z);
     void getRandomOpenWaypoint(unsigned & x, unsigned & z);
 
@@ -75,14 +160,72 @@ class WaypointManagerServer
 
  private:
 
+    //------------------------------------------------------------------------------
+    struct PathRequester
+    {
+        hPathRequest id_;
+        PathCallback callback_;
+        RegisteredFpGroup * fp_group_; ///< Needed to remove the request after
+                                       ///its callback was executed.
+    };
+
+    //------------------------------------------------------------------------------
+    /**
+     *  A queued search and everyone waiting for its result.
+     */
+    struct PathSearch
+    {
+        WaypointSearchNode start_;
+        WaypointSearchNode end_;
+        std::vector<PathRequester> requester_;
+    };
+
+    typedef std::pair<unsigned, unsigned> PathCacheKey; ///< Start and goal cell.
+    typedef std::map<PathCacheKey, std::deque<WaypointServer*> > PathCache;
+
+    bool loadWaypointFile(const std::string & wp_file);
+    bool loadCookedWaypoints(const std::string & lvl_path);
+    void buildHierarchy(const std::string & lvl_name);
+
+    bool findHierarchicalPath(const WaypointSearchNode & start, const WaypointSearchNode & end,
+                              std::deque<WaypointServer*> & result);
+    std::deque<WaypointServer*> findGridPath(WaypointSearchNode * start, WaypointSearchNode * end);
+    std::deque<WaypointServer*> getGridSearchResult(unsigned search_state);
+    void cancelGridSearch();
+
+    void handlePathRequests(float dt);
+    void finishPathSearch(const std::deque<WaypointServer*> & path);
+    void removePathRequest(hPathRequest request);
+
+    void addToPathCache(const PathSearch & search, const std::deque<WaypointServer*> & path);
+    bool isValidCell(const WaypointSearchNode & node) const;
+
     unsigned w_;
     unsigned h_;
     float horz_scale_;
 
-    std::vector<Vector> open_wp_; ///< this vector stores all open waypoints
+    OpenWaypointGrid open_wp_; ///< this grid stores all open waypoints
 
     std::vector< std::vector<WaypointServer> > wp_map_; ///< the 2D array that stores 
                                                         ///< all the waypoints
+
+    WaypointHierarchy hierarchy_; ///< Answers long-range queries.
+
+    AStarSearch<WaypointSearchNode> astar_search_; ///< Reused for every
+                                                   ///search to avoid
+                                                   ///reallocating its node
+                                                   ///memory.
+
+    std::deque<PathSearch> path_search_; ///< Pending searches, the first
+                                         ///one may be in progress.
+    bool grid_search_active_;            ///< Whether astar_search_ is
+                                         ///working on the first search.
+    hPathRequest next_path_request_;
+
+    PathCache path_cache_;
+    std::deque<PathCacheKey> path_cache_order_; ///< Oldest first, for eviction.
+
+    RegisteredFpGroup fp_group_;
 };
 
 
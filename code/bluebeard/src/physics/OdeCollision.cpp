@@ -422,6 +422,37 @@ void OdeGeom::clearCollisionCallback()
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Called when the owning body is returned to its simulator's body
+ *  pool. The geom must already have been removed from its space.
+ *  Restores the state the geom had right after being instantiated
+ *  from blueprint.
+ */
+void OdeGeom::recycle(const OdeGeom * blueprint)
+{
+    assert(space_ == NULL);
+
+    dGeomSetCategoryBits(id_, ~0);
+    dGeomSetCollideBits (id_, ~0);
+    enable(true);
+
+    if (blueprint->collision_callback_.get())
+    {
+        collision_callback_.reset(new CollisionCallback(*blueprint->collision_callback_.get()));
+    } else clearCollisionCallback();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Called when the owning body is taken from the body pool again.
+ */
+void OdeGeom::reuse()
+{
+}
+
+
 //------------------------------------------------------------------------------
 OdeGeom::OdeGeom(const OdeGeom & other) :
     name_(other.name_),
@@ -974,6 +1005,30 @@ dMass OdeContinuousGeom::getMass() const
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Pooled geoms must not be advanced by the simulator.
+ */
+void OdeContinuousGeom::recycle(const OdeGeom * blueprint)
+{
+    OdeGeom::recycle(blueprint);
+
+    body_->getSimulator()->removeContinuousGeom(this);
+
+    prev_pos_ = Vector(std::numeric_limits<float>::max(),
+                       std::numeric_limits<float>::max(),
+                       std::numeric_limits<float>::max());
+    enable(false);
+}
+
+
+//------------------------------------------------------------------------------
+void OdeContinuousGeom::reuse()
+{
+    body_->getSimulator()->addContinuousGeom(this);
+}
+
+
 //------------------------------------------------------------------------------
 void OdeContinuousGeom::frameMove()
 {
@@ -198,6 +198,9 @@ class OdeGeom
     void setCollisionCallback(const CollisionCallback & callback);
     const CollisionCallback * getCollisionCallback() const;
     void clearCollisionCallback();
+
+    virtual void recycle(const OdeGeom * blueprint);
+    virtual void reuse();
     
 
  protected:
@@ -384,6 +387,9 @@ class OdeContinuousGeom : public OdeGeom
     virtual void setBody(OdeRigidBody * body);
 
     virtual dMass getMass() const;
+
+    virtual void recycle(const OdeGeom * blueprint);
+    virtual void reuse();
     
     void frameMove();
     
@@ -8,6 +8,8 @@
 
 #include "Profiler.h"
 #include "RigidBody.h"
+#include "ParameterManager.h"
+#include "WorkerPool.h"
 
 #undef min
 #undef max
@@ -21,6 +23,13 @@ const float CONTACT_MERGE_THRESHOLD = 0.05f * 0.05f;
 
 const float RAY_OFFSET = 0.001;
 
+/// Below this number of potentially colliding pairs, the overhead of
+/// waking the worker threads isn't worth it.
+const unsigned MIN_PARALLEL_PAIRS = 64;
+
+/// Number of pairs handed to a worker thread at once.
+const unsigned PAIRS_PER_JOB = 32;
+
 
 //------------------------------------------------------------------------------
 bool operator<(const CollisionInfo & i1, const CollisionInfo & i2)
@@ -85,6 +94,7 @@ OdeCollisionSpace::OdeCollisionSpace(const std::string & name, bool generate_sta
     name_(name),
     remember_disabled_geoms_(false),
     generate_start_stop_events_(generate_start_stop_events),
+    cur_pairs_(NULL),
     space_id_(dHashSpaceCreate(0)),
     is_quadtree_(false)
 {
@@ -144,8 +154,11 @@ void OdeCollisionSpace::collide(OdeCollisionSpace * other_space, bool check_for_
  *  track of stopped collisions. This makes it possible to collide a
  *  single geom against a space without letting the contained objects
  *  know it.
+ *
+ *  \param skip_heightfield Don't test against the terrain heightfield,
+ *  for callers which already queried terrain::TerrainData directly.
  */
-void OdeCollisionSpace::collide(const OdeGeom * geom, CollisionCallback callback)
+void OdeCollisionSpace::collide(const OdeGeom * geom, CollisionCallback callback, bool skip_heightfield)
 {
     potentially_colliding_geoms_.push(std::vector<std::pair<dGeomID, dGeomID> >());
 
@@ -155,7 +168,7 @@ void OdeCollisionSpace::collide(const OdeGeom * geom, CollisionCallback callback
                    geom->getId(),
                    this, &physics::spaceCollideCallback);
 
-    handlePotentialCollisionsSingle(geom, callback);
+    handlePotentialCollisionsSingle(geom, callback, skip_heightfield);
 }
 
 
@@ -260,11 +273,7 @@ void OdeCollisionSpace::disableGeom(const OdeGeom * body_geom)
 {
     if (remember_disabled_geoms_)
     {
-        if (std::find(disabled_geom_.begin(), disabled_geom_.end(), body_geom->getId()) != disabled_geom_.end())
-        {
-            return;
-        }
-        disabled_geom_.push_back(body_geom->getId());
+        if (!disabled_geom_.insert(body_geom->getId()).second) return;
     }
     
     if (!generate_start_stop_events_) return;
@@ -405,163 +414,333 @@ void OdeCollisionSpace::createQuadtreeSpace(const Vector & center, const Vector
  *
  *  Then let the callback functions react to the collision event and
  *  create a contact joint if so desired.
+ *
+ *  If physics.collision_threads is larger than one, contacts for all
+ *  pairs are generated up front by the worker pool. Callbacks and
+ *  contact joints are still handled serially in pair order, so the
+ *  outcome doesn't depend on thread scheduling.
  */
 void OdeCollisionSpace::handlePotentialCollisions()
 {
     PROFILE(OdeCollisionSpace::handlePotentialCollisions);
 
+    static ParameterHandle<unsigned> collision_threads("physics.collision_threads");
+    
     remember_disabled_geoms_ = true;
+
+    const std::vector<std::pair<dGeomID, dGeomID> > & pairs = potentially_colliding_geoms_.top();
     
-    dContactGeom contact_geom  [MAX_NUM_CONTACTS];
-    dContactGeom merged_contact[MAX_NUM_CONTACTS];
+    bool parallel = collision_threads.get() > 1 && pairs.size() >= MIN_PARALLEL_PAIRS;
+    if (parallel)
+    {
+        s_worker_pool.setNumThreads(collision_threads.get());
+        narrowPhaseParallel(pairs);
+    }
 
+    const unsigned serial_buffer = s_worker_pool.getNumThreads();
+    if (contact_buffer_.size() <= serial_buffer) contact_buffer_.resize(serial_buffer+1);
+    
+    NarrowPhaseResult serial_result;
+    
 //    s_log << "\n\nhandle potential\n";
     
-    for (unsigned c=0; c<potentially_colliding_geoms_.top().size(); ++c)
+    for (unsigned c=0; c<pairs.size(); ++c)
     {
-        dGeomID o1 = potentially_colliding_geoms_.top()[c].first;
-        dGeomID o2 = potentially_colliding_geoms_.top()[c].second;
+        dGeomID o1 = pairs[c].first;
+        dGeomID o2 = pairs[c].second;
 
         if(!disabled_geom_.empty())
         {
             // Continue if geom was disabled during this function call
-            if (std::find(disabled_geom_.begin(), disabled_geom_.end(), o1) != disabled_geom_.end() ||
-                std::find(disabled_geom_.begin(), disabled_geom_.end(), o2) != disabled_geom_.end())
+            if (disabled_geom_.find(o1) != disabled_geom_.end() ||
+                disabled_geom_.find(o2) != disabled_geom_.end())
             {
                 continue;
             }
         }
-        
-        OdeGeom * geom1 = (OdeGeom*)dGeomGetData(o1);
-        OdeGeom * geom2 = (OdeGeom*)dGeomGetData(o2);
 
-        
-        OdeRigidBody * body1 = geom1->getBody();
-        OdeRigidBody * body2 = geom2->getBody();
-
-        // This can happen if a geom is detached from its body.
-        if (body1 == body2) continue;
-        
-        // Ignore sleeping geoms which are not sensors
-        if (!(geom1->isSensor() || geom2->isSensor()) &&
-            (!body1 || body1->isSleeping()) &&
-            (!body2 || body2->isSleeping())) continue;
+        const NarrowPhaseResult * result = parallel ? &narrow_phase_result_[c] : NULL;
 
-        unsigned num_contacts;
+        // Callbacks of previous pairs might have woken up bodies
+        // which were skipped by the parallel narrow phase.
+        if (!result || result->skipped_)
         {
             PROFILE(dCollide);
-            num_contacts = dCollide(o1, o2, MAX_NUM_CONTACTS, &contact_geom[0], sizeof(dContactGeom));
+            contact_buffer_[serial_buffer].clear();
+            collidePair(o1, o2, serial_buffer, serial_result);
+            result = &serial_result;
         }
-        if (num_contacts == 0) continue;
 
-        if (num_contacts == MAX_NUM_CONTACTS)
+        if (result->max_contacts_reached_)
         {
-            s_log << Log::debug('p')
+            LOG_DEBUG('p')
                   << "max number of contacts ("
                   << MAX_NUM_CONTACTS
                   << ") reached.\n";
         }
+        
+        if (result->num_contacts_ == 0) continue;
 
-        // Find deepest penetration. Rays return distance to ray
-        // origin instead of penetration, so we must invert the
-        // condition.
-        unsigned deepest = 0;
-        bool ray = (geom1->getType() == GT_RAY ||
-                    geom2->getType() == GT_RAY);
-        for (unsigned i=1; i<num_contacts; ++i)
-        {
-            if ((ray &&  contact_geom[i].depth > contact_geom[deepest].depth) ||
-                (!ray && contact_geom[i].depth < contact_geom[deepest].depth))
-            {
-                deepest = i;
-            }
-        }
+        applyCollision((OdeGeom*)dGeomGetData(o1),
+                       (OdeGeom*)dGeomGetData(o2),
+                       *result);
+    }
 
-        // Bail if no contact joint should be generated. Never
-        // generate contact joints for rays.
-        CONTACT_GENERATION generate_contacts = handleCollisionEvent(geom1, geom2, contact_geom[deepest]);
-        if (generate_contacts == CG_GENERATE_NONE || ray) continue;
-        
-        num_contacts = mergeContacts(num_contacts, contact_geom, merged_contact);        
+    potentially_colliding_geoms_.pop();
 
+    remember_disabled_geoms_ = false;    
+}
 
-        // ---------- acquire material properties to use for this collision ----------
-        const Material & mat1 = geom1->getMaterial();
-        const Material & mat2 = geom2->getMaterial();
 
-        dContact contact = {{0}};
-        contact.surface.mode   = dContactBounce | dContactApprox1;
-        contact.surface.mu     = sqrtf ( mat1.friction_   * mat2.friction_ );
-        contact.surface.bounce = 0.5f * (mat1.bounciness_ + mat2.bounciness_);
+//------------------------------------------------------------------------------
+/**
+ *  Generates the contacts for all given pairs using the worker
+ *  pool. The results are stored in narrow_phase_result_.
+ *
+ *  ODE's heightfield and trimesh colliders use per-geom or global
+ *  scratch memory, so all pairs involving those geoms are processed
+ *  by a single job.
+ */
+void OdeCollisionSpace::narrowPhaseParallel(const std::vector<std::pair<dGeomID, dGeomID> > & pairs)
+{
+    PROFILE(OdeCollisionSpace::narrowPhaseParallel);
+    
+    cur_pairs_ = &pairs;
+    
+    narrow_phase_result_.resize(pairs.size());
+    contact_buffer_.resize(s_worker_pool.getNumThreads()+1);
+    for (unsigned b=0; b<contact_buffer_.size(); ++b) contact_buffer_[b].clear();
 
+    serial_pair_  .clear();
+    parallel_pair_.clear();
+    
+    for (unsigned c=0; c<pairs.size(); ++c)
+    {
+        int class1 = dGeomGetClass(pairs[c].first);
+        int class2 = dGeomGetClass(pairs[c].second);
 
-        assert(!body1 || !body2 || (body1->getSimulator() == body2->getSimulator()));
-        OdeSimulator * sim = body1 ? body1->getSimulator() : body2->getSimulator();
+        if (class1 == dHeightfieldClass || class1 == dTriMeshClass ||
+            class2 == dHeightfieldClass || class2 == dTriMeshClass)
+        {
+            serial_pair_.push_back(c);
+        } else
+        {
+            parallel_pair_.push_back(c);
+        }
+    }
 
-        OdeRigidBody * joint_body1 = body1 && body1->isStatic() ? NULL : body1;
-        OdeRigidBody * joint_body2 = body2 && body2->isStatic() ? NULL : body2;
+    // Job 0 handles the serial pairs, the others a chunk of the
+    // parallel pairs each.
+    unsigned num_jobs = 1 + (parallel_pair_.size() + PAIRS_PER_JOB - 1) / PAIRS_PER_JOB;
+    
+    s_worker_pool.run(num_jobs, WorkerJob(this, &OdeCollisionSpace::narrowPhaseJob));
 
+    cur_pairs_ = NULL;
+}
 
-        bool multiply_depth = false;
 
-        if (!(generate_contacts & CG_GENERATE_FIRST))
-        {
-            joint_body1  = NULL;
-            multiply_depth = true;
-        }
+//------------------------------------------------------------------------------
+/**
+ *  Executed by the worker pool, mustn't log or profile.
+ */
+void OdeCollisionSpace::narrowPhaseJob(unsigned job, unsigned thread)
+{
+    const std::vector<unsigned> * pair_index;
+    unsigned first, last;
+    
+    if (job == 0)
+    {
+        pair_index = &serial_pair_;
+        first      = 0;
+        last       = serial_pair_.size();
+    } else
+    {
+        pair_index = &parallel_pair_;
+        first      = (job-1) * PAIRS_PER_JOB;
+        last       = std::min(first + PAIRS_PER_JOB, (unsigned)parallel_pair_.size());
+    }
+
+    for (unsigned i=first; i<last; ++i)
+    {
+        unsigned c = (*pair_index)[i];
+        collidePair((*cur_pairs_)[c].first, (*cur_pairs_)[c].second,
+                    thread, narrow_phase_result_[c]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Runs dCollide for a single pair of geoms and appends the merged
+ *  contacts to the given contact buffer. Doesn't access any state
+ *  shared between threads apart from the geoms themselves.
+ */
+void OdeCollisionSpace::collidePair(dGeomID o1, dGeomID o2, unsigned buffer, NarrowPhaseResult & result)
+{
+    result.skipped_              = false;
+    result.buffer_               = buffer;
+    result.first_contact_        = 0;
+    result.num_contacts_         = 0;
+    result.max_contacts_reached_ = false;
+    
+    OdeGeom * geom1 = (OdeGeom*)dGeomGetData(o1);
+    OdeGeom * geom2 = (OdeGeom*)dGeomGetData(o2);
         
-        if (!(generate_contacts & CG_GENERATE_SECOND))
-        {
-            joint_body2 = NULL;
-            multiply_depth = true;
-        }
+    OdeRigidBody * body1 = geom1->getBody();
+    OdeRigidBody * body2 = geom2->getBody();
+
+    // This can happen if a geom is detached from its body.
+    if (body1 == body2) return;
         
+    // Ignore sleeping geoms which are not sensors
+    if (!(geom1->isSensor() || geom2->isSensor()) &&
+        (!body1 || body1->isSleeping()) &&
+        (!body2 || body2->isSleeping()))
+    {
+        result.skipped_ = true;
+        return;
+    }
 
-        // If one of the bodies is client side only and the other
-        // isn't, the client side body doesn't influence the other
-        // body.
-        //
-        // A joint with NULL doesn't wake up the body, so we have
-        // to do it manually.
-        if (joint_body1 && joint_body2 &&
-            joint_body1->isClientSideOnly() != joint_body2->isClientSideOnly())
+    dContactGeom contact_geom[MAX_NUM_CONTACTS];
+    
+    unsigned num_contacts = dCollide(o1, o2, MAX_NUM_CONTACTS, &contact_geom[0], sizeof(dContactGeom));
+    if (num_contacts == 0) return;
+
+    result.max_contacts_reached_ = (num_contacts == MAX_NUM_CONTACTS);
+
+    // Find deepest penetration. Rays return distance to ray
+    // origin instead of penetration, so we must invert the
+    // condition.
+    unsigned deepest = 0;
+    bool ray = (geom1->getType() == GT_RAY ||
+                geom2->getType() == GT_RAY);
+    for (unsigned i=1; i<num_contacts; ++i)
+    {
+        if ((ray &&  contact_geom[i].depth > contact_geom[deepest].depth) ||
+            (!ray && contact_geom[i].depth < contact_geom[deepest].depth))
         {
-            // slightly hackish: collisions of client side objects
-            // are handles as if against static geometry, but
-            // geometry can be moving => larger penetration to
-            // achieve stronger repulsion and make going-through
-            // less likely.
-            multiply_depth = true;
-                
-            if (joint_body1->isClientSideOnly())
-            {
-                joint_body1->setSleeping(false);
-                joint_body2 = NULL;
-            } else
-            {
-                joint_body2->setSleeping(false);
-                joint_body1 = NULL;
-            }
+            deepest = i;
         }
+    }
+    result.deepest_ = contact_geom[deepest];
+
+    // Never generate contact joints for rays, so don't bother
+    // merging.
+    std::vector<dContactGeom> & contacts = contact_buffer_[buffer];
+    result.first_contact_ = contacts.size();
+    if (ray)
+    {
+        result.num_contacts_ = 1;
+        contacts.push_back(result.deepest_);
+    } else
+    {
+        dContactGeom merged_contact[MAX_NUM_CONTACTS];
+        result.num_contacts_ = mergeContacts(num_contacts, contact_geom, merged_contact);
+        contacts.insert(contacts.end(), merged_contact, merged_contact + result.num_contacts_);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Notifies the geoms' callbacks of the collision and creates contact
+ *  joints as requested.
+ */
+void OdeCollisionSpace::applyCollision(OdeGeom * geom1, OdeGeom * geom2, const NarrowPhaseResult & narrow_phase_result)
+{
+    // Copy result and contacts before notifying anyone: a nested
+    // collide() from a collision callback clears the contact buffers
+    // and may resize narrow_phase_result_.
+    const NarrowPhaseResult result = narrow_phase_result;
+    dContactGeom merged_contact[MAX_NUM_CONTACTS];
+    std::copy(&contact_buffer_[result.buffer_][result.first_contact_],
+              &contact_buffer_[result.buffer_][result.first_contact_] + result.num_contacts_,
+              merged_contact);
+    
+    OdeRigidBody * body1 = geom1->getBody();
+    OdeRigidBody * body2 = geom2->getBody();
 
-        if (!joint_body1 && !joint_body2) continue;
+    bool ray = (geom1->getType() == GT_RAY ||
+                geom2->getType() == GT_RAY);
+    
+    // Bail if no contact joint should be generated. Never
+    // generate contact joints for rays.
+    CONTACT_GENERATION generate_contacts = handleCollisionEvent(geom1, geom2, result.deepest_);
+    if (generate_contacts == CG_GENERATE_NONE || ray) return;
         
-        // Now add all contact joints
-        for (unsigned c=0; c<num_contacts; ++c)
+
+    // ---------- acquire material properties to use for this collision ----------
+    const Material & mat1 = geom1->getMaterial();
+    const Material & mat2 = geom2->getMaterial();
+
+    dContact contact = {{0}};
+    contact.surface.mode   = dContactBounce | dContactApprox1;
+    contact.surface.mu     = sqrtf ( mat1.friction_   * mat2.friction_ );
+    contact.surface.bounce = 0.5f * (mat1.bounciness_ + mat2.bounciness_);
+
+
+    assert(!body1 || !body2 || (body1->getSimulator() == body2->getSimulator()));
+    OdeSimulator * sim = body1 ? body1->getSimulator() : body2->getSimulator();
+
+    OdeRigidBody * joint_body1 = body1 && body1->isStatic() ? NULL : body1;
+    OdeRigidBody * joint_body2 = body2 && body2->isStatic() ? NULL : body2;
+
+
+    bool multiply_depth = false;
+
+    if (!(generate_contacts & CG_GENERATE_FIRST))
+    {
+        joint_body1  = NULL;
+        multiply_depth = true;
+    }
+        
+    if (!(generate_contacts & CG_GENERATE_SECOND))
+    {
+        joint_body2 = NULL;
+        multiply_depth = true;
+    }
+        
+
+    // If one of the bodies is client side only and the other
+    // isn't, the client side body doesn't influence the other
+    // body.
+    //
+    // A joint with NULL doesn't wake up the body, so we have
+    // to do it manually.
+    if (joint_body1 && joint_body2 &&
+        joint_body1->isClientSideOnly() != joint_body2->isClientSideOnly())
+    {
+        // slightly hackish: collisions of client side objects
+        // are handles as if against static geometry, but
+        // geometry can be moving => larger penetration to
+        // achieve stronger repulsion and make going-through
+        // less likely.
+        multiply_depth = true;
+                
+        if (joint_body1->isClientSideOnly())
         {
-            // Set collision details (pos, n, penetration)
-            contact.geom = merged_contact[c];
-            if (multiply_depth && contact.geom.depth < 0.025f) // PPPP
-            {
-                contact.geom.depth *= 4.0f;
-            }
-            sim->addContactJoint(contact, joint_body1, joint_body2);
+            joint_body1->setSleeping(false);
+            joint_body2 = NULL;
+        } else
+        {
+            joint_body2->setSleeping(false);
+            joint_body1 = NULL;
         }
     }
 
-    potentially_colliding_geoms_.pop();
+    if (!joint_body1 && !joint_body2) return;
 
-    remember_disabled_geoms_ = false;    
+    // Now add all contact joints
+    for (unsigned c=0; c<result.num_contacts_; ++c)
+    {
+        // Set collision details (pos, n, penetration)
+        contact.geom = merged_contact[c];
+        if (multiply_depth && contact.geom.depth < 0.025f) // PPPP
+        {
+            contact.geom.depth *= 4.0f;
+        }
+        sim->addContactJoint(contact, joint_body1, joint_body2);
+    }
 }
 
 
@@ -572,8 +751,10 @@ void OdeCollisionSpace::handlePotentialCollisions()
  *
  *  \param single_geom The geom which was collided and whose callback
  *  functions should be called.
+ *  \param skip_heightfield Ignore pairs with a heightfield geom.
  */
-void OdeCollisionSpace::handlePotentialCollisionsSingle(const OdeGeom * single_geom, CollisionCallback callback)
+void OdeCollisionSpace::handlePotentialCollisionsSingle(const OdeGeom * single_geom, CollisionCallback callback,
+                                                        bool skip_heightfield)
 {
     PROFILE(OdeCollisionSpace::handlePotentialCollisionsSingle);    
 
@@ -596,6 +777,8 @@ void OdeCollisionSpace::handlePotentialCollisionsSingle(const OdeGeom * single_g
         }
         assert(geom1 == single_geom);
 
+        if (skip_heightfield && geom2->getType() == GT_HEIGHTFIELD) continue;
+
         if (!dCollide(o1, o2, 1, &contact_geom, sizeof(dContactGeom))) continue;
 
         info.this_geom_  = geom1;
@@ -29,7 +29,7 @@ class OdeCollisionSpace
 
 
     void collide(OdeCollisionSpace * other_space = NULL, bool check_for_stopped_collisions = true);
-    void collide(const OdeGeom * geom, CollisionCallback callback);
+    void collide(const OdeGeom * geom, CollisionCallback callback, bool skip_heightfield = false);
     void collideRayMultiple(OdeRayGeom * ray, CollisionCallback callback);
 
     void spaceCollideCallback(dGeomID o1, dGeomID o2);
@@ -46,8 +46,30 @@ class OdeCollisionSpace
     
  protected:    
 
+    //------------------------------------------------------------------------------
+    /**
+     *  The outcome of contact generation for a single pair of
+     *  potentially colliding geoms.
+     */
+    struct NarrowPhaseResult
+    {
+        bool skipped_;              ///< Geoms weren't tested because both are asleep.
+        unsigned buffer_;           ///< Index into contact_buffer_.
+        unsigned first_contact_;    ///< Offset of the merged contacts in the buffer.
+        unsigned num_contacts_;     ///< Number of merged contacts, 0 if no collision.
+        bool max_contacts_reached_;
+        dContactGeom deepest_;      ///< Deepest contact before merging.
+    };
+    
     void handlePotentialCollisions();
-    void handlePotentialCollisionsSingle(const OdeGeom * single_geom, CollisionCallback callback);
+    void handlePotentialCollisionsSingle(const OdeGeom * single_geom, CollisionCallback callback,
+                                         bool skip_heightfield);
+
+    void narrowPhaseParallel(const std::vector<std::pair<dGeomID, dGeomID> > & pairs);
+    void narrowPhaseJob(unsigned job, unsigned thread);
+
+    void collidePair(dGeomID o1, dGeomID o2, unsigned buffer, NarrowPhaseResult & result);
+    void applyCollision(OdeGeom * geom1, OdeGeom * geom2, const NarrowPhaseResult & result);
     
     bool addCollidingGeoms   (OdeGeom * geom1, OdeGeom * geom2);
     CONTACT_GENERATION handleCollisionEvent(OdeGeom * geom1, OdeGeom * geom2, const dContactGeom & contact_geom);
@@ -79,7 +101,7 @@ class OdeCollisionSpace
     ///events must not be generated for those geoms after the CT_STOP
     ///event, so ignore them if they are still pending in
     ///potentially_colliding_geoms_.
-    std::vector<dGeomID> disabled_geom_; 
+    std::set<dGeomID> disabled_geom_; 
     /// Only remember disabled geoms while handling collisions. This
     /// avoids problems when the same geoms are re-added directly
     /// after removal (e.g. at a level restart)
@@ -89,6 +111,18 @@ class OdeCollisionSpace
     
     bool generate_start_stop_events_;
 
+    /// Narrow phase results, indexed like the pairs in
+    /// potentially_colliding_geoms_.top().
+    std::vector<NarrowPhaseResult> narrow_phase_result_;
+    
+    /// One contact buffer per worker thread, plus one for pairs
+    /// handled serially.
+    std::vector<std::vector<dContactGeom> > contact_buffer_;
+    
+    const std::vector<std::pair<dGeomID, dGeomID> > * cur_pairs_; ///< Pairs of the current parallel narrow phase.
+    std::vector<unsigned> serial_pair_;   ///< Pairs which must be collided by a single thread.
+    std::vector<unsigned> parallel_pair_; ///< Pairs which can be collided by any thread.
+
     
     dSpaceID space_id_;
     bool is_quadtree_;
@@ -4,9 +4,13 @@
 
 #include <tinyxml.h>
 
+#include <boost/filesystem.hpp>
+
 
 #include "Log.h"
 #include "TinyXmlUtils.h"
+#include "MappedFile.h"
+#include "Serializer.h"
 #include "OdeSimulator.h"
 #include "OdeRigidBody.h"
 
@@ -19,6 +23,52 @@ namespace physics
 
 
 const std::string ODE_MODEL_PATH = "data/models/";
+
+/// Cooked trimeshes are stored next to the model's xml file.
+const std::string COOKED_TRIMESH_EXTENSION = ".trimesh";
+const uint32_t    COOKED_TRIMESH_MAGIC     = 0x4d495254; // "TRIM"
+const uint32_t    COOKED_TRIMESH_VERSION   = 2;
+
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+/**
+ *  Followed by one CookedTrimeshMesh per trimesh shape of the model,
+ *  in xml order, and then the vertices and faces of each mesh. All
+ *  data is stored in its memory layout and in native byte order.
+ */
+struct CookedTrimeshHeader
+{
+    uint32_t magic_;
+    uint32_t version_;
+    uint32_t num_meshes_;
+};
+
+//------------------------------------------------------------------------------
+struct CookedTrimeshMesh
+{
+    uint32_t num_vertices_;
+    uint32_t num_faces_;
+};
+
+//------------------------------------------------------------------------------
+/**
+ *  FNV-1a, used as key for the blueprint map.
+ */
+uint32_t hashName(const std::string & name)
+{
+    uint32_t ret = 2166136261u;
+    for (unsigned i=0; i<name.size(); ++i)
+    {
+        ret ^= (uint8_t)name[i];
+        ret *= 16777619u;
+    }
+    return ret;
+}
+
+} // namespace
     
     
 //------------------------------------------------------------------------------
@@ -37,14 +87,14 @@ OdeModelLoader::~OdeModelLoader()
     s_log << Log::debug('d')
           << "OdeModelLoader destructor\n";
     
-    for (std::vector<OdeModelInfo>::iterator it = info_.begin();
-         it != info_.end();
+    for (BlueprintMap::iterator it = blueprint_.begin();
+         it != blueprint_.end();
          ++it)
     {
-        delete it->body_;
+        delete it->second.body_;
     }
 
-    info_.clear();
+    blueprint_.clear();
 }
 
 //------------------------------------------------------------------------------
@@ -52,36 +102,121 @@ OdeRigidBody * OdeModelLoader::instantiateModel(OdeSimulator * simulator,
                                                 const std::string & name)
 {
     assert(simulator);
+
+    try
+    {
+        return simulator->instantiate(getBlueprint(name));
+    } catch (Exception & e)
+    {
+        e.addHistory("OdeModelLoader::instantiateModel(" + name + ")");
+        throw e;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Enables pooling of bodies of the specified model in simulator, see
+ *  OdeSimulator::prewarmBodyPool.
+ */
+void OdeModelLoader::prewarmBodyPool(OdeSimulator * simulator,
+                                     const std::string & name,
+                                     unsigned num_bodies)
+{
+    assert(simulator);
+
+    try
+    {
+        simulator->prewarmBodyPool(getBlueprint(name), num_bodies);
+    } catch (Exception & e)
+    {
+        e.addHistory("OdeModelLoader::prewarmBodyPool(" + name + ")");
+        throw e;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the blueprint body for the specified model, loading it if
+ *  this didn't happen before.
+ */
+const OdeRigidBody * OdeModelLoader::getBlueprint(const std::string & name)
+{
+    uint32_t hash = hashName(name);
+
+    std::pair<BlueprintMap::iterator, BlueprintMap::iterator> range = blueprint_.equal_range(hash);
+    for (BlueprintMap::iterator it = range.first; it != range.second; ++it)
+    {
+        if (it->second.name_ == name) return it->second.body_;
+    }
+
+    // Body wasn't loaded before, so we have to do it...
+    OdeRigidBody * blueprint = loadModel(name);
+    blueprint_.insert(std::make_pair(hash, OdeModelInfo(name, blueprint)));
     
-    OdeRigidBody * blueprint = NULL;
-     
-    for (std::vector<OdeModelInfo>::iterator it = info_.begin();
-         it != info_.end();
-         ++it)
+    return blueprint;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Writes all trimesh shapes of the specified model in binary form
+ *  into a single file next to its xml file. As long as the cooked
+ *  file is up to date, it is loaded instead of parsing the trimesh
+ *  text.
+ *
+ *  \return false if the model has no trimesh shape.
+ */
+bool OdeModelLoader::cookTrimesh(const std::string & name)
+{
+    using namespace tinyxml_utils;
+
+    TiXmlBase::SetCondenseWhiteSpace(false);
+    TiXmlDocument xml_doc;
+    TiXmlHandle root_handle = getRootHandle(ODE_MODEL_PATH + name + ".xml", xml_doc);
+    TiXmlBase::SetCondenseWhiteSpace(true);
+
+    std::vector<std::vector<Vector> >      vertices;
+    std::vector<std::vector<TrimeshFace> > faces;
+    
+    for (TiXmlNode * shape_node = root_handle.FirstChildElement("Shape").ToElement();
+         shape_node;
+         shape_node = shape_node->NextSiblingElement("Shape"))
     {
-        if (it->name_ == name)
-        {
-            blueprint = it->body_;
-            break;
-        }
+        if (getAttributeString(shape_node, "type") != "trimesh") continue;
+
+        vertices.push_back(std::vector<Vector>());
+        faces   .push_back(std::vector<TrimeshFace>());
+        parseTrimesh(name, shape_node, vertices.back(), faces.back());
     }
 
+    if (vertices.empty()) return false;
+
+    CookedTrimeshHeader header;
+    header.magic_      = COOKED_TRIMESH_MAGIC;
+    header.version_    = COOKED_TRIMESH_VERSION;
+    header.num_meshes_ = vertices.size();
+        
+    serializer::Serializer s(ODE_MODEL_PATH + name + COOKED_TRIMESH_EXTENSION,
+                             serializer::SOM_WRITE);
+    s.putRaw(&header, sizeof(header));
 
-    if (!blueprint)
+    for (unsigned m=0; m<vertices.size(); ++m)
     {
-        // Body wasn't loaded before, so we have to do it...
-        try
-        {
-            blueprint = loadModel(name);
-            info_.push_back(OdeModelInfo(name, blueprint));
-        } catch (Exception & e)
-        {
-            e.addHistory("OdeModelLoader::instantiateModel(" + name + ")");
-            throw e;
-        }
+        CookedTrimeshMesh mesh;
+        mesh.num_vertices_ = vertices[m].size();
+        mesh.num_faces_    = faces   [m].size();
+        s.putRaw(&mesh, sizeof(mesh));
     }
     
-    return simulator->instantiate(blueprint);
+    for (unsigned m=0; m<vertices.size(); ++m)
+    {
+        if (!vertices[m].empty()) s.putRaw(&vertices[m][0], vertices[m].size()*sizeof(Vector));
+        if (!faces   [m].empty()) s.putRaw(&faces   [m][0], faces   [m].size()*sizeof(TrimeshFace));
+    }
+
+    return true;
 }
 
 
@@ -166,8 +301,7 @@ OdeRigidBody * OdeModelLoader::loadModel(const std::string & name)
 
 //------------------------------------------------------------------------------
 /**
- *  \param name Only used to identify any contained trimesh. An xml
- *  file can contain only one trimesh shape.
+ *  \param name Only used to identify any contained trimesh.
  *  \param shape_node The shape node to load.
  */
 OdeGeom * OdeModelLoader::loadShape(const std::string & name, TiXmlNode * shape_node)
@@ -299,9 +433,45 @@ OdeGeom * OdeModelLoader::loadTrimesh(const std::string & name, TiXmlNode * trim
 {
     using namespace tinyxml_utils;
 
+    // The cooked file stores the trimesh shapes in xml order.
+    unsigned mesh_index = 0;
+    for (TiXmlNode * prev_node = trimesh_node->PreviousSibling("Shape");
+         prev_node;
+         prev_node = prev_node->PreviousSibling("Shape"))
+    {
+        if (getAttributeString(prev_node, "type") == "trimesh") ++mesh_index;
+    }
+    
     Trimesh * trimesh = new Trimesh;
 
+    if (!loadCookedTrimesh(name, mesh_index, trimesh->vertex_data_, trimesh->index_data_))
+    {
+        parseTrimesh(name, trimesh_node, trimesh->vertex_data_, trimesh->index_data_);
+    }
+
+    s_log << Log::debug('r')
+          << "Loaded trimesh "
+          << name
+          << ": "
+          << trimesh->vertex_data_.size()
+          << " vertices, "
+          << trimesh->index_data_.size()
+          << " faces.\n";
+
+    trimesh->buildTrimesh();
+    
+    return new OdeTrimeshGeom(trimesh);
+}
+
 
+//------------------------------------------------------------------------------
+/**
+ *  Reads the vertices and faces from the text of the trimesh node.
+ */
+void OdeModelLoader::parseTrimesh(const std::string & name, TiXmlNode * trimesh_node,
+                                  std::vector<Vector> & vertices,
+                                  std::vector<TrimeshFace> & faces) const
+{
     TiXmlElement * text_element = trimesh_node->ToElement();
     if (!text_element) throw Exception("Bad XML:" + name);
 
@@ -309,29 +479,121 @@ OdeGeom * OdeModelLoader::loadTrimesh(const std::string & name, TiXmlNode * trim
     std::string text = text_element->GetText();
     std::istringstream in(text);
 
-    ::operator>>(in, trimesh->vertex_data_);
-    ::operator>>(in, trimesh->index_data_);    
+    ::operator>>(in, vertices);
+    ::operator>>(in, faces);    
 
-    if (removeDegenerates(trimesh))
+    if (removeDegenerates(vertices, faces))
     {
         s_log << Log::warning
               << "Degenerate triangles removed in mesh \""
               << name
               << "\"\n";
     }
+}
 
-    s_log << Log::debug('r')
-          << "Loaded trimesh "
-          << name
-          << ": "
-          << trimesh->vertex_data_.size()
-          << " vertices, "
-          << trimesh->index_data_.size()
-          << " faces.\n";
 
-    trimesh->buildTrimesh();
+//------------------------------------------------------------------------------
+/**
+ *  Reads vertices and faces from the model's cooked trimesh file.
+ *
+ *  \param mesh_index The index of the shape among the model's
+ *  trimesh shapes.
+ *
+ *  \return false if there is no cooked file, if it is older than the
+ *  model's xml file or if it is invalid.
+ */
+bool OdeModelLoader::loadCookedTrimesh(const std::string & name,
+                                       unsigned mesh_index,
+                                       std::vector<Vector> & vertices,
+                                       std::vector<TrimeshFace> & faces) const
+{
+    using namespace boost::filesystem;
+
+    std::string cooked_file = ODE_MODEL_PATH + name + COOKED_TRIMESH_EXTENSION;
     
-    return new OdeTrimeshGeom(trimesh);
+    try
+    {
+        if (!exists(path(cooked_file))) return false;
+
+        if (last_write_time(path(cooked_file)) <
+            last_write_time(path(ODE_MODEL_PATH + name + ".xml")))
+        {
+            s_log << Log::warning
+                  << cooked_file << " is older than the model, parsing trimesh instead.\n";
+            return false;
+        }
+    } catch (basic_filesystem_error<path> & e)
+    {
+        s_log << Log::warning << e.what() << "\n";
+        return false;
+    }
+
+    try
+    {
+        MappedFile file(cooked_file);
+
+        const CookedTrimeshHeader * header = (const CookedTrimeshHeader*)file.getData();
+        const CookedTrimeshMesh   * mesh   = (const CookedTrimeshMesh*)(header+1);
+        
+        bool valid = file.getSize() >= sizeof(CookedTrimeshHeader) &&
+                     header->magic_   == COOKED_TRIMESH_MAGIC &&
+                     header->version_ == COOKED_TRIMESH_VERSION &&
+                     file.getSize() >= sizeof(CookedTrimeshHeader) +
+                                       (size_t)header->num_meshes_*sizeof(CookedTrimeshMesh);
+
+        // Mesh data follows the mesh entries. Find the requested
+        // mesh's data and check the total size.
+        size_t size   = sizeof(CookedTrimeshHeader);
+        size_t offset = 0;
+        if (valid) size += (size_t)header->num_meshes_*sizeof(CookedTrimeshMesh);
+        for (unsigned m=0; valid && m<header->num_meshes_; ++m)
+        {
+            if (m == mesh_index) offset = size;
+            size += (size_t)mesh[m].num_vertices_*sizeof(Vector) +
+                    (size_t)mesh[m].num_faces_   *sizeof(TrimeshFace);
+        }
+        if (!valid || file.getSize() != size)
+        {
+            Exception e(cooked_file);
+            e << " is invalid or has the wrong version. Recook the model.";
+            throw e;
+        }
+        if (mesh_index >= header->num_meshes_)
+        {
+            Exception e(cooked_file);
+            e << " has no trimesh " << mesh_index << ". Recook the model.";
+            throw e;
+        }
+        
+        uint32_t num_vertices = mesh[mesh_index].num_vertices_;
+        uint32_t num_faces    = mesh[mesh_index].num_faces_;
+        
+        const Vector      * cur_vertex = (const Vector*)((const uint8_t*)file.getData() + offset);
+        const TrimeshFace * cur_face   = (const TrimeshFace*)(cur_vertex + num_vertices);
+
+        // Bad indices would crash ODE.
+        for (unsigned f=0; f<num_faces; ++f)
+        {
+            if ((uint32_t)cur_face[f].v1_ >= num_vertices ||
+                (uint32_t)cur_face[f].v2_ >= num_vertices ||
+                (uint32_t)cur_face[f].v3_ >= num_vertices)
+            {
+                Exception e(cooked_file);
+                e << " contains invalid indices.";
+                throw e;
+            }
+        }
+
+        vertices.assign(cur_vertex, cur_vertex + num_vertices);
+        faces   .assign(cur_face,   cur_face   + num_faces);
+        
+    } catch (Exception & e)
+    {
+        s_log << Log::warning << e << "\n";
+        return false;
+    }
+
+    return true;
 }
 
 
@@ -362,16 +624,17 @@ Material OdeModelLoader::loadMaterial(TiXmlNode * shape_node)
 /**
  *  \return Whether any degenerates were removed.
  */
-bool OdeModelLoader::removeDegenerates(Trimesh * trimesh) const
+bool OdeModelLoader::removeDegenerates(const std::vector<Vector> & vertices,
+                                       std::vector<TrimeshFace> & faces) const
 {
-    std::vector<TrimeshFace>::iterator cur_face = trimesh->index_data_.begin();
+    std::vector<TrimeshFace>::iterator cur_face = faces.begin();
 
     bool ret = false;
     
-    while (cur_face != trimesh->index_data_.end())
+    while (cur_face != faces.end())
     {
-        Vector ab = trimesh->vertex_data_[cur_face->v2_] - trimesh->vertex_data_[cur_face->v1_];
-        Vector ac = trimesh->vertex_data_[cur_face->v3_] - trimesh->vertex_data_[cur_face->v1_];
+        Vector ab = vertices[cur_face->v2_] - vertices[cur_face->v1_];
+        Vector ac = vertices[cur_face->v3_] - vertices[cur_face->v1_];
         Vector cross;
 
         vecCross(&cross, &ab, &ac);
@@ -383,9 +646,9 @@ bool OdeModelLoader::removeDegenerates(Trimesh * trimesh) const
             
             s_log << Log::debug('r')
                   << "Ignoring zero-area triangle. Coords: "
-                  << trimesh->vertex_data_[cur_face->v1_]
-                  << trimesh->vertex_data_[cur_face->v2_]
-                  << trimesh->vertex_data_[cur_face->v3_]
+                  << vertices[cur_face->v1_]
+                  << vertices[cur_face->v2_]
+                  << vertices[cur_face->v3_]
                   << "\n";
             s_log << Log::debug('r')
                   << "indices: "
@@ -394,7 +657,7 @@ bool OdeModelLoader::removeDegenerates(Trimesh * trimesh) const
                   << cur_face->v3_ << " "
                   << "\n";
             
-            cur_face = trimesh->index_data_.erase(cur_face);
+            cur_face = faces.erase(cur_face);
             
         } else ++cur_face;
     }
@@ -4,6 +4,7 @@
 #define BLUEBEARD_ODE_MODEL_LOADER_INCLUDED
 
 #include <string>
+#include <map>
 
 #include <loki/Singleton.h>
 
@@ -41,10 +42,18 @@ class OdeModelLoader
     virtual ~OdeModelLoader();
     
     OdeRigidBody * instantiateModel(OdeSimulator * simulator, const std::string & name);
-    
+    void prewarmBodyPool(OdeSimulator * simulator, const std::string & name, unsigned num_bodies);
+
+    bool cookTrimesh(const std::string & name);
     
  protected:
 
+    /// Blueprints by hash of their name. Names with the same hash
+    /// share a key.
+    typedef std::multimap<uint32_t, OdeModelInfo> BlueprintMap;
+    
+    const OdeRigidBody * getBlueprint(const std::string & name);
+
     OdeRigidBody * loadModel(const std::string & name);
 
     OdeGeom * loadShape (const std::string & name, TiXmlNode * shape_node);
@@ -59,10 +68,19 @@ class OdeModelLoader
     
     Material loadMaterial(TiXmlNode * shape_node);
 
-    bool removeDegenerates(Trimesh * trimesh) const;
+    void parseTrimesh(const std::string & name, TiXmlNode * trimesh_node,
+                      std::vector<Vector> & vertices,
+                      std::vector<TrimeshFace> & faces) const;
+    bool loadCookedTrimesh(const std::string & name,
+                           unsigned mesh_index,
+                           std::vector<Vector> & vertices,
+                           std::vector<TrimeshFace> & faces) const;
+
+    bool removeDegenerates(const std::vector<Vector> & vertices,
+                           std::vector<TrimeshFace> & faces) const;
 
     
-    std::vector<OdeModelInfo> info_;
+    BlueprintMap blueprint_;
 };
 
 
@@ -18,6 +18,8 @@ OdeRigidBody::OdeRigidBody() :
     below_water_(false),
     simulator_(NULL),
     mass_initialized_(false),
+    mass_adjusted_(false),
+    blueprint_(NULL),
     lifetime_(0),
     activation_points_(0),
     align_cog_(false),
@@ -394,6 +396,8 @@ void OdeRigidBody::setTotalMass(float m)
     dBodyGetMass(id_, &mass);
     dMassAdjust(&mass, m);
     dBodySetMass(id_, &mass);
+
+    mass_adjusted_ = true;
 }
 
 
@@ -490,6 +494,7 @@ OdeRigidBody * OdeRigidBody::instantiate(dBodyID id, OdeSimulator * simulator) c
     ret->activation_points_ = activation_points_;
     ret->align_cog_ = align_cog_;
     ret->client_side_only_ = client_side_only_;
+    ret->blueprint_ = blueprint_ ? blueprint_ : this;
 
     for (unsigned g=0; g<geom_.size(); ++g)
     {
@@ -519,6 +524,95 @@ OdeRigidBody * OdeRigidBody::instantiate(dBodyID id, OdeSimulator * simulator) c
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Returns the blueprint this body was instantiated from. Proxy
+ *  bodies, which are instantiated from another instance, return the
+ *  blueprint of that instance.
+ */
+const OdeRigidBody * OdeRigidBody::getBlueprint() const
+{
+    return blueprint_;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns whether recycle() can restore this body to its
+ *  instantiated state. This is not possible if geoms were deleted or
+ *  the mass was changed.
+ */
+bool OdeRigidBody::isRecyclable() const
+{
+    if (!blueprint_ || mass_adjusted_) return false;
+
+    unsigned num_geoms = 0;
+    for (unsigned g=0; g<blueprint_->geom_.size(); ++g)
+    {
+        if (!blueprint_->geom_[g]->isMassOnly()) ++num_geoms;
+    }
+
+    return num_geoms == geom_.size();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Called by the simulator when the body is put into its body
+ *  pool. Removes all geoms from their spaces and resets the body to
+ *  the state it had after instantiate(), so it can be handed out
+ *  again by OdeSimulator::instantiate.
+ */
+void OdeRigidBody::recycle()
+{
+    assert(isRecyclable());
+
+    unsigned g=0;
+    for (unsigned b=0; b<blueprint_->geom_.size(); ++b)
+    {
+        if (blueprint_->geom_[b]->isMassOnly()) continue;
+
+        geom_[g]->setSpace(NULL);
+        geom_[g]->recycle(blueprint_->geom_[b]);
+        ++g;
+    }
+
+    name_              = blueprint_->name_;
+    static_            = blueprint_->static_;
+    lifetime_          = blueprint_->lifetime_;
+    activation_points_ = blueprint_->activation_points_;
+    below_water_       = false;
+    user_data_         = NULL;
+
+    dQuaternion q = { 1.0f, 0.0f, 0.0f, 0.0f };
+    dBodySetQuaternion(id_, q);
+    dBodySetPosition  (id_, 0,0,0);
+    dBodySetLinearVel (id_, 0,0,0);
+    dBodySetAngularVel(id_, 0,0,0);
+    dBodySetForce     (id_, 0,0,0);
+    dBodySetTorque    (id_, 0,0,0);
+    dBodySetGravityMode(id_, 1);
+    dBodySetAutoDisableDefaults(id_);
+    dBodyDisable(id_);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Called by the simulator when the body is taken from the body pool
+ *  again. Like freshly instantiated bodies, the body starts out
+ *  sleeping in static space.
+ */
+void OdeRigidBody::reuse()
+{
+    for (unsigned g=0; g<geom_.size(); ++g)
+    {
+        geom_[g]->reuse();
+        if (!geom_[g]->isSensor()) geom_[g]->setSpace(simulator_->getStaticSpace());
+    }
+}
+
+
 //------------------------------------------------------------------------------
 void OdeRigidBody::addGeom(OdeGeom * geom)
 {
@@ -91,6 +91,11 @@ class OdeRigidBody
     OdeSimulator * getSimulator();
 
     OdeRigidBody * instantiate(dBodyID id, OdeSimulator * simulator) const;
+    const OdeRigidBody * getBlueprint() const;
+
+    bool isRecyclable() const;
+    void recycle();
+    void reuse();
 
     void addGeom(OdeGeom * geom);
 
@@ -149,6 +154,12 @@ class OdeRigidBody
     OdeSimulator * simulator_;
 
     bool mass_initialized_;
+    bool mass_adjusted_; ///< setTotalMass was called, the body cannot
+                         ///be recycled.
+
+    const OdeRigidBody * blueprint_; ///< The blueprint this body was
+                                     ///instantiated from, NULL for
+                                     ///blueprints.
 
     unsigned lifetime_;
     unsigned activation_points_;
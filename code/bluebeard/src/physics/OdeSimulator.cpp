@@ -79,6 +79,18 @@ OdeSimulator::~OdeSimulator()
     s_log << Log::debug('d')
           << "OdeSimulator destructor\n";
     
+    // Pooled bodies are not in body_. Hand them back so they are
+    // cleaned up below.
+    for (BodyPool::iterator it = body_pool_.begin(); it != body_pool_.end(); ++it)
+    {
+        for (unsigned b=0; b<it->second.size(); ++b)
+        {
+            it->second[b]->reuse();
+            body_.push_back(it->second[b]);
+        }
+    }
+    body_pool_.clear();
+    
     if (!body_.empty())
     {
         s_log << Log::debug('d')
@@ -236,13 +248,46 @@ void OdeSimulator::renderGeoms() const
 //------------------------------------------------------------------------------
 OdeRigidBody * OdeSimulator::instantiate(const OdeRigidBody * blueprint)
 {    
-    OdeRigidBody * ret = blueprint->instantiate(dBodyCreate(world_id_), this);
+    OdeRigidBody * ret = NULL;
+
+    BodyPool::iterator it = body_pool_.find(blueprint);
+    if (it != body_pool_.end() && !it->second.empty())
+    {
+        ret = it->second.back();
+        it->second.pop_back();
+        ret->reuse();
+    } else
+    {
+        ret = blueprint->instantiate(dBodyCreate(world_id_), this);
+    }
 
     body_.push_back(ret);
     
     return ret;
 }
 
+
+//------------------------------------------------------------------------------
+/**
+ *  To be used instead of deleting a body created with
+ *  instantiate(). If a pool exists for the body's blueprint, the body
+ *  is recycled and handed out again by the next call to
+ *  instantiate(). Otherwise, it is deleted.
+ */
+void OdeSimulator::releaseBody(OdeRigidBody * body)
+{
+    BodyPool::iterator it = body_pool_.find(body->getBlueprint());
+    if (it == body_pool_.end() || !body->isRecyclable())
+    {
+        delete body;
+        return;
+    }
+
+    removeBody(body);
+    body->recycle();
+    it->second.push_back(body);
+}
+
 //------------------------------------------------------------------------------
 /**
  *  Remove the body from the internal body list.
@@ -264,6 +309,33 @@ void OdeSimulator::removeBody(const OdeRigidBody * body)
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Enables pooling for bodies instantiated from blueprint and makes
+ *  sure the pool holds at least num_bodies bodies, so the first
+ *  num_bodies instantiations don't need to create any ODE objects.
+ */
+void OdeSimulator::prewarmBodyPool(const OdeRigidBody * blueprint, unsigned num_bodies)
+{
+    std::vector<OdeRigidBody*> & pool = body_pool_[blueprint];
+
+    while (pool.size() < num_bodies)
+    {
+        OdeRigidBody * body = blueprint->instantiate(dBodyCreate(world_id_), this);
+        body_.push_back(body);
+        
+        if (!body->isRecyclable())
+        {
+            body_pool_.erase(blueprint);
+            delete body;
+            return;
+        }
+
+        releaseBody(body);
+    }
+}
+
+
 //------------------------------------------------------------------------------
 /**
  *  A geom might be in both simulator's cur_colliding_geoms_ or
@@ -406,16 +478,19 @@ void OdeSimulator::handleBodyVelocities()
 
             cur_body->setGlobalLinearVel(v);
 
-            s_log << Log::debug('p')
-                  << "Capping linear velocity for "
-                  << cur_body->getName()
-                  << " which is at "
-                  << cur_body->getTransform().getTranslation()
-                  << " and belongs to ";
-
-            RigidBody * body = ((RigidBody*)cur_body->getUserData());
-            if (body) s_log << *body << "\n";
-            else      s_log << "No Body\n";
+            if (s_log.isDebugEnabled('p'))
+            {
+                s_log << Log::debug('p')
+                      << "Capping linear velocity for "
+                      << cur_body->getName()
+                      << " which is at "
+                      << cur_body->getTransform().getTranslation()
+                      << " and belongs to ";
+
+                RigidBody * body = ((RigidBody*)cur_body->getUserData());
+                if (body) s_log << *body << "\n";
+                else      s_log << "No Body\n";
+            }
         } else
         {
             // Apply velocity dampening
@@ -433,16 +508,19 @@ void OdeSimulator::handleBodyVelocities()
 
             cur_body->setLocalAngularVel(w);
 
-            s_log << Log::debug('p')
-                  << "Capping angular velocity for "
-                  << cur_body->getName()
-                  << " which is at "
-                  << cur_body->getTransform().getTranslation()
-                  << " and belongs to ";
-
-            RigidBody * body = ((RigidBody*)cur_body->getUserData());
-            if (body) s_log << *body << "\n";
-            else      s_log << "No Body\n";
+            if (s_log.isDebugEnabled('p'))
+            {
+                s_log << Log::debug('p')
+                      << "Capping angular velocity for "
+                      << cur_body->getName()
+                      << " which is at "
+                      << cur_body->getTransform().getTranslation()
+                      << " and belongs to ";
+
+                RigidBody * body = ((RigidBody*)cur_body->getUserData());
+                if (body) s_log << *body << "\n";
+                else      s_log << "No Body\n";
+            }
         } else
         {
             // Apply angular dampening
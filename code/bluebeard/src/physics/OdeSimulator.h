@@ -4,6 +4,7 @@
 #define BLUEBEARD_ODE_SIMULATOR_INCLUDED
 
 #include <list>
+#include <map>
 
 #include <ode/ode.h>
 
@@ -34,8 +35,11 @@ class OdeSimulator
     void renderGeoms() const;
 
     OdeRigidBody * instantiate(const OdeRigidBody * blueprint);
+    void releaseBody(OdeRigidBody * body);
     void removeBody(const OdeRigidBody * body);
 
+    void prewarmBodyPool(const OdeRigidBody * blueprint, unsigned num_bodies);
+
     void disableGeom(OdeGeom * geom);
     
     void addContinuousGeom(OdeContinuousGeom * g);
@@ -68,6 +72,11 @@ class OdeSimulator
     
     std::list<OdeRigidBody*> body_;
 
+    typedef std::map<const OdeRigidBody*, std::vector<OdeRigidBody*> > BodyPool;
+    BodyPool body_pool_; ///< Recycled bodies per blueprint. Only
+                         ///blueprints with an entry here are pooled,
+                         ///see prewarmBodyPool.
+
 
     uint32_t category_collide_flag_[32]; ///< For each category,
                                          ///stores categories it
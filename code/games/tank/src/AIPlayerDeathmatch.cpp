@@ -28,6 +28,7 @@ const float DELTA_YAW_FACTOR_THRESHOLD = 0.030f;
 //------------------------------------------------------------------------------
 AIPlayerDeathmatch::AIPlayerDeathmatch(PuppetMasterServer * puppet_master) :
     AIPlayer(puppet_master),
+    path_request_(INVALID_PATH_REQUEST),
     enemy_(NULL),
     stuck_dt_(0.0f),
     projectile_inital_velocity_(NULL),
@@ -99,7 +100,7 @@ void AIPlayerDeathmatch::handleLogic(float dt)
 
         // if the player has got no controllable delete waypoint
         // positions to goto, avoid going to old WP still in the queue
-        ai_target_positions_.clear();
+        clearPath();
 
         // check if player has team here (after loadLevel no team possible)
         GameLogicServerCommon * glsc = dynamic_cast<GameLogicServerCommon*>(puppet_master_->getGameLogic());
@@ -328,12 +329,17 @@ void AIPlayerDeathmatch::handleWaypoints(float dt, PlayerInput & input, Tank * t
     // if there are no positions to go to, calc new route
     if(ai_target_positions_.empty())
     {
+        // still waiting for the route
+        if(path_request_ != INVALID_PATH_REQUEST) return;
+
         WaypointSearchNode start, end;
 
         s_waypoint_manager_server.getNearestOpenWaypoint(tank->getPosition(), start.x_, start.z_);
         s_waypoint_manager_server.getRandomOpenWaypoint(end.x_, end.z_);       
 
-        ai_target_positions_ = s_waypoint_manager_server.findPath(&start, &end);
+        path_request_ = s_waypoint_manager_server.requestPath(start, end,
+                                                              PathCallback(this, &AIPlayerDeathmatch::onPathFound),
+                                                              &fp_group_);
     }
     else
     {
@@ -373,6 +379,25 @@ void AIPlayerDeathmatch::handleWaypoints(float dt, PlayerInput & input, Tank * t
     return;
 }
 
+//------------------------------------------------------------------------------
+void AIPlayerDeathmatch::onPathFound(const std::deque<WaypointServer*> & path)
+{
+    path_request_ = INVALID_PATH_REQUEST;
+    ai_target_positions_ = path;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Forgets the current route, including one still being searched for.
+ */
+void AIPlayerDeathmatch::clearPath()
+{
+    ai_target_positions_.clear();
+
+    s_waypoint_manager_server.cancelPathRequest(path_request_, &fp_group_);
+    path_request_ = INVALID_PATH_REQUEST;
+}
+
 //------------------------------------------------------------------------------
 void AIPlayerDeathmatch::handleHeal(float dt, PlayerInput & input, Tank * tank)
 {
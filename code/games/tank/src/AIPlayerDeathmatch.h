@@ -50,7 +50,11 @@ class AIPlayerDeathmatch : public AIPlayer
     virtual void getNearestEnemy(Tank * tank);
     virtual void onEnemyDestroyed();
 
+    void onPathFound(const std::deque<WaypointServer*> & path);
+    void clearPath();
+
     std::deque<WaypointServer*> ai_target_positions_;
+    hPathRequest path_request_; ///< The path being searched for, if any.
 
     Controllable * enemy_;
 
@@ -34,6 +34,7 @@ const float BALL_MOVEMENT_RANGE_SQR = 10.0f;
 //------------------------------------------------------------------------------
 AIPlayerSoccer::AIPlayerSoccer(PuppetMasterServer * puppet_master) :
     AIPlayer(puppet_master),
+    path_request_(INVALID_PATH_REQUEST),
     enemy_(NULL),
     stuck_dt_(0.0f),
     projectile_inital_velocity_(NULL),
@@ -107,7 +108,7 @@ void AIPlayerSoccer::handleLogic(float dt)
 
         // if the player has got no controllable delete waypoint
         // positions to goto, avoid going to old WP still in the queue
-        ai_target_positions_.clear();
+        clearPath();
 
         // check if player has team here (after loadLevel no team possible)
         GameLogicServerCommon * glsc = dynamic_cast<GameLogicServerCommon*>(puppet_master_->getGameLogic());
@@ -263,6 +264,9 @@ void AIPlayerSoccer::handleWaypoints(float dt, PlayerInput & input, Tank * tank)
     // if there are no positions to go to, calc new route
     if(ai_target_positions_.empty())
     {
+        // still waiting for the route
+        if(path_request_ != INVALID_PATH_REQUEST) return;
+
         WaypointSearchNode start, end;
 		s_waypoint_manager_server.getNearestOpenWaypoint(tank->getPosition(), start.x_, start.z_);
 		
@@ -282,7 +286,9 @@ void AIPlayerSoccer::handleWaypoints(float dt, PlayerInput & input, Tank * tank)
 			s_waypoint_manager_server.getNearestOpenWaypoint(enemy_goal_pos, end.x_, end.z_);       
 		}
 
-        ai_target_positions_ = s_waypoint_manager_server.findPath(&start, &end);
+        path_request_ = s_waypoint_manager_server.requestPath(start, end,
+                                                              PathCallback(this, &AIPlayerSoccer::onPathFound),
+                                                              &fp_group_);
     }
     else
     {
@@ -297,7 +303,7 @@ void AIPlayerSoccer::handleWaypoints(float dt, PlayerInput & input, Tank * tank)
 			// if ball moved to far, clear deque and find new path to ball
 			if(ball_moved_distance_sqr > BALL_MOVEMENT_RANGE_SQR)
 			{
-				ai_target_positions_.clear();
+				clearPath();
 				return;
 			}
 		}
@@ -341,6 +347,25 @@ void AIPlayerSoccer::handleWaypoints(float dt, PlayerInput & input, Tank * tank)
 
 }
 
+//------------------------------------------------------------------------------
+void AIPlayerSoccer::onPathFound(const std::deque<WaypointServer*> & path)
+{
+    path_request_ = INVALID_PATH_REQUEST;
+    ai_target_positions_ = path;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Forgets the current route, including one still being searched for.
+ */
+void AIPlayerSoccer::clearPath()
+{
+    ai_target_positions_.clear();
+
+    s_waypoint_manager_server.cancelPathRequest(path_request_, &fp_group_);
+    path_request_ = INVALID_PATH_REQUEST;
+}
+
 //------------------------------------------------------------------------------
 void AIPlayerSoccer::handleDragBall(float dt, PlayerInput & input, Tank * tank)
 {
@@ -354,14 +379,14 @@ void AIPlayerSoccer::handleDragBall(float dt, PlayerInput & input, Tank * tank)
 		if(distance_to_ball > (1.5*BALL_INSIDE_DRAG_RANGE))
 		{
 			state_ = APSS_IDLE;
-			ai_target_positions_.clear(); // make the bot find new ways
+			clearPath(); // make the bot find new ways
 			return;
 		}
 	}
 	else
 	{
 		state_ = APSS_IDLE;
-		ai_target_positions_.clear(); // make the bot find new ways
+		clearPath(); // make the bot find new ways
 		return;
 	}
 
@@ -56,7 +56,11 @@ class AIPlayerSoccer : public AIPlayer
     void getNearestEnemy(Tank * tank);
     void onEnemyDestroyed();
 
+    void onPathFound(const std::deque<WaypointServer*> & path);
+    void clearPath();
+
     std::deque<WaypointServer*> ai_target_positions_;
+    hPathRequest path_request_; ///< The path being searched for, if any.
 
     Controllable * enemy_;
 
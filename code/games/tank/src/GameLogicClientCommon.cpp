@@ -36,6 +36,7 @@
 #include "EffectManager.h"
 #include "ParameterManager.h"
 #include "TankVisual.h"
+#include "TankParameterSet.h"
 #include "WeaponSystem.h"
 #include "ReaderWriterBbm.h"
 #include "InputHandler.h"
@@ -379,6 +380,9 @@ void GameLogicClientCommon::loadLevel(const std::string & lvl_name)
         throw e;
     }
 
+    // parse tank, upgrade and equipment parameters up front
+    s_tank_parameter_sets.preload();
+
     respawn_input_blocked_ = false;
     
     s_log << Log::debug('i')
@@ -11,6 +11,7 @@
 #include "physics/OdeSimulator.h"
 #include "physics/OdeRigidBody.h"
 #include "physics/OdeCollisionSpace.h"
+#include "physics/OdeModelLoader.h"
 
 #include "GameState.h"
 #include "PlayerInput.h"
@@ -19,6 +20,7 @@
 #include "TankMine.h"
 #include "InstantHitWeapon.h"
 #include "Tank.h"
+#include "TankParameterSet.h"
 #include "WeaponSystem.h"
 #include "ParameterManager.h"
 #include "LevelData.h"
@@ -237,6 +239,9 @@ void GameLogicServerCommon::loadLevel(const std::string & name)
         throw e;
     }
 
+    // parse tank, upgrade and equipment parameters up front
+    s_tank_parameter_sets.preload();
+
     /// XXX fast fix to avoid client message flooding
     s_scheduler.addTask(PeriodicTaskCallback(this, &GameLogicServerCommon::decAnnoyingClientRequests),
                         DEC_ANNOYING_CLIENT_REQUEST_PERIOD,
@@ -277,6 +282,15 @@ void GameLogicServerCommon::loadLevel(const std::string & name)
     // pass ownership to gamestate
     puppet_master_->getGameState()->setTerrainData(td, CCCS_HEIGHTFIELD);
 
+    // Avoid creating ODE bodies for each shot during the game.
+    std::vector<std::string> pooled_models = s_params.get<std::vector<std::string> >("physics.body_pool.models");
+    for (unsigned m=0; m<pooled_models.size(); ++m)
+    {
+        s_ode_model_loader.prewarmBodyPool(puppet_master_->getGameState()->getSimulator(),
+                                           pooled_models[m],
+                                           s_params.get<unsigned>("physics.body_pool.prewarm_size"));
+    }
+
 
         
     for (std::vector<bbm::ObjectInfo>::const_iterator cur_object_desc = lvl_data.getObjectInfo().begin();
@@ -21,6 +21,7 @@
 #include "GameLogicServerCommon.h"
 #include "TankMine.h"
 #include "Water.h"
+#include "TerrainData.h"
 
 #ifndef DEDICATED_SERVER
 
@@ -83,12 +84,29 @@ void InstantHitWeapon::doRayTest(physics::OdeSimulator * sim)
     Matrix muzzle_trans;
     tank_->getMuzzleTransform(&muzzle_trans);
 
+    Vector pos = muzzle_trans.getTranslation();
+    Vector dir = -muzzle_trans.getZ();
+    
     ray_intersection_dist_ = s_params.get<float>(section_ + ".range");
+    hit_body_ = NULL;
+
+    // Query terrain directly and shorten the ray to the terrain hit,
+    // so ODE only needs to report closer objects.
+    const terrain::TerrainData * terrain_data = Tank::getTerrainData();
+    float terrain_dist;
+    if (terrain_data &&
+        terrain_data->intersectRay(pos, dir, ray_intersection_dist_, terrain_dist, &hit_normal_))
+    {
+        ray_intersection_dist_ = terrain_dist;
+        hit_rigid_body_type_   = "";
+        hit_player_            = UNASSIGNED_SYSTEM_ADDRESS;
+    }
+    
     physics::OdeRayGeom ray(ray_intersection_dist_);
-    ray.set(muzzle_trans.getTranslation(), -muzzle_trans.getZ());
+    ray.set(pos, dir);
 
-    hit_body_ = NULL;
-    sim->getStaticSpace()->collide(&ray, physics::CollisionCallback(this, &InstantHitWeapon::rayCollisionCallback));
+    sim->getStaticSpace()->collide(&ray, physics::CollisionCallback(this, &InstantHitWeapon::rayCollisionCallback),
+                                   terrain_data != NULL);
     sim->getActorSpace() ->collide(&ray, physics::CollisionCallback(this, &InstantHitWeapon::rayCollisionCallback));
 }
 
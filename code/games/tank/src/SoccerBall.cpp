@@ -12,6 +12,9 @@
 
 REGISTER_CLASS(GameObject, SoccerBall);
 
+/// The ball is what the game is about, it must never appear stale.
+const float SOCCER_BALL_NETWORK_IMPORTANCE = 4.0f;
+
 
 SoccerBall::SoccerBall() :
     rel_object_id_(INVALID_GAMEOBJECT_ID),
@@ -107,6 +110,13 @@ void SoccerBall::writeStateToBitstream (RakNet::BitStream & stream, unsigned typ
 }
 
 
+//------------------------------------------------------------------------------
+float SoccerBall::getNetworkImportance() const
+{
+    return SOCCER_BALL_NETWORK_IMPORTANCE;
+}
+
+
 //------------------------------------------------------------------------------
 void SoccerBall::readStateFromBitstream(RakNet::BitStream & stream, unsigned type, uint32_t timestamp)
 {
@@ -33,6 +33,8 @@ class SoccerBall : public RigidBody
 
     virtual void writeStateToBitstream (RakNet::BitStream & stream, unsigned type) const;
     virtual void readStateFromBitstream(RakNet::BitStream & stream, unsigned type, uint32_t timestamp);
+
+    virtual float getNetworkImportance() const;
     
  protected:
 
@@ -21,6 +21,7 @@
 #include "VariableWatcher.h"
 #include "NetworkCommand.h"
 #include "GameLogicServerCommon.h"
+#include "TankParameterSet.h"
 
 
 #include "Paths.h"
@@ -161,10 +162,12 @@ void Tank::frameMove(float dt)
     
     if (location_ == CL_SERVER_SIDE)
     {
+        static ParameterHandle<float> heal_velocity_threshold("server.logic.tank_heal_velocity_threshold");
+        
         /// heal logic
         if (!firing &&
-            params_.get<bool>("tank.heal_skill") &&
-            getGlobalLinearVel().length() < s_params.get<float>("server.logic.tank_heal_velocity_threshold") &&
+            heal_skill_.get() &&
+            getGlobalLinearVel().length() < heal_velocity_threshold.get() &&
             getOwner() != UNASSIGNED_SYSTEM_ADDRESS)
         {
             startHealing();
@@ -296,7 +299,7 @@ void Tank::handleProxyInterpolation()
 {
     Controllable::handleProxyInterpolation();
 
-    float turret_proxy_interpolation_factor = params_.get<float>("tank.turret_proxy_interpolation_factor");
+    float turret_proxy_interpolation_factor = turret_proxy_interpolation_factor_.get();
 
     if (is_locally_controlled_ && doing_stabilization_)
     {
@@ -459,14 +462,15 @@ bool Tank::pickupObject(RigidBody * object)
         Vector docking_pos = target_object_->getPosition() + target_object_->vecToWorld(docking_offset);
         Vector ab = docking_pos - tank_pos;
 
-        pickup_los_given_ = true;
+        pickup_los_given_ = !(terrain_data_ && terrain_data_->isOccluded(tank_pos, docking_pos));
     
         physics::OdeRayGeom ray(ab.length());
         ray.set(tank_pos, ab);
-        target_object_->getSimulator()->getStaticSpace()->collide(
-            &ray, physics::CollisionCallback(this, &Tank::pickupRayCollisionCallback));
         if (pickup_los_given_)
         {
+            target_object_->getSimulator()->getStaticSpace()->collide(
+                &ray, physics::CollisionCallback(this, &Tank::pickupRayCollisionCallback),
+                terrain_data_ != NULL);
             target_object_->getSimulator()->getActorSpace()->collide(
                 &ray, physics::CollisionCallback(this, &Tank::pickupRayCollisionCallback));
         }
@@ -539,8 +543,9 @@ void Tank::dropObject()
 //------------------------------------------------------------------------------
 void Tank::applyRecoil(const Vector & force, const Vector & pos)
 {
+    static ParameterHandle<float> fps("physics.fps");
     target_object_->addGlobalForceAtGlobalPos(
-        force*s_params.get<float>("physics.fps"),
+        force*fps.get(),
         pos);
 
     turret_stabilization_enabled_ = false;
@@ -598,7 +603,7 @@ void Tank::setHasRamUpgrade(bool b)
 //------------------------------------------------------------------------------
 bool Tank::hasRamUpgrade() const
 {
-    return params_.get<bool>("tank.ram_upgrade");
+    return ram_upgrade_.get();
 }
 
 
@@ -628,14 +633,24 @@ const LocalParameters & Tank::getParams() const
 }
 
 //------------------------------------------------------------------------------
+/**
+ *  Applies the specified parameter set to this tank. The set is taken
+ *  from s_tank_parameter_sets, so the xml is parsed only once per
+ *  level.
+ */
 void Tank::loadParameters(const std::string & filename, const std::string & super_section)
 {
-    ParameterLoadCallback callback(this, &Tank::parameterLoadCallback);
-
     try
     {
+        const TankParameterSet & set = s_tank_parameter_sets.get(filename, super_section);
+        params_.merge(set.getParams(), set.getConsoleKeys());
+
+        const TankParameterSet::EntryContainer & entries = set.getEntries();
+        for (unsigned i=0; i<entries.size(); ++i)
+        {
+            parameterLoadCallback(entries[i].first, entries[i].second);
+        }
         
-        params_.loadParameters(filename, super_section, &callback);
         setCollisionDamageParameters(params_.get<float>("tank.collision_damage_speed_threshold"),
                                      params_.get<float>("tank.collision_min_damage"),
                                      params_.get<float>("tank.collision_max_damage"));
@@ -763,6 +778,12 @@ Tank::Tank() :
     turret_stabilization_enabled_(true),
     doing_stabilization_(true),
     beacon_action_executed_(false),
+    heal_skill_                       ("tank.heal_skill",                        &params_),
+    ram_upgrade_                      ("tank.ram_upgrade",                       &params_),
+    turret_proxy_interpolation_factor_("tank.turret_proxy_interpolation_factor", &params_),
+    aloft_ang_dampening_              ("tank.aloft_ang_dampening",               &params_),
+    aloft_lin_dampening_              ("tank.aloft_lin_dampening",               &params_),
+    drag_point_offset_                ("tank.drag_point_offset",                 &params_),
     max_speed_(0.0f),
     boost_activated_(false),
     prev_max_speed_(0.0f),
@@ -810,6 +831,12 @@ Tank::Tank(const Tank & other, physics::OdeSimulator * sim) :
     turret_stabilization_enabled_(other.turret_stabilization_enabled_),
     doing_stabilization_(other.doing_stabilization_),
     beacon_action_executed_(false),
+    heal_skill_                       ("tank.heal_skill",                        &params_),
+    ram_upgrade_                      ("tank.ram_upgrade",                       &params_),
+    turret_proxy_interpolation_factor_("tank.turret_proxy_interpolation_factor", &params_),
+    aloft_ang_dampening_              ("tank.aloft_ang_dampening",               &params_),
+    aloft_lin_dampening_              ("tank.aloft_lin_dampening",               &params_),
+    drag_point_offset_                ("tank.drag_point_offset",                 &params_),
 
     max_speed_(0.0f),
 
@@ -1009,12 +1036,12 @@ void Tank::frameMoveTires(float dt)
     contact.surface.slip2 = abs(dir_vel) * force_dependent_slip_;
 
     
+    doTerrainWheelCollisions(tank_transform, true);
+    
     for (unsigned w=0; w<wheel_.size(); ++w)
     {
         bool braking = is_braking_ || (wheel_[w].handbraked_ && input_.action2_);
 
-        doTerrainWheelCollision(wheel_[w], tank_transform, true);
-
         if (wheel_[w].collision_info_.penetration_ != 0.0f)
         {
             contact.surface.mu2 = (braking ? static_mu_lat_brake_ : static_mu_lat_) * inv_gravity_;
@@ -1241,15 +1268,15 @@ void Tank::handleExtraDampening()
     // Apply angular dampening
     Vector w = target_object_->getLocalAngularVel();
     w = target_object_->getInertiaTensor().transformVector(w);
-    target_object_->addLocalTorque(-params_.get<float>("tank.aloft_ang_dampening") * w);
+    target_object_->addLocalTorque(-aloft_ang_dampening_.get() * w);
 
 
     // Apply linear dampening to get nose down while flying
     Vector p = target_object_->getCog();
-    p.z_ += params_.get<float>("tank.drag_point_offset");
+    p.z_ += drag_point_offset_.get();
     
     Vector v = target_object_->getLocalLinearVel();
-    target_object_->addLocalForceAtLocalPos(-v*params_.get<float>("tank.aloft_lin_dampening"), p);
+    target_object_->addLocalForceAtLocalPos(-v*aloft_lin_dampening_.get(), p);
 }
 
 
@@ -1267,14 +1294,16 @@ void Tank::enableStabilization(void*)
 
 //------------------------------------------------------------------------------
 /**
- *  Used as substitute for "event-driven" parameter loading
+ *  Used as substitute for "event-driven" parameter loading. Called
+ *  for every entry of a parameter set in file order, after the whole
+ *  set has been merged into params_, so only value may be used here.
  */
 void Tank::parameterLoadCallback(const std::string & key,
                                  const std::string & value)
 {
     if (key == "tank.weapon_slot" && getLocation() != CL_REPLAY_SIM)
     {
-        std::vector<std::string> slot_info = params_.get<std::vector<std::string> >(key);
+        std::vector<std::string> slot_info = fromString<std::vector<std::string> >(value);
 
         if (slot_info.size() != 3)
         {
@@ -1334,10 +1363,10 @@ void Tank::parameterLoadCallback(const std::string & key,
         
     } else if (key == "tank.delta_max_speed")
     {
-        max_speed_ += params_.get<float>(key);
+        max_speed_ += fromString<float>(value);
     } else if (key == "tank.delta_max_hitpoints")
     {
-        int delta = params_.get<int>(key);
+        int delta = fromString<int>(value);
         max_hitpoints_ += delta;
         setHitpoints(max_hitpoints_);
     }
@@ -1345,15 +1374,39 @@ void Tank::parameterLoadCallback(const std::string & key,
 
 
 //------------------------------------------------------------------------------
-void Tank::doTerrainWheelCollision(Wheel & wheel, const Matrix & tank_transform, bool bicubic)
+/**
+ *  Collides the rays of all wheels with the terrain, sampling the
+ *  terrain for several wheels at once.
+ */
+void Tank::doTerrainWheelCollisions(const Matrix & tank_transform, bool bicubic)
 {
-    terrain_data_->collideRay(wheel.collision_info_,
-                              tank_transform.transformPoint(wheel.pos_),
-                              tank_transform.getY(),
-                              wheel.prev_penetration_,
-                              bicubic);    
+    const unsigned MAX_BATCH_SIZE = 8;
 
-    wheel.prev_penetration_ = wheel.collision_info_.penetration_;
+    physics::CollisionInfo * info[MAX_BATCH_SIZE];
+    Vector tip[MAX_BATCH_SIZE];
+    float prev_penetration[MAX_BATCH_SIZE];
+
+    Vector up = tank_transform.getY();
+    
+    for (unsigned w0=0; w0<wheel_.size(); w0+=MAX_BATCH_SIZE)
+    {
+        unsigned batch_size = std::min(MAX_BATCH_SIZE, (unsigned)wheel_.size()-w0);
+
+        for (unsigned i=0; i<batch_size; ++i)
+        {
+            Wheel & wheel = wheel_[w0+i];
+            info[i]             = &wheel.collision_info_;
+            tip[i]              = tank_transform.transformPoint(wheel.pos_);
+            prev_penetration[i] = wheel.prev_penetration_;
+        }
+
+        terrain_data_->collideRays(batch_size, info, tip, up, prev_penetration, bicubic);
+
+        for (unsigned i=0; i<batch_size; ++i)
+        {
+            wheel_[w0+i].prev_penetration_ = wheel_[w0+i].collision_info_.penetration_;
+        }
+    }
 }
 
 
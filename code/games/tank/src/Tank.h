@@ -154,7 +154,7 @@ class Tank : public Controllable, public HitpointTracker
                                const std::string & value);
 
 
-    void doTerrainWheelCollision(Wheel & wheel, const Matrix & tank_transform, bool bicubic);
+    void doTerrainWheelCollisions(const Matrix & tank_transform, bool bicubic);
 
     bool pickupRayCollisionCallback(const physics::CollisionInfo & info);
 
@@ -199,6 +199,13 @@ class Tank : public Controllable, public HitpointTracker
 
     bool beacon_action_executed_;
 
+    // Accessed every frame
+    ParameterHandle<bool>  heal_skill_;
+    ParameterHandle<bool>  ram_upgrade_;
+    ParameterHandle<float> turret_proxy_interpolation_factor_;
+    ParameterHandle<float> aloft_ang_dampening_;
+    ParameterHandle<float> aloft_lin_dampening_;
+    ParameterHandle<float> drag_point_offset_;
 
     // ---------- Cached Parameters ----------
 
@@ -0,0 +1,172 @@
+
+#include "TankParameterSet.h"
+
+#include "TinyXmlUtils.h"
+#include "Paths.h"
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Loads the sections below handle, see ParameterManager::load().
+ */
+void TankParameterSet::load(const TiXmlHandle & handle)
+{
+    ParameterLoadCallback callback(this, &TankParameterSet::loadCallback);
+
+    params_.load(handle, &callback, &console_keys_);
+}
+
+
+//------------------------------------------------------------------------------
+const LocalParameters & TankParameterSet::getParams() const
+{
+    return params_;
+}
+
+//------------------------------------------------------------------------------
+const TankParameterSet::EntryContainer & TankParameterSet::getEntries() const
+{
+    return entries_;
+}
+
+//------------------------------------------------------------------------------
+const std::vector<std::string> & TankParameterSet::getConsoleKeys() const
+{
+    return console_keys_;
+}
+
+
+//------------------------------------------------------------------------------
+void TankParameterSet::loadCallback(const std::string & key, const std::string & value)
+{
+    entries_.push_back(std::make_pair(key, value));
+}
+
+
+
+//------------------------------------------------------------------------------
+TankParameterSetTable::TankParameterSetTable()
+{
+}
+
+//------------------------------------------------------------------------------
+TankParameterSetTable::~TankParameterSetTable()
+{
+    clear();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Parses all config files tanks can load parameters from. Called on
+ *  level load so changes to the files are picked up between levels.
+ */
+void TankParameterSetTable::preload()
+{
+    clear();
+    
+    loadFile(CONFIG_PATH + "tanks.xml");
+    loadFile(CONFIG_PATH + "upgrades.xml");
+    loadFile(CONFIG_PATH + "equipment.xml");
+}
+
+//------------------------------------------------------------------------------
+void TankParameterSetTable::clear()
+{
+    for (SetMap::iterator it = set_.begin(); it != set_.end(); ++it)
+    {
+        delete it->second;
+    }
+
+    set_.clear();
+    loaded_file_.clear();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the parameters of the specified super section, or the
+ *  parameters outside any super section if super_section is
+ *  empty. Files which weren't preloaded are parsed on first access.
+ *
+ *  If the super section doesn't exist, an error is logged and an
+ *  empty set is returned.
+ */
+const TankParameterSet & TankParameterSetTable::get(const std::string & filename,
+                                                    const std::string & super_section)
+{
+    if (loaded_file_.find(filename) == loaded_file_.end()) loadFile(filename);
+
+    SetMap::const_iterator it = set_.find(std::make_pair(filename, super_section));
+    if (it != set_.end()) return *it->second;
+
+    s_log << Log::error
+          << "Could not find supersection "
+          << super_section
+          << " in file "
+          << filename
+          << ".\n";
+
+    // Remember the empty set so the error is reported only once.
+    TankParameterSet * empty_set = new TankParameterSet;
+    set_[std::make_pair(filename, super_section)] = empty_set;
+    return *empty_set;
+}
+
+
+//------------------------------------------------------------------------------
+void TankParameterSetTable::loadFile(const std::string & filename)
+{
+    using namespace tinyxml_utils;
+
+    loaded_file_.insert(filename);
+    
+    TiXmlDocument xml_doc;
+    TiXmlHandle root_handle = getRootHandle(filename, xml_doc);
+
+    loadSet(filename, "", root_handle);
+        
+    for (TiXmlElement * cur_super_section = root_handle.FirstChild("super_section").Element();
+         cur_super_section;
+         cur_super_section = cur_super_section->NextSiblingElement("super_section"))
+    {
+        loadSet(filename, getAttributeString(cur_super_section, "name"), cur_super_section);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void TankParameterSetTable::loadSet(const std::string & filename,
+                                    const std::string & super_section,
+                                    const TiXmlHandle & handle)
+{
+    TankParameterSet *& set = set_[std::make_pair(filename, super_section)];
+    if (set)
+    {
+        s_log << Log::error
+              << "Super section "
+              << super_section
+              << " exists twice in "
+              << filename
+              << "\n";
+        return;
+    }
+
+    set = new TankParameterSet;
+    try
+    {
+        set->load(handle);
+    } catch (MalformedEntryException & e)
+    {
+        s_log << Log::error
+              << "Malformed entry in TankParameterSetTable::loadSet("
+              << filename
+              << ", "
+              << super_section
+              << ")\n";
+    } catch (Exception & e)
+    {
+        e.addHistory("TankParameterSetTable::loadSet(" + filename + ", " + super_section + ")");
+        throw e;
+    }
+}
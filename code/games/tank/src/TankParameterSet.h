@@ -0,0 +1,73 @@
+
+#ifndef TANKGAME_TANK_PARAMETER_SET_INCLUDED
+#define TANKGAME_TANK_PARAMETER_SET_INCLUDED
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "Singleton.h"
+#include "ParameterManager.h"
+
+
+//------------------------------------------------------------------------------
+/**
+ *  The parameters of one super section of a tank config file
+ *  (tanks.xml, upgrades.xml, equipment.xml), parsed once and applied
+ *  to tanks with LocalParameters::merge() afterwards.
+ */
+class TankParameterSet
+{
+ public:
+    typedef std::vector<std::pair<std::string, std::string> > EntryContainer;
+    
+    void load(const TiXmlHandle & handle);
+
+    const LocalParameters & getParams() const;
+    const EntryContainer & getEntries() const;
+    const std::vector<std::string> & getConsoleKeys() const;
+    
+ protected:
+    void loadCallback(const std::string & key, const std::string & value);
+    
+    LocalParameters params_;
+    EntryContainer entries_; ///< key / value pairs in file order, to
+                             ///be passed to ParameterLoadCallbacks.
+    std::vector<std::string> console_keys_;
+};
+
+
+#define s_tank_parameter_sets Loki::SingletonHolder<TankParameterSetTable, Loki::CreateUsingNew, SingletonDefaultLifetime >::Instance()
+//------------------------------------------------------------------------------
+/**
+ *  Holds a TankParameterSet for every super section of the tank
+ *  config files, so upgrades and equipment changes don't hit the xml
+ *  parser during a match. Rebuilt on every level load.
+ */
+class TankParameterSetTable
+{
+    DECLARE_SINGLETON(TankParameterSetTable);
+ public:
+    virtual ~TankParameterSetTable();
+
+    void preload();
+    void clear();
+    
+    const TankParameterSet & get(const std::string & filename, const std::string & super_section);
+    
+ protected:
+    void loadFile(const std::string & filename);
+    void loadSet(const std::string & filename,
+                 const std::string & super_section,
+                 const TiXmlHandle & handle);
+
+    typedef std::map<std::pair<std::string, std::string>, TankParameterSet*> SetMap;
+    SetMap set_;
+
+    std::set<std::string> loaded_file_;
+};
+
+
+#endif
@@ -5,11 +5,15 @@
 #include "Log.h"
 #include "Beacon.h"
 #include "physics/OdeCollisionSpace.h"
+#include "TerrainData.h"
+#include "GameState.h"
+#include "physics/OdeSimulator.h"
 
 
 //------------------------------------------------------------------------------
-BeaconBoundary::BeaconBoundary(physics::OdeCollisionSpace * world_space) :
-    world_space_(world_space),
+BeaconBoundary::BeaconBoundary(GameState * game_state) :
+    game_state_(game_state),
+    world_space_(game_state->getSimulator()->getStaticSpace()),
     beacon_space_(new physics::OdeCollisionSpace("beacon", false))
 {
 }
@@ -105,12 +109,20 @@ bool BeaconBoundary::checkLos(const Beacon * b1, const Vector & pos)
     {
         dir /= len;
 
+        Vector start = b1->getPosition() + beacon_body_radius*dir;
+
+        // Terrain is the most common occluder, test it without
+        // going through ODE first.
+        const terrain::TerrainData * terrain_data = game_state_->getTerrainData();
+        if (terrain_data && terrain_data->isOccluded(start, pos - beacon_body_radius*dir)) return false;
+        
         physics::OdeRayGeom ray(len);
-        ray.set(b1->getPosition() + beacon_body_radius*dir, dir);
+        ray.set(start, dir);
 
         // Sets is_los_ to false in case of collision
         world_space_->collide(
-            &ray, physics::CollisionCallback(this, &BeaconBoundary::losCollisionCallback));
+            &ray, physics::CollisionCallback(this, &BeaconBoundary::losCollisionCallback),
+            terrain_data != NULL);
     }
 
     return is_los_;
@@ -16,6 +16,7 @@ namespace physics
 
 class Beacon;
 class Observable;
+class GameState;
 
 
 //------------------------------------------------------------------------------
@@ -25,7 +26,7 @@ class BeaconBoundary
 
     typedef std::vector<Beacon*> BeaconContainer;
     
-    BeaconBoundary(physics::OdeCollisionSpace * world_space);
+    BeaconBoundary(GameState * game_state);
     virtual ~BeaconBoundary();
 
     void addBeacon   (Beacon * beacon);
@@ -45,6 +46,7 @@ class BeaconBoundary
     bool checkLos(const Beacon * b1, const Vector & pos);
     bool losCollisionCallback(const physics::CollisionInfo & info);
     
+    GameState * game_state_; ///< Provides the terrain for LOS tests.
     physics::OdeCollisionSpace * world_space_;
     std::auto_ptr<physics::OdeCollisionSpace> beacon_space_;
     
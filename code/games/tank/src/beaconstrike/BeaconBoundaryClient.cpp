@@ -131,9 +131,9 @@ protected:
 
 
 //------------------------------------------------------------------------------
-BeaconBoundaryClient::BeaconBoundaryClient(physics::OdeCollisionSpace * world_space,
+BeaconBoundaryClient::BeaconBoundaryClient(GameState * game_state,
                                            const std::string & tex_file) :
-    BeaconBoundary(world_space),
+    BeaconBoundary(game_state),
     update_outline_(true),
     draw_los_hints_(false)
 {
@@ -65,7 +65,7 @@ class BeaconBoundaryClient : public BeaconBoundary
 {
  public:
 
-    BeaconBoundaryClient(physics::OdeCollisionSpace * world_space,
+    BeaconBoundaryClient(GameState * game_state,
                          const std::string & tex_file);
     virtual ~BeaconBoundaryClient();
 
@@ -1,15 +1,19 @@
 
 #include "BeaconBoundaryServer.h"
 
+#include <algorithm>
+
 
 #include "Log.h"
 #include "Beacon.h"
 #include "physics/OdeCollisionSpace.h"
 #include "Profiler.h"
+#include "utility_Math.h"
 
 //------------------------------------------------------------------------------
-BeaconBoundaryServer::BeaconBoundaryServer(physics::OdeCollisionSpace * world_space) :
-    BeaconBoundary(world_space)
+BeaconBoundaryServer::BeaconBoundaryServer(GameState * game_state) :
+    BeaconBoundary(game_state),
+    activation_dirty_(true)
 {
     s_log << Log::debug('i')
           << "BeaconBoundaryServer constructor\n";
@@ -28,46 +32,89 @@ BeaconBoundaryServer::~BeaconBoundaryServer()
 
 
 //------------------------------------------------------------------------------
+/**
+ *  Updates neighborhood information for beacons which were added,
+ *  moved, changed their deployed state or team since the last call,
+ *  and redoes activation spreading if this changed any connections.
+ */
 void BeaconBoundaryServer::update()
 {
     PROFILE(BeaconBoundaryServer::update);
     s_log << Log::debug('l')
           << "BeaconBoundaryServer::update\n";
 
-    // Recalculate neighborhood information
+    // Find beacons whose neighbors must be recalculated and place
+    // their geoms.
+    std::vector<Beacon*> changed_beacon;
     for (BeaconContainer::iterator it = beacon_.begin();
          it != beacon_.end();
          ++it)
     {
-        (*it)->clearNeighbors();
+        NeighborState & state = neighbor_state_[*it];
+
+        bool fixed = (*it)->getState() == BS_FIXED;
+        if (state.fixed_ != fixed)
+        {
+            state.fixed_ = fixed;
+            activation_dirty_ = true;
+        }
+        
+        Vector pos = (*it)->getPosition();
+        if (!state.new_                                  &&
+            equalsZero((pos - state.pos_).lengthSqr())   &&
+            state.deployed_ == (*it)->isDeployed()       &&
+            state.team_id_  == (*it)->getTeamId()) continue;
+
+        // Activation spreads only through deployed beacons of the
+        // same team, so it must be redone even if the neighbors stay
+        // the same.
+        if (state.new_ ||
+            state.deployed_ != (*it)->isDeployed() ||
+            state.team_id_  != (*it)->getTeamId())
+        {
+            activation_dirty_ = true;
+        }
+        
+        state.new_      = false;
+        state.pos_      = pos;
+        state.deployed_ = (*it)->isDeployed();
+        state.team_id_  = (*it)->getTeamId();
+
         (*it)->placeGeoms();
+        changed_beacon.push_back(*it);
     }
-    beacon_space_->collide();
-
 
-    // Activate fixed beacon, use activation spreading information for
-    // beacon connections.
-    connected_beacons_.clear();
-    std::set<Beacon*> active_beacons;
-    for (BeaconContainer::iterator it = beacon_.begin();
-         it != beacon_.end();
-         ++it)
+    if (!changed_beacon.empty())
     {
-        if ((*it)->getState() == BS_FIXED)
+        // Remember old neighbors to see whether any connections
+        // actually changed.
+        std::vector<std::vector<Beacon*> > prev_neighbor(changed_beacon.size());
+        for (unsigned b=0; b<changed_beacon.size(); ++b)
         {
-            setBeaconInsideRadius(*it, active_beacons);
+            prev_neighbor[b] = changed_beacon[b]->getNeighbor();
+            std::sort(prev_neighbor[b].begin(), prev_neighbor[b].end());
         }
-    }
 
-    // Now traverse all beacons which have not been set to active and
-    // set them to inactive.
-    for (unsigned i=0; i<beacon_.size(); ++i)
-    {
-        if (active_beacons.find(beacon_[i]) == active_beacons.end())
+        for (unsigned b=0; b<changed_beacon.size(); ++b)
         {
-            beacon_[i]->setInsideRadius(false);
+            removeNeighbors(changed_beacon[b]);
+        }
+
+        for (unsigned b=0; b<changed_beacon.size(); ++b)
+        {
+            addNeighbors(changed_beacon[b]);
+        }
+
+        for (unsigned b=0; b<changed_beacon.size() && !activation_dirty_; ++b)
+        {
+            std::vector<Beacon*> cur_neighbor = changed_beacon[b]->getNeighbor();
+            std::sort(cur_neighbor.begin(), cur_neighbor.end());
+
+            if (cur_neighbor != prev_neighbor[b]) activation_dirty_ = true;
         }
     }
+
+    if (activation_dirty_) updateActivation();
 }
 
 //------------------------------------------------------------------------------
@@ -98,36 +145,90 @@ const std::vector<std::pair<uint16_t, uint16_t> > & BeaconBoundaryServer::getCon
 //------------------------------------------------------------------------------
 void BeaconBoundaryServer::onBeaconAdded(Beacon * beacon)
 {
-    beacon->getBodyGeom()->setCollisionCallback(
-        physics::CollisionCallback(this, &BeaconBoundaryServer::beaconBodyCollisionCallback) );
+    neighbor_state_[beacon] = NeighborState();
+}
+
+//------------------------------------------------------------------------------
+void BeaconBoundaryServer::onBeaconDeleted(Beacon * beacon)
+{
+    removeNeighbors(beacon);
+    neighbor_state_.erase(beacon);
+
+    activation_dirty_ = true;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Removes all connections of the given beacon, from both sides.
+ */
+void BeaconBoundaryServer::removeNeighbors(Beacon * beacon)
+{
+    std::vector<Beacon*> & neighbor = beacon->getNeighbor();
+    for (unsigned n=0; n<neighbor.size(); ++n)
+    {
+        std::vector<Beacon*> & other_neighbor = neighbor[n]->getNeighbor();
+        other_neighbor.erase(std::remove(other_neighbor.begin(), other_neighbor.end(), beacon),
+                             other_neighbor.end());
+    }
+
+    beacon->clearNeighbors();
 }
 
+
+//------------------------------------------------------------------------------
+/**
+ *  Collides the geoms of the given beacon against the beacon space to
+ *  find its neighbors. Only the pairs involving this beacon are
+ *  tested, instead of colliding the entire space.
+ */
+void BeaconBoundaryServer::addNeighbors(Beacon * beacon)
+{
+    physics::CollisionCallback callback(this, &BeaconBoundaryServer::neighborCollisionCallback);
+    
+    beacon_space_->collide(beacon->getBodyGeom(),   callback);
+    beacon_space_->collide(beacon->getRadiusGeom(), callback);
+}
+
+
 //------------------------------------------------------------------------------
 /**
  *  This keeps track of beacon neighboring state. If a beacon radius
  *  collides with a beacon body, mark the two as neighbors.
  */
-bool BeaconBoundaryServer::beaconBodyCollisionCallback(const physics::CollisionInfo & info)
+bool BeaconBoundaryServer::neighborCollisionCallback(const physics::CollisionInfo & info)
 {
-    if (info.type_ == physics::CT_STOP) return false;
-
-    Beacon * beacon       = (Beacon*)                         info.this_geom_ ->getUserData();
+    Beacon * beacon       = dynamic_cast<Beacon*>((RigidBody*)info.this_geom_ ->getUserData());
     Beacon * other_beacon = dynamic_cast<Beacon*>((RigidBody*)info.other_geom_->getUserData());
+    assert(beacon && other_beacon);
+
+    if (beacon == other_beacon) return false;
 
+    // We need a body / radius pair, find out which beacon's body is
+    // involved.
+    bool this_is_body  = info.this_geom_  == beacon      ->getBodyGeom();
+    bool other_is_body = info.other_geom_ == other_beacon->getBodyGeom();
+    if (this_is_body == other_is_body) return false;
+
+    Beacon * body_beacon   = this_is_body ? beacon : other_beacon;
+    Beacon * radius_beacon = this_is_body ? other_beacon : beacon;
+    
     // Count collisions only once
-    if (beacon < other_beacon) return false;
+    if (body_beacon < radius_beacon) return false;
 
     if (beacon->getTeamId() != other_beacon->getTeamId()) return false;
 
     // At least one beacon must be deployed
     if (!beacon->isDeployed() && !other_beacon->isDeployed()) return false;
 
-    // bail if colliding against other body
-    if (other_beacon->getBodyGeom() == info.other_geom_) return false;
+    // Both beacons may have been changed in this update, don't
+    // connect them twice.
+    std::vector<Beacon*> & neighbor = beacon->getNeighbor();
+    if (std::find(neighbor.begin(), neighbor.end(), other_beacon) != neighbor.end()) return false;
     
     // Beacons of same team: check whether LOS is given. If so,
     // add to neighboring list.
-    if (checkLos(beacon, other_beacon->getPosition()))
+    if (checkLos(body_beacon, radius_beacon->getPosition()))
     {        
         beacon->addNeighbor(other_beacon);
         other_beacon->addNeighbor(beacon);
@@ -153,6 +254,38 @@ bool BeaconBoundaryServer::areaTestCollisionCallback(const physics::CollisionInf
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Activate fixed beacons, use activation spreading information for
+ *  beacon connections.
+ */
+void BeaconBoundaryServer::updateActivation()
+{
+    activation_dirty_ = false;
+    
+    connected_beacons_.clear();
+    std::set<Beacon*> active_beacons;
+    for (BeaconContainer::iterator it = beacon_.begin();
+         it != beacon_.end();
+         ++it)
+    {
+        if ((*it)->getState() == BS_FIXED)
+        {
+            setBeaconInsideRadius(*it, active_beacons);
+        }
+    }
+
+    // Now traverse all beacons which have not been set to active and
+    // set them to inactive.
+    for (unsigned i=0; i<beacon_.size(); ++i)
+    {
+        if (active_beacons.find(beacon_[i]) == active_beacons.end())
+        {
+            beacon_[i]->setInsideRadius(false);
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 void BeaconBoundaryServer::setBeaconInsideRadius(Beacon * b,
                                                  std::set<Beacon*> & beacons_inside)
@@ -4,7 +4,9 @@
 
 #include <vector>
 #include <set>
+#include <map>
 
+#include "Vector.h"
 #include "Vector2d.h"
 #include "physics/OdeCollision.h"
 #include "BeaconBoundary.h"
@@ -27,7 +29,7 @@ class Observable;
 class BeaconBoundaryServer : public BeaconBoundary
 {
  public:
-    BeaconBoundaryServer(physics::OdeCollisionSpace * world_space);
+    BeaconBoundaryServer(GameState * game_state);
     virtual ~BeaconBoundaryServer();
 
     void update();
@@ -38,18 +40,39 @@ class BeaconBoundaryServer : public BeaconBoundary
     
  protected:
 
-    virtual void onBeaconAdded(Beacon * beacon);
+    /// The state a beacon's neighbors were last determined with.
+    struct NeighborState
+    {
+        NeighborState() : new_(true), deployed_(false), fixed_(false), team_id_(INVALID_TEAM_ID) {}
+        
+        bool new_;
+        Vector pos_;
+        bool deployed_;
+        bool fixed_;
+        TEAM_ID team_id_;
+    };
     
-    bool beaconBodyCollisionCallback  (const physics::CollisionInfo & info);
+    virtual void onBeaconAdded  (Beacon * beacon);
+    virtual void onBeaconDeleted(Beacon * beacon);
+
+    void removeNeighbors(Beacon * beacon);
+    void addNeighbors(Beacon * beacon);
+    
+    bool neighborCollisionCallback  (const physics::CollisionInfo & info);
 
     bool areaTestCollisionCallback  (const physics::CollisionInfo & info);
 
+    void updateActivation();
     void setBeaconInsideRadius(Beacon * b,
                                std::set<Beacon*> & beacons_inside);
     
     bool is_inside_[NUM_TEAMS_BS]; ///< Used for isInsideArea queries
 
     std::vector<std::pair<uint16_t, uint16_t> > connected_beacons_; ///< Caches connected beacons between calls to update().
+
+    std::map<Beacon*, NeighborState> neighbor_state_;
+    bool activation_dirty_; ///< Whether activation spreading must be
+                            ///redone in the next update().
 };
 
 #endif
@@ -122,7 +122,7 @@ void GameLogicClientBeaconstrike::loadLevel(const std::string & lvl_name)
     
     for (unsigned t=0; t<NUM_TEAMS_BS; ++t)
     {
-        team_[t].createBoundary(puppet_master_->getGameState()->getSimulator()->getStaticSpace());
+        team_[t].createBoundary(puppet_master_->getGameState());
     }
     
     setInputMode(IM_CONTROL_CAMERA);    
@@ -58,8 +58,7 @@ void GameLogicServerBeaconstrike::init(PuppetMasterServer * master)
         score_.addTeam(&team_[t]);
     }
 
-    physics::OdeSimulator * sim = puppet_master_->getGameState()->getSimulator();
-    beacon_boundary_.reset(new BeaconBoundaryServer(sim->getStaticSpace()));    
+    beacon_boundary_.reset(new BeaconBoundaryServer(puppet_master_->getGameState()));    
     
 }
 
@@ -80,10 +80,10 @@ ClientTeam::~ClientTeam()
 
 
 //------------------------------------------------------------------------------
-void ClientTeam::createBoundary(physics::OdeCollisionSpace * world_space)
+void ClientTeam::createBoundary(GameState * game_state)
 {    
     if (beacon_boundary_) return;
-    beacon_boundary_ = new BeaconBoundaryClient(world_space,
+    beacon_boundary_ = new BeaconBoundaryClient(game_state,
                                                 s_params.get<std::string>(config_name_ + ".boundary_tex_name") );
 
 //    beacon_boundary_->setDrawLosHints(s_params.get<bool>(TEAM_CONFIG_NAME[id_] + ".draw_los_hints"));
@@ -6,12 +6,8 @@
 #include "RegisteredFpGroup.h"
 
 
-namespace physics
-{
-    class OdeCollisionSpace;
-}
-
 class BeaconBoundaryClient;
+class GameState;
 
 
 
@@ -53,7 +49,7 @@ class ClientTeam : public Team
     ClientTeam();
     virtual ~ClientTeam();
     
-    void createBoundary(physics::OdeCollisionSpace * world_space);
+    void createBoundary(GameState * game_state);
 
     BeaconBoundaryClient * getBoundary();
 
@@ -0,0 +1,267 @@
+#include <cstdio>
+#include <set>
+#include <vector>
+
+#include "Exception.h"
+#include "Log.h"
+#include "Utils.h"
+#include "Paths.h"
+#include "TimeStructs.h"
+#include "Serializer.h"
+#include "Vector.h"
+#include "BbmImporter.h"
+#include "LevelData.h"
+
+
+/// Every file is loaded this often, the average time is reported.
+const unsigned NUM_LOADS = 20;
+
+/// Written and read back to measure raw vector throughput.
+const std::string VECTOR_FILE = "serializer_bench.tmp";
+
+typedef void (*LoadFun)(const std::string & file);
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Reads terrain.hm like TerrainData::loadHm.
+ */
+void loadHm(const std::string & file)
+{
+    serializer::Serializer s(file, serializer::SOM_READ);
+
+    uint32_t width, height;
+    float32_t max_height, min_height, horz_scale;
+
+    s.get(width);
+    s.get(height);
+    s.get(max_height);
+    s.get(min_height);
+    s.get(horz_scale);
+
+    std::vector<float32_t> height_data(width*height);
+    s.getRaw(&height_data[0], height_data.size() * sizeof(float32_t));
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Reads waypoints.bin like WaypointManagerServer::loadWaypointFile.
+ */
+void loadWaypoints(const std::string & file)
+{
+    serializer::Serializer s(file, serializer::SOM_READ | serializer::SOM_COMPRESS);
+
+    unsigned w, h;
+    float horz_scale;
+
+    s.get(w);
+    s.get(h);
+    s.get(horz_scale);
+
+    for (unsigned i=0; i<w*h; ++i)
+    {
+        Vector pos;
+        unsigned lvl;
+
+        s.get(pos);
+        s.get(lvl);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void loadBbm(const std::string & file)
+{
+    delete bbm::Node::loadFromFile(file);
+}
+
+
+//------------------------------------------------------------------------------
+void loadVectors(const std::string & file)
+{
+    serializer::Serializer s(file, serializer::SOM_READ | serializer::SOM_COMPRESS);
+
+    std::vector<Vector>   vertices;
+    std::vector<uint16_t> indices;
+
+    s.get(vertices);
+    s.get(indices);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Writes a file resembling a large mesh: 200k vertices and 300k
+ *  indices, compressed.
+ */
+void writeVectors(const std::string & file)
+{
+    std::vector<Vector>   vertices(200000);
+    std::vector<uint16_t> indices (300000);
+
+    for (unsigned i=0; i<vertices.size(); ++i)
+    {
+        vertices[i] = Vector((float)i, (float)(i % 317), (float)(i % 1009));
+    }
+    for (unsigned i=0; i<indices.size(); ++i)
+    {
+        indices[i] = (uint16_t)(i*7);
+    }
+
+    serializer::Serializer s(file, serializer::SOM_WRITE | serializer::SOM_COMPRESS);
+    s.put(vertices);
+    s.put(indices);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the average time in msecs to load the given file with fun.
+ */
+float timeLoads(LoadFun fun, const std::string & file)
+{
+    TimeValue start_time, end_time;
+    getCurTime(start_time);
+
+    for (unsigned l=0; l<NUM_LOADS; ++l) fun(file);
+
+    getCurTime(end_time);
+
+    return getTimeDiff(end_time, start_time) / NUM_LOADS;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the names of the models placed in the level or used as
+ *  grass, for which a bbm file exists.
+ */
+std::set<std::string> getLevelModels(const std::string & lvl_name)
+{
+    bbm::LevelData lvl_data;
+    lvl_data.load(lvl_name);
+
+    std::set<std::string> names;
+
+    const std::vector<bbm::ObjectInfo> & object_info = lvl_data.getObjectInfo();
+    for (unsigned o=0; o<object_info.size(); ++o)
+    {
+        names.insert(object_info[o].name_);
+    }
+
+    const std::vector<bbm::DetailTexInfo> & tex_info = lvl_data.getDetailTexInfo();
+    for (unsigned t=0; t<tex_info.size(); ++t)
+    {
+        for (unsigned z=0; z<tex_info[t].zone_info_.size(); ++z)
+        {
+            names.insert(tex_info[t].zone_info_[z].model_);
+        }
+    }
+
+    std::set<std::string> ret;
+    for (std::set<std::string>::const_iterator it = names.begin(); it != names.end(); ++it)
+    {
+        if (existsFile((MODEL_PATH + *it + ".bbm").c_str())) ret.insert(*it);
+    }
+
+    return ret;
+}
+
+
+//------------------------------------------------------------------------------
+void benchmarkLevel(const std::string & lvl_name)
+{
+    std::string path = LEVEL_PATH + lvl_name + "/";
+
+    s_log << "\nLevel " << lvl_name << ":\n";
+
+    if (existsFile((path + "terrain.hm").c_str()))
+    {
+        s_log << "  terrain.hm:    " << timeLoads(&loadHm, path + "terrain.hm") << " msecs\n";
+    }
+
+    if (existsFile((path + "waypoints.bin").c_str()))
+    {
+        s_log << "  waypoints.bin: " << timeLoads(&loadWaypoints, path + "waypoints.bin") << " msecs\n";
+    }
+
+    std::set<std::string> models = getLevelModels(lvl_name);
+
+    float total = 0.0f;
+    for (std::set<std::string>::const_iterator it = models.begin(); it != models.end(); ++it)
+    {
+        total += timeLoads(&loadBbm, MODEL_PATH + *it + ".bbm");
+    }
+    s_log << "  " << models.size() << " bbm models:  " << total << " msecs\n";
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the names of all directories in LEVEL_PATH.
+ */
+std::vector<std::string> getAllLevelNames()
+{
+    using namespace boost::filesystem;
+
+    std::vector<std::string> ret;
+
+    for (directory_iterator it((path(LEVEL_PATH)));
+         it != directory_iterator();
+         ++it)
+    {
+        if (is_directory(it->status())) ret.push_back(it->path().leaf());
+    }
+
+    return ret;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Measures the time needed to read the level files through the
+ *  Serializer. Times are averaged over NUM_LOADS loads, so they
+ *  mostly reflect files in the OS cache. Without level names, all
+ *  levels are measured. Must be run from the directory containing
+ *  "data".
+ */
+int main(int argc, char ** argv)
+{
+    std::vector<std::string> names(argv+1, argv+argc);
+
+    int ret = 0;
+    try
+    {
+        writeVectors(VECTOR_FILE);
+        s_log << "vector<Vector> (200k) + vector<uint16_t> (300k), compressed: "
+              << timeLoads(&loadVectors, VECTOR_FILE) << " msecs\n";
+        remove(VECTOR_FILE.c_str());
+
+        if (names.empty()) names = getAllLevelNames();
+
+        for (unsigned i=0; i<names.size(); ++i)
+        {
+            try
+            {
+                benchmarkLevel(names[i]);
+            } catch (Exception & e)
+            {
+                e.addHistory("main(" + names[i] + ")");
+                s_log << Log::error << e << "\n";
+                ret = 1;
+            }
+        }
+    } catch (Exception & e)
+    {
+        e.addHistory("main()");
+        s_log << Log::error << e << "\n";
+        ret = 1;
+    } catch (boost::filesystem::basic_filesystem_error<boost::filesystem::path> & e)
+    {
+        s_log << Log::error << e.what() << "\n";
+        ret = 1;
+    }
+
+    return ret;
+}
@@ -0,0 +1,231 @@
+
+
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+#include "NetworkServer.h"
+#include "NetworkCommand.h"
+#include "ParameterManager.h"
+#include "PuppetMasterServer.h"
+#include "ServerPlayer.h"
+#include "Scheduler.h"
+#include "Profiler.h"
+#include "Console.h"
+#include "TimeStructs.h"
+#include "VersionInfo.h"
+#include "Log.h"
+#include "Utils.h"
+#include "Ranking.h"
+
+VersionInfo g_version = VERSION_ZB_SERVER;
+
+
+#ifdef _WIN32
+#include <tchar.h>
+#endif
+
+#undef min
+#undef max
+
+
+/// Counts all heap allocations made by the process. Worker threads
+/// allocate rarely, so the unsynchronized increment is accurate
+/// enough.
+unsigned g_num_allocations = 0;
+
+//------------------------------------------------------------------------------
+void * operator new(size_t size) throw(std::bad_alloc)
+{
+    ++g_num_allocations;
+    void * ret = malloc(size ? size : 1);
+    if (!ret) throw std::bad_alloc();
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+void * operator new[](size_t size) throw(std::bad_alloc)
+{
+    ++g_num_allocations;
+    void * ret = malloc(size ? size : 1);
+    if (!ret) throw std::bad_alloc();
+    return ret;
+}
+
+//------------------------------------------------------------------------------
+void operator delete(void * p) throw()
+{
+    free(p);
+}
+
+//------------------------------------------------------------------------------
+void operator delete[](void * p) throw()
+{
+    free(p);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Runs the server simulation and state transmission for a fixed
+ *  number of ticks with a fixed timestep, without any real network
+ *  connections. The RakPeer is never started, so all packets are
+ *  written and accounted, but dropped.
+ *
+ *  Bots are added via the addBot console command. Observers are fake
+ *  clients without controllable which receive the full game state,
+ *  so state transmission is exercised as well.
+ */
+class ServerBenchmark : public NetworkServer
+{
+ public:
+    ServerBenchmark();
+
+    void run();
+
+ protected:
+
+    void addObservers(unsigned num_observers);
+
+    void tick(float dt, float send_dt, float & send_time);
+};
+
+
+//------------------------------------------------------------------------------
+ServerBenchmark::ServerBenchmark()
+{
+}
+
+
+//------------------------------------------------------------------------------
+void ServerBenchmark::run()
+{
+    unsigned num_bots      = s_params.get<unsigned>("server.benchmark.num_bots");
+    unsigned num_observers = s_params.get<unsigned>("server.benchmark.num_observers");
+    unsigned warmup_ticks  = s_params.get<unsigned>("server.benchmark.warmup_ticks");
+    unsigned num_ticks     = s_params.get<unsigned>("server.benchmark.num_ticks");
+
+    s_params.set("server.settings.max_connections", num_bots + num_observers);
+
+    srand(s_params.get<unsigned>("server.benchmark.seed"));
+
+    puppet_master_->loadLevel(new HostOptions(s_params.get<std::string>("server.benchmark.map_name"),
+                                              s_params.get<std::string>("server.benchmark.logic_type")));
+
+    for (unsigned b=0; b<num_bots; ++b) s_console.executeCommand("addBot");
+    addObservers(num_observers);
+
+    float dt      = 1.0f / s_params.get<float>("physics.fps");
+    float send_dt = 1.0f / s_params.get<float>("server.network.send_gamestate_fps");
+    float send_time = 0.0f;
+
+    for (unsigned t=0; t<warmup_ticks; ++t) tick(dt, send_dt, send_time);
+
+    s_profiler.clearAll();
+    network::NetworkCommand::printAndResetNetSummary(std::vector<std::string>());
+    unsigned start_allocations = g_num_allocations;
+
+    TimeValue start_time, end_time;
+    getCurTime(start_time);
+
+    for (unsigned t=0; t<num_ticks; ++t) tick(dt, send_dt, send_time);
+
+    getCurTime(end_time);
+
+    unsigned num_allocations = g_num_allocations - start_allocations;
+    unsigned num_bits        = network::NetworkCommand::getNumBitsAccounted(AT_OUTGOING);
+    float msecs              = getTimeDiff(end_time, start_time);
+
+    s_log << "\n--------------------------- Server Benchmark -----------------------------------\n"
+          << "Level:        " << puppet_master_->getLevelName() << "\n"
+          << "Players:      " << num_bots << " bots, " << num_observers << " observers\n"
+          << "Ticks:        " << num_ticks << " (" << num_ticks * dt << " simulated secs)\n"
+          << "Wall time:    " << msecs << " msecs, " << msecs / std::max(num_ticks, 1u) << " msecs per tick\n"
+          << "Outgoing:     " << (float)num_bits / 8 / std::max(num_ticks, 1u) << " bytes per tick\n"
+          << "Allocations:  " << (float)num_allocations / std::max(num_ticks, 1u) << " per tick\n";
+
+    s_log << s_profiler.getSummary(num_ticks);
+}
+
+
+//------------------------------------------------------------------------------
+void ServerBenchmark::addObservers(unsigned num_observers)
+{
+    for (unsigned o=0; o<num_observers; ++o)
+    {
+        SystemAddress address;
+        address.binaryAddress = 0x0100007f; // 127.0.0.1
+        address.port          = 60000 + o;
+
+        if (!puppet_master_->addPlayer(address)) continue;
+
+        puppet_master_->setPlayerData(address, "observer" + toString(o),
+                                      network::ranking::INVALID_USER_ID,
+                                      network::ranking::INVALID_SESSION_KEY);
+
+        ServerPlayer * player = puppet_master_->getPlayer(address);
+        while (player && player->getNeededReadies()) puppet_master_->playerReady(address);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Does what the scheduler does for a running server: advance all
+ *  tasks, step the physics and send the game state at its own rate.
+ */
+void ServerBenchmark::tick(float dt, float send_dt, float & send_time)
+{
+    {
+        PROFILE(Scheduler);
+        s_scheduler.frameMove(dt);
+    }
+
+    handlePhysics(dt);
+
+    send_time += dt;
+    if (send_time >= send_dt)
+    {
+        send_time -= send_dt;
+        handleSendGameState(send_dt);
+    }
+}
+
+
+
+//------------------------------------------------------------------------------
+#ifdef _WIN32
+    int _tmain(int argc, _TCHAR* argv[])
+    {
+#else
+    int main( int argc, char **argv )
+        {
+#endif
+    try
+    {
+        s_params.loadParameters("config_server.xml");
+        s_params.loadParameters("config_common.xml");
+
+        s_params.loadParameters("data/config/teams.xml");
+        s_params.loadParameters("data/config/weapon_systems.xml");
+        s_params.loadParameters("data/config/tanks.xml");
+        s_params.loadParameters("data/config/upgrade_system.xml");
+
+        s_params.mergeCommandLineParams(argc, argv);
+
+        s_log.open("./", "server");
+        s_log.appendCr(true);
+        s_log << "Version " << g_version << "\n";
+
+        ServerBenchmark benchmark;
+        benchmark.run();
+
+    } catch (Exception & e)
+    {
+        e.addHistory("main()");
+        s_log << Log::error << e << "\n";
+        return 1;
+    }
+
+    return 0;
+}
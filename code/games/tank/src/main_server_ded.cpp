@@ -6,7 +6,11 @@
 #include "PuppetMasterServer.h"
 #include "VersionInfo.h"
 #include "Scheduler.h"
+#include "ProfileTrace.h"
 #include "GameLogicServer.h"
+#include "Utils.h"
+#include "CookedTerrain.h"
+#include "Paths.h"
 
 #include "VersionInfo.h"
 
@@ -16,9 +20,18 @@ VersionInfo g_version = VERSION_ZB_SERVER;
 
 #ifdef _WIN32
 #include <tchar.h>
+#else
+#include <algorithm>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #endif
 
 
+unsigned g_instance = 0; ///< Index of this match instance, see forkInstances.
 unsigned g_next_level_index = 0;
 PuppetMasterServer * g_puppet_master = NULL;
 RegisteredFpGroup g_fp_group;
@@ -60,6 +73,7 @@ void loadNextLevel(void*)
         s_params.get<std::vector<std::vector<std::string> > >("server.settings.map_names");
 
     if (level_list.empty())                         throw Exception("Level list is empty");
+    g_next_level_index %= level_list.size();
     if (level_list[g_next_level_index].size() != 2) throw Exception("Invalid level list");
     
     g_puppet_master->loadLevel(
@@ -76,6 +90,148 @@ void startMapRotation()
     loadNextLevel(NULL);
 }
 
+#ifndef _WIN32
+//------------------------------------------------------------------------------
+/**
+ *  Maps the cooked terrain of every level in the map rotation and
+ *  touches all of its pages. The instances map the same files when
+ *  loading a level, so the terrain grids are read from disk and held
+ *  in memory once for all of them. Levels without an up to date
+ *  cooked file get their own copy in each instance.
+ */
+void mapRotationTerrain(std::vector<terrain::CookedTerrain*> & cooked)
+{
+    std::vector<std::vector<std::string> > level_list =
+        s_params.get<std::vector<std::vector<std::string> > >("server.settings.map_names");
+
+    for (unsigned l=0; l<level_list.size(); ++l)
+    {
+        if (level_list[l].empty()) continue;
+        
+        std::string path = LEVEL_PATH + level_list[l][0] + "/";
+        if (!terrain::CookedTerrain::isUpToDate(path))
+        {
+            s_log << Log::warning
+                  << "No up to date cooked terrain for "
+                  << level_list[l][0]
+                  << ", its terrain won't be shared between instances.\n";
+            continue;
+        }
+
+        try
+        {
+            cooked.push_back(new terrain::CookedTerrain(path));
+        } catch (Exception & e)
+        {
+            s_log << Log::warning << e << "\n";
+            continue;
+        }
+
+        const terrain::CookedTerrainHeader & header = cooked.back()->getHeader();
+        volatile uint8_t touch = 0;
+        for (unsigned s=0; s<terrain::CTS_LAST; ++s)
+        {
+            if (header.section_size_[s] == 0) continue;
+            
+            const uint8_t * data = (const uint8_t*)cooked.back()->getSection(
+                (terrain::COOKED_TERRAIN_SECTION)s, header.section_size_[s]);
+            for (unsigned b=0; b<header.section_size_[s]; b+=4096) touch ^= data[b];
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Runs server.settings.num_instances independent matches by forking
+ *  one child process per instance. Each instance listens on its own
+ *  port (listen_port + instance index) and starts its map rotation at
+ *  a different map.
+ *
+ *  The instances share code pages, the configuration parsed before
+ *  the fork (copy-on-write) and the mapped cooked terrain files, see
+ *  mapRotationTerrain. Everything built on level load (collision
+ *  geometry, waypoint search structures, game objects) is per
+ *  instance.
+ *
+ *  Console input would be garbled with several processes reading the
+ *  terminal, so instances are administered via rcon only.
+ *
+ *  \return True in a child process, which should go on to run its
+ *  match. False in the parent process after all children exited.
+ */
+bool forkInstances(unsigned num_instances)
+{
+    std::vector<pid_t> child;
+    
+    for (unsigned i=0; i<num_instances; ++i)
+    {
+        pid_t pid = fork();
+        if (pid == -1)
+        {
+            Exception e("fork failed for instance ");
+            e << i << ": " << strerror(errno);
+            throw e;
+        }
+
+        if (pid == 0)
+        {
+            g_instance         = i;
+            g_next_level_index = i;
+
+            s_params.set("server.settings.listen_port",
+                         s_params.get<unsigned>("server.settings.listen_port") + i);
+            s_params.set("server.settings.name",
+                         s_params.get<std::string>("server.settings.name") + " #" + toString(i+1));
+
+            std::string log_file = s_params.get<std::string>("server.log.filename");
+            std::string::size_type ext = log_file.rfind('.');
+            if (ext == std::string::npos) ext = log_file.size();
+            s_params.set("server.log.filename", log_file.insert(ext, "_" + toString(i+1)));
+
+            int null_fd = open("/dev/null", O_RDONLY);
+            if (null_fd != -1)
+            {
+                dup2(null_fd, STDIN_FILENO);
+                close(null_fd);
+            }
+            
+            return true;
+        }
+
+        child.push_back(pid);
+    }
+
+    // The parent never opens its log file, so this goes to the
+    // console only.
+    s_log << "Started " << num_instances << " server instances, waiting for them to exit.\n";
+    
+    unsigned num_running = child.size();
+    while (num_running)
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        std::vector<pid_t>::iterator it = std::find(child.begin(), child.end(), pid);
+        if (it == child.end()) continue;
+        
+        s_log << "Server instance " << (unsigned)(it - child.begin()) + 1
+              << " exited with status " << status << ".\n";
+        
+        *it = 0;
+        --num_running;
+    }
+
+    return false;
+}
+#endif
+
+
 //------------------------------------------------------------------------------
 #ifdef _WIN32
     int _tmain(int argc, _TCHAR* argv[])
@@ -100,10 +256,30 @@ void startMapRotation()
         s_params.loadParameters("data/config/upgrade_system.xml");
 
         s_params.mergeCommandLineParams(argc, argv);
+
+        unsigned num_instances = s_params.get<unsigned>("server.settings.num_instances");
+#ifdef _WIN32
+        if (num_instances > 1) throw Exception("server.settings.num_instances > 1 is not supported on win32");
+#else
+        if (num_instances > 1)
+        {
+            std::vector<terrain::CookedTerrain*> cooked;
+            mapRotationTerrain(cooked);
+
+            bool child = forkInstances(num_instances);
+
+            // Instances map the files themselves on level load.
+            for (unsigned c=0; c<cooked.size(); ++c) delete cooked[c];
+            
+            if (!child) return 0;
+        }
+#endif
         
         s_log.open("./", "server");
         s_log.appendCr(true);
         s_log << "Version " << g_version << "\n";
+
+        s_trace_recorder.setEnabled(s_params.get<bool>("profiler.trace.enabled"));
         
         NetworkServer server;
 
@@ -120,7 +296,8 @@ void startMapRotation()
                                      PMOE_AUTH_DATA_SET,
                                      &g_fp_group);
         
-        ConsoleApp app;
+        ConsoleApp app(num_instances <= 1);
+        app.setPollTask(PeriodicTaskCallback(&server, &NetworkServer::handleNetwork));
         app.run();
 
     } catch (Exception & e)
@@ -23,6 +23,9 @@
 
 */
 
+#ifndef ASTARSEARCH_H
+#define ASTARSEARCH_H
+
 // used for text debugging
 #include <iostream>
 #include <stdio.h>
@@ -50,7 +53,9 @@ using namespace std;
 #pragma warning( disable : 4786 )
 #endif
 
-// The AStar search class. UserState is the users state space type
+// The AStar search class. UserState is the users state space type.
+// Besides the search callbacks it must provide Hash(), which has to
+// return the same value for states where IsSameState() is true.
 template <class UserState> class AStarSearch
 {
 
@@ -83,12 +88,17 @@ template <class UserState> class AStarSearch
             float h; // heuristic estimate of distance to goal
             float f; // sum of cumulative cost of predecessors and self and heuristic
 
+            int m_HeapIndex; // position in the open heap, -1 if not on open
+            int m_ClosedIndex; // position in the closed list, -1 if not on closed
+
             Node() :
                 parent( 0 ),
                 child( 0 ),
                 g( 0.0f ),
                 h( 0.0f ),
-                f( 0.0f )
+                f( 0.0f ),
+                m_HeapIndex( -1 ),
+                m_ClosedIndex( -1 )
                 {			
                 }
 
@@ -121,8 +131,15 @@ template <class UserState> class AStarSearch
         m_FixedSizeAllocator( MaxNodes ),
 #endif
         m_AllocateNodeCount(0),
-        m_CancelRequest( false )
+        m_CancelRequest( false ),
+        m_NumIndexed( 0 )
 	{
+            // The index holds every node on open or closed. Keep it at
+            // most half full so probe sequences stay short.
+            unsigned int IndexSize = 16;
+            while( IndexSize < 2 * (unsigned int)MaxNodes ) IndexSize <<= 1;
+
+            m_Index.resize( IndexSize, NULL );
 	}
 
     // call at any time to cancel the search and free up all the memory
@@ -132,8 +149,16 @@ template <class UserState> class AStarSearch
 	}
 
     // Set Start and goal states
+    // The search object can be reused for any number of searches, which
+    // avoids reallocating the node memory, index and lists every time.
+    // A search still in progress is abandoned.
     void SetStartAndGoalStates( UserState &Start, UserState &Goal )
 	{
+            if( m_State == SEARCH_STATE_SEARCHING )
+            {
+                FreeAllNodes();
+            }
+
             m_CancelRequest = false;
 
             m_Start = AllocateNode();
@@ -156,10 +181,10 @@ template <class UserState> class AStarSearch
 
             // Push the start node on the Open list
 
-            m_OpenList.push_back( m_Start ); // heap now unsorted
+            *FindIndexSlot( m_Start->m_UserState ) = m_Start;
+            m_NumIndexed ++;
 
-            // Sort back element into heap
-            push_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
+            HeapPush( m_Start );
 
             // Initialise counter for search steps
             m_Steps = 0;
@@ -194,9 +219,7 @@ template <class UserState> class AStarSearch
             m_Steps ++;
 
             // Pop the best node (the one with the lowest f) 
-            Node *n = m_OpenList.front(); // get pointer to the node
-            pop_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
-            m_OpenList.pop_back();
+            Node *n = HeapPop();
 
             // Check for the goal, once we pop that we're done
             if( n->m_UserState.IsGoal( m_Goal->m_UserState ) )
@@ -276,56 +299,48 @@ template <class UserState> class AStarSearch
 
                     // Now we need to find whether the node is on the open or closed lists
                     // If it is but the node that is already on them is better (lower g)
-                    // then we can forget about this successor
-
-                    // First linear search of open list to find node
+                    // then we can forget about this successor.
+                    // Every node on open or closed is in the index, so this is a
+                    // single hash lookup instead of a linear search of both lists.
 
-                    typename vector< Node * >::iterator openlist_result;
-
-                    for( openlist_result = m_OpenList.begin(); openlist_result != m_OpenList.end(); openlist_result ++ )
+                    if( 2 * (m_NumIndexed + 1) > m_Index.size() )
                     {
-                        if( (*openlist_result)->m_UserState.IsSameState( (*successor)->m_UserState ) )
-                        {
-                            break;					
-                        }
+                        GrowIndex();
                     }
 
-                    if( openlist_result != m_OpenList.end() )
-                    {
+                    Node **slot = FindIndexSlot( (*successor)->m_UserState );
+                    Node *existing = *slot;
 
-                        // we found this state on open
+                    if( existing )
+                    {
+                        // The existing node is kept and updated in place, its
+                        // heuristic is the same as the successor's
+                        FreeNode( (*successor) );
 
-                        if( (*openlist_result)->g <= newg )
+                        if( existing->g <= newg )
                         {
-                            FreeNode( (*successor) );
-
-                            // the one on Open is cheaper than this one
+                            // the one on Open or Closed is cheaper than this one
                             continue;
                         }
-                    }
 
-                    typename vector< Node * >::iterator closedlist_result;
+                        existing->parent = n;
+                        existing->g = newg;
+                        existing->f = existing->g + existing->h;
 
-                    for( closedlist_result = m_ClosedList.begin(); closedlist_result != m_ClosedList.end(); closedlist_result ++ )
-                    {
-                        if( (*closedlist_result)->m_UserState.IsSameState( (*successor)->m_UserState ) )
+                        if( existing->m_HeapIndex >= 0 )
                         {
-                            break;					
+                            // still on open: its f decreased, so move it up the heap
+                            HeapSiftUp( existing->m_HeapIndex );
                         }
-                    }
-
-                    if( closedlist_result != m_ClosedList.end() )
-                    {
-
-                        // we found this state on closed
-
-                        if( (*closedlist_result)->g <= newg )
+                        else
                         {
-                            // the one on Closed is cheaper than this one
-                            FreeNode( (*successor) );
-
-                            continue;
+                            // Here we have found a new state which is already CLOSED,
+                            // reopen it
+                            RemoveFromClosed( existing );
+                            HeapPush( existing );
                         }
+
+                        continue;
                     }
 
                     // This node is the best node so far with this particular state
@@ -336,47 +351,16 @@ template <class UserState> class AStarSearch
                     (*successor)->h = (*successor)->m_UserState.GoalDistanceEstimate( m_Goal->m_UserState );
                     (*successor)->f = (*successor)->g + (*successor)->h;
 
-                    // Remove successor from closed if it was on it
-
-                    if( closedlist_result != m_ClosedList.end() )
-                    {
-                        // remove it from Closed
-                        FreeNode(  (*closedlist_result) ); 
-                        m_ClosedList.erase( closedlist_result );
-
-                        // Fix thanks to ...
-                        // Greg Douglas <gregdouglasmail@gmail.com>
-                        // who noticed that this code path was incorrect
-                        // Here we have found a new state which is already CLOSED
-                        // anus
-					
-                    }
-
-                    // Update old version of this node
-                    if( openlist_result != m_OpenList.end() )
-                    {	   
-
-                        FreeNode( (*openlist_result) ); 
-                        m_OpenList.erase( openlist_result );
-
-                        // re-make the heap 
-                        // make_heap rather than sort_heap is an essential bug fix
-                        // thanks to Mike Ryynanen for pointing this out and then explaining
-                        // it in detail. sort_heap called on an invalid heap does not work
-                        make_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
-			
-                    }
+                    *slot = (*successor);
+                    m_NumIndexed ++;
 
-                    // heap now unsorted
-                    m_OpenList.push_back( (*successor) );
-
-                    // sort back element into heap
-                    push_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
+                    HeapPush( (*successor) );
 
                 }
 
                 // push n onto Closed, as we have expanded it now
 
+                n->m_ClosedIndex = m_ClosedList.size();
                 m_ClosedList.push_back( n );
 
             } // end else (not goal so expand)
@@ -630,6 +614,8 @@ template <class UserState> class AStarSearch
 
             m_ClosedList.clear();
 
+            ClearIndex();
+
             // delete the goal
 
             FreeNode(m_Goal);
@@ -677,6 +663,150 @@ template <class UserState> class AStarSearch
 
             m_ClosedList.clear();
 
+            ClearIndex();
+
+	}
+
+    // Open list heap management. The heap is ordered like the STL heap
+    // functions would order it, but each node knows its own position, so
+    // a node whose f has decreased can be moved up in place instead of
+    // rebuilding the whole heap.
+    void HeapPush( Node *node )
+	{
+            node->m_HeapIndex = m_OpenList.size();
+            m_OpenList.push_back( node );
+
+            HeapSiftUp( node->m_HeapIndex );
+	}
+
+    Node *HeapPop()
+	{
+            Node *top = m_OpenList.front();
+            top->m_HeapIndex = -1;
+
+            Node *last = m_OpenList.back();
+            m_OpenList.pop_back();
+
+            if( !m_OpenList.empty() )
+            {
+                m_OpenList[0] = last;
+                last->m_HeapIndex = 0;
+                HeapSiftDown( 0 );
+            }
+
+            return top;
+	}
+
+    void HeapSiftUp( int index )
+	{
+            Node *node = m_OpenList[index];
+
+            while( index > 0 )
+            {
+                int parent = (index - 1) / 2;
+
+                if( !HeapCompare_f()( m_OpenList[parent], node ) )
+                {
+                    break;
+                }
+
+                m_OpenList[index] = m_OpenList[parent];
+                m_OpenList[index]->m_HeapIndex = index;
+
+                index = parent;
+            }
+
+            m_OpenList[index] = node;
+            node->m_HeapIndex = index;
+	}
+
+    void HeapSiftDown( int index )
+	{
+            Node *node = m_OpenList[index];
+            int size = m_OpenList.size();
+
+            for( ;; )
+            {
+                int child = 2 * index + 1;
+
+                if( child >= size )
+                {
+                    break;
+                }
+
+                if( child + 1 < size &&
+                    HeapCompare_f()( m_OpenList[child], m_OpenList[child+1] ) )
+                {
+                    child ++;
+                }
+
+                if( !HeapCompare_f()( node, m_OpenList[child] ) )
+                {
+                    break;
+                }
+
+                m_OpenList[index] = m_OpenList[child];
+                m_OpenList[index]->m_HeapIndex = index;
+
+                index = child;
+            }
+
+            m_OpenList[index] = node;
+            node->m_HeapIndex = index;
+	}
+
+    // Closed list removal, swapping the last node into the gap
+    void RemoveFromClosed( Node *node )
+	{
+            Node *last = m_ClosedList.back();
+
+            m_ClosedList[node->m_ClosedIndex] = last;
+            last->m_ClosedIndex = node->m_ClosedIndex;
+
+            m_ClosedList.pop_back();
+            node->m_ClosedIndex = -1;
+	}
+
+    // Node index. This is an open addressing hash table over all nodes on
+    // open or closed, keyed by UserState::Hash() and UserState::IsSameState().
+    // Nodes are never removed during a search, only the whole index is
+    // cleared when a search ends.
+
+    // Returns the slot holding the node with the given state, or the empty
+    // slot where it should be inserted
+    Node **FindIndexSlot( UserState &State )
+	{
+            unsigned int mask = m_Index.size() - 1;
+            unsigned int pos = State.Hash() & mask;
+
+            while( m_Index[pos] && !m_Index[pos]->m_UserState.IsSameState( State ) )
+            {
+                pos = (pos + 1) & mask;
+            }
+
+            return &m_Index[pos];
+	}
+
+    // Only needed if the node limit exceeds the initial index size,
+    // e.g. without the fixed size allocator
+    void GrowIndex()
+	{
+            vector< Node * > old_index( m_Index.size() * 2, NULL );
+            old_index.swap( m_Index );
+
+            for( typename vector< Node * >::iterator it = old_index.begin(); it != old_index.end(); it ++ )
+            {
+                if( *it )
+                {
+                    *FindIndexSlot( (*it)->m_UserState ) = *it;
+                }
+            }
+	}
+
+    void ClearIndex()
+	{
+            fill( m_Index.begin(), m_Index.end(), (Node *)NULL );
+            m_NumIndexed = 0;
 	}
 
     // Node memory management
@@ -716,7 +846,8 @@ template <class UserState> class AStarSearch
     // Heap (simple vector but used as a heap, cf. Steve Rabin's game gems article)
     vector< Node *> m_OpenList;
 
-    // Closed list is a vector.
+    // Closed list is a vector. Nodes store their position in it, so
+    // they can be removed in constant time.
     vector< Node * > m_ClosedList; 
 
     // Successors is a vector filled out by the user each type successors to a node
@@ -750,8 +881,10 @@ template <class UserState> class AStarSearch
 	
     bool m_CancelRequest;
 
-};
-
+    // Hash index of all nodes on open or closed, its size is a power of two
+    vector< Node * > m_Index;
+    unsigned int m_NumIndexed;
 
+};
 
-   
+#endif // defined ASTARSEARCH_H
@@ -0,0 +1,118 @@
+
+#include "BackgroundWorker.h"
+
+#include <boost/bind.hpp>
+
+#include "Exception.h"
+#include "ProfileTrace.h"
+
+
+//------------------------------------------------------------------------------
+BackgroundWorker::BackgroundWorker() :
+    thread_(NULL),
+    last_job_added_(0),
+    last_job_done_(0),
+    quit_(false)
+{
+    thread_ = new boost::thread(boost::bind(&BackgroundWorker::workerMain, this));
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Finishes all queued jobs.
+ */
+BackgroundWorker::~BackgroundWorker()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        quit_ = true;
+    }
+    job_added_.notify_one();
+
+    thread_->join();
+    delete thread_;
+}
+
+
+//------------------------------------------------------------------------------
+hBackgroundJob BackgroundWorker::addJob(BackgroundJob job)
+{
+    hBackgroundJob ret;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        queue_.push_back(job);
+        ret = ++last_job_added_;
+    }
+    job_added_.notify_one();
+
+    return ret;
+}
+
+
+//------------------------------------------------------------------------------
+bool BackgroundWorker::isDone(hBackgroundJob job)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return job <= last_job_done_;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Blocks until the given job has been executed.
+ *
+ *  If any job threw since the last call to wait, the exception is
+ *  rethrown here.
+ */
+void BackgroundWorker::wait(hBackgroundJob job)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    while (job > last_job_done_) job_done_.wait(lock);
+
+    if (!error_.empty())
+    {
+        std::string error;
+        error.swap(error_);
+        throw Exception(error);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void BackgroundWorker::workerMain()
+{
+    while (true)
+    {
+        BackgroundJob job;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (!quit_ && queue_.empty()) job_added_.wait(lock);
+
+            if (queue_.empty()) return;
+
+            job = queue_.front();
+            queue_.pop_front();
+        }
+
+        std::string error;
+        try
+        {
+            PROFILE_TRACE(BackgroundWorker::job);
+            job();
+        } catch (Exception & e)
+        {
+            error = e.getMessage();
+        } catch (std::exception & e)
+        {
+            error = e.what();
+        }
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (!error.empty() && error_.empty()) error_ = error;
+            ++last_job_done_;
+        }
+        job_done_.notify_all();
+    }
+}
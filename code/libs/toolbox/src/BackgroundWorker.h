@@ -0,0 +1,70 @@
+
+#ifndef LIB_BACKGROUND_WORKER_INCLUDED
+#define LIB_BACKGROUND_WORKER_INCLUDED
+
+#include <deque>
+#include <string>
+
+#include <loki/Functor.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+#include "Singleton.h"
+
+
+typedef Loki::Functor<void> BackgroundJob;
+
+/// Identifies a job added to the background worker. 0 is never
+/// returned by addJob and can be used for "no job".
+typedef unsigned hBackgroundJob;
+
+
+#define s_background_worker Loki::SingletonHolder<BackgroundWorker, Loki::CreateUsingNew, SingletonBackgroundWorkerLifetime >::Instance()
+//------------------------------------------------------------------------------
+/**
+ *  A single thread executing jobs in the order they were added,
+ *  while the main thread continues. Unlike WorkerPool, the caller
+ *  doesn't wait for the jobs but later checks whether they are done.
+ *
+ *  Used for work whose result may arrive a frame late, like
+ *  regenerating terrain data. The same restrictions as for WorkerPool
+ *  jobs apply.
+ *
+ *  Objects owning jobs must wait for them before being destroyed.
+ */
+class BackgroundWorker
+{
+    DECLARE_SINGLETON(BackgroundWorker);
+ public:
+    virtual ~BackgroundWorker();
+
+    hBackgroundJob addJob(BackgroundJob job);
+
+    bool isDone(hBackgroundJob job);
+    void wait(hBackgroundJob job);
+
+ protected:
+
+    void workerMain();
+
+    boost::thread * thread_;
+
+    boost::mutex mutex_;
+    boost::condition job_added_;
+    boost::condition job_done_;
+
+    std::deque<BackgroundJob> queue_;
+
+    hBackgroundJob last_job_added_;
+    hBackgroundJob last_job_done_;
+
+    bool quit_;
+
+    std::string error_; ///< Message of the first exception thrown by
+                        ///a job since the last call to wait().
+};
+
+
+#endif
@@ -6,6 +6,7 @@
 #include "TimeStructs.h"
 #include "Scheduler.h"
 #include "VariableWatcher.h"
+#include "ProfileTrace.h"
 #include "Log.h"
 
 #ifdef _WIN32
@@ -17,6 +18,7 @@
 #endif
 
 #include <limits>
+#include <cmath>
 #include <fcntl.h>
 
 #undef min
@@ -62,27 +64,42 @@ const int VK_ARROW_LEFT      = 256 + 75;
 #endif
 
 //------------------------------------------------------------------------------
-ConsoleApp::ConsoleApp() :
+/**
+ *  \param interactive Whether to read commands from stdin. Should be
+ *  false if several processes share the terminal.
+ */
+ConsoleApp::ConsoleApp(bool interactive) :
     cursor_pos_(0),
     dumb_terminal_(true),
-    quit_(false)
+    quit_(false),
+    interactive_(interactive),
+    poll_task_set_(false),
+    num_frames_(0),
+    num_overruns_(0),
+    total_frame_time_(0),
+    max_frame_time_(0),
+    max_overrun_(0)
 {
 #ifndef _WIN32
-    // Check whether we have dumb terminal (e.g. started from ddd)
-    char * term = getenv("TERM");
-    if (term && strcmp(term, "dumb") != 0)
+    if (interactive_)
     {
-        system("stty raw -echo -isig");
-        dumb_terminal_ = false;
-    } else
-    {
-        s_log << "Dumb terminal detected. Console input will be limited.\n";
+        // Check whether we have dumb terminal (e.g. started from ddd)
+        char * term = getenv("TERM");
+        if (term && strcmp(term, "dumb") != 0)
+        {
+            system("stty raw -echo -isig");
+            dumb_terminal_ = false;
+        } else
+        {
+            s_log << "Dumb terminal detected. Console input will be limited.\n";
+        }
+        setFlag(STDIN_FILENO, O_NONBLOCK);
     }
-    setFlag(STDIN_FILENO, O_NONBLOCK);
 #endif
 
     s_console.addFunction("quit", ConsoleFun(this, &ConsoleApp::quit), &fp_group_);
     s_console.addFunction("exit", ConsoleFun(this, &ConsoleApp::quit), &fp_group_); 
+    s_console.addFunction("printTickStats", ConsoleFun(this, &ConsoleApp::printTickStats), &fp_group_);
 
 #ifdef _WIN32
     if (SetConsoleCtrlHandler(
@@ -107,39 +124,81 @@ ConsoleApp::~ConsoleApp()
 //------------------------------------------------------------------------------
 void ConsoleApp::run()
 {
-    TimeValue last_time;
-    getCurTime(last_time);
+    // The start of the next regular frame. Kept unrounded, so whole
+    // periods can be added without drift.
+    uint64_t last_time  = getCurMicros();
+    double   next_frame = (double)last_time;
 
     while (!quit_)
     {
-        TimeValue cur_time;
-        getCurTime(cur_time);
-        float dt = getTimeDiff(cur_time, last_time) * 0.001f;
-            
-        // due to timer resolution
-        if(dt == 0.0f) continue;
-            
-        last_time = cur_time;
+        uint64_t frame_start = getCurMicros();
+        float dt = (float)(frame_start - last_time) * 0.000001f;
+        last_time = frame_start;
 
         dt = std::min(dt, 1.0f / s_params.get<float>("server.app.min_fps"));
             
-        s_scheduler.frameMove(dt);
+        {
+            PROFILE_TRACE(ConsoleApp::frame);
+            s_scheduler.frameMove(dt);
+        }
             
+        if (interactive_)
+        {
 #ifndef _WIN32
-        handleInput();
+            handleInput();
 #else          
-        handleInputWin32();
-#endif        
+            handleInputWin32();
+#endif
+        }
+
+        uint64_t frame_end = getCurMicros();
 
-        getCurTime(cur_time);
-        int sleep_time = (int)(1000.0f / s_params.get<float>("server.app.target_fps") -
-                               getTimeDiff(cur_time, last_time));
+        ++num_frames_;
+        total_frame_time_ += frame_end - frame_start;
+        max_frame_time_    = std::max(max_frame_time_, frame_end - frame_start);
 
-        if (sleep_time > 0) sleep(sleep_time);
+        // Extra frames run for scheduled tasks don't move the
+        // regular frame times.
+        if ((double)frame_start >= next_frame)
+        {
+            next_frame += 1000000.0 / s_params.get<float>("server.app.target_fps");
+
+            if ((double)frame_end > next_frame)
+            {
+                ++num_overruns_;
+                max_overrun_ = std::max(max_overrun_, (uint64_t)((double)frame_end - next_frame));
+
+                // Don't try to catch up on missed frames.
+                next_frame = (double)frame_end;
+            }
+        }
+
+        // A task due right now is executed in the next regular
+        // frame, so tasks with period 0 don't keep us from sleeping.
+        uint64_t wakeup_time = (uint64_t)ceil(next_frame);
+        float task_delay = s_scheduler.getNextTaskDelay();
+        if (task_delay > 0.0f)
+        {
+            wakeup_time = std::min(wakeup_time, frame_start + (uint64_t)ceilf(task_delay * 1000000.0f));
+        }
+
+        waitUntil(wakeup_time);
     }        
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Sets a task to be executed repeatedly while waiting for the next
+ *  frame, see server.app.poll_interval. It is passed a dt of 0.
+ */
+void ConsoleApp::setPollTask(PeriodicTaskCallback task)
+{
+    poll_task_     = task;
+    poll_task_set_ = true;
+}
+
+
 #ifdef _WIN32
 //------------------------------------------------------------------------------
 /**
@@ -186,15 +245,79 @@ std::string ConsoleApp::quit(const std::vector<std::string>&)
 
 
 //------------------------------------------------------------------------------
-void ConsoleApp::sleep(int msecs)
+/**
+ *  Console function to print statistics about frame times since the
+ *  last call.
+ */
+std::string ConsoleApp::printTickStats(const std::vector<std::string>&)
+{
+    if (num_frames_ == 0) return "No frames since last call.";
+    
+    std::ostringstream ret;
+    ret << num_frames_ << " frames, "
+        << num_overruns_ << " overrun.\n"
+        << "Average frame time " << (float)total_frame_time_ / num_frames_ * 0.001f << " ms, "
+        << "max " << (float)max_frame_time_ * 0.001f << " ms.\n"
+        << "Max overrun " << (float)max_overrun_ * 0.001f << " ms.";
+
+    num_frames_       = 0;
+    num_overruns_     = 0;
+    total_frame_time_ = 0;
+    max_frame_time_   = 0;
+    max_overrun_      = 0;
+
+    return ret.str();
+}
+
+
+//------------------------------------------------------------------------------
+void ConsoleApp::sleep(unsigned micros)
 {
 #ifdef _WIN32
-    ::Sleep((DWORD)msecs);    
+    ::Sleep((DWORD)(micros / 1000));    
 #else
-    usleep(1000*msecs);
+    usleep(micros);
 #endif    
 }
 
+
+//------------------------------------------------------------------------------
+/**
+ *  Sleeps until the specified getCurMicros() time, executing the poll
+ *  task every server.app.poll_interval milliseconds if there is one.
+ */
+void ConsoleApp::waitUntil(uint64_t time)
+{
+    uint64_t poll_interval = 0;
+    if (poll_task_set_)
+    {
+        poll_interval = (uint64_t)(s_params.get<float>("server.app.poll_interval") * 1000.0f);
+    }
+
+    while (true)
+    {
+        uint64_t cur_time = getCurMicros();
+        if (cur_time >= time) return;
+
+        uint64_t sleep_time = time - cur_time;
+        if (poll_interval) sleep_time = std::min(sleep_time, poll_interval);
+        
+        sleep((unsigned)sleep_time);
+
+        if (poll_task_set_)
+        {
+            try
+            {
+                poll_task_(0.0f);
+            } catch (Exception & e)
+            {
+                e.addHistory("ConsoleApp::waitUntil");
+                s_log << Log::error << e << "\n";
+            }
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 /**
  *  First see whether a key was pressed and return immediately if not.
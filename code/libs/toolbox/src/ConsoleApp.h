@@ -8,15 +8,34 @@
 
 #include "Datatypes.h"
 #include "RegisteredFpGroup.h"
+#include "Scheduler.h"
 
 //------------------------------------------------------------------------------
+/**
+ *  Runs the scheduler for server applications.
+ *
+ *  Frames are started at a fixed rate of server.app.target_fps on a
+ *  monotonic microsecond clock. Frame start times are advanced by
+ *  whole periods, so the frame rate doesn't drift with the time
+ *  spent per frame. If a scheduled task falls due between frames, an
+ *  extra frame is run at that time, so fixed rate tasks like the
+ *  physics step are executed on time instead of bunched into the
+ *  next regular frame.
+ *
+ *  Between frames, the poll task is executed every
+ *  server.app.poll_interval milliseconds. This allows network
+ *  packets to be handled as they arrive instead of at the start of
+ *  the next frame.
+ */
 class ConsoleApp
 {
  public:
-    ConsoleApp();
+    ConsoleApp(bool interactive = true);
     virtual ~ConsoleApp();
 
     void run();
+
+    void setPollTask(PeriodicTaskCallback task);
     
  protected:
 
@@ -26,7 +45,10 @@ class ConsoleApp
 
     std::string quit(const std::vector<std::string>&);
 
-    void sleep(int msecs);
+    void sleep(unsigned micros);
+    void waitUntil(uint64_t time);
+
+    std::string printTickStats(const std::vector<std::string>&);
     void handleInput();
     void handleInputWin32();
 
@@ -41,6 +63,19 @@ class ConsoleApp
     bool dumb_terminal_;
     bool quit_;
 
+    bool interactive_; ///< If false, no console input is read at all.
+
+    PeriodicTaskCallback poll_task_;
+    bool poll_task_set_;
+
+    // Tick statistics. A frame is overrun if it ends after the next
+    // frame was due. Times are in microseconds.
+    unsigned num_frames_;
+    unsigned num_overruns_;
+    uint64_t total_frame_time_;
+    uint64_t max_frame_time_;
+    uint64_t max_overrun_;
+
     RegisteredFpGroup fp_group_;
 };
 
@@ -95,6 +95,23 @@ namespace serializer
 {
     class Serializer;
 
+//------------------------------------------------------------------------------
+/**
+ *  Marks types whose untagged serialized form is identical to their
+ *  memory layout, i.e. which consist only of fundamental datatypes
+ *  without padding. Vectors of these types are read and written as
+ *  a single block.
+ */
+    template<typename T> struct IsRawSerializable { enum { value = false }; };
+
+    template<> struct IsRawSerializable<uint8_t>   { enum { value = true }; };
+    template<> struct IsRawSerializable<uint16_t>  { enum { value = true }; };
+    template<> struct IsRawSerializable<int32_t>   { enum { value = true }; };
+    template<> struct IsRawSerializable<uint32_t>  { enum { value = true }; };
+    template<> struct IsRawSerializable<float32_t> { enum { value = true }; };
+    template<> struct IsRawSerializable<Color>     { enum { value = true }; };
+    template<> struct IsRawSerializable<TexCoord>  { enum { value = true }; };
+    
     void putInto(Serializer & s, const Color & c);
     void getFrom(Serializer & s, Color & c);
 
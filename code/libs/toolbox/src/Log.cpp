@@ -1,7 +1,10 @@
 
 #include "Log.h"
 
+#include <algorithm>
+
 #include "ParameterManager.h"
+#include "LogWriter.h"
 
 LogFuncVoid Log::date;   
 LogFuncVoid Log::time; 
@@ -19,6 +22,7 @@ const char * BUILD_TIME = __TIME__;
  *
  */
 Log::Log() : 
+    writer_(NULL),
     enabled_(true),
     append_cr_(false),
     always_flush_(true),
@@ -27,6 +31,8 @@ Log::Log() :
 {
     getCurTime(start_time_);
 
+    std::fill(debug_enabled_, debug_enabled_ + 256, false);
+
     date    = &Log::logDate;
     time    = &Log::logTime;
     millis  = &Log::logMillis;
@@ -43,6 +49,9 @@ Log::~Log()
         *this << Log::millis << " Closing log.\n";
         *this << "--------------------------------------------------------------------------------\n";
 
+        delete writer_;
+        writer_ = NULL;
+
         out_.close();
     }
 }
@@ -55,12 +64,16 @@ void Log::open(const std::string & path, const std::string & application_section
     if (out_.is_open()) return;
 
     bool append = true;
+    bool async  = false;
     try
     {
         log_file_      = path + s_params.get<std::string>(application_section_ + ".log.filename");
         append         = s_params.get<bool>(application_section_ + ".log.append");
         debug_classes_ = s_params.getPointer<std::string>(application_section_ + ".log.debug_classes");
         always_flush_  = s_params.get<bool>(application_section_ + ".log.always_flush");
+        async          = s_params.get<bool>(application_section_ + ".log.async");
+
+        updateDebugClasses();
     } catch (Exception & e)
     {
         e.addHistory("Log::open");
@@ -86,6 +99,8 @@ void Log::open(const std::string & path, const std::string & application_section
           << Log::date << ", " << Log::time << "log session started\n"
           << "Build " << BUILD_DATE << " - " << BUILD_TIME << "\n"
           << "Debug classes: " << (debug_classes_ ? *debug_classes_ : "not specified") << "\n";
+
+    if (async) writer_ = new LogWriter(out_, append_cr_);
 }
 
 
@@ -100,10 +115,16 @@ Log & Log::logMessage(const std::string & msg)
         return *this;
     }
 
+    s_console.print(msg);
+
+    if (writer_)
+    {
+        writer_->write(msg);
+        return *this;
+    }
+
     if (append_cr_) std::cout << addCr(msg);
     else            std::cout << msg;
-
-    s_console.print(msg);
     
     if (!out_.is_open()) return *this;
 
@@ -116,17 +137,27 @@ Log & Log::logMessage(const std::string & msg)
         throw e;
     }
     
-    if (always_flush_)
-    {
-        out_.flush();
-        out_.close();
-        out_.open(log_file_.c_str(), std::ios_base::app);
-    }
+    if (always_flush_) out_.flush();
     
     return *this;
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Called instead of logMessage for the parts of a disabled debug
+ *  message.
+ *
+ *  \param newline Whether the skipped part ends with a newline, which
+ *  ends the debug message.
+ */
+Log & Log::skipMessage(bool newline)
+{
+    if (newline) enabled_ = true;
+    return *this;
+}
+
+
 //------------------------------------------------------------------------------
 const TimeValue & Log::getStartTime() const
 {
@@ -142,10 +173,16 @@ const std::string & Log::getDebugClasses() const
 }
 
 //------------------------------------------------------------------------------
+/**
+ *  Must be called from the main thread. Changing
+ *  log.debug_classes by other means has no effect on isDebugEnabled.
+ */
 void Log::setDebugClasses(const std::string & classes)
 {
     assert(debug_classes_);
     *debug_classes_ = classes;
+
+    updateDebugClasses();
 }
 
 
@@ -158,6 +195,7 @@ void Log::setDebugClasses(const std::string & classes)
 void Log::appendCr(bool a)
 {
     append_cr_ = a;
+    if (writer_) writer_->appendCr(a);
 }
 
 
@@ -261,9 +299,7 @@ Log & Log::logError()
  */
 Log & Log::logDebug(char type)
 {
-    if (!debug_classes_ ||
-        ((*debug_classes_).find(type) == std::string::npos && (*debug_classes_).find('+') == std::string::npos) ||
-        (*debug_classes_).find('-') != std::string::npos)
+    if (!isDebugEnabled(type))
     {
         enabled_ = false;
     } else
@@ -274,6 +310,27 @@ Log & Log::logDebug(char type)
     return *this;
 }
 
+//------------------------------------------------------------------------------
+/**
+ *  Rebuilds the lookup table used by isDebugEnabled. '+' enables all
+ *  classes, '-' disables all classes.
+ */
+void Log::updateDebugClasses()
+{
+    const std::string & classes = *debug_classes_;
+
+    bool all  = classes.find('+') != std::string::npos;
+    bool none = classes.find('-') != std::string::npos;
+
+    std::fill(debug_enabled_, debug_enabled_ + 256, all && !none);
+    if (none) return;
+    
+    for (unsigned c=0; c<classes.size(); ++c)
+    {
+        debug_enabled_[(unsigned char)classes[c]] = true;
+    }
+}
+
 //------------------------------------------------------------------------------
 LogManip Log::debug(char ch)
 {
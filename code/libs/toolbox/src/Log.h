@@ -6,6 +6,7 @@
 
 #include <fstream>
 #include <string>
+#include <cstring>
 
 #include <time.h>
 
@@ -18,6 +19,7 @@
 
 
 class Log;
+class LogWriter;
 
 typedef Log & (Log::*LogFuncVoid)();
 typedef Log & (Log::*LogFuncChar)(char);
@@ -46,6 +48,12 @@ class LogManip
 
 
 #define s_log Loki::SingletonHolder<Log, Loki::CreateUsingNew, SingletonLogLifetime >::Instance()
+
+/// Equivalent to s_log << Log::debug(type), but if the debug class is
+/// disabled, the rest of the statement isn't evaluated at all. Use
+/// on paths executed every frame.
+#define LOG_DEBUG(type) if (!s_log.isDebugEnabled(type)) {} else s_log << Log::debug(type)
+
 //------------------------------------------------------------------------------
 class Log
 {
@@ -56,6 +64,10 @@ class Log
     void open(const std::string & path, const std::string & application_section);
     
     Log & logMessage(const std::string & msg);
+    Log & skipMessage(bool newline);
+
+    bool isEnabled() const;
+    bool isDebugEnabled(char type) const;
 
     const TimeValue & getStartTime() const;
 
@@ -81,9 +93,13 @@ class Log
     Log & logWarning();
     Log & logError();
     Log & logDebug(char type);
+
+    void updateDebugClasses();
     
     std::ofstream out_;
 
+    LogWriter * writer_; ///< Only exists if log.async is set.
+
     TimeValue start_time_;
 
     bool enabled_;
@@ -91,18 +107,43 @@ class Log
     bool always_flush_;
 
     std::string * debug_classes_;
+    bool debug_enabled_[256];
     std::string application_section_;
     std::string log_file_;
 };
      
 
+//------------------------------------------------------------------------------
+inline bool Log::isEnabled() const
+{
+    return enabled_;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Called once per logged debug message, possibly from worker
+ *  threads. The table is only written by open() and
+ *  setDebugClasses(), both on the main thread.
+ */
+inline bool Log::isDebugEnabled(char type) const
+{
+    return debug_enabled_[(unsigned char)type];
+}
+     
+
 //------------------------------------------------------------------------------
 /*
- *  Ordinary arguments are just forwarded to our ofstream
+ *  Ordinary arguments are just forwarded to our ofstream.
+ *
+ *  While a disabled debug message is being skipped, they aren't even
+ *  formatted. Only strings and chars can end a skipped message, so
+ *  debug messages must end with a newline string or char.
  */
 template<class T>
 inline Log & operator<< (Log & log, const T & msg)
 {
+    if (!log.isEnabled()) return log;
+    
     std::ostringstream str;
     str << msg;
     return log.logMessage(str.str());
@@ -128,5 +169,25 @@ inline Log & operator<<(Log & log, const LogFuncVoid & func)
     return (log.*func)();
 }
 
+//------------------------------------------------------------------------------
+inline Log & operator<<(Log & log, const std::string & msg)
+{
+    return log.logMessage(msg);
+}
+
+//------------------------------------------------------------------------------
+inline Log & operator<<(Log & log, const char * msg)
+{
+    if (!log.isEnabled()) return log.skipMessage(*msg && msg[strlen(msg)-1] == '\n');
+    return log.logMessage(msg);
+}
+
+//------------------------------------------------------------------------------
+inline Log & operator<<(Log & log, char msg)
+{
+    if (!log.isEnabled()) return log.skipMessage(msg == '\n');
+    return log.logMessage(std::string(1, msg));
+}
+
 
 #endif // #ifndef LIB_LOG_INCLUDED
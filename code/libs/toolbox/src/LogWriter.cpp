@@ -0,0 +1,114 @@
+
+#include "LogWriter.h"
+
+#include <iostream>
+
+#include <boost/bind.hpp>
+
+#include "Utils.h"
+
+
+//------------------------------------------------------------------------------
+/**
+ *  \param out The already opened log file.
+ */
+LogWriter::LogWriter(std::ofstream & out, bool append_cr) :
+    out_(out),
+    thread_(NULL),
+    append_cr_(append_cr),
+    quit_(false)
+{
+    thread_ = new boost::thread(boost::bind(&LogWriter::writerMain, this));
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Blocks until all queued messages have been written.
+ */
+LogWriter::~LogWriter()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        quit_ = true;
+    }
+    queue_filled_.notify_one();
+
+    thread_->join();
+    delete thread_;
+}
+
+
+//------------------------------------------------------------------------------
+void LogWriter::write(const std::string & msg)
+{
+    bool was_empty;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        was_empty = queue_.empty();
+        queue_ += msg;
+    }
+
+    // The writer only sleeps if it found the queue empty.
+    if (was_empty) queue_filled_.notify_one();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  \see Log::appendCr
+ */
+void LogWriter::appendCr(bool a)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    append_cr_ = a;
+}
+
+
+//------------------------------------------------------------------------------
+void LogWriter::writerMain()
+{
+    std::string batch;
+
+    while (true)
+    {
+        bool append_cr;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (!quit_ && queue_.empty()) queue_filled_.wait(lock);
+
+            if (queue_.empty()) return;
+
+            batch.swap(queue_);
+            append_cr = append_cr_;
+        }
+
+        writeBatch(batch, append_cr);
+        batch.clear();
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Exceptions cannot be passed to the logging thread from here, so
+ *  failure to write the log file is reported on std::cout and file
+ *  output is stopped.
+ */
+void LogWriter::writeBatch(const std::string & batch, bool append_cr)
+{
+    if (append_cr) std::cout << addCr(batch);
+    else           std::cout << batch;
+    std::cout.flush();
+
+    if (!out_.is_open()) return;
+
+    out_ << batch;
+    out_.flush();
+
+    if (!out_)
+    {
+        std::cout << "Warning: writing the log file failed, file logging disabled.\n";
+        out_.close();
+    }
+}
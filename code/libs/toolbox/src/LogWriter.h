@@ -0,0 +1,54 @@
+#ifndef LIB_LOG_WRITER_INCLUDED
+#define LIB_LOG_WRITER_INCLUDED
+
+#include <fstream>
+#include <string>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Moves the output of log messages to std::cout and the log file off
+ *  the logging thread.
+ *
+ *  Messages are appended to a queue, which a background thread swaps
+ *  out and writes in one go, flushing the file once per batch. The
+ *  lock is only held to append to or swap the queue, so a logging
+ *  thread never waits for the file system.
+ *
+ *  Messages still queued when the process crashes are lost.
+ */
+class LogWriter
+{
+ public:
+    LogWriter(std::ofstream & out, bool append_cr);
+    virtual ~LogWriter();
+
+    void write(const std::string & msg);
+
+    void appendCr(bool a);
+
+ protected:
+
+    void writerMain();
+    void writeBatch(const std::string & batch, bool append_cr);
+
+    std::ofstream & out_; ///< Owned by Log, not accessed there while
+                          ///the writer exists.
+
+    boost::thread * thread_;
+
+    boost::mutex mutex_;
+    boost::condition queue_filled_;
+
+    std::string queue_; ///< Messages not yet picked up by the writer thread.
+
+    bool append_cr_;
+    bool quit_;
+};
+
+
+#endif
@@ -0,0 +1,127 @@
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Exception.h"
+
+
+//------------------------------------------------------------------------------
+MappedFile::MappedFile(const std::string & filename) :
+    data_(NULL),
+    size_(0),
+#ifdef _WIN32
+    file_(INVALID_HANDLE_VALUE),
+    mapping_(NULL),
+#endif
+    filename_(filename)
+{
+#ifdef _WIN32
+    file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        Exception e("Cannot open ");
+        e << filename << " for mapping.";
+        throw e;
+    }
+
+    size_ = GetFileSize(file_, NULL);
+    if (size_ == 0) return;
+    
+    mapping_ = CreateFileMapping(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_) data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    
+    if (!data_)
+    {
+        if (mapping_) CloseHandle(mapping_);
+        CloseHandle(file_);
+        
+        Exception e("Cannot map ");
+        e << filename << ".";
+        throw e;
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        Exception e("Cannot open ");
+        e << filename << " for mapping.";
+        throw e;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        Exception e("Cannot determine size of ");
+        e << filename << ".";
+        throw e;
+    }
+
+    size_ = st.st_size;
+    if (size_ == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    void * data = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        Exception e("Cannot map ");
+        e << filename << ".";
+        throw e;
+    }
+
+    data_ = data;
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (data_)    UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    CloseHandle(file_);
+#else
+    if (data_) munmap(const_cast<void*>(data_), size_);
+#endif
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns NULL for empty files.
+ */
+const void * MappedFile::getData() const
+{
+    return data_;
+}
+
+
+//------------------------------------------------------------------------------
+size_t MappedFile::getSize() const
+{
+    return size_;
+}
+
+
+//------------------------------------------------------------------------------
+const std::string & MappedFile::getFilename() const
+{
+    return filename_;
+}
@@ -0,0 +1,44 @@
+
+#ifndef LIB_MAPPED_FILE_INCLUDED
+#define LIB_MAPPED_FILE_INCLUDED
+
+#include <string>
+
+#include <cstddef>
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Maps a file read-only into memory. Pages are loaded on first
+ *  access and shared between all processes mapping the same file.
+ *
+ *  Throws an Exception if the file cannot be opened or mapped.
+ */
+class MappedFile
+{
+ public:
+    MappedFile(const std::string & filename);
+    virtual ~MappedFile();
+
+    const void * getData() const;
+    size_t getSize() const;
+
+    const std::string & getFilename() const;
+    
+ protected:
+
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+    
+    const void * data_;
+    size_t size_;
+
+#ifdef _WIN32
+    void * file_;    ///< HANDLE of the opened file.
+    void * mapping_; ///< HANDLE of the file mapping object.
+#endif
+
+    std::string filename_;
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include "Vector.h"
 #include "Vector2d.h"
 #include "Datatypes.h"
+#include "Console.h"
 
 
 //------------------------------------------------------------------------------
@@ -40,6 +41,9 @@ public:
     virtual bool hasKey(const std::string & key) = 0;
 
     virtual ParameterCacheBase * clone() = 0;
+
+    virtual void merge(const ParameterCacheBase & other) = 0;
+    virtual void registerConsoleVariable(const std::string & key, RegisteredFpGroup * group) = 0;
 };
 
 
@@ -65,6 +69,9 @@ public:
     virtual bool hasKey(const std::string & key);
 
     virtual ParameterCache<TYPE> * clone() { return new ParameterCache<TYPE>(*this); }
+
+    virtual void merge(const ParameterCacheBase & other);
+    virtual void registerConsoleVariable(const std::string & key, RegisteredFpGroup * group);
     
  private:
 
@@ -170,6 +177,31 @@ bool ParameterCache<TYPE>::hasKey(const std::string & key)
     return params_.find(key) != params_.end();
 }
 
+//------------------------------------------------------------------------------
+/**
+ *  Overwrites or adds all values contained in other, which must be
+ *  of the same datatype.
+ */
+template <class TYPE>
+void ParameterCache<TYPE>::merge(const ParameterCacheBase & other)
+{
+    const std::map<std::string, TYPE > & other_params = ((const ParameterCache<TYPE>&)other).params_;
+    
+    for (typename std::map<std::string, TYPE >::const_iterator it = other_params.begin();
+         it != other_params.end();
+         ++it)
+    {
+        params_[it->first] = it->second;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <class TYPE>
+void ParameterCache<TYPE>::registerConsoleVariable(const std::string & key, RegisteredFpGroup * group)
+{
+    s_console.addVariable(key.c_str(), getPointer(key), group);
+}
+
 
 
 template < >
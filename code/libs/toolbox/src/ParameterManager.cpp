@@ -4,17 +4,12 @@
 #include "TinyXmlUtils.h"
 #include "Log.h"
 
-//------------------------------------------------------------------------------
-class MalformedEntryException : public Exception
-{
- public:
-    MalformedEntryException() : Exception("MalformedEntryException"){}
-};
-
 
+unsigned ParameterManager::num_string_lookups_ = 0;
 
 //------------------------------------------------------------------------------
-ParameterManager::ParameterManager()
+ParameterManager::ParameterManager() :
+    generation_(1)
 {
 }
 
@@ -108,9 +103,17 @@ void ParameterManager::loadParameters(const std::string & filename,
 
 
 //------------------------------------------------------------------------------
-void ParameterManager::load(const TiXmlHandle & handle, ParameterLoadCallback * callback)
+/**
+ *  \param console_keys If not NULL, variables flagged for console
+ *  registration are not registered but their keys are appended to
+ *  this vector instead, see merge().
+ */
+void ParameterManager::load(const TiXmlHandle & handle, ParameterLoadCallback * callback,
+                            std::vector<std::string> * console_keys)
 {
     using namespace tinyxml_utils;
+
+    ++generation_;
     
     if (!handle.ToElement()) throw Exception("Missing top-lvl element");
 
@@ -140,8 +143,15 @@ void ParameterManager::load(const TiXmlHandle & handle, ParameterLoadCallback *
 
                 std::string full_key = section_name + std::string(key);
 
+                bool register_console = console && *console=='1';
+                if (register_console && console_keys)
+                {
+                    console_keys->push_back(full_key);
+                    register_console = false;
+                }
+
                 // insert value into ParameterCache                
-                setOnLoad(full_key, value, datatype, console && *console=='1');
+                setOnLoad(full_key, value, datatype, register_console);
 
                 if (callback) (*callback)(full_key, value);
             }
@@ -162,6 +172,41 @@ void ParameterManager::load(const TiXmlHandle & handle, ParameterLoadCallback *
 }
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Copies all values of other into this ParameterManager, overwriting
+ *  existing keys. This is equivalent to loading the xml other was
+ *  loaded from, without touching the file again.
+ *
+ *  \param console_keys The keys to register as console variables, as
+ *  obtained from load().
+ */
+void ParameterManager::merge(const ParameterManager & other,
+                             const std::vector<std::string> & console_keys)
+{
+    ++generation_;
+
+    for (CacheMap::const_iterator it = other.caches_.begin();
+         it != other.caches_.end();
+         ++it)
+    {
+        CacheMap::iterator own = caches_.find(it->first);
+        if (own == caches_.end())
+        {
+            caches_[it->first] = it->second->clone();
+        } else
+        {
+            own->second->merge(*it->second);
+        }
+    }
+
+    for (unsigned k=0; k<console_keys.size(); ++k)
+    {
+        getCacheForKey(console_keys[k])->second->registerConsoleVariable(console_keys[k], &fp_group_);
+    }
+}
+
+
 //------------------------------------------------------------------------------
 /**
  *  Parameters specified on the command line have the format
@@ -562,6 +607,27 @@ GlobalParameters::GlobalParameters()
 
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Changes whenever previously obtained pointers to parameter values
+ *  might have become invalid or new parameters were loaded.
+ */
+unsigned ParameterManager::getGeneration() const
+{
+    return generation_;
+}
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the total number of parameter lookups by key so far.
+ */
+unsigned ParameterManager::getNumStringLookups()
+{
+    return num_string_lookups_;
+}
+
+
+
 //------------------------------------------------------------------------------
 LocalParameters::LocalParameters(const LocalParameters & other)
 {
@@ -573,6 +639,7 @@ LocalParameters::LocalParameters(const LocalParameters & other)
 LocalParameters & LocalParameters::operator=(const LocalParameters & other)
 {
     caches_.clear();
+    ++generation_;
     
     for (CacheMap::const_iterator it = other.caches_.begin();
          it != other.caches_.end();
@@ -3,6 +3,7 @@
 #define TANK_PARAMETERMANAGER_INCLUDED
 
 #include <string>
+#include <vector>
 #include <sstream>
 #include <map>
 
@@ -18,6 +19,18 @@
 typedef Loki::Functor<void, LOKI_TYPELIST_2(const std::string &, const std::string&)> ParameterLoadCallback;
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Thrown by ParameterManager::load() after all well-formed entries
+ *  have been loaded.
+ */
+class MalformedEntryException : public Exception
+{
+ public:
+    MalformedEntryException() : Exception("MalformedEntryException"){}
+};
+
+
 //------------------------------------------------------------------------------
 /**
  * \brief Class for managing key/value pairs intended to be used as parameters.
@@ -41,7 +54,10 @@ class ParameterManager
 
     void loadParameters(const std::string & filename, const std::string & super_section = "",
                         ParameterLoadCallback * callback = NULL);    
-    void load(const TiXmlHandle & handle, ParameterLoadCallback * callback = NULL);
+    void load(const TiXmlHandle & handle, ParameterLoadCallback * callback = NULL,
+              std::vector<std::string> * console_keys = NULL);
+    void merge(const ParameterManager & other,
+               const std::vector<std::string> & console_keys = std::vector<std::string>());
 
     void mergeCommandLineParams( int argc, char **argv );
 	
@@ -62,6 +78,10 @@ class ParameterManager
     template<typename TYPE> 
     void set(const std::string & key, const TYPE & value);
 
+    unsigned getGeneration() const;
+
+    static unsigned getNumStringLookups();
+
  protected:
 
     void setOnLoad(const std::string & key, const std::string & value, const std::string & datatype, bool console);
@@ -73,6 +93,13 @@ class ParameterManager
 
     CacheMap caches_;
 
+    unsigned generation_; ///< Incremented whenever pointers to
+                          ///parameter values might have become
+                          ///invalid, see ParameterHandle.
+
+    static unsigned num_string_lookups_; ///< Total number of lookups
+                                         ///by key, for profiling.
+
     RegisteredFpGroup fp_group_; ///< For console registration
 };
 
@@ -115,6 +142,8 @@ const RETURN_TYPE & ParameterManager::get(const std::string & key) const
 template <typename RETURN_TYPE>
 RETURN_TYPE * ParameterManager::getPointer(const std::string & key) const
 {
+    ++num_string_lookups_;
+    
     CacheMap::const_iterator it = caches_.find(getDatatypeAsString<RETURN_TYPE>());
         
     ParameterCache<RETURN_TYPE> * cache;
@@ -157,6 +186,7 @@ void ParameterManager::set(const std::string & key, const TYPE & value)
     {
         cache = new ParameterCache<TYPE>();
         caches_[key] = cache;
+        ++generation_;
     } else
     {
         cache = (ParameterCache<TYPE>*)it->second;
@@ -216,4 +246,63 @@ class LocalParameters : public ParameterManager
 
 
 
+//------------------------------------------------------------------------------
+/**
+ *  Gives access to a single parameter without looking up its key
+ *  every time. The key is resolved on first use and again only after
+ *  the ParameterManager's contents were reloaded or replaced, so
+ *  handles can be declared before the parameters are loaded:
+ *
+ *  static ParameterHandle<float> time_scale("physics.time_scale");
+ *  dt *= time_scale.get();
+ */
+template <typename TYPE>
+class ParameterHandle
+{
+ public:
+    ParameterHandle(const std::string & key, const ParameterManager * params = NULL);
+
+    const TYPE & get() const;
+    
+ protected:
+    std::string key_;
+    const ParameterManager * params_; ///< NULL to use s_params.
+
+    mutable const TYPE * value_;
+    mutable unsigned generation_; ///< Generation of params_ value_ was resolved in.
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  \param params The parameters to get the value from, or NULL for
+ *  the global parameters.
+ */
+template <typename TYPE>
+ParameterHandle<TYPE>::ParameterHandle(const std::string & key, const ParameterManager * params) :
+    key_(key),
+    params_(params),
+    value_(NULL),
+    generation_(0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+template <typename TYPE>
+const TYPE & ParameterHandle<TYPE>::get() const
+{
+    const ParameterManager & params = params_ ? *params_ : s_params;
+
+    if (generation_ != params.getGeneration())
+    {
+        value_      = params.getPointer<TYPE>(key_);
+        generation_ = params.getGeneration();
+    }
+
+    return *value_;
+}
+
+
+
 #endif
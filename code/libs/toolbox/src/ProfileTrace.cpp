@@ -0,0 +1,255 @@
+
+#include "ProfileTrace.h"
+
+#include <fstream>
+#include <algorithm>
+
+#include "ParameterManager.h"
+#include "Console.h"
+#include "Exception.h"
+#include "Utils.h"
+
+#undef min
+#undef max
+
+
+namespace profiler
+{
+
+bool TraceRecorder::enabled_ = false;
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Writes the string with JSON escaping. Profile names are C++
+ *  identifiers in most cases, so this rarely does anything.
+ */
+void writeJsonString(std::ostream & out, const char * str)
+{
+    out << '"';
+    for (const char * c = str; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\') out << '\\';
+        if ((unsigned char)*c < 0x20) out << ' ';
+        else out << *c;
+    }
+    out << '"';
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Used as cleanup function for the thread specific buffer pointer.
+ *  Buffers are owned by the TraceRecorder and outlive their thread,
+ *  so the samples of finished threads can still be exported.
+ */
+void keepTraceBuffer(TraceBuffer * buffer)
+{
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  \param capacity The number of samples kept, rounded up to the next
+ *  power of two.
+ */
+TraceBuffer::TraceBuffer(unsigned thread, unsigned capacity) :
+    thread_(thread),
+    write_pos_(0)
+{
+    unsigned size = 1;
+    while (size < capacity) size <<= 1;
+
+    event_.resize(size);
+    mask_ = size-1;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Appends the samples currently held by the buffer to events, oldest
+ *  first.
+ */
+void TraceBuffer::getEvents(std::vector<TraceEvent> & events) const
+{
+    unsigned num_events = std::min(write_pos_, (unsigned)event_.size());
+
+    for (unsigned pos = write_pos_ - num_events; pos != write_pos_; ++pos)
+    {
+        events.push_back(event_[pos & mask_]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void TraceBuffer::clear()
+{
+    write_pos_ = 0;
+}
+
+
+
+//------------------------------------------------------------------------------
+TraceRecorder::TraceRecorder() :
+    start_time_(getCurMicros()),
+    buffer_size_(0),
+    thread_buffer_(&keepTraceBuffer)
+{
+    s_console.addFunction("startTrace",
+                          ConsoleFun(this, &TraceRecorder::startTraceConsole),
+                          &fp_group_);
+    s_console.addFunction("stopTrace",
+                          ConsoleFun(this, &TraceRecorder::stopTraceConsole),
+                          &fp_group_);
+    s_console.addFunction("exportTrace",
+                          ConsoleFun(this, &TraceRecorder::exportTraceConsole),
+                          &fp_group_);
+}
+
+
+//------------------------------------------------------------------------------
+TraceRecorder::~TraceRecorder()
+{
+    enabled_ = false;
+
+    for (unsigned b=0; b<buffer_.size(); ++b)
+    {
+        delete buffer_[b];
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Starts or stops recording. Previously recorded samples are
+ *  discarded when recording is started.
+ *
+ *  Must be called from the main thread.
+ */
+void TraceRecorder::setEnabled(bool e)
+{
+    if (e == enabled_) return;
+
+    if (e)
+    {
+        // Worker threads must not access s_params.
+        buffer_size_ = s_params.get<unsigned>("profiler.trace.buffer_size");
+        
+        boost::mutex::scoped_lock lock(buffer_mutex_);
+        for (unsigned b=0; b<buffer_.size(); ++b)
+        {
+            buffer_[b]->clear();
+        }
+    }
+
+    enabled_ = e;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the calling thread's buffer, creating it on first use.
+ */
+TraceBuffer * TraceRecorder::getThreadBuffer()
+{
+    TraceBuffer * ret = thread_buffer_.get();
+    if (ret) return ret;
+
+    boost::mutex::scoped_lock lock(buffer_mutex_);
+
+    ret = new TraceBuffer(buffer_.size(), buffer_size_);
+    buffer_.push_back(ret);
+    thread_buffer_.reset(ret);
+
+    return ret;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Writes all samples currently held by the thread buffers in the
+ *  Chrome trace event format. Thread 0 is the first thread which
+ *  recorded a sample, usually the main thread.
+ */
+void TraceRecorder::exportChromeTrace(const std::string & filename) const
+{
+    std::ofstream out(filename.c_str());
+    if (!out) throw Exception("Could not open " + filename + " for writing.");
+
+    boost::mutex::scoped_lock lock(buffer_mutex_);
+
+    std::vector<TraceEvent> events;
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool first = true;
+    for (unsigned b=0; b<buffer_.size(); ++b)
+    {
+        unsigned thread = buffer_[b]->getThread();
+
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread
+            << ",\"args\":{\"name\":\"" << (thread == 0 ? "main" : "thread " + toString(thread)) << "\"}}";
+        first = false;
+
+        events.clear();
+        buffer_[b]->getEvents(events);
+
+        for (unsigned e=0; e<events.size(); ++e)
+        {
+            out << ",\n{\"name\":";
+            writeJsonString(out, events[e].name_);
+            out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread
+                << ",\"ts\":"  << events[e].start_ - start_time_
+                << ",\"dur\":" << events[e].duration_ << "}";
+        }
+    }
+
+    out << "\n]}\n";
+
+    if (!out) throw Exception("Error writing " + filename);
+}
+
+
+//------------------------------------------------------------------------------
+std::string TraceRecorder::startTraceConsole(const std::vector<std::string> & args)
+{
+    setEnabled(true);
+    return "Trace recording started.";
+}
+
+
+//------------------------------------------------------------------------------
+std::string TraceRecorder::stopTraceConsole(const std::vector<std::string> & args)
+{
+    setEnabled(false);
+    return "Trace recording stopped.";
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Exports the current buffer contents to the specified file or
+ *  profiler.trace.filename. Recording continues.
+ */
+std::string TraceRecorder::exportTraceConsole(const std::vector<std::string> & args)
+{
+    if (args.size() > 1) return "usage: exportTrace [filename]";
+
+    std::string filename = args.empty() ?
+        s_params.get<std::string>("profiler.trace.filename") :
+        args[0];
+
+    try
+    {
+        exportChromeTrace(filename);
+    } catch (Exception & e)
+    {
+        return e.getMessage();
+    }
+
+    return "Trace written to " + filename + ".";
+}
+
+
+} // namespace profiler
@@ -0,0 +1,152 @@
+
+#ifndef LIB_PROFILE_TRACE_INCLUDED
+#define LIB_PROFILE_TRACE_INCLUDED
+
+#include <vector>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "Datatypes.h"
+#include "Singleton.h"
+#include "TimeStructs.h"
+#include "RegisteredFpGroup.h"
+
+
+namespace profiler
+{
+
+//------------------------------------------------------------------------------
+/**
+ *  A single completed profile sample. Begin and end are stored
+ *  together, so a sample never loses its counterpart when the ring
+ *  buffer wraps.
+ */
+struct TraceEvent
+{
+    const char * name_;  ///< Static string passed to PROFILE.
+    uint64_t     start_; ///< Microseconds, see getCurMicros().
+    uint32_t     duration_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Fixed size ring buffer of the most recent samples of a single
+ *  thread. Only the owning thread writes to it, so recording needs
+ *  no synchronization at all.
+ */
+class TraceBuffer
+{
+ public:
+    TraceBuffer(unsigned thread, unsigned capacity);
+
+    void record(const char * name, uint64_t start, uint64_t end)
+        {
+            TraceEvent & event = event_[write_pos_ & mask_];
+            event.name_     = name;
+            event.start_    = start;
+            event.duration_ = (uint32_t)(end - start);
+            ++write_pos_;
+        }
+
+    unsigned getThread() const { return thread_; }
+
+    void getEvents(std::vector<TraceEvent> & events) const;
+    void clear();
+
+ protected:
+    unsigned thread_;
+
+    std::vector<TraceEvent> event_;
+    unsigned mask_;      ///< Capacity is a power of two.
+    unsigned write_pos_; ///< Total number of events recorded.
+};
+
+
+#define s_trace_recorder Loki::SingletonHolder<profiler::TraceRecorder, Loki::CreateUsingNew, SingletonDefaultLifetime >::Instance()
+//------------------------------------------------------------------------------
+/**
+ *  Records profile samples of all threads into per-thread ring
+ *  buffers and writes them to a Chrome trace file (chrome://tracing,
+ *  ui.perfetto.dev) on demand. Unlike the Profiler tree, which
+ *  averages over many frames, this keeps the individual samples of
+ *  the last few seconds, so single slow frames can be examined.
+ *
+ *  When disabled, a sample costs a single check of a static flag.
+ *
+ *  Export must not run concurrently with recording threads other
+ *  than the calling one. This holds for the console command, which
+ *  is executed by the main thread between two WorkerPool batches.
+ */
+class TraceRecorder
+{
+    DECLARE_SINGLETON(TraceRecorder);
+ public:
+    virtual ~TraceRecorder();
+
+    static bool isEnabled() { return enabled_; }
+    void setEnabled(bool e);
+
+    TraceBuffer * getThreadBuffer();
+
+    void exportChromeTrace(const std::string & filename) const;
+
+ protected:
+
+    std::string startTraceConsole (const std::vector<std::string> & args);
+    std::string stopTraceConsole  (const std::vector<std::string> & args);
+    std::string exportTraceConsole(const std::vector<std::string> & args);
+
+    static bool enabled_;
+
+    uint64_t start_time_; ///< Exported timestamps are relative to this.
+
+    unsigned buffer_size_; ///< profiler.trace.buffer_size, read on the
+                           ///main thread when recording starts.
+
+    boost::thread_specific_ptr<TraceBuffer> thread_buffer_;
+
+    mutable boost::mutex buffer_mutex_;  ///< Guards buffer_.
+    std::vector<TraceBuffer*> buffer_;   ///< Buffers of all threads which ever recorded.
+
+    RegisteredFpGroup fp_group_;
+};
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Records the lifetime of its scope to the calling thread's trace
+ *  buffer if tracing is enabled. Safe to use from any thread.
+ */
+class TraceSample
+{
+ public:
+    TraceSample(const char * name) : buffer_(NULL), name_(name), start_(0)
+        {
+            if (!TraceRecorder::isEnabled()) return;
+
+            buffer_ = s_trace_recorder.getThreadBuffer();
+            start_  = getCurMicros();
+        }
+
+    ~TraceSample()
+        {
+            if (buffer_) buffer_->record(name_, start_, getCurMicros());
+        }
+
+ protected:
+    TraceBuffer * buffer_;
+    const char * name_;
+    uint64_t start_;
+};
+
+/// Like PROFILE, but only recorded to the trace. To be used on
+/// worker threads, where the Profiler tree must not be touched.
+#define PROFILE_TRACE( name ) profiler::TraceSample _trace_sample_( #name )
+
+
+} // namespace profiler
+
+#endif // #ifndef LIB_PROFILE_TRACE_INCLUDED
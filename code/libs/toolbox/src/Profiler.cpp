@@ -1,9 +1,14 @@
 
 #include "Profiler.h"
 
+#include <algorithm>
+
 #include "Scheduler.h"
 #include "ParameterManager.h"
 
+#undef min
+#undef max
+
 
 namespace profiler
 {
@@ -105,7 +110,8 @@ ProfileNode::ProfileNode( const char * name, ProfileNode * parent ) :
     recursion_counter_( 0 ),
     parent_( parent ),
     child_( NULL ),
-    sibling_( NULL )
+    sibling_( NULL ),
+    last_child_( NULL )
 {
     reset();
 }
@@ -125,11 +131,14 @@ ProfileNode::~ProfileNode()
  */
 ProfileNode * ProfileNode::getOrCreateChild( const char * name )
 {
+    if ( last_child_ && last_child_->name_ == name ) return last_child_;
+    
     ProfileNode * child = child_;
     while ( child )
     {
         if ( child->name_ == name )
         {
+            last_child_ = child;
             return child;
         }
         child = child->sibling_;
@@ -139,6 +148,7 @@ ProfileNode * ProfileNode::getOrCreateChild( const char * name )
     ProfileNode * node = new ProfileNode( name, this );
     node->sibling_ = child_;
     child_ = node;
+    last_child_ = node;
     return node;
 }
 
@@ -147,6 +157,7 @@ void ProfileNode::clearAll()
 {
     DELNULL(child_);
     DELNULL(sibling_);
+    last_child_ = NULL;
     reset();
 }
 
@@ -308,7 +319,9 @@ Profiler::Profiler() : root_( "Root", NULL),
                        iterator_(&root_),
                        reset_(false),
                        refresh_(true),
-                       frame_counter_(0)
+                       frame_counter_(0),
+                       num_param_lookups_(0),
+                       last_num_param_lookups_(ParameterManager::getNumStringLookups())
 {
     root_.call();
 
@@ -329,13 +342,16 @@ Profiler::~Profiler()
 /**
  *  Writes the timing information of all nodes into the buffer, then
  *  removes all ProfilNodes accumulated until now, and starts over.
+ *
+ *  \param num_frames The accumulated values are divided by this
+ *  number, so the summary shows averages per frame instead of totals.
  */
-const char * Profiler::getSummary()
+const char * Profiler::getSummary(unsigned num_frames)
 {
     if (!root_.getChild()) return "";
     
     root_.finish();
-    root_.calcFrameValues(1.0f);
+    root_.calcFrameValues(1.0f / std::max(num_frames, 1u));
 
     std::ostringstream out;
 
@@ -360,6 +376,7 @@ const char * Profiler::getSummary()
     root_.clearAll();
 
     frame_counter_ = 0;
+    num_param_lookups_ = 0;
     
     root_.call();
 
@@ -401,12 +418,17 @@ void Profiler::refresh(float dt)
 void Profiler::frameMove()
 {
     root_.finish();
+
+    unsigned num_param_lookups = ParameterManager::getNumStringLookups();
+    num_param_lookups_ += num_param_lookups - last_num_param_lookups_;
+    last_num_param_lookups_ = num_param_lookups;
     
     if (reset_)
     {
         reset_ = false;
         root_.reset(); 
         frame_counter_ = 0;
+        num_param_lookups_ = 0;
     } else if (refresh_)
     {
         refresh_ = false;
@@ -535,7 +557,8 @@ void Profiler::writeFrameToBuffer()
     out << std::left;
     out << std::setprecision(3);
     
-    out << 1.0f / root_.getFrameTime() << " fps\n\n";
+    out << 1.0f / root_.getFrameTime() << " fps, "
+        << (float)num_param_lookups_ / frame_counter_ << " parameter lookups by key\n\n";
 
     if (iterator_.first())
     {
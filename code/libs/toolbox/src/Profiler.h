@@ -10,6 +10,7 @@
 #include "Singleton.h"
 #include "TimeStructs.h"
 #include "Scheduler.h"
+#include "ProfileTrace.h"
 
 namespace profiler
 {
@@ -67,6 +68,10 @@ class ProfileNode
     ProfileNode * parent_;
     ProfileNode * child_;
     ProfileNode * sibling_;
+
+    ProfileNode * last_child_; ///< The child most recently returned
+                               ///by getOrCreateChild, checked
+                               ///before scanning the list.
 };
 
 
@@ -109,7 +114,7 @@ class Profiler
 
     virtual ~Profiler();
     
-    const char * getSummary();
+    const char * getSummary(unsigned num_frames = 1);
     void clearAll();
 
     void reset(float dt);
@@ -147,6 +152,9 @@ class Profiler
                                   ///child or parent node).
     
     unsigned frame_counter_;
+
+    unsigned num_param_lookups_;      ///< Parameter lookups by key since the last reset.
+    unsigned last_num_param_lookups_; ///< ParameterManager's total at the last frameMove.
     
     std::string buffer_;          ///< A multiline-string containing profile information.
 
@@ -157,12 +165,15 @@ class Profiler
 //------------------------------------------------------------------------------
 /**
  *  ProfileSampleClass is a simple way to profile a function's scope
- *  Use the PROFILE macro at the start of scope to time
+ *  Use the PROFILE macro at the start of scope to time. The sample
+ *  is recorded to the trace as well, if enabled.
+ *
+ *  Main thread only, use PROFILE_TRACE on worker threads.
  */
 class ProfileSample
 {
  public:
-    ProfileSample( const char * name )
+    ProfileSample( const char * name ) : trace_sample_( name )
 	{ 
             s_profiler.startProfile( name ); 
 	}
@@ -171,6 +182,9 @@ class ProfileSample
 	{ 
             s_profiler.stopProfile(); 
 	}
+
+ private:
+    TraceSample trace_sample_;
 };
 
 #define	PROFILE( name ) profiler::ProfileSample _profile_sample_( #name )
@@ -3,6 +3,7 @@
 #include "Scheduler.h"
 
 #include <limits>
+#include <algorithm>
 
 #include "Log.h"
 
@@ -14,6 +15,11 @@
 /// rendered frame.
 const float FRAME_TASK_TIME = std::numeric_limits<float>::max();
 
+/// Task handles consist of the task's slot in the pool and the slot's
+/// serial number, so removing a task needn't search for it.
+const unsigned TASK_SLOT_BITS = 18;
+const unsigned TASK_SLOT_MASK = (1 << TASK_SLOT_BITS) - 1;
+
 //------------------------------------------------------------------------------
 TaskFp::TaskFp(hTask task) :
     htask_(task)
@@ -49,8 +55,9 @@ void TaskFp::deregisterPointer() const
 //------------------------------------------------------------------------------
 Scheduler::Scheduler() :
     last_frame_dt_(0.0f),
+    cur_time_(0.0),
     render_callback_(RenderCallback(this, &Scheduler::dummyRender)),
-    next_id_(0)
+    next_heap_seq_(1)
 {
     s_log << Log::debug('i') << "Scheduler constructor\n";
 
@@ -92,109 +99,108 @@ Scheduler::~Scheduler()
 void Scheduler::frameMove(float dt)
 {
     last_frame_dt_ = dt;
-    unsigned tasks_per_frame = 0;    
-    if (!task_.empty())
+    unsigned tasks_per_frame = 0;
+
+    cur_time_ += dt;
+    
+    while (!heap_.empty() && heap_.front().time_ < cur_time_)
     {
-        // Update task next_time_
-        for (TaskContainer::iterator it = task_.begin();
-             it != task_.end();
-             ++it)
+        TaskHeapEntry entry = heap_.front();
+        std::pop_heap(heap_.begin(), heap_.end());
+        heap_.pop_back();
+
+        Task * cur_task = &task_[entry.slot_];
+
+        // The task was rescheduled or its slot reused, a newer entry
+        // exists.
+        if (!cur_task->in_use_ ||
+            cur_task->is_frame_task_ ||
+            cur_task->heap_seq_ != entry.seq_) continue;
+
+        // remove deregistered tasks
+        if (cur_task->id_ == INVALID_TASK_HANDLE)
         {
-            if (it->next_time_ != FRAME_TASK_TIME) it->next_time_ -= dt;
+            releaseTask(entry.slot_);
+            continue;
         }
-        
-        Task * cur_task;
-        while (cur_task = &(*task_.begin()),
-               cur_task->next_time_ < 0.0f)
-        {            
-            ++tasks_per_frame;
-            
-            // remove deregistered tasks
-            if (cur_task->id_ == INVALID_TASK_HANDLE)
-            {
-                task_.erase(task_.begin());
-                if (task_.size() == 0) return;
-                continue;
-            }
 
-            try
+        ++tasks_per_frame;
+            
+        try
+        {
+            if (cur_task->is_periodic_)
             {
-                if (cur_task->is_periodic_)
-                {
-                    // re-schedule periodic tasks
+                // re-schedule periodic tasks
                     
-                    // Do this before doing the callback, in case another task is inserted
-                    // and comes first in the list.
-                    cur_task->next_time_ += cur_task->period_;
-                    reschedule(task_.begin()); 
+                // Do this before doing the callback, in case the
+                // task is removed or rescheduled from the callback.
+                // Tasks with period 0 are executed once per frame,
+                // all others catch up on missed periods.
+                if (cur_task->period_ == 0.0f) cur_task->next_time_ = cur_time_;
+                else                           cur_task->next_time_ += cur_task->period_;
+                pushHeapEntry(entry.slot_);
                     
-                    cur_task->periodic_callback_(cur_task->period_);
-                } else
-                {
-                    // remove nonperiodic tasks
-                    s_log << Log::debug('t')
-                          << "Executing event "
-                          << cur_task->name_
-                          << "\n";
-
-                    // Store callback and user data pointer to call
-                    // task after erasing it. This avoids issues when
-                    // the callback inserts tasks which come on first
-                    // place.
-                    void * user_data             = cur_task->user_data_;
-                    SingleEventCallback callback = cur_task->single_callback_;
-
-                    // Remove expired events from their respective fp
-                    // group.
-                    TaskFp tf(cur_task->id_);
-                    cur_task->fp_group_->deregister(tf);
+                cur_task->periodic_callback_(cur_task->period_);
+            } else
+            {
+                // remove nonperiodic tasks
+                s_log << Log::debug('t')
+                      << "Executing event "
+                      << cur_task->name_
+                      << "\n";
+
+                // Store callback and user data pointer to call task
+                // after releasing it. The callback might schedule the
+                // same slot again.
+                void * user_data             = cur_task->user_data_;
+                SingleEventCallback callback = cur_task->single_callback_;
+
+                // Remove expired events from their respective fp
+                // group.
+                TaskFp tf(cur_task->id_);
+                cur_task->fp_group_->deregister(tf);
                     
-                    task_.erase(task_.begin());
-                    cur_task = NULL;
+                releaseTask(entry.slot_);
+                cur_task = NULL;
                     
-                    callback(user_data);    
-                }
-
-                if (task_.size() == 0) break;
-            } catch (Exception & e)
-            {
-                if (cur_task) e.addHistory(cur_task->name_);
-                s_log << Log::error << e << "\n";
-                emit(EE_EXCEPTION_CAUGHT, &e);
+                callback(user_data);    
             }
+        } catch (Exception & e)
+        {
+            if (cur_task) e.addHistory(cur_task->name_);
+            s_log << Log::error << e << "\n";
+            emit(EE_EXCEPTION_CAUGHT, &e);
         }
     }
 
     // Delete old frame tasks
-    std::list<Task>::reverse_iterator it = task_.rbegin();
-    while (it != task_.rend() && it->next_time_ == FRAME_TASK_TIME)
+    for (unsigned i=0; i<frame_task_.size(); /* do nothing */)
     {
-        if (it->id_ == INVALID_TASK_HANDLE)
+        if (task_[frame_task_[i]].id_ == INVALID_TASK_HANDLE)
         {
-            task_.erase(--it.base());
-            it = task_.rbegin();
-        } else ++it;
+            releaseTask(frame_task_[i]);
+            frame_task_.erase(frame_task_.begin() + i);
+        } else ++i;
     }
 
-    // Perform frame tasks
-    it = task_.rbegin();
-    while (it != task_.rend() && it->next_time_ == FRAME_TASK_TIME)
+    // Perform frame tasks, most recently added first. Frame tasks
+    // added from a callback are first executed next frame.
+    for (int i=(int)frame_task_.size()-1; i>=0; --i)
     {
-        if (it->id_ != INVALID_TASK_HANDLE)
+        Task & cur_task = task_[frame_task_[i]];
+        if (cur_task.id_ == INVALID_TASK_HANDLE) continue;
+
+        try
         {
-            try
-            {
-                it->periodic_callback_(dt);
-            } catch (Exception & e)
-            {
-                e.addHistory(it->name_);
-                s_log << Log::error
-                      << e
-                      << "\n";
-                emit(EE_EXCEPTION_CAUGHT, &e);
-            }
+            cur_task.periodic_callback_(dt);
+        } catch (Exception & e)
+        {
+            e.addHistory(cur_task.name_);
+            s_log << Log::error
+                  << e
+                  << "\n";
+            emit(EE_EXCEPTION_CAUGHT, &e);
         }
-        ++it;
     }
 
     ADD_LOCAL_CONSOLE_VAR(unsigned, tasks_per_frame);
@@ -231,20 +237,21 @@ hTask Scheduler::addTask (PeriodicTaskCallback callback, float period,
     {
         s_log << " with FPS " << 1.0f / period <<"\n";
     }
+
+    hTask id = allocateTask(name);
+    unsigned slot = id & TASK_SLOT_MASK;
+    Task & inserted = task_[slot];
+
+    inserted.is_periodic_       = true;
+    inserted.periodic_callback_ = callback;
+    inserted.next_time_         = cur_time_;
+    inserted.period_            = period;
+
+    pushHeapEntry(slot);
     
-    TaskContainer::iterator inserted = task_.insert(task_.begin(), Task());
-
-    inserted->id_                = next_id_;
-    inserted->is_periodic_       = true;
-    inserted->periodic_callback_ = callback;
-    inserted->next_time_         = 0.0f;
-    inserted->period_            = period;
-    inserted->name_              = name;
-    inserted->fp_group_          = NULL;
-    
-    group->addFunctionPointer(new TaskFp(next_id_));
+    group->addFunctionPointer(new TaskFp(id));
 
-    return next_id_++;
+    return id;
 }
 
 
@@ -262,22 +269,22 @@ hTask Scheduler::addEvent(SingleEventCallback  callback, float delay,
           << "\n";
     
     assert(delay >= 0.0f);
+
+    hTask id = allocateTask(name);
+    unsigned slot = id & TASK_SLOT_MASK;
+    Task & inserted = task_[slot];
     
-    TaskContainer::iterator inserted = task_.insert(task_.begin(), Task());
-    
-    inserted->id_              = next_id_;
-    inserted->is_periodic_     = false;
-    inserted->single_callback_ = callback;
-    inserted->next_time_       = delay;
-    inserted->user_data_       = user_data;
-    inserted->name_            = name;
-    inserted->fp_group_        = group;
+    inserted.is_periodic_     = false;
+    inserted.single_callback_ = callback;
+    inserted.next_time_       = cur_time_ + delay;
+    inserted.user_data_       = user_data;
+    inserted.fp_group_        = group;
 
-    reschedule(task_.begin());
+    pushHeapEntry(slot);
 
-    group->addFunctionPointer(new TaskFp(next_id_));
+    group->addFunctionPointer(new TaskFp(id));
 
-    return next_id_++;
+    return id;
 }
 
 
@@ -295,21 +302,20 @@ hTask Scheduler::addFrameTask(PeriodicTaskCallback callback,
           << name
           << "\n";
 
-    task_.push_back(Task());
-    Task & inserted = *task_.rbegin();
+    hTask id = allocateTask(name);
+    unsigned slot = id & TASK_SLOT_MASK;
+    Task & inserted = task_[slot];
 
-    inserted.id_                = next_id_;
     inserted.is_periodic_       = true;
+    inserted.is_frame_task_     = true;
     inserted.periodic_callback_ = callback;
-    inserted.next_time_         = FRAME_TASK_TIME;
     inserted.period_            = 0;
-    inserted.name_              = name;
-    inserted.fp_group_          = NULL;
 
+    frame_task_.push_back(slot);
     
-    group->addFunctionPointer(new TaskFp(next_id_));
+    group->addFunctionPointer(new TaskFp(id));
 
-    return next_id_++;
+    return id;
 }
 
 //------------------------------------------------------------------------------
@@ -322,33 +328,28 @@ hTask Scheduler::addFrameTask(PeriodicTaskCallback callback,
 void Scheduler::reschedule(hTask task, float new_time)
 {
     assert(task != INVALID_TASK_HANDLE);
-    
-    for (TaskContainer::iterator it = task_.begin();
-         it != task_.end();
-         ++it)
-    {
-        if (it->id_ == task)
-        {
-            s_log << Log::debug('t')
-                  << "Rescheduling task " << it->name_ << "\n";
 
-            if (it->is_periodic_)
-            {
-                it->period_ = new_time;
-            } else
-            {
-                it->next_time_ = new_time;
-                reschedule(it);
-            }
-            
-            return;
-        }
+    Task * t = getTask(task);
+    if (!t)
+    {
+        s_log << Log::error
+              << "Tried to reschedule non-existing task "
+              << task
+              << "\n";
+        return;
     }
     
-    s_log << Log::error
-          << "Tried to reschedule non-existing task "
-          << task
-          << "\n";
+    s_log << Log::debug('t')
+          << "Rescheduling task " << t->name_ << "\n";
+
+    if (t->is_periodic_)
+    {
+        t->period_ = new_time;
+    } else
+    {
+        t->next_time_ = cur_time_ + new_time;
+        pushHeapEntry(task & TASK_SLOT_MASK);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -358,20 +359,34 @@ void Scheduler::reschedule(hTask task, float new_time)
 float Scheduler::getExecutionDelay(hTask task) const
 {
     assert(task != INVALID_TASK_HANDLE);
-    
-    for (TaskContainer::const_iterator it = task_.begin();
-         it != task_.end();
-         ++it)
+
+    const Task * t = getTask(task);
+    if (!t)
     {
-        if (it->id_ == task) return it->next_time_;
+        s_log << Log::error
+              << "getExecutionDelay called fo nonexisting task "
+              << task
+              << "\n";
+        return 0.0f;
     }
+
+    if (t->is_frame_task_) return FRAME_TASK_TIME;
     
-    s_log << Log::error
-          << "getExecutionDelay called fo nonexisting task "
-          << task
-          << "\n";
-    
-    return 0.0f;
+    return (float)(t->next_time_ - cur_time_);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the time until the earliest event or periodic task is due,
+ *  or a negative value if none is scheduled. May be too early if that
+ *  task has been removed or rescheduled in the meantime.
+ */
+float Scheduler::getNextTaskDelay() const
+{
+    if (heap_.empty()) return -1.0f;
+
+    return std::max((float)(heap_.front().time_ - cur_time_), 0.0f);
 }
 
 
@@ -389,12 +404,8 @@ void * Scheduler::removeTask(hTask task, RegisteredFpGroup * fp_group)
     if (task == INVALID_TASK_HANDLE) return NULL;
 
     void * ret = NULL;
-    for (TaskContainer::iterator it = task_.begin();
-         it != task_.end();
-         ++it)
-    {
-        if (it->id_ == task && !it->is_periodic_) ret = it->user_data_;
-    }
+    const Task * t = getTask(task);
+    if (t && !t->is_periodic_) ret = t->user_data_;
     
     fp_group->deregister(TaskFp(task));
 
@@ -415,12 +426,8 @@ void Scheduler::setRenderCallback(RenderCallback callback)
 //------------------------------------------------------------------------------
 const std::string & Scheduler::getTaskName(hTask task) const
 {
-    for (TaskContainer::const_iterator it = task_.begin();
-         it != task_.end();
-         ++it)
-    {
-        if (it->id_ == task) return it->name_;
-    }
+    const Task * t = getTask(task);
+    if (t) return t->name_;
 
     const static std::string unknown = "Unknown task";
     return unknown;
@@ -444,6 +451,8 @@ std::string Scheduler::printTasks(const std::vector<std::string>&args)
          it != task_.end();
          ++it)
     {
+        if (!it->in_use_) continue;
+        
         if (it->id_ == INVALID_TASK_HANDLE)
         {
             strstr << "<defunct>";
@@ -455,7 +464,10 @@ std::string Scheduler::printTasks(const std::vector<std::string>&args)
                << it->name_
                << " ";
 
-        if (it->is_periodic_)
+        if (it->is_frame_task_)
+        {
+            strstr << "every frame ";
+        } else if (it->is_periodic_)
         {
             if (equalsZero(it->period_))
             {
@@ -471,7 +483,7 @@ std::string Scheduler::printTasks(const std::vector<std::string>&args)
         } else
         {
             strstr << "in "
-                   << it->next_time_
+                   << it->next_time_ - cur_time_
                    << " seconds.";
         }
 
@@ -483,53 +495,133 @@ std::string Scheduler::printTasks(const std::vector<std::string>&args)
 
 
 
-
 //------------------------------------------------------------------------------
 /**
- *  Removed tasks are not erased from the task list instantly because
- *  they could be just handled by framemove, instead they are marked
- *  for removal.
+ *  Takes a task from the pool and initializes its handle and name.
  */
-void Scheduler::removeTask(hTask task)
-{    
-    for (TaskContainer::iterator it = task_.begin();
-         it != task_.end();
-         ++it)
+hTask Scheduler::allocateTask(const std::string & name)
+{
+    unsigned slot;
+    if (free_slot_.empty())
     {
-        if (it->id_ == task)
-        {
-            s_log << Log::debug('t') << "Removing task " << it->name_ << "\n";
-            it->id_ = INVALID_TASK_HANDLE; // Flag for removal            
-            return;
-        }
+        slot = task_.size();
+        if (slot > TASK_SLOT_MASK) throw Exception("Too many scheduler tasks.");
+        
+        task_.push_back(Task());
+        task_.back().serial_ = 0;
+    } else
+    {
+        slot = free_slot_.front();
+        free_slot_.pop_front();
     }
 
+    Task & task = task_[slot];
 
-    s_log << Log::error
-          << "Tried to remove non-existing task "
-          << task
-          << "\n";
+    hTask id;
+    do
+    {
+        ++task.serial_;
+        id = slot | (task.serial_ << TASK_SLOT_BITS);
+    } while (id == INVALID_TASK_HANDLE);
+
+    task.id_            = id;
+    task.name_          = name;
+    task.in_use_        = true;
+    task.is_periodic_   = false;
+    task.is_frame_task_ = false;
+    task.next_time_     = cur_time_;
+    task.heap_seq_      = 0;
+    task.fp_group_      = NULL;
+    task.user_data_     = NULL;
+
+    return id;
 }
 
+
 //------------------------------------------------------------------------------
 /**
- *  Moves the given item of the task list to its proper place based on
- *  next_time_.
+ *  Returns the task to the pool. Stale heap entries referring to it
+ *  are recognized by their sequence number.
  */
-void Scheduler::reschedule(TaskContainer::iterator scheduled_task)
+void Scheduler::releaseTask(unsigned slot)
 {
-    // bail if list has only one element
-    if (task_.size() == 1) return;
+    Task & task = task_[slot];
+
+    task.id_     = INVALID_TASK_HANDLE;
+    task.in_use_ = false;
+    task.name_.clear();
+    task.periodic_callback_ = PeriodicTaskCallback();
+    task.single_callback_   = SingleEventCallback();
+
+    free_slot_.push_back(slot);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the task with the given handle, or NULL if it doesn't exist
+ *  (anymore).
+ */
+Task * Scheduler::getTask(hTask task)
+{
+    if (task == INVALID_TASK_HANDLE) return NULL;
     
-    TaskContainer::iterator it = task_.begin();
+    unsigned slot = task & TASK_SLOT_MASK;
+    if (slot >= task_.size() || task_[slot].id_ != task) return NULL;
+
+    return &task_[slot];
+}
+
+//------------------------------------------------------------------------------
+const Task * Scheduler::getTask(hTask task) const
+{
+    if (task == INVALID_TASK_HANDLE) return NULL;
+    
+    unsigned slot = task & TASK_SLOT_MASK;
+    if (slot >= task_.size() || task_[slot].id_ != task) return NULL;
+
+    return &task_[slot];
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Inserts a heap entry for the task in the given slot at its
+ *  next_time_. Any previous entry for the task becomes stale.
+ */
+void Scheduler::pushHeapEntry(unsigned slot)
+{
+    Task & task = task_[slot];
+    task.heap_seq_ = next_heap_seq_++;
+
+    TaskHeapEntry entry;
+    entry.time_ = task.next_time_;
+    entry.seq_  = task.heap_seq_;
+    entry.slot_ = slot;
 
-    // search element before which to insert task
-    while (it != task_.end() &&
-           (it == scheduled_task || *it < *scheduled_task))
+    heap_.push_back(entry);
+    std::push_heap(heap_.begin(), heap_.end());
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Removed tasks are not released instantly because they could be
+ *  just handled by framemove, instead they are marked for removal and
+ *  released when their heap entry comes up.
+ */
+void Scheduler::removeTask(hTask task)
+{    
+    Task * t = getTask(task);
+    if (!t)
     {
-        ++it;
+        s_log << Log::error
+              << "Tried to remove non-existing task "
+              << task
+              << "\n";
+        return;
     }
 
-    // reinsert task
-    task_.splice(it, task_, scheduled_task);
+    s_log << Log::debug('t') << "Removing task " << t->name_ << "\n";
+    t->id_ = INVALID_TASK_HANDLE; // Flag for removal            
 }
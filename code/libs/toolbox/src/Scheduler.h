@@ -2,7 +2,8 @@
 #ifndef RACING_SCHEDULER_INCLUDED
 #define RACING_SCHEDULER_INCLUDED
 
-#include <list>
+#include <deque>
+#include <vector>
 
 #include <loki/Functor.h>
 
@@ -40,13 +41,21 @@ class TaskFp : public RegisteredFp
 
 
 //------------------------------------------------------------------------------
+/**
+ *  Tasks are pooled by the scheduler and never move in memory, so a
+ *  task can safely be executed while other tasks are added.
+ */
 struct Task
 {
-    hTask id_;
+    hTask id_;         ///< INVALID_TASK_HANDLE if the task was removed or the slot is unused.
     std::string name_;
-    
+
+    bool in_use_;      ///< False if this slot is on the free list.
     bool is_periodic_; ///< False if single event, true if periodic task.
-    float next_time_;  ///< The time in seconds until this task is scheduled to execute next.
+    bool is_frame_task_;
+    double next_time_; ///< The absolute scheduler time this task is to execute next.
+    unsigned heap_seq_; ///< Sequence number of the task's current heap entry.
+    unsigned serial_;   ///< Incremented each time the slot is reused, part of the handle.
     
     PeriodicTaskCallback periodic_callback_; ///< The task's callback function for periodic tasks
     SingleEventCallback  single_callback_;   ///< Callback function for single events
@@ -58,13 +67,6 @@ struct Task
         float period_;     ///< The period of the task.
         void * user_data_; ///< User data pointer for single event.
     };
-
-    bool operator<(const Task & other)
-        {
-            if (next_time_ < other.next_time_) return true;
-            else if (next_time_ > other.next_time_) return false;
-            else return name_.compare(other.name_) > 0;
-        }
 };
 
 
@@ -95,6 +97,7 @@ class Scheduler : public Observable
     
     void reschedule(hTask task, float new_time);
     float getExecutionDelay(hTask task) const;
+    float getNextTaskDelay() const;
     
     void * removeTask(hTask task, RegisteredFpGroup * fp_group);
 
@@ -108,21 +111,58 @@ class Scheduler : public Observable
 
  protected:
 
-    typedef std::list<Task> TaskContainer;
+    //------------------------------------------------------------------------------
+    /**
+     *  Entry of the binary heap used to find the next task to
+     *  execute. Entries are never removed from the middle of the heap;
+     *  if a task is removed or rescheduled, its old entry becomes stale
+     *  and is discarded when it reaches the top.
+     */
+    struct TaskHeapEntry
+    {
+        /// Inverted so std::push_heap / pop_heap yield the earliest
+        /// task first. Tasks due at the same time are executed in
+        /// order of scheduling.
+        bool operator<(const TaskHeapEntry & other) const
+            {
+                if (time_ != other.time_) return time_ > other.time_;
+                return (int)(seq_ - other.seq_) > 0;
+            }
+        
+        double time_;
+        unsigned seq_;
+        unsigned slot_;
+    };
+    
+    typedef std::deque<Task> TaskContainer;
+
+    hTask allocateTask(const std::string & name);
+    void releaseTask(unsigned slot);
+    Task * getTask(hTask task);
+    const Task * getTask(hTask task) const;
 
+    void pushHeapEntry(unsigned slot);
+    
     void removeTask(hTask task);
 
-    void reschedule(TaskContainer::iterator scheduled_task);
-
     void dummyRender() {}
     
     float last_frame_dt_;
 
+    double cur_time_; ///< Accumulated dt since scheduler creation.
+    
     RenderCallback render_callback_;
 
-    unsigned next_id_;
+    unsigned next_heap_seq_; ///< 0 is never used, it marks tasks without heap entry.
     
-    TaskContainer task_;
+    TaskContainer task_;                ///< Task pool, indexed by slot.
+    std::deque<unsigned> free_slot_;    ///< Reused in FIFO order to
+                                        ///make handle collisions
+                                        ///unlikely.
+    std::vector<TaskHeapEntry> heap_;   ///< All events and periodic
+                                        ///tasks, earliest first.
+    std::vector<unsigned> frame_task_;  ///< Slots of frame tasks in
+                                        ///order of addition.
 
     RegisteredFpGroup fp_group_;
 };
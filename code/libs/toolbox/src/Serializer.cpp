@@ -28,16 +28,25 @@
  *******************************************************************************/
 
 #include "Serializer.h"
+
+#include <cstring>
+
 #include "Log.h"
 
 
 using namespace serializer;
 
+
+/// Size of the blocks read from the underlying stream.
+const size_t READ_BUFFER_SIZE = 64*1024;
+
 //------------------------------------------------------------------------------
 Serializer::Serializer() :
     tagging_enabled_(0),
     in_(NULL),
-    out_(NULL)
+    out_(NULL),
+    read_pos_(0),
+    read_end_(0)
 {
 }
 
@@ -54,7 +63,9 @@ Serializer::Serializer(const std::string & filename, uint32_t mode) :
     tagging_enabled_(false),
     filename_(filename),
     in_(NULL),
-    out_(NULL)
+    out_(NULL),
+    read_pos_(0),
+    read_end_(0)
 {
     open(filename, mode);
 }
@@ -111,6 +122,10 @@ void Serializer::open(const std::string & filename, uint32_t mode)
         }
         
 
+        read_buffer_.resize(READ_BUFFER_SIZE);
+        read_pos_ = 0;
+        read_end_ = 0;
+        
         // decide whether the file was written in "tagging" mode
         uint32_t marker;
         readBuffer(&marker, sizeof(marker));
@@ -122,17 +137,9 @@ void Serializer::open(const std::string & filename, uint32_t mode)
         {
             s_log << Log::debug('s') << "Reading " << filename << " in untagged mode.\n";
 
-            bool b=0;
-            b |= !in_->unget();
-            b |= !in_->unget();
-            b |= !in_->unget();
-            b |= !in_->unget();
-
-            if (b)
-            {
-                reset();
-                throw IoException("Unable to unget");
-            }
+            // The marker was the first read, so it is still in the
+            // buffer.
+            read_pos_ -= sizeof(marker);
         }
         
     } else if (mode & SOM_WRITE)
@@ -183,6 +190,10 @@ void Serializer::close()
     if (in_) 
     {
         DELNULL(in_);
+
+        std::vector<char> rb; read_buffer_.swap(rb);
+        read_pos_ = 0;
+        read_end_ = 0;
     }
     if (out_) 
     {
@@ -419,6 +430,10 @@ void Serializer::finalizeDeserialization()
 void Serializer::reset()
 {
     DELNULL(in_);
+
+    std::vector<char> rb; read_buffer_.swap(rb);
+    read_pos_ = 0;
+    read_end_ = 0;
     
     for (std::vector<IReference*>::iterator cur_ref = references_to_resolve_.begin();
          cur_ref != references_to_resolve_.end();
@@ -464,15 +479,51 @@ void Serializer::writeBuffer(const void * val, size_t length)
  */
 void Serializer::readBuffer(void * buf, size_t length)
 {
+    if (length <= read_end_ - read_pos_)
+    {
+        memcpy(buf, &read_buffer_[read_pos_], length);
+        read_pos_ += length;
+        return;
+    }
+
     if (in_ == NULL)
     {
         throw IoException("Stream is not open for reading.");
     }
-    
-    if (!in_->read((char*)buf, length))
+
+    // Use up what is left in the buffer.
+    size_t buffered = read_end_ - read_pos_;
+    if (buffered) memcpy(buf, &read_buffer_[read_pos_], buffered);
+    buf     = (char*)buf + buffered;
+    length -= buffered;
+
+    read_pos_ = 0;
+    read_end_ = 0;
+
+    if (length >= read_buffer_.size())
     {
-        reset();
-        throw IoException("Couldn't read from file " + filename_);
+        // Large blocks go directly to their destination.
+        if (!in_->read((char*)buf, length))
+        {
+            reset();
+            throw IoException("Couldn't read from file " + filename_);
+        }
+    } else
+    {
+        // Reaching the end of the file while filling the buffer is
+        // expected, only a short read for the requested data is
+        // an error.
+        in_->read(&read_buffer_[0], read_buffer_.size());
+        read_end_ = in_->gcount();
+
+        if (read_end_ < length)
+        {
+            reset();
+            throw IoException("Couldn't read from file " + filename_);
+        }
+
+        memcpy(buf, &read_buffer_[0], length);
+        read_pos_ = length;
     }
 }
 
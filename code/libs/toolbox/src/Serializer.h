@@ -324,6 +324,12 @@ private:
     
     std::istream * in_;
     std::ostream * out_;
+
+    std::vector<char> read_buffer_; ///< Input is read in large blocks
+                                    ///to avoid the stream overhead
+                                    ///for every single value.
+    size_t read_pos_;               ///< Next unread byte in read_buffer_.
+    size_t read_end_;               ///< End of the valid data in read_buffer_.
 };
 
 
@@ -341,6 +347,14 @@ void putInto(Serializer & s, const std::vector<T> & v)
 {
     s.put((uint32_t)v.size());
 
+    // Without tags, this yields the same file as writing each
+    // element.
+    if (IsRawSerializable<T>::value && !s.isTaggingEnabled())
+    {
+        if (!v.empty()) s.putRaw(&v[0], v.size()*sizeof(T));
+        return;
+    }
+    
     for (unsigned i=0; i<v.size(); ++i)
     {
         s.put(v[i]);
@@ -369,6 +383,12 @@ void getFrom(Serializer & s, std::vector<T> & v)
         throw e;
     }
 
+    if (IsRawSerializable<T>::value && !s.isTaggingEnabled())
+    {
+        if (!v.empty()) s.getRaw(&v[0], v.size()*sizeof(T));
+        return;
+    }
+    
     for (unsigned i=0; i<v.size(); ++i)
     {
         s.get(v[i]);
@@ -20,7 +20,8 @@ enum SINGLETON_LONGEVITY_LIFETIME
     SLL_LOG,
     SLL_PARAMETER_MANAGER,
     SLL_CONSOLE,
-    SLL_VARIABLE_WATCHER
+    SLL_VARIABLE_WATCHER,
+    SLL_BACKGROUND_WORKER
 };
 
 template<class T>
@@ -59,6 +60,9 @@ struct SingletonSchedulerLifetime  : Loki::LongevityLifetime::SingletonFixedLong
 template<class T>
 struct SingletonSdlAppLifetime  : Loki::LongevityLifetime::SingletonFixedLongevity< SLL_SDL_APP ,T> {};
 
+template<class T>
+struct SingletonBackgroundWorkerLifetime  : Loki::LongevityLifetime::SingletonFixedLongevity< SLL_BACKGROUND_WORKER ,T> {};
+
 
 //------------------------------------------------------------------------------
 namespace Loki
@@ -1,6 +1,10 @@
 
 #include "TimeStructs.h"
 
+#ifndef _WIN32
+#include <time.h>
+#endif
+
 //------------------------------------------------------------------------------
 /**
  *  Converts the specified time to milliseconds.
@@ -43,3 +47,28 @@ void getCurTime(TimeValue & time)
 #endif
 }
 
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns a timestamp in microseconds with an arbitrary but fixed
+ *  origin. Unlike getCurTime, this has sub-millisecond resolution on
+ *  win32 as well, and is monotonic, so it isn't affected by changes
+ *  to the system clock.
+ */
+uint64_t getCurMicros()
+{
+#if _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+        (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+#endif
+}
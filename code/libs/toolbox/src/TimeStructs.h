@@ -2,10 +2,10 @@
 #ifndef LIB_TIME_INCLUDED
 #define LIB_TIME_INCLUDED
 
-#ifdef _WIN32
-
 #include "Datatypes.h"
 
+#ifdef _WIN32
+
 typedef DWORD TimeValue;
 
 #else
@@ -21,6 +21,8 @@ float getMillis(const TimeValue & time);
 float getTimeDiff(const TimeValue & t2, const TimeValue & t1);
 void getCurTime(TimeValue & time);    
 
+uint64_t getCurMicros();
+
 
 
 #endif // #ifndef LIB_TIME_INCLUDED
@@ -96,6 +96,8 @@ void putInto(Serializer & s, const Vector & v);
     
 void getFrom(Serializer & s, Vector & v);
 
+template<> struct IsRawSerializable<Vector> { enum { value = true }; };
+
 }
 
 #endif // #ifndef LIB_VECTOR_INCLUDED
@@ -7,6 +7,8 @@
 
 #include <cmath>
 
+#include "Datatypes.h"
+
 class Vector;
 class Matrix;
 
@@ -66,6 +68,8 @@ class Serializer;
 void putInto(Serializer & s, const Vector2d & v);    
 void getFrom(Serializer & s, Vector2d & v);
 
+template<> struct IsRawSerializable<Vector2d> { enum { value = true }; };
+
 }
 
 
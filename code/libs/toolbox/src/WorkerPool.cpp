@@ -0,0 +1,188 @@
+
+#include "WorkerPool.h"
+
+#include <boost/bind.hpp>
+
+#include "Exception.h"
+#include "Log.h"
+#include "ProfileTrace.h"
+
+
+//------------------------------------------------------------------------------
+WorkerPool::WorkerPool() :
+    num_jobs_(0),
+    next_job_(0),
+    num_jobs_done_(0),
+    batch_(0),
+    quit_(false)
+{
+}
+
+
+//------------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+    stopThreads();
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  \param num_threads The total number of threads executing jobs,
+ *  including the calling thread. 0 and 1 both mean that all jobs are
+ *  executed serially by the calling thread.
+ */
+void WorkerPool::setNumThreads(unsigned num_threads)
+{
+    if (num_threads == 0) num_threads = 1;
+    if (num_threads == getNumThreads()) return;
+
+    stopThreads();
+
+    s_log << Log::debug('i')
+          << "Starting "
+          << num_threads-1
+          << " worker threads.\n";
+
+    for (unsigned t=1; t<num_threads; ++t)
+    {
+        thread_.push_back(new boost::thread(boost::bind(&WorkerPool::workerMain, this, t)));
+    }
+}
+
+
+//------------------------------------------------------------------------------
+unsigned WorkerPool::getNumThreads() const
+{
+    return thread_.size() + 1;
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Calls job for every index in [0, num_jobs) and returns after all
+ *  calls have completed. The order in which jobs are executed is
+ *  unspecified.
+ *
+ *  If a job throws, the remaining jobs are still executed and the
+ *  exception is rethrown in the calling thread afterwards.
+ */
+void WorkerPool::run(unsigned num_jobs, WorkerJob job)
+{
+    if (num_jobs == 0) return;
+
+    if (thread_.empty() || num_jobs == 1)
+    {
+        for (unsigned j=0; j<num_jobs; ++j) job(j, 0);
+        return;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        job_           = job;
+        num_jobs_      = num_jobs;
+        next_job_      = 0;
+        num_jobs_done_ = 0;
+        error_.clear();
+        ++batch_;
+    }
+    work_available_.notify_all();
+
+    executeJobs(0);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while (num_jobs_done_ != num_jobs_) work_done_.wait(lock);
+
+    num_jobs_ = 0;
+    job_      = WorkerJob();
+
+    if (!error_.empty())
+    {
+        std::string error;
+        error.swap(error_);
+        throw Exception(error);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void WorkerPool::stopThreads()
+{
+    if (thread_.empty()) return;
+
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        quit_ = true;
+    }
+    work_available_.notify_all();
+
+    for (unsigned t=0; t<thread_.size(); ++t)
+    {
+        thread_[t]->join();
+        delete thread_[t];
+    }
+    thread_.clear();
+
+    quit_ = false;
+}
+
+
+//------------------------------------------------------------------------------
+void WorkerPool::workerMain(unsigned thread)
+{
+    unsigned last_batch = 0;
+
+    while (true)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (!quit_ && (batch_ == last_batch || next_job_ >= num_jobs_))
+            {
+                work_available_.wait(lock);
+            }
+            if (quit_) return;
+
+            last_batch = batch_;
+        }
+
+        executeJobs(thread);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Fetches and executes jobs of the current batch until there are
+ *  none left.
+ */
+void WorkerPool::executeJobs(unsigned thread)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    while (next_job_ < num_jobs_)
+    {
+        unsigned cur_job = next_job_++;
+
+        lock.unlock();
+
+        std::string error;
+        try
+        {
+            PROFILE_TRACE(WorkerPool::job);
+            job_(cur_job, thread);
+        } catch (Exception & e)
+        {
+            error = e.getMessage();
+        } catch (std::exception & e)
+        {
+            error = e.what();
+        }
+
+        lock.lock();
+
+        if (!error.empty() && error_.empty()) error_ = error;
+
+        if (++num_jobs_done_ == num_jobs_) work_done_.notify_one();
+    }
+}
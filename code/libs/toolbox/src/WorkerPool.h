@@ -0,0 +1,73 @@
+
+#ifndef LIB_WORKER_POOL_INCLUDED
+#define LIB_WORKER_POOL_INCLUDED
+
+#include <vector>
+#include <string>
+
+#include <loki/Functor.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+#include "Singleton.h"
+
+
+/// Called once for every job index. The second argument is the index
+/// of the executing thread, 0 being the calling thread, and can be
+/// used to select per-thread buffers.
+typedef Loki::Functor<void, LOKI_TYPELIST_2(unsigned, unsigned) > WorkerJob;
+
+
+#define s_worker_pool Loki::SingletonHolder<WorkerPool, Loki::CreateUsingNew, SingletonDefaultLifetime >::Instance()
+//------------------------------------------------------------------------------
+/**
+ *  A fixed set of threads which execute batches of independent jobs
+ *  on behalf of the main thread. The calling thread takes part in the
+ *  work and run() blocks until all jobs are done, so the pool can be
+ *  used to spread a single loop over several cores without changing
+ *  the program's overall flow.
+ *
+ *  Jobs must not touch non-thread-safe state like s_log, s_params or
+ *  the profiler tree. PROFILE_TRACE may be used.
+ */
+class WorkerPool
+{
+    DECLARE_SINGLETON(WorkerPool);
+ public:
+    virtual ~WorkerPool();
+
+    void setNumThreads(unsigned num_threads);
+    unsigned getNumThreads() const;
+
+    void run(unsigned num_jobs, WorkerJob job);
+
+ protected:
+
+    void stopThreads();
+
+    void workerMain(unsigned thread);
+    void executeJobs(unsigned thread);
+
+    std::vector<boost::thread*> thread_;
+
+    boost::mutex mutex_;
+    boost::condition work_available_;
+    boost::condition work_done_;
+
+    WorkerJob job_;
+    unsigned num_jobs_;
+    unsigned next_job_;
+    unsigned num_jobs_done_;
+
+    unsigned batch_; ///< Incremented for every call to run(), so
+                     ///sleeping threads can tell whether there is
+                     ///new work.
+    bool quit_;
+
+    std::string error_; ///< Message of the first exception thrown by a job.
+};
+
+
+#endif
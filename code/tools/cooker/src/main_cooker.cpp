@@ -0,0 +1,178 @@
+
+#include <cstring>
+#include <vector>
+
+#include "Exception.h"
+#include "Log.h"
+#include "Utils.h"
+#include "Paths.h"
+#include "Serializer.h"
+#include "TerrainDataClient.h"
+#include "CookedTerrain.h"
+#include "physics/OdeModelLoader.h"
+
+
+using namespace terrain;
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Reads the level's waypoints.bin in the format expected by
+ *  WaypointManagerServer. Levels without waypoints are cooked without
+ *  the waypoint section.
+ */
+void readWaypoints(const std::string & path,
+                   CookedTerrainHeader & header,
+                   std::vector<CookedWaypoint> & waypoints)
+{
+    std::string wp_file = path + "waypoints.bin";
+    if (!existsFile(wp_file.c_str()))
+    {
+        s_log << Log::warning << "No waypoints found in " << path << "\n";
+        return;
+    }
+    
+    serializer::Serializer s(wp_file, serializer::SOM_READ | serializer::SOM_COMPRESS);
+
+    s.get(header.wp_width_);
+    s.get(header.wp_height_);
+    s.get(header.wp_horz_scale_);
+
+    waypoints.resize(header.wp_width_*header.wp_height_);
+    for (unsigned i=0; i<waypoints.size(); ++i)
+    {
+        Vector pos;
+        unsigned lvl;
+        
+        s.get(pos);
+        s.get(lvl);
+
+        waypoints[i].pos_[0] = pos.x_;
+        waypoints[i].pos_[1] = pos.y_;
+        waypoints[i].pos_[2] = pos.z_;
+        waypoints[i].level_  = lvl;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+void cookLevel(const std::string & name)
+{
+    std::string path = LEVEL_PATH + name + "/";
+
+    s_log << "Cooking " << path << "\n";
+    
+    TerrainDataClient terrain;
+    terrain.load(name, false);
+    
+    CookedTerrainHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.width_              = terrain.getResX();
+    header.height_             = terrain.getResZ();
+    header.max_height_         = terrain.getMaxHeight();
+    header.min_height_         = terrain.getMinHeight();
+    header.horz_scale_         = terrain.getHorzScale();
+    header.lm_texels_per_quad_ = terrain.getLmTexelsPerQuad();
+
+    std::vector<CookedWaypoint> waypoints;
+    readWaypoints(path, header, waypoints);
+
+    unsigned num_samples = header.width_*header.height_;
+    unsigned num_texels  = num_samples*header.lm_texels_per_quad_*header.lm_texels_per_quad_;
+
+    header.section_size_[CTS_HEIGHT]    = num_samples*sizeof(float32_t);
+    header.section_size_[CTS_COLOR]     = num_texels *sizeof(RgbTriplet);
+    header.section_size_[CTS_DETAIL]    = num_samples*sizeof(uint32_t);
+    header.section_size_[CTS_WAYPOINTS] = waypoints.size()*sizeof(CookedWaypoint);
+
+    const void * section_data[CTS_LAST];
+    section_data[CTS_HEIGHT]    = terrain.getHeightData();
+    section_data[CTS_COLOR]     = terrain.getColorData();
+    section_data[CTS_DETAIL]    = terrain.getDetailData();
+    section_data[CTS_WAYPOINTS] = waypoints.empty() ? NULL : &waypoints[0];
+    
+    CookedTerrain::write(path, header, section_data);
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Returns the names of all models, relative to MODEL_PATH and without
+ *  extension, as expected by OdeModelLoader.
+ */
+std::vector<std::string> getAllModelNames()
+{
+    using namespace boost::filesystem;
+
+    std::vector<std::string> ret;
+
+    for (recursive_directory_iterator it((path(MODEL_PATH)));
+         it != recursive_directory_iterator();
+         ++it)
+    {
+        std::string name = it->path().string().substr(MODEL_PATH.length());
+        if (name.length() < 4 || name.rfind(".xml") != name.length()-4) continue;
+
+        ret.push_back(name.substr(0, name.length()-4));
+    }
+    
+    return ret;
+}
+
+
+//------------------------------------------------------------------------------
+void cookModel(physics::OdeModelLoader & loader, const std::string & name)
+{
+    if (loader.cookTrimesh(name))
+    {
+        s_log << "Cooked trimesh of " << name << "\n";
+    }
+}
+
+
+//------------------------------------------------------------------------------
+/**
+ *  Writes the cooked terrain files of the given levels or the cooked
+ *  trimeshes of the given models. Without model names, all models are
+ *  cooked. Must be run from the directory containing "data".
+ */
+int main(int argc, char ** argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    if ((mode != "level" || argc < 3) && mode != "model")
+    {
+        std::cout << "Usage: " << argv[0] << " level level_name [level_name ...]\n"
+                  << "       " << argv[0] << " model [model_name ...]\n";
+        return 1;
+    }
+
+    std::vector<std::string> names(argv+2, argv+argc);
+    
+    int ret = 0;
+    try
+    {
+        physics::OdeModelLoader loader;
+        if (mode == "model" && names.empty()) names = getAllModelNames();
+        
+        for (unsigned i=0; i<names.size(); ++i)
+        {
+            try
+            {
+                if (mode == "level") cookLevel(names[i]);
+                else                 cookModel(loader, names[i]);
+            } catch (Exception & e)
+            {
+                e.addHistory("main(" + names[i] + ")");
+                s_log << Log::error << e << "\n";
+                ret = 1;
+            }
+        }
+    } catch (boost::filesystem::basic_filesystem_error<boost::filesystem::path> & e)
+    {
+        s_log << Log::error << e.what() << "\n";
+        ret = 1;
+    }
+    
+    return ret;
+}